@@ -0,0 +1,116 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * creates the source name of a cross-directory rename while it is in flight,
+ * src and dst must be served by different leaders for the rename to go across.
+ * usage : rename_race <src dir> <dst dir> [count]
+ */
+
+static bool has_marker(const std::string &path, const std::string &marker) {
+	char buf[64] = {0};
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	return (len == (ssize_t)marker.size()) && (marker == buf);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "usage : %s <src dir> <dst dir> [count]\n", argv[0]);
+		return 1;
+	}
+	std::string src = argv[1];
+	std::string dst = argv[2];
+	int count = (argc > 3) ? atoi(argv[3]) : 100;
+
+	for (int i = 0; i < count; i++) {
+		std::string name = "/f_" + std::to_string(i);
+		std::string marker = "renamed_" + std::to_string(i);
+		int fd = open((src + name).c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+		if (fd < 0) {
+			perror("open");
+			return 1;
+		}
+		if (write(fd, marker.c_str(), marker.size()) != (ssize_t)marker.size()) {
+			perror("write");
+			return 1;
+		}
+		close(fd);
+	}
+
+	std::vector<int> rename_ret(count);
+	std::vector<int> create_ret(count);
+	std::atomic<bool> go(false);
+	std::atomic<int> renamed_num(0);
+
+	std::thread renamer([&]() {
+		while (!go.load());
+		for (int i = 0; i < count; i++) {
+			std::string name = "/f_" + std::to_string(i);
+			rename_ret[i] = rename((src + name).c_str(), (dst + name).c_str());
+			renamed_num.store(i + 1);
+		}
+	});
+	std::thread creator([&]() {
+		while (!go.load());
+		for (int i = 0; i < count; i++) {
+			std::string name = "/f_" + std::to_string(i);
+			/* spin on the name until the rename of it returns */
+			int fd;
+			do {
+				fd = open((src + name).c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+			} while ((fd < 0) && (errno == EEXIST) && (renamed_num.load() <= i));
+			create_ret[i] = (fd < 0) ? -errno : 0;
+			if (fd >= 0) {
+				std::string marker = "created_" + std::to_string(i);
+				if (write(fd, marker.c_str(), marker.size()) != (ssize_t)marker.size())
+					create_ret[i] = -EIO;
+				close(fd);
+			}
+		}
+	});
+
+	go.store(true);
+	renamer.join();
+	creator.join();
+
+	int lost = 0;
+	for (int i = 0; i < count; i++) {
+		std::string name = "/f_" + std::to_string(i);
+		std::string renamed = "renamed_" + std::to_string(i);
+		std::string created = "created_" + std::to_string(i);
+
+		/* the renamed file is under exactly one of the names, never under none */
+		bool at_dst = has_marker(dst + name, renamed);
+		bool at_src = has_marker(src + name, renamed);
+		if (at_dst == at_src) {
+			printf("f_%d : renamed file at_src=%d at_dst=%d (rename %d)\n", i, at_src, at_dst, rename_ret[i]);
+			lost++;
+		}
+		if ((rename_ret[i] == 0) != at_dst) {
+			printf("f_%d : rename returned %d but at_dst=%d\n", i, rename_ret[i], at_dst);
+			lost++;
+		}
+		/* a create that succeeded owns the source name */
+		if ((create_ret[i] == 0) && !has_marker(src + name, created)) {
+			printf("f_%d : created file lost its name\n", i);
+			lost++;
+		}
+	}
+
+	printf("%d of %d names broken\n", lost, count);
+	return (lost == 0) ? 0 : 1;
+}
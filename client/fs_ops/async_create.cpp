@@ -0,0 +1,173 @@
+#include "async_create.hpp"
+
+#include "local_ops.hpp"
+#include "remote_ops.hpp"
+
+#include "../rpc/rpc_client.hpp"
+
+extern std::unique_ptr<directory_table> indexing_table;
+
+async_create_queue::async_create_queue() : pending_num(0), stopping(false) {
+	for (int t = 0; t < ASYNC_CREATE_SENDERS; t++)
+		this->senders.emplace_back(&async_create_queue::send_loop, this);
+}
+
+async_create_queue::~async_create_queue() {
+	this->stop();
+}
+
+int async_create_queue::submit(shared_ptr<remote_inode> parent_i, uuid dir_ino, const std::string &name, shared_ptr<inode> i) {
+	global_logger.log(remote_fs_op, "Called async_create_queue::submit(" + name + ")");
+	uuid table_ino = parent_i->get_dentry_table_ino();
+	auto c = std::make_shared<pending_create>(pending_create{std::move(parent_i), table_ino, dir_ino, name, std::move(i)});
+	entry_key key{table_ino, name};
+
+	std::unique_lock lock(this->queue_mutex);
+	this->done_cv.wait(lock, [this, &key]() {
+		return (this->pending_num < ASYNC_CREATE_MAX_PENDING) && (this->provisional.find(key) == this->provisional.end());
+	});
+	this->provisional.insert({key, c});
+
+	auto ret = this->dir_pending.insert({dir_ino, 0});
+	ret.first.value()++;
+	this->pending_num++;
+	this->queue.push_back(c);
+	this->queue_cv.notify_one();
+
+	return 0;
+}
+
+bool async_create_queue::find(const uuid &table_ino, const std::string &name, uuid &ino) {
+	std::scoped_lock lock(this->queue_mutex);
+	auto it = this->provisional.find(entry_key{table_ino, name});
+	if (it == this->provisional.end())
+		return false;
+
+	ino = it->second->i->get_ino();
+	return true;
+}
+
+bool async_create_queue::fill_stat(const uuid &table_ino, const std::string &name, struct stat *s) {
+	shared_ptr<inode> i;
+	{
+		std::scoped_lock lock(this->queue_mutex);
+		auto it = this->provisional.find(entry_key{table_ino, name});
+		if (it == this->provisional.end())
+			return false;
+		i = it->second->i;
+	}
+
+	std::scoped_lock scl{i->inode_mutex};
+	i->fill_stat(s);
+	return true;
+}
+
+bool async_create_queue::get_mode(const uuid &table_ino, const std::string &name, mode_t &mode) {
+	std::scoped_lock lock(this->queue_mutex);
+	auto it = this->provisional.find(entry_key{table_ino, name});
+	if (it == this->provisional.end())
+		return false;
+
+	mode = it->second->i->get_mode();
+	return true;
+}
+
+void async_create_queue::wait(const uuid &table_ino, const std::string &name) {
+	std::unique_lock lock(this->queue_mutex);
+	entry_key key{table_ino, name};
+	this->done_cv.wait(lock, [this, &key]() { return this->provisional.find(key) == this->provisional.end(); });
+}
+
+void async_create_queue::wait_dir(const uuid &dir_ino) {
+	std::unique_lock lock(this->queue_mutex);
+	this->done_cv.wait(lock, [this, &dir_ino]() { return this->dir_pending.find(dir_ino) == this->dir_pending.end(); });
+}
+
+int async_create_queue::flush(const uuid &dir_ino) {
+	global_logger.log(remote_fs_op, "Called async_create_queue::flush(" + uuid_to_string(dir_ino) + ")");
+	std::unique_lock lock(this->queue_mutex);
+	this->done_cv.wait(lock, [this, &dir_ino]() { return this->dir_pending.find(dir_ino) == this->dir_pending.end(); });
+
+	auto it = this->dir_errors.find(dir_ino);
+	if (it == this->dir_errors.end())
+		return 0;
+
+	int ret = it->second;
+	this->dir_errors.erase(it);
+	return ret;
+}
+
+void async_create_queue::stop() {
+	{
+		std::scoped_lock lock(this->queue_mutex);
+		if (this->stopping)
+			return;
+		this->stopping = true;
+	}
+	this->queue_cv.notify_all();
+
+	for (std::thread &t : this->senders)
+		t.join();
+}
+
+void async_create_queue::send_loop() {
+	while (true) {
+		shared_ptr<pending_create> c;
+		{
+			std::unique_lock lock(this->queue_mutex);
+			this->queue_cv.wait(lock, [this]() { return this->stopping || !this->queue.empty(); });
+			/* the queue is drained before the senders stop */
+			if (this->queue.empty())
+				return;
+			c = this->queue.front();
+			this->queue.pop_front();
+		}
+
+		int ret;
+		try {
+			ret = this->send(*c);
+		} catch (std::exception &e) {
+			global_logger.log(remote_fs_op, "Failed to send a create: " + std::string(e.what()));
+			ret = -EIO;
+		}
+		this->finish(c, ret);
+	}
+}
+
+int async_create_queue::send(pending_create &c) {
+	global_logger.log(remote_fs_op, "Called async_create_queue::send(" + c.name + ")");
+	while (true) {
+		std::shared_ptr<rpc_client> rc = get_rpc_client(c.parent_i->get_address());
+		int ret = rc->create(c.parent_i, c.name, c.i);
+
+		if (ret == -ENOTLEADER) {
+			indexing_table->find_remote_dentry_table_again(c.parent_i);
+			continue;
+		} else if (ret == -ENEEDRECOV) {
+			return -EIO;
+		}
+
+		/* without O_EXCL, a name created meanwhile by another client is simply opened, the handle works by name */
+		if (ret == -EEXIST)
+			return 0;
+		return ret;
+	}
+}
+
+void async_create_queue::finish(const shared_ptr<pending_create> &c, int ret) {
+	global_logger.log(remote_fs_op, "Called async_create_queue::finish(" + c->name + ", " + std::to_string(ret) + ")");
+
+	{
+		std::scoped_lock lock(this->queue_mutex);
+		this->provisional.erase(entry_key{c->table_ino, c->name});
+
+		auto it = this->dir_pending.find(c->dir_ino);
+		if ((it != this->dir_pending.end()) && (--it.value() == 0))
+			this->dir_pending.erase(it);
+
+		if (ret != 0)
+			this->dir_errors.insert({c->dir_ino, ret});
+		this->pending_num--;
+	}
+	this->done_cv.notify_all();
+}
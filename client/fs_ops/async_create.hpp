@@ -0,0 +1,97 @@
+#ifndef _ASYNC_CREATE_HPP_
+#define _ASYNC_CREATE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <tsl/robin_map.h>
+
+#include "../meta/inode.hpp"
+#include "../meta/remote_inode.hpp"
+
+/* creates streamed to the leaders at once */
+#define ASYNC_CREATE_SENDERS (8)
+/* a create waits for room beyond this many queued or in flight */
+#define ASYNC_CREATE_MAX_PENDING (4096)
+
+using std::shared_ptr;
+using namespace boost::uuids;
+
+/*
+ * Creates without O_EXCL or O_TRUNC in REMOTE directories, finished by the leader in the background.
+ * Exclusive creates and mkdirs wait for the leader, their caller must learn whether the name was free.
+ *
+ * The ino is allocated here and the new inode is kept as a provisional entry under
+ * (dentry table, name) until the leader replies, so that lookups and getattr of the
+ * new name are answered without waiting. Any other remote operation on the name waits
+ * for the reply first, so the leader sees the create before it.
+ * A failed create is kept as the error of its directory and returned by fsyncdir().
+ */
+class async_create_queue {
+private:
+	struct pending_create {
+		shared_ptr<remote_inode> parent_i;
+		/* the table the provisional entry is kept under, 'parent_i' moves on if the leader changes */
+		uuid table_ino;
+		/* the directory, which the table of 'parent_i' is a fragment of if it is fragmented */
+		uuid dir_ino;
+		std::string name;
+		shared_ptr<inode> i;
+	};
+
+	using entry_key = std::pair<uuid, std::string>;
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::condition_variable done_cv;
+	std::deque<shared_ptr<pending_create>> queue;
+	uint64_t pending_num;
+	bool stopping;
+
+	tsl::robin_map<entry_key, shared_ptr<pending_create>, boost::hash<entry_key>> provisional;
+	/* <directory, creates not replied yet> */
+	tsl::robin_map<uuid, uint64_t, boost::hash<uuid>> dir_pending;
+	/* <directory, first error> of the failed creates */
+	tsl::robin_map<uuid, int, boost::hash<uuid>> dir_errors;
+
+	std::vector<std::thread> senders;
+
+	void send_loop();
+	int send(pending_create &c);
+	void finish(const shared_ptr<pending_create> &c, int ret);
+
+public:
+	async_create_queue();
+	~async_create_queue();
+
+	/*
+	 * Queue the create of the regular file 'i', whose ino is already allocated, under 'name' of 'parent_i'.
+	 * A create of a name still provisional waits for its reply first.
+	 */
+	int submit(shared_ptr<remote_inode> parent_i, uuid dir_ino, const std::string &name, shared_ptr<inode> i);
+
+	/* the provisional entry of 'name' in the table 'table_ino' */
+	bool find(const uuid &table_ino, const std::string &name, uuid &ino);
+	bool fill_stat(const uuid &table_ino, const std::string &name, struct stat *s);
+	bool get_mode(const uuid &table_ino, const std::string &name, mode_t &mode);
+
+	/* waits until the leader replies to the create of 'name', if there is one */
+	void wait(const uuid &table_ino, const std::string &name);
+	/* waits until every create in directory 'dir_ino' is replied */
+	void wait_dir(const uuid &dir_ino);
+	/* wait_dir(), then returns and clears the first error of the directory */
+	int flush(const uuid &dir_ino);
+
+	/* sends what is queued and stops the senders */
+	void stop();
+};
+
+#endif /* _ASYNC_CREATE_HPP_ */
@@ -0,0 +1,198 @@
+#include "cross_rename.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include "remote_ops.hpp"
+
+#include "../in_memory/directory_table.hpp"
+#include "../journal/journal.hpp"
+
+extern std::unique_ptr<directory_table> indexing_table;
+extern std::unique_ptr<journal> journalctl;
+extern std::shared_ptr<lease_client> lc;
+
+/*
+ * a destination fragmented or handed over meanwhile is routed again.
+ * 'in_doubt' is set if no answer came back, the destination may have linked the name anyway.
+ */
+static int link_at_dst(const uuid &dst_parent_ino, const std::string &new_name, const shared_ptr<inode> &target_i, unsigned int flags,
+		       bool &in_doubt) {
+	in_doubt = false;
+	while (true) {
+		shared_ptr<dentry_table> dst_dentry_table = indexing_table->get_dentry_table_of(dst_parent_ino, new_name);
+		if (dst_dentry_table->get_loc() == LOCAL) {
+			try {
+				return link_renamed(dst_dentry_table, dst_dentry_table->get_this_dir_inode(), new_name, target_i, flags);
+			} catch (dentry_table::not_leader &e) {
+				continue;
+			}
+		}
+
+		shared_ptr<remote_inode> dst_remote_i = std::make_shared<remote_inode>(
+			dst_dentry_table->get_leader_ip(),
+			dst_dentry_table->get_dir_ino(),
+			new_name);
+		while (true) {
+			int ret = remote_rename_link(dst_remote_i, target_i, flags);
+			if (ret == -ENOTLEADER) {
+				indexing_table->find_remote_dentry_table_again(dst_remote_i);
+				continue;
+			} else if (ret == -ENEEDRECOV) {
+				in_doubt = true;
+				ret = -EIO;
+			}
+			return ret;
+		}
+	}
+}
+
+/* 1 if 'new_name' links 'ino' at the destination, 0 if it doesn't, -EIO if the destination can't be asked */
+static int check_linked(const uuid &dst_parent_ino, const std::string &new_name, const uuid &ino) {
+	for (int tries = 0; tries < LEADER_REDIRECT_MAX_HINTS; tries++) {
+		shared_ptr<dentry_table> dst_dentry_table;
+		try {
+			dst_dentry_table = indexing_table->get_dentry_table_of(dst_parent_ino, new_name, false);
+			return (dst_dentry_table->check_child_inode(new_name) == ino) ? 1 : 0;
+		} catch (dentry_table::not_leader &e) {
+			if ((dst_dentry_table != nullptr) && (dst_dentry_table->get_loc() == REMOTE))
+				indexing_table->find_remote_dentry_table_again(std::make_shared<remote_inode>(
+					dst_dentry_table->get_leader_ip(), dst_dentry_table->get_dir_ino(), new_name));
+		} catch (std::exception &e) {
+			global_logger.log(local_fs_op, "Failed to ask the destination of a rename: " + std::string(e.what()));
+			return -EIO;
+		}
+	}
+
+	return -EIO;
+}
+
+int rename_across(const shared_ptr<dentry_table> &src_dentry_table, const shared_ptr<inode> &src_parent_i, const std::string &old_name,
+		  const uuid &dst_parent_ino, const std::string &new_name, unsigned int flags) {
+	global_logger.log(local_fs_op, "Called rename_across(" + old_name + ", " + new_name + ")");
+	if (flags != 0)
+		return -ENOSYS;
+
+	/*
+	 * prepare: the name is detached so that nothing else reaches the inode, the unlink waits for the destination.
+	 * It stays reserved meanwhile, a create of the same name fails instead of being unlinked by the commit.
+	 * The intent is durable before the destination is asked, the next leader of the source resolves it after a crash.
+	 */
+	shared_ptr<inode> target_i;
+	uuid src_table_ino = src_dentry_table->get_dir_ino();
+	{
+		std::scoped_lock scl{src_dentry_table->dentry_table_mutex};
+		target_i = src_dentry_table->get_child_inode(old_name);
+		journalctl->prepare_rename(src_table_ino, rename_intent{old_name, target_i->get_ino(), dst_parent_ino, new_name});
+		src_dentry_table->delete_child_inode(old_name);
+		src_dentry_table->reserve_name(old_name, target_i->get_ino());
+	}
+
+	bool in_doubt;
+	int ret;
+	try {
+		ret = link_at_dst(dst_parent_ino, new_name, target_i, flags, in_doubt);
+	} catch (...) {
+		in_doubt = true;
+		ret = -EIO;
+	}
+
+	/* a lost reply says nothing, the destination is asked while this client still leads the source */
+	while (in_doubt) {
+		int linked = check_linked(dst_parent_ino, new_name, target_i->get_ino());
+		if (linked >= 0) {
+			in_doubt = false;
+			ret = (linked == 1) ? 0 : -EIO;
+			break;
+		}
+		if (!lc->is_mine(src_table_ino)) {
+			/* the name stays reserved here, the next leader finds the intent */
+			global_logger.log(local_fs_op, "A rename is left in doubt for the next leader: " + old_name);
+			return -EIO;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(CROSS_RENAME_RETRY_MS));
+	}
+
+	/* commit or abort */
+	{
+		std::scoped_lock scl{src_dentry_table->dentry_table_mutex, target_i->inode_mutex};
+		src_dentry_table->release_name(old_name);
+		if (ret == 0)
+			journalctl->rmreg(src_table_ino, src_parent_i, old_name, target_i);
+		else
+			src_dentry_table->create_child_inode(old_name, target_i);
+	}
+
+	/* the intent outlives the unlink until it is checkpointed */
+	if (ret == 0)
+		journalctl->flush(src_table_ino);
+	journalctl->resolve_rename(src_table_ino, old_name);
+
+	return ret;
+}
+
+void recover_renames(const shared_ptr<dentry_table> &src_dentry_table) {
+	uuid src_table_ino = src_dentry_table->get_dir_ino();
+	std::vector<rename_intent> pending = journalctl->pending_renames(src_table_ino);
+	if (pending.empty())
+		return;
+	global_logger.log(local_fs_op, "Called recover_renames(" + uuid_to_string(src_table_ino) + ")");
+
+	for (const rename_intent &r : pending) {
+		int linked = check_linked(r.dst_parent_ino, r.dst_name, r.ino);
+
+		std::scoped_lock scl{src_dentry_table->dentry_table_mutex};
+		if (src_dentry_table->check_child_inode(r.name) != r.ino) {
+			/* the name was unlinked or linked to another inode before the crash, nothing is left to resolve */
+			journalctl->resolve_rename(src_table_ino, r.name);
+			continue;
+		}
+		shared_ptr<inode> target_i = src_dentry_table->get_child_inode(r.name);
+
+		if (linked < 0) {
+			/* still in doubt, the name is hidden so that the inode is never reached under two names */
+			src_dentry_table->delete_child_inode(r.name);
+			src_dentry_table->reserve_name(r.name, r.ino);
+			continue;
+		}
+
+		if (linked == 1) {
+			std::scoped_lock iscl{target_i->inode_mutex};
+			src_dentry_table->delete_child_inode(r.name);
+			journalctl->rmreg(src_table_ino, src_dentry_table->get_this_dir_inode(), r.name, target_i);
+		}
+	}
+
+	journalctl->flush(src_table_ino);
+	for (const rename_intent &r : pending)
+		if (!src_dentry_table->is_reserved(r.name))
+			journalctl->resolve_rename(src_table_ino, r.name);
+}
+
+int link_renamed(const shared_ptr<dentry_table> &dst_dentry_table, const shared_ptr<inode> &dst_parent_i, const std::string &new_name,
+		 const shared_ptr<inode> &target_i, unsigned int flags) {
+	global_logger.log(local_fs_op, "Called link_renamed(" + new_name + ")");
+	if (flags != 0)
+		return -ENOSYS;
+
+	{
+		std::scoped_lock scl{dst_dentry_table->dentry_table_mutex, target_i->inode_mutex};
+		/* the name of another rename still in flight */
+		if (dst_dentry_table->is_reserved(new_name))
+			return -EEXIST;
+		uuid check_dst_ino = dst_dentry_table->check_child_inode(new_name);
+
+		if (!check_dst_ino.is_nil()) {
+			std::shared_ptr<inode> check_dst_inode = dst_dentry_table->get_child_inode(new_name);
+			dst_dentry_table->delete_child_inode(new_name);
+			journalctl->rmreg(dst_dentry_table->get_dir_ino(), dst_parent_i, new_name, check_dst_inode);
+		}
+		target_i->set_loc(LOCAL);
+		dst_dentry_table->create_child_inode(new_name, target_i);
+		journalctl->mkreg(dst_dentry_table->get_dir_ino(), dst_parent_i, new_name, target_i);
+	}
+
+	/* the source journals the unlink once this returns */
+	journalctl->flush(dst_dentry_table->get_dir_ino());
+	return 0;
+}
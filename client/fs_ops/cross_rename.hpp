@@ -0,0 +1,39 @@
+#ifndef _CROSS_RENAME_HPP_
+#define _CROSS_RENAME_HPP_
+
+#include <memory>
+#include <string>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "../in_memory/dentry_table.hpp"
+
+using std::shared_ptr;
+using namespace boost::uuids;
+
+/*
+ * Renames 'old_name' of the LOCAL table 'src_dentry_table' to 'new_name' of 'dst_parent_ino' in another table,
+ * run by the leader of the source table for itself or for the client which sent it rpc_rename.
+ *
+ * Prepare: an intent naming both ends is written next to the journal of the source, then the source name is
+ * detached without being journaled and reserved, nothing can be created or renamed onto it.
+ * The leader of the destination links the inode and flushes its journal before it answers. Only then the source
+ * journals the unlink, if the destination refused the name is attached again. Without an answer the destination
+ * is asked whether the name links the inode, as long as this client leads the source.
+ * The intent is dropped once the outcome is checkpointed, a leader crashing before that leaves it to
+ * recover_renames() of the next one.
+ */
+int rename_across(const shared_ptr<dentry_table> &src_dentry_table, const shared_ptr<inode> &src_parent_i, const std::string &old_name,
+		  const uuid &dst_parent_ino, const std::string &new_name, unsigned int flags);
+
+/* a retry after a link without an answer */
+#define CROSS_RENAME_RETRY_MS (100)
+
+/* resolves the renames a previous leader of the LOCAL table 'src_dentry_table' left in doubt */
+void recover_renames(const shared_ptr<dentry_table> &src_dentry_table);
+
+/* run by the leader of the destination table, the link is in its journal object when this returns */
+int link_renamed(const shared_ptr<dentry_table> &dst_dentry_table, const shared_ptr<inode> &dst_parent_i, const std::string &new_name,
+		 const shared_ptr<inode> &target_i, unsigned int flags);
+
+#endif /* _CROSS_RENAME_HPP_ */
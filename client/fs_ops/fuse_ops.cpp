@@ -3,15 +3,22 @@
 #include <mutex>
 #include <thread>
 
+#include <sys/xattr.h>
+
 #include "lib/rados_io/rados_io.hpp"
 #include "util/config.hpp"
 
 #include "fuse_ops.hpp"
 #include "local_ops.hpp"
 #include "remote_ops.hpp"
+#include "async_create.hpp"
+#include "cross_rename.hpp"
+#include "write_delegation.hpp"
 
 #include "../in_memory/directory_table.hpp"
+#include "../in_memory/remote_attr_cache.hpp"
 #include "../journal/journal.hpp"
+#include "../rpc/invalidation.hpp"
 #include "../rpc/rpc_server.hpp"
 
 using namespace std;
@@ -28,11 +35,268 @@ std::unique_ptr<directory_table> indexing_table;
 std::unique_ptr<uuid_controller> ino_controller;
 std::unique_ptr<file_handler_list> open_context;
 std::unique_ptr<journal> journalctl;
+/* nullptr if creates in REMOTE directories wait for the leader */
+std::unique_ptr<async_create_queue> async_creates;
+/* nullptr if the writes in REMOTE directories always go through the leader */
+std::unique_ptr<write_delegation_table> write_delegations;
+/* nullptr if getattr in REMOTE directories always asks the leader */
+std::unique_ptr<remote_attr_cache> attr_cache;
+/* tells the followers of the directories led here what they cached became stale */
+std::unique_ptr<invalidation_hub> invalidations;
+/* nullptr if the attributes cached from the leaders expire on their own */
+std::unique_ptr<invalidation_listener> invalidation_subscriptions;
 
 std::unique_ptr<thread> remote_server_thread;
 
 std::unique_ptr<client> this_client;
 unsigned int fuse_capable;
+/* store regular file inodes in the dentry object of their parent */
+bool embedded_reg_inode;
+
+/* the value is the remote address of the client the directory subtree is pinned to, empty for this client */
+#define PIN_XATTR_NAME "nmfs.pin"
+
+/* offset of the 'pos'-th readdir entry of fragment 'f', "." and ".." are the first two of fragment 0 */
+#define FRAG_READDIR_OFFSET(f, pos) ((static_cast<off_t>(f) << 40) | (pos))
+
+/* listing a fragment only needs a shared lease */
+static shared_ptr<dentry_table> get_fragment_dentry_table(uuid dir_ino, uint32_t depth, uint64_t bits) {
+	return indexing_table->get_fragment_dentry_table(dir_ino, make_frag_id(depth, bits), false);
+}
+
+/* an inode opened through a table this client no longer leads is looked up again by its ino, never by its path */
+static shared_ptr<inode> get_inode_to_modify(const char *path, struct fuse_file_info *file_info) {
+	if (file_info) {
+		shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
+		shared_ptr<inode> i = handler->get_open_inode_info();
+		if (i->get_loc() != LOCAL)
+			return i;
+
+		uuid table_ino = S_ISDIR(i->get_mode()) ? i->get_ino() : i->get_p_ino();
+		if (lc->is_mine(table_ino))
+			return i;
+
+		shared_ptr<inode> reopened = indexing_table->reopen_inode(i, *get_filename_from_path(path));
+		if (reopened->get_loc() == LOCAL)
+			handler->set_i(reopened);
+		return reopened;
+	}
+
+	return indexing_table->path_traversal(path, true);
+}
+
+/* a handle open for writing in a REMOTE directory keeps the size and mtime here once it writes */
+static bool is_delegable(shared_ptr<inode> i, struct fuse_file_info *file_info) {
+	return (write_delegations != nullptr) && (i->get_loc() == REMOTE) && ((file_info->flags & O_ACCMODE) != O_RDONLY);
+}
+
+/* the size and mtime of a LOCAL file written by a delegate are brought back before this client uses them */
+static void recall_local_write_delegation(shared_ptr<inode> i) {
+	if (!S_ISREG(i->get_mode()))
+		return;
+
+	shared_ptr<dentry_table> dtable = indexing_table->get_dentry_table(i->get_p_ino(), false);
+	recall_write_delegation(dtable, i, lc->get_self_remote());
+}
+
+/*
+ * the leader links the new regular file in the background, the handle reaches it by name like any remote handle.
+ * Without O_EXCL a name the leader already has is simply opened.
+ */
+static int async_remote_create(shared_ptr<remote_inode> parent_i, uuid dir_ino, const std::string &name, mode_t mode, struct fuse_file_info *file_info) {
+	uuid new_ino = alloc_new_ino();
+	shared_ptr<inode> new_i = make_inode(parent_i->get_dentry_table_ino(), this_client->get_client_uid(), this_client->get_client_gid(),
+					     mode | S_IFREG, new_ino);
+
+	int ret = async_creates->submit(parent_i, dir_ino, name, new_i);
+	if (ret != 0)
+		return ret;
+
+	shared_ptr<file_handler> fh = std::make_shared<file_handler>(new_ino);
+	fh->set_loc(REMOTE);
+	std::shared_ptr<remote_inode> open_remote_i = std::make_shared<remote_inode>(parent_i->get_address(), parent_i->get_dentry_table_ino(), name);
+	open_remote_i->inode::set_ino(new_ino);
+	fh->set_remote_i(open_remote_i);
+	file_info->fh = reinterpret_cast<uint64_t>(fh.get());
+	fh->set_fhno(file_info->fh);
+
+	open_context->add_file_handler(file_info->fh, fh);
+	if (is_delegable(open_remote_i, file_info))
+		write_delegations->open(new_ino);
+	return 0;
+}
+
+/* the entries of a snapshot from 'child' on */
+static void read_fragment_snapshot(const dentry_snapshot &snap, uint64_t child, bool plus, std::vector<dir_cache_entry> &entries) {
+	for (uint64_t k = child; (k < snap.size()) && (k < child + READDIR_BATCH_SIZE); k++) {
+		const child_entry &e = snap[k];
+		dir_cache_entry d{e.name, false, {}};
+		std::scoped_lock scl{e.i->inode_mutex};
+		if (plus && !S_ISDIR(e.i->get_mode())) {
+			e.i->fill_stat(&d.attr);
+			d.attr_valid = true;
+		}
+		entries.push_back(std::move(d));
+	}
+}
+
+/* the offset in the snapshot of 'pin' of the readdir offset 'child' */
+static uint64_t pinned_offset(const frag_pin *pin, uint64_t child) {
+	if (pin == nullptr)
+		return child;
+	return static_cast<uint64_t>(std::max<int64_t>(0, static_cast<int64_t>(child) + pin->shift));
+}
+
+/*
+ * reads the names of a fragment from 'child' on.
+ * With 'pin' the offsets index the snapshot pinned at the first read, otherwise the latest one is read.
+ * A pinned snapshot lost with its leader is pinned again and read after the last name read from it.
+ */
+static int read_remote_fragment(uuid dir_ino, uint32_t depth, uint64_t bits, uint64_t child, bool plus, std::vector<dir_cache_entry> &entries,
+				frag_pin *pin = nullptr) {
+	std::string resume_name;
+	if ((pin != nullptr) && (child > 0) && (pin->next_child == child))
+		resume_name = pin->last_name;
+
+	while (true) {
+		if ((pin != nullptr) && (pin->snapshot != nullptr)) {
+			read_fragment_snapshot(*(pin->snapshot), pinned_offset(pin, child), plus, entries);
+			break;
+		}
+
+		shared_ptr<remote_inode> remote_i;
+		if ((pin != nullptr) && !pin->leader_ip.empty()) {
+			remote_i = std::make_shared<remote_inode>(pin->leader_ip, pin->frag_ino, "", true);
+		} else {
+			shared_ptr<dentry_table> frag_dentry_table = get_fragment_dentry_table(dir_ino, depth, bits);
+			if ((frag_dentry_table->get_loc() == LOCAL) || (frag_dentry_table->get_loc() == SHARED)) {
+				shared_ptr<const dentry_snapshot> snap = frag_dentry_table->get_snapshot();
+				if (pin != nullptr) {
+					if (!resume_name.empty())
+						pin->shift = static_cast<int64_t>(snapshot_position_after(*snap, resume_name)) - static_cast<int64_t>(child);
+					pin->snapshot = snap;
+				}
+				read_fragment_snapshot(*snap, pinned_offset(pin, child), plus, entries);
+				break;
+			}
+
+			remote_i = std::make_shared<remote_inode>(frag_dentry_table->get_leader_ip(), frag_dentry_table->get_dir_ino(), "", true);
+			if (pin != nullptr) {
+				/* a handle opened at a previous leader is kept, the new one pins a snapshot for it again */
+				if (pin->dir_handle == 0) {
+					uint64_t dir_handle = 0;
+					int ret = get_rpc_client(remote_i->get_address())->opendir(remote_i, dir_handle);
+					if (ret == -ENOTLEADER) {
+						indexing_table->find_remote_dentry_table_again(remote_i);
+						continue;
+					} else if (ret == -ENEEDRECOV) {
+						throw std::runtime_error("Need Recovery of remote dentry_table");
+					} else if (ret < 0) {
+						return ret;
+					}
+					pin->dir_handle = dir_handle;
+				}
+				pin->leader_ip = remote_i->get_address();
+				pin->frag_ino = frag_dentry_table->get_dir_ino();
+			}
+		}
+
+		std::shared_ptr<rpc_client> rc = get_rpc_client(remote_i->get_address());
+		uint64_t dir_handle = (pin != nullptr) ? pin->dir_handle : 0;
+		uint64_t offset = pinned_offset(pin, child);
+		int ret;
+		if (plus)
+			ret = rc->readdirplus(remote_i, dir_handle, offset, resume_name, READDIR_BATCH_SIZE, entries);
+		else
+			ret = rc->readdir(remote_i, dir_handle, offset, resume_name, READDIR_BATCH_SIZE, entries);
+
+		if (ret == -ENOTLEADER) {
+			indexing_table->find_remote_dentry_table_again(remote_i);
+			if (pin != nullptr)
+				pin->leader_ip.clear();
+			continue;
+		} else if (ret == -ENEEDRECOV) {
+			throw std::runtime_error("Need Recovery of remote dentry_table");
+		} else if (ret < 0) {
+			return ret;
+		}
+
+		if ((pin != nullptr) && (dir_handle != pin->dir_handle)) {
+			pin->dir_handle = dir_handle;
+			pin->shift = static_cast<int64_t>(offset) - static_cast<int64_t>(child);
+		}
+		break;
+	}
+
+	if ((pin != nullptr) && !entries.empty()) {
+		pin->last_name = entries.back().name;
+		pin->next_child = child + entries.size();
+	}
+	return 0;
+}
+
+/* lets the leaders of the fragments drop the snapshots pinned by 'fh' */
+static void release_frag_pins(const shared_ptr<file_handler> &fh) {
+	for (auto &[bits, pin] : fh->get_frag_pins()) {
+		if ((pin.dir_handle == 0) || pin.leader_ip.empty())
+			continue;
+		shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(pin.leader_ip, pin.frag_ino, "", true);
+		remote_releasedir(remote_i, pin.dir_handle);
+	}
+	fh->get_frag_pins().clear();
+}
+
+/* walks the fragments in order, each fragment is read from the snapshot pinned for 'fh' so that the offsets stay valid */
+static int readdir_fragments(uuid dir_ino, uint32_t depth, void *buffer, fuse_fill_dir_t filler, off_t offset, bool plus,
+			     const shared_ptr<file_handler> &fh) {
+	uint64_t f = static_cast<uint64_t>(offset) >> 40;
+	uint64_t pos = static_cast<uint64_t>(offset) & ((1ULL << 40) - 1);
+
+	/* a rewind reads the fragments again from new snapshots */
+	if (offset == 0)
+		release_frag_pins(fh);
+
+	if ((f == 0) && (pos < 2)) {
+		for (; pos < 2; pos++)
+			if (filler(buffer, (pos == 0) ? "." : "..", nullptr, FRAG_READDIR_OFFSET(0, pos + 1), static_cast<fuse_fill_dir_flags>(0)))
+				return 0;
+	}
+
+	for (; f < (1ULL << depth); f++, pos = 2) {
+		frag_pin &pin = fh->get_frag_pins().insert(std::make_pair(f, frag_pin{nullptr, "", nil_uuid(), 0})).first->second;
+		while (true) {
+			std::vector<dir_cache_entry> entries;
+			int ret = read_remote_fragment(dir_ino, depth, f, pos - 2, plus, entries, &pin);
+			if (ret < 0)
+				return ret;
+			if (entries.empty())
+				break;
+
+			for (const dir_cache_entry &e : entries) {
+				if (filler(buffer, e.name.c_str(), e.attr_valid ? &(e.attr) : nullptr, FRAG_READDIR_OFFSET(f, pos + 1),
+					   static_cast<fuse_fill_dir_flags>(e.attr_valid ? FUSE_FILL_DIR_PLUS : 0)))
+					return 0;
+				pos++;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* a fragmented directory is empty if each of its fragments is */
+static int check_fragments_empty(uuid dir_ino, uint32_t depth) {
+	for (uint64_t bits = 0; bits < (1ULL << depth); bits++) {
+		std::vector<dir_cache_entry> entries;
+		int ret = read_remote_fragment(dir_ino, depth, bits, 0, false, entries);
+		if (ret < 0)
+			return ret;
+		if (!entries.empty())
+			return -ENOTEMPTY;
+	}
+
+	return 0;
+}
 
 void *fuse_ops::init(struct fuse_conn_info *info, struct fuse_config *config)
 {
@@ -54,6 +318,13 @@ void *fuse_ops::init(struct fuse_conn_info *info, struct fuse_config *config)
 	std::string meta_pool_name = lookup_config<std::string>(cfg, "meta_pool_name");
 	std::string data_pool_name = lookup_config<std::string>(cfg, "data_pool_name");
 
+	embedded_reg_inode = lookup_config<bool>(cfg, "embedded_reg_inode", false);
+	long long max_cached_inodes = lookup_config<long long>(cfg, "max_cached_inodes", DIRECTORY_TABLE_DEFAULT_MAX_INODES);
+	bool async_remote_create = lookup_config<bool>(cfg, "async_remote_create", true);
+	bool write_delegation = lookup_config<bool>(cfg, "write_delegation", true);
+	long long remote_attr_cache_ms = lookup_config<long long>(cfg, "remote_attr_cache_ms", 1000);
+	bool remote_invalidation = lookup_config<bool>(cfg, "remote_invalidation", true);
+
 	rados_io::conn_info ci = {"client.admin", "ceph", 0};
 	meta_pool = std::make_shared<rados_io>(ci, meta_pool_name);
 	data_pool = std::make_shared<rados_io>(ci, data_pool_name);
@@ -77,13 +348,25 @@ void *fuse_ops::init(struct fuse_conn_info *info, struct fuse_config *config)
 		d.sync();
 	}
 
-	indexing_table = std::make_unique<directory_table>();
-	ino_controller = std::make_unique<uuid_controller>();
+	indexing_table = std::make_unique<directory_table>(static_cast<uint64_t>(max_cached_inodes));
+	ino_controller = std::make_unique<uuid_controller>(this_client->get_client_id());
 	open_context = std::make_unique<file_handler_list>();
+	invalidations = std::make_unique<invalidation_hub>();
 	journalctl = std::make_unique<journal>(meta_pool, lc);
+	if (async_remote_create)
+		async_creates = std::make_unique<async_create_queue>();
+	if (write_delegation)
+		write_delegations = std::make_unique<write_delegation_table>();
+	if (remote_attr_cache_ms > 0)
+		attr_cache = std::make_unique<remote_attr_cache>(std::chrono::milliseconds(remote_attr_cache_ms));
+	if ((attr_cache != nullptr) && remote_invalidation)
+		invalidation_subscriptions = std::make_unique<invalidation_listener>();
 
 	config->nullpath_ok = 0;
 	fuse_capable = info->capable;
+	/* readdir ships attributes with names, see local_readdir() and remote_readdir() */
+	if (info->capable & FUSE_CAP_READDIRPLUS)
+		info->want |= FUSE_CAP_READDIRPLUS;
 
 	remote_server_thread = std::make_unique<thread>(run_rpc_server, remote_service_ip + ":" + remote_service_port);
 	return nullptr;
@@ -92,6 +375,16 @@ void *fuse_ops::init(struct fuse_conn_info *info, struct fuse_config *config)
 void fuse_ops::destroy(void *private_data) {
 	global_logger.log(fuse_op, "Called destroy()");
 
+	/* the creates still queued are sent while this client can lead the new directories */
+	if (async_creates != nullptr)
+		async_creates->stop();
+
+	/* the other clients lead the directories of this one right away instead of waiting for the leases to expire */
+	indexing_table->release_all();
+	if (invalidation_subscriptions != nullptr)
+		invalidation_subscriptions->stop();
+	/* the subscription streams of the other clients would hold the server */
+	invalidations->stop();
 	remote_handle->Shutdown();
 }
 
@@ -110,6 +403,7 @@ int fuse_ops::getattr(const char *path, struct stat *stat, struct fuse_file_info
 		}
 
 		if (i->get_loc() == LOCAL) {
+			recall_local_write_delegation(i);
 			local_getattr(i, stat);
 		} else if (i->get_loc() == REMOTE) {
 			while(true){
@@ -172,9 +466,10 @@ int fuse_ops::symlink(const char *src, const char *dst) {
 	int ret = 0;
 	try {
 		unique_ptr<std::string> dst_parent_name = get_parent_dir_path(dst);
-		shared_ptr<inode> dst_parent_i = indexing_table->path_traversal(*dst_parent_name);
-		shared_ptr<dentry_table> dst_parent_dentry_table = indexing_table->get_dentry_table(
-			dst_parent_i->get_ino());
+		unique_ptr<std::string> symlink_name = get_filename_from_path(dst);
+		shared_ptr<inode> dst_parent_i = indexing_table->path_traversal(*dst_parent_name, true);
+		shared_ptr<dentry_table> dst_parent_dentry_table = indexing_table->get_dentry_table_of(
+			dst_parent_i->get_ino(), *symlink_name);
 
 		if (dst_parent_dentry_table->get_loc() == LOCAL) {
 			ret = local_symlink(dst_parent_i, src, dst);
@@ -182,7 +477,7 @@ int fuse_ops::symlink(const char *src, const char *dst) {
 			shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(
 				dst_parent_dentry_table->get_leader_ip(),
 				dst_parent_dentry_table->get_dir_ino(),
-				*dst_parent_name);
+				*symlink_name);
 			while(true){
 				ret = remote_symlink(remote_i, src, dst);
 				if(ret == -ENOTLEADER) {
@@ -199,6 +494,9 @@ int fuse_ops::symlink(const char *src, const char *dst) {
 		return -ENOENT;
 	} catch (inode::permission_denied &e) {
 		return -EACCES;
+	} catch (dentry_table::not_leader &e) {
+		/* the directory was fragmented after the name was routed */
+		return symlink(src, dst);
 	}
 
 	return ret;
@@ -282,6 +580,11 @@ int fuse_ops::releasedir(const char *path, struct fuse_file_info *file_info) {
 	if(file_info){
 		shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
 		i = handler->get_open_inode_info();
+
+		/* let the leader drop the snapshot pinned for this handle, a new leader doesn't have it anyway */
+		if((handler->get_loc() == REMOTE) && (handler->get_dir_handle() != 0))
+			remote_releasedir(std::dynamic_pointer_cast<remote_inode>(i), handler->get_dir_handle());
+		release_frag_pins(handler);
 	} else {
 		i = indexing_table->path_traversal(path);
 	}
@@ -297,22 +600,33 @@ int fuse_ops::readdir(const char *path, void *buffer, fuse_fill_dir_t filler, of
 
 	int ret = 0;
 	shared_ptr<inode> i;
+	shared_ptr<file_handler> handler;
 	if(file_info){
-		shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
+		handler = open_context->get_file_handler(file_info->fh);
 		i = handler->get_open_inode_info();
 	} else {
 		i = indexing_table->path_traversal(path);
 	}
-	shared_ptr<dentry_table> target_dentry_table = indexing_table->get_dentry_table(i->get_ino());
-
-	if (target_dentry_table->get_loc() == LOCAL) {
-		local_readdir(i, buffer, filler);
+	/* the names created here asynchronously are listed by their leaders once they reply */
+	if (async_creates != nullptr)
+		async_creates->wait_dir(i->get_ino());
+	shared_ptr<dentry_table> target_dentry_table = indexing_table->get_dentry_table(i->get_ino(), false, false);
+
+	bool plus = (readdir_flags & FUSE_READDIR_PLUS) != 0;
+	if (target_dentry_table->get_frag_depth() > 0) {
+		/* a readdir without an open handle pins the fragments only for this call */
+		shared_ptr<file_handler> frag_handler = (handler != nullptr) ? handler : std::make_shared<file_handler>(i->get_ino());
+		ret = readdir_fragments(i->get_ino(), target_dentry_table->get_frag_depth(), buffer, filler, offset, plus, frag_handler);
+		if (handler == nullptr)
+			release_frag_pins(frag_handler);
+	} else if ((target_dentry_table->get_loc() == LOCAL) || (target_dentry_table->get_loc() == SHARED)) {
+		local_readdir(i, buffer, filler, offset, handler, plus);
 	} else if (target_dentry_table->get_loc() == REMOTE) {
 		shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(target_dentry_table->get_leader_ip(),
 										   target_dentry_table->get_dir_ino(),
-										   *(get_filename_from_path(path)));
+										   *(get_filename_from_path(path)), true);
 		while(true) {
-			ret = remote_readdir(remote_i, buffer, filler);
+			ret = remote_readdir(remote_i, buffer, filler, offset, handler, plus);
 			if(ret == -ENOTLEADER) {
 				indexing_table->find_remote_dentry_table_again(remote_i);
 				continue;
@@ -326,6 +640,31 @@ int fuse_ops::readdir(const char *path, void *buffer, fuse_fill_dir_t filler, of
 	return ret;
 }
 
+int fuse_ops::fsyncdir(const char *path, int datasync, struct fuse_file_info *file_info) {
+	global_logger.log(fuse_op, "Called fsyncdir()");
+	global_logger.log(fuse_op, "path : " + std::string(path));
+
+	if (async_creates == nullptr)
+		return 0;
+
+	try {
+		shared_ptr<inode> i;
+		if (file_info) {
+			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
+			i = handler->get_open_inode_info();
+		} else {
+			i = indexing_table->path_traversal(path);
+		}
+
+		/* a create that failed at the leader after create() returned is reported here */
+		return async_creates->flush(i->get_ino());
+	} catch (inode::no_entry &e) {
+		return -ENOENT;
+	} catch (inode::permission_denied &e) {
+		return -EACCES;
+	}
+}
+
 int fuse_ops::mkdir(const char *path, mode_t mode) {
 	global_logger.log(fuse_op, "Called mkdir()");
 	global_logger.log(fuse_op, "path : " + std::string(path));
@@ -335,13 +674,14 @@ int fuse_ops::mkdir(const char *path, mode_t mode) {
 	try {
 		std::unique_ptr<std::string> target_name = get_filename_from_path(path);
 
-		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()));
-		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()), true);
+		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), *target_name);
 
 		int ret = 0;
 		if (parent_dentry_table->get_loc() == LOCAL) {
 			ret = local_mkdir(parent_i, *target_name, mode, new_dir_inode, new_dir_dentry);
-			indexing_table->lease_dentry_table_mkdir(new_dir_inode, new_dir_dentry);
+			if (ret == 0)
+				indexing_table->lease_dentry_table_mkdir(new_dir_inode);
 		} else if (parent_dentry_table->get_loc() == REMOTE) {
 			shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(
 				parent_dentry_table->get_leader_ip(),
@@ -357,12 +697,17 @@ int fuse_ops::mkdir(const char *path, mode_t mode) {
 				} else
 					break;
 			}
-			indexing_table->lease_dentry_table_mkdir(new_dir_inode, new_dir_dentry);
+			if (ret != 0)
+				return ret;
+			indexing_table->lease_dentry_table_mkdir(new_dir_inode);
 		}
 	} catch (inode::no_entry &e) {
 		return -ENOENT;
 	} catch (inode::permission_denied &e) {
 		return -EACCES;
+	} catch (dentry_table::not_leader &e) {
+		/* the directory was fragmented after the name was routed */
+		return mkdir(path, mode);
 	}
 
 	return 0;
@@ -376,8 +721,8 @@ int fuse_ops::rmdir(const char *path) {
 	try {
 		std::unique_ptr<std::string> target_name = get_filename_from_path(path);
 
-		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()));
-		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()), true);
+		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), *target_name);
 
 		uuid target_ino = parent_dentry_table->check_child_inode(*target_name);
 		shared_ptr<inode> target_i = parent_dentry_table->get_child_inode(*(get_filename_from_path(path).get()));
@@ -386,6 +731,13 @@ int fuse_ops::rmdir(const char *path) {
 
 		shared_ptr<dentry_table> target_dentry_table = indexing_table->get_dentry_table(target_ino);
 
+		/* the leader of the directory only sees its own table, the names live in the fragments */
+		if(target_dentry_table->get_frag_depth() > 0) {
+			ret = check_fragments_empty(target_ino, target_dentry_table->get_frag_depth());
+			if(ret < 0)
+				return ret;
+		}
+
 		if ((parent_dentry_table->get_loc() == LOCAL) && (target_dentry_table->get_loc() == LOCAL)) {
 			ret = local_rmdir_top(target_i, target_ino);
 			if(ret == 0)
@@ -394,7 +746,7 @@ int fuse_ops::rmdir(const char *path) {
 			shared_ptr<remote_inode> target_remote_i = std::make_shared<remote_inode>(
 				target_dentry_table->get_leader_ip(),
 				target_dentry_table->get_dir_ino(),
-				*target_name);
+				*target_name, true);
 			while(true) {
 				ret = remote_rmdir_top(target_remote_i, target_ino);
 				if(ret == -ENOTLEADER) {
@@ -429,7 +781,7 @@ int fuse_ops::rmdir(const char *path) {
 			shared_ptr<remote_inode> target_remote_i = std::make_shared<remote_inode>(
 				target_dentry_table->get_leader_ip(),
 				target_dentry_table->get_dir_ino(),
-				*target_name);
+				*target_name, true);
 			while(true) {
 				ret = remote_rmdir_top(target_remote_i, target_ino);
 				if(ret == -ENOTLEADER) {
@@ -461,6 +813,9 @@ int fuse_ops::rmdir(const char *path) {
 		return -ENOENT;
 	} catch (inode::permission_denied &e) {
 		return -EACCES;
+	} catch (dentry_table::not_leader &e) {
+		/* the directory was fragmented after the name was routed */
+		return rmdir(path);
 	}
 
 	return ret;
@@ -478,19 +833,24 @@ int fuse_ops::rename(const char *old_path, const char *new_path, unsigned int fl
 	try {
 		unique_ptr<std::string> src_parent_path = get_parent_dir_path(old_path);
 		unique_ptr<std::string> dst_parent_path = get_parent_dir_path(new_path);
+		unique_ptr<std::string> old_name = get_filename_from_path(old_path);
+		unique_ptr<std::string> new_name = get_filename_from_path(new_path);
 
-		if (*src_parent_path == *dst_parent_path) {
-			shared_ptr<inode> parent_i = indexing_table->path_traversal(*src_parent_path);
-			shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(
-				parent_i->get_ino());
+		shared_ptr<inode> src_parent_i = indexing_table->path_traversal(*src_parent_path, true);
+		shared_ptr<dentry_table> src_dentry_table = indexing_table->get_dentry_table_of(src_parent_i->get_ino(), *old_name);
 
-			if (parent_dentry_table->get_loc() == LOCAL) {
-				ret = local_rename_same_parent(parent_i, old_path, new_path, flags);
-			} else if (parent_dentry_table->get_loc() == REMOTE) {
+		shared_ptr<inode> dst_parent_i = (*src_parent_path == *dst_parent_path) ? src_parent_i : indexing_table->path_traversal(*dst_parent_path, true);
+		shared_ptr<dentry_table> dst_dentry_table = indexing_table->get_dentry_table_of(dst_parent_i->get_ino(), *new_name);
+
+		/* two names of a fragmented directory may be held by different fragments, which is renamed like across directories */
+		if (src_dentry_table == dst_dentry_table) {
+			if (src_dentry_table->get_loc() == LOCAL) {
+				ret = local_rename_same_parent(src_parent_i, old_path, new_path, flags);
+			} else if (src_dentry_table->get_loc() == REMOTE) {
 				shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(
-					parent_dentry_table->get_leader_ip(),
-					parent_dentry_table->get_dir_ino(),
-					new_path);
+					src_dentry_table->get_leader_ip(),
+					src_dentry_table->get_dir_ino(),
+					*new_name);
 				while(true) {
 					ret = remote_rename_same_parent(remote_i, old_path, new_path, flags);
 					if(ret == -ENOTLEADER) {
@@ -503,58 +863,16 @@ int fuse_ops::rename(const char *old_path, const char *new_path, unsigned int fl
 				}
 			}
 		} else {
-			shared_ptr<inode> src_parent_i = indexing_table->path_traversal(*src_parent_path);
-			shared_ptr<dentry_table> src_dentry_table = indexing_table->get_dentry_table(src_parent_i->get_ino());
-
-			shared_ptr<inode> dst_parent_i = indexing_table->path_traversal(*dst_parent_path);
-			shared_ptr<dentry_table> dst_dentry_table = indexing_table->get_dentry_table(dst_parent_i->get_ino());
-
-			uuid check_dst_ino = dst_dentry_table->check_child_inode(*get_filename_from_path(new_path));
-			if ((src_dentry_table->get_loc() == LOCAL) && (dst_dentry_table->get_loc() == LOCAL)) {
-				std::shared_ptr<inode> target_inode = local_rename_not_same_parent_src(src_parent_i, old_path, flags);
-				ret = local_rename_not_same_parent_dst(dst_parent_i, target_inode, check_dst_ino, new_path, flags);
-			} else if ((src_dentry_table->get_loc() == LOCAL) && (dst_dentry_table->get_loc() == REMOTE)) {
-				/* TODO : TODO : change to use inode pointer */
-				std::shared_ptr<inode> target_inode = local_rename_not_same_parent_src(src_parent_i, old_path, flags);
-				shared_ptr<remote_inode> dst_remote_i = std::make_shared<remote_inode>(
-					dst_dentry_table->get_leader_ip(),
-					dst_dentry_table->get_dir_ino(),
-					new_path);
-				while(true) {
-					ret = remote_rename_not_same_parent_dst(dst_remote_i, target_inode, check_dst_ino, new_path, flags);
-					if(ret == -ENOTLEADER) {
-						indexing_table->find_remote_dentry_table_again(dst_remote_i);
-						continue;
-					} else if(ret == -ENEEDRECOV) {
-						throw std::runtime_error("Need Recovery of remote dentry_table");
-					} else
-						break;
-				}
-			} else if ((src_dentry_table->get_loc() == REMOTE) && (dst_dentry_table->get_loc() == LOCAL)) {
-				shared_ptr<remote_inode> src_remote_i = std::make_shared<remote_inode>(
-					src_dentry_table->get_leader_ip(),
-					src_dentry_table->get_dir_ino(),
-					old_path);
-				std::shared_ptr<inode> target_inode;
-				while(true) {
-					ret = remote_rename_not_same_parent_src(src_remote_i, old_path, flags, target_inode);
-					if(ret == -ENOTLEADER) {
-						indexing_table->find_remote_dentry_table_again(src_remote_i);
-						continue;
-					} else if(ret == -ENEEDRECOV) {
-						throw std::runtime_error("Need Recovery of remote dentry_table");
-					} else
-						break;
-				}
-				ret = local_rename_not_same_parent_dst(dst_parent_i, target_inode, check_dst_ino, new_path, flags);
-			} else if ((src_dentry_table->get_loc() == REMOTE) && (dst_dentry_table->get_loc() == REMOTE)) {
+			/* the leader of the source has the leader of the destination link the name, see rename_across() */
+			if (src_dentry_table->get_loc() == LOCAL) {
+				ret = rename_across(src_dentry_table, src_parent_i, *old_name, dst_parent_i->get_ino(), *new_name, flags);
+			} else if (src_dentry_table->get_loc() == REMOTE) {
 				shared_ptr<remote_inode> src_remote_i = std::make_shared<remote_inode>(
 					src_dentry_table->get_leader_ip(),
 					src_dentry_table->get_dir_ino(),
-					old_path);
-				std::shared_ptr<inode> target_inode;
+					*old_name);
 				while(true) {
-					ret = remote_rename_not_same_parent_src(src_remote_i, old_path, flags, target_inode);
+					ret = remote_rename_across(src_remote_i, old_path, dst_parent_i->get_ino(), dst_dentry_table->get_dir_ino(), new_path, flags);
 					if(ret == -ENOTLEADER) {
 						indexing_table->find_remote_dentry_table_again(src_remote_i);
 						continue;
@@ -563,27 +881,15 @@ int fuse_ops::rename(const char *old_path, const char *new_path, unsigned int fl
 					} else
 						break;
 				}
-				shared_ptr<remote_inode> dst_remote_i = std::make_shared<remote_inode>(
-					dst_dentry_table->get_leader_ip(),
-					dst_dentry_table->get_dir_ino(),
-					new_path);
-				while(true) {
-					ret = remote_rename_not_same_parent_dst(dst_remote_i, target_inode, check_dst_ino, new_path, flags);
-					if(ret == -ENOTLEADER) {
-						indexing_table->find_remote_dentry_table_again(dst_remote_i);
-						continue;
-					} else if(ret == -ENEEDRECOV) {
-						throw std::runtime_error("Need Recovery of remote dentry_table");
-					} else
-						break;
-				}
 			}
-
 		}
 	} catch (inode::no_entry &e) {
 		return -ENOENT;
 	} catch (inode::permission_denied &e) {
 		return -EACCES;
+	} catch (dentry_table::not_leader &e) {
+		/* nothing is unlinked yet, the directory was fragmented after the names were routed */
+		return rename(old_path, new_path, flags);
 	} catch (std::runtime_error &e) {
 		return -ENOSYS;
 	}
@@ -626,9 +932,12 @@ int fuse_ops::open(const char *path, struct fuse_file_info *file_info) {
 
 	int ret = 0;
 	try {
-		shared_ptr<inode> i = indexing_table->path_traversal(path);
+		bool modify = ((file_info->flags & O_ACCMODE) != O_RDONLY) || (file_info->flags & O_TRUNC);
+		shared_ptr<inode> i = indexing_table->path_traversal(path, modify);
 
 		if (i->get_loc() == LOCAL) {
+			if (file_info->flags & O_TRUNC)
+				recall_local_write_delegation(i);
 			ret = local_open(i, file_info);
 		} else if (i->get_loc() == REMOTE) {
 			while(true) {
@@ -641,6 +950,9 @@ int fuse_ops::open(const char *path, struct fuse_file_info *file_info) {
 				} else
 					break;
 			}
+
+			if ((ret == 0) && is_delegable(i, file_info))
+				write_delegations->open(i->get_ino());
 		}
 
 	} catch (inode::no_entry &e) {
@@ -669,11 +981,47 @@ int fuse_ops::release(const char *path, struct fuse_file_info *file_info) {
 		i = indexing_table->path_traversal(path);
 	}
 
+	/* the last writable handle reports the size and mtime to the leader */
+	if ((file_info != nullptr) && is_delegable(i, file_info)) {
+		try {
+			write_delegations->release(std::dynamic_pointer_cast<remote_inode>(i));
+		} catch (std::exception &e) {
+			global_logger.log(fuse_op, "Failed to return the write delegation: " + std::string(e.what()));
+		}
+	}
+
 	ret = local_release(i, file_info);
 
 	return ret;
 }
 
+int fuse_ops::fsync(const char *path, int datasync, struct fuse_file_info *file_info) {
+	global_logger.log(fuse_op, "Called fsync()");
+	global_logger.log(fuse_op, "path : " + std::string(path));
+
+	if (write_delegations == nullptr)
+		return 0;
+
+	try {
+		shared_ptr<inode> i;
+		if (file_info) {
+			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
+			i = handler->get_open_inode_info();
+		} else {
+			i = indexing_table->path_traversal(path);
+		}
+
+		/* the data is already in the data pool, only the delegated size and mtime are behind */
+		if (i->get_loc() != REMOTE)
+			return 0;
+		return write_delegations->flush(std::dynamic_pointer_cast<remote_inode>(i), false);
+	} catch (inode::no_entry &e) {
+		return -ENOENT;
+	} catch (inode::permission_denied &e) {
+		return -EACCES;
+	}
+}
+
 int fuse_ops::create(const char *path, mode_t mode, struct fuse_file_info *file_info) {
 	global_logger.log(fuse_op, "Called create()");
 	global_logger.log(fuse_op, "path : " + std::string(path));
@@ -684,16 +1032,20 @@ int fuse_ops::create(const char *path, mode_t mode, struct fuse_file_info *file_
 	try {
 		std::unique_ptr<std::string> target_name = get_filename_from_path(path);
 
-		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()));
-		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()), true);
+		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), *target_name);
 
 		if (parent_dentry_table->get_loc() == LOCAL) {
-			local_create(parent_i, *target_name, mode, file_info);
+			ret = local_create(parent_i, *target_name, mode, file_info);
 		} else if (parent_dentry_table->get_loc() == REMOTE) {
 			shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(
 				parent_dentry_table->get_leader_ip(),
 				parent_dentry_table->get_dir_ino(),
 				*target_name);
+			/* an exclusive create or a truncating open needs the answer of the leader */
+			if ((async_creates != nullptr) && !(file_info->flags & (O_EXCL | O_TRUNC)))
+				return async_remote_create(remote_i, parent_i->get_ino(), *target_name, mode, file_info);
+
 			while(true) {
 				ret = remote_create(remote_i, *target_name, mode, file_info);
 				if(ret == -ENOTLEADER) {
@@ -704,11 +1056,17 @@ int fuse_ops::create(const char *path, mode_t mode, struct fuse_file_info *file_
 				} else
 					break;
 			}
+
+			if ((ret == 0) && is_delegable(remote_i, file_info))
+				write_delegations->open(open_context->get_file_handler(file_info->fh)->get_ino());
 		}
 	} catch (inode::no_entry &e) {
 		return -ENOENT;
 	} catch (inode::permission_denied &e) {
 		return -EACCES;
+	} catch (dentry_table::not_leader &e) {
+		/* the directory was fragmented after the name was routed */
+		return create(path, mode, file_info);
 	}
 
 	return ret;
@@ -722,8 +1080,8 @@ int fuse_ops::unlink(const char *path) {
 	try {
 		std::unique_ptr<std::string> target_name = get_filename_from_path(path);
 
-		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()));
-		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+		shared_ptr<inode> parent_i = indexing_table->path_traversal(*(get_parent_dir_path(path).get()), true);
+		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), *target_name);
 
 		if (parent_dentry_table->get_loc() == LOCAL) {
 			local_unlink(parent_i, *target_name);
@@ -747,6 +1105,9 @@ int fuse_ops::unlink(const char *path) {
 		return -ENOENT;
 	} catch (inode::permission_denied &e) {
 		return -EACCES;
+	} catch (dentry_table::not_leader &e) {
+		/* the directory was fragmented after the name was routed */
+		return unlink(path);
 	}
 	return ret;
 }
@@ -785,17 +1146,16 @@ int fuse_ops::write(const char *path, const char *buffer, size_t size, off_t off
 
 	ssize_t written_len = 0;
 	try {
-		shared_ptr<inode> i;
-		if(file_info){
-			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
-			i = handler->get_open_inode_info();
-		} else {
-			i = indexing_table->path_traversal(path);
-		}
+		shared_ptr<inode> i = get_inode_to_modify(path, file_info);
 
 		if (i->get_loc() == LOCAL) {
+			recall_local_write_delegation(i);
 			written_len = local_write(i, buffer, size, offset, file_info->flags);
 		} else if (i->get_loc() == REMOTE) {
+			if ((write_delegations != nullptr)
+			    && write_delegations->write(std::dynamic_pointer_cast<remote_inode>(i), buffer, size, offset, file_info->flags, written_len))
+				return (int) written_len;
+
 			while(true) {
 				written_len = remote_write(std::dynamic_pointer_cast<remote_inode>(i), buffer, size, offset, file_info->flags);
 				if(written_len == -ENOTLEADER) {
@@ -822,13 +1182,7 @@ int fuse_ops::chmod(const char *path, mode_t mode, struct fuse_file_info *file_i
 
 	int ret = 0;
 	try {
-		shared_ptr<inode> i;
-		if(file_info){
-			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
-			i = handler->get_open_inode_info();
-		} else {
-			i = indexing_table->path_traversal(path);
-		}
+		shared_ptr<inode> i = get_inode_to_modify(path, file_info);
 
 		if (i->get_loc() == LOCAL) {
 			local_chmod(i, mode);
@@ -859,13 +1213,7 @@ int fuse_ops::chown(const char *path, uid_t uid, gid_t gid, struct fuse_file_inf
 
 	int ret = 0;
 	try {
-		shared_ptr<inode> i;
-		if(file_info){
-			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
-			i = handler->get_open_inode_info();
-		} else {
-			i = indexing_table->path_traversal(path);
-		}
+		shared_ptr<inode> i = get_inode_to_modify(path, file_info);
 
 		if (i->get_loc() == LOCAL) {
 			local_chown(i, uid, gid);
@@ -897,13 +1245,7 @@ int fuse_ops::utimens(const char *path, const struct timespec tv[2], struct fuse
 
 	int ret = 0;
 	try {
-		shared_ptr<inode> i;
-		if(file_info){
-			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
-			i = handler->get_open_inode_info();
-		} else {
-			i = indexing_table->path_traversal(path);
-		}
+		shared_ptr<inode> i = get_inode_to_modify(path, file_info);
 
 		if (i->get_loc() == LOCAL) {
 			local_utimens(i, tv);
@@ -935,15 +1277,10 @@ int fuse_ops::truncate(const char *path, off_t offset, struct fuse_file_info *fi
 
 	int ret = 0;
 	try {
-		shared_ptr<inode> i;
-		if(file_info){
-			shared_ptr<file_handler> handler = open_context->get_file_handler(file_info->fh);
-			i = handler->get_open_inode_info();
-		} else {
-			i = indexing_table->path_traversal(path);
-		}
+		shared_ptr<inode> i = get_inode_to_modify(path, file_info);
 
 		if (i->get_loc() == LOCAL) {
+			recall_local_write_delegation(i);
 			ret = local_truncate(i, offset);
 		} else if (i->get_loc() == REMOTE) {
 			while(true) {
@@ -966,6 +1303,100 @@ int fuse_ops::truncate(const char *path, off_t offset, struct fuse_file_info *fi
 	return ret;
 }
 
+int fuse_ops::setxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
+	global_logger.log(fuse_op, "Called setxattr()");
+	global_logger.log(fuse_op, "path : " + std::string(path) + " name : " + std::string(name));
+
+	if (strcmp(name, PIN_XATTR_NAME) != 0)
+		return -ENOTSUP;
+
+	try {
+		shared_ptr<inode> i = indexing_table->path_traversal(path);
+		if (!S_ISDIR(i->get_mode()))
+			return -ENOTDIR;
+		i->permission_check(W_OK);
+
+		std::string pin_addr(value, size);
+		if (pin_addr.empty())
+			pin_addr = lc->get_self_remote();
+
+		std::string cur_pin;
+		lc->get_pin(i->get_ino(), cur_pin);
+		if ((flags & XATTR_CREATE) && !cur_pin.empty())
+			return -EEXIST;
+		if ((flags & XATTR_REPLACE) && cur_pin.empty())
+			return -ENODATA;
+
+		lc->pin(i->get_ino(), pin_addr);
+		/* a directory led here is handed over right away, the others move on their next reacquire */
+		if (pin_addr != lc->get_self_remote())
+			indexing_table->migrate_dentry_table(i->get_ino(), pin_addr);
+		else
+			indexing_table->forget_pin_misses();
+	} catch (inode::no_entry &e) {
+		return -ENOENT;
+	} catch (inode::permission_denied &e) {
+		return -EACCES;
+	}
+
+	return 0;
+}
+
+int fuse_ops::getxattr(const char *path, const char *name, char *value, size_t size) {
+	global_logger.log(fuse_op, "Called getxattr()");
+	global_logger.log(fuse_op, "path : " + std::string(path) + " name : " + std::string(name));
+
+	if (strcmp(name, PIN_XATTR_NAME) != 0)
+		return -ENOTSUP;
+
+	std::string pin_addr;
+	try {
+		shared_ptr<inode> i = indexing_table->path_traversal(path);
+		if (!S_ISDIR(i->get_mode()))
+			return -ENODATA;
+		lc->get_pin(i->get_ino(), pin_addr);
+	} catch (inode::no_entry &e) {
+		return -ENOENT;
+	} catch (inode::permission_denied &e) {
+		return -EACCES;
+	}
+
+	if (pin_addr.empty())
+		return -ENODATA;
+	if (size == 0)
+		return static_cast<int>(pin_addr.length());
+	if (size < pin_addr.length())
+		return -ERANGE;
+
+	memcpy(value, pin_addr.data(), pin_addr.length());
+	return static_cast<int>(pin_addr.length());
+}
+
+int fuse_ops::removexattr(const char *path, const char *name) {
+	global_logger.log(fuse_op, "Called removexattr()");
+	global_logger.log(fuse_op, "path : " + std::string(path) + " name : " + std::string(name));
+
+	if (strcmp(name, PIN_XATTR_NAME) != 0)
+		return -ENOTSUP;
+
+	try {
+		shared_ptr<inode> i = indexing_table->path_traversal(path);
+		if (!S_ISDIR(i->get_mode()))
+			return -ENODATA;
+		i->permission_check(W_OK);
+
+		/* an inherited pin is removed from the directory it is set on */
+		if (lc->pin(i->get_ino(), "") != 0)
+			return -ENODATA;
+	} catch (inode::no_entry &e) {
+		return -ENOENT;
+	} catch (inode::permission_denied &e) {
+		return -EACCES;
+	}
+
+	return 0;
+}
+
 fuse_operations fuse_ops::get_fuse_ops(void) {
 	fuse_operations fops;
 	memset(&fops, 0, sizeof(fuse_operations));
@@ -979,6 +1410,7 @@ fuse_operations fuse_ops::get_fuse_ops(void) {
 
 	fops.opendir = opendir;
 	fops.releasedir = releasedir;
+	fops.fsyncdir = fsyncdir;
 
 	fops.readdir = readdir;
 	fops.mkdir = mkdir;
@@ -987,6 +1419,7 @@ fuse_operations fuse_ops::get_fuse_ops(void) {
 
 	fops.open = open;
 	fops.release = release;
+	fops.fsync = fsync;
 
 	fops.create = create;
 	fops.unlink = unlink;
@@ -999,5 +1432,9 @@ fuse_operations fuse_ops::get_fuse_ops(void) {
 	fops.utimens = utimens;
 
 	fops.truncate = truncate;
+
+	fops.setxattr = setxattr;
+	fops.getxattr = getxattr;
+	fops.removexattr = removexattr;
 	return fops;
 }
@@ -13,6 +13,7 @@ int getattr(const char* path, struct stat* stat, struct fuse_file_info* file_inf
 int access(const char* path, int mask);
 int opendir(const char* path, struct fuse_file_info* file_info);
 int releasedir(const char* path, struct fuse_file_info* file_info);
+int fsyncdir(const char* path, int datasync, struct fuse_file_info* file_info);
 int readdir(const char* path, void* buffer, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* file_info, enum fuse_readdir_flags readdir_flags);
 int mkdir(const char* path, mode_t mode);
 int rmdir(const char* path);
@@ -21,6 +22,7 @@ int readlink(const char *path, char *buf, size_t size);
 int rename(const char* old_path, const char* new_path, unsigned int flags);
 int open(const char* path, struct fuse_file_info* file_info);
 int release(const char* path, struct fuse_file_info* file_info);
+int fsync(const char* path, int datasync, struct fuse_file_info* file_info);
 int create(const char* path, mode_t mode, struct fuse_file_info* file_info);
 int unlink(const char* path);
 int read(const char* path, char* buffer, size_t size, off_t offset, struct fuse_file_info* file_info);
@@ -29,6 +31,9 @@ int chmod(const char* path, mode_t mode, struct fuse_file_info* file_info);
 int chown(const char* path, uid_t uid, gid_t gid, struct fuse_file_info* file_info);
 int utimens(const char *path, const struct timespec tv[2], struct fuse_file_info *fi);
 int truncate (const char *path, off_t, struct fuse_file_info *fi);
+int setxattr(const char *path, const char *name, const char *value, size_t size, int flags);
+int getxattr(const char *path, const char *name, char *value, size_t size);
+int removexattr(const char *path, const char *name);
 
 fuse_operations get_fuse_ops(void);
 
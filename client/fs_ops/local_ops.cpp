@@ -1,5 +1,7 @@
 #include "local_ops.hpp"
 
+#include <optional>
+
 extern std::shared_ptr<rados_io> meta_pool;
 extern std::shared_ptr<rados_io> data_pool;
 extern std::unique_ptr<directory_table> indexing_table;
@@ -49,29 +51,62 @@ int local_releasedir(shared_ptr<inode> i, struct fuse_file_info *file_info) {
 	return ret;
 }
 
-void local_readdir(shared_ptr<inode> i, void *buffer, fuse_fill_dir_t filler) {
+void local_readdir(shared_ptr<inode> i, void *buffer, fuse_fill_dir_t filler, off_t offset, shared_ptr<file_handler> fh, bool plus) {
 	global_logger.log(local_fs_op, "Called readdir()");
-	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(i->get_ino());
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		parent_dentry_table->fill_filler(buffer, filler);
+	shared_ptr<const dentry_snapshot> snap;
+	if (fh != nullptr)
+		snap = fh->get_dir_snapshot();
+
+	/* the first readdir of the handle or rewinddir() takes a new snapshot, later offsets index into it */
+	if (snap == nullptr || offset == 0) {
+		shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(i->get_ino(), false, false);
+		snap = parent_dentry_table->get_snapshot();
+		if (fh != nullptr)
+			fh->set_dir_snapshot(snap);
+	}
+
+	/* offset 0 and 1 are "." and "..", children start from 2 */
+	off_t end = static_cast<off_t>(snap->size()) + 2;
+	for (off_t pos = offset; pos < end; pos++) {
+		if (pos < 2) {
+			if (filler(buffer, (pos == 0) ? "." : "..", nullptr, pos + 1, static_cast<fuse_fill_dir_flags>(0)))
+				break;
+			continue;
+		}
+
+		const child_entry &e = (*snap)[pos - 2];
+		struct stat attr{};
+		bool attr_valid = false;
+		/* READDIRPLUS : the attributes of a child directory belong to its own leader, leave them to lookup */
+		if (plus) {
+			std::scoped_lock scl{e.i->inode_mutex};
+			if (!S_ISDIR(e.i->get_mode())) {
+				e.i->fill_stat(&attr);
+				attr_valid = true;
+			}
+		}
+
+		if (filler(buffer, e.name.c_str(), attr_valid ? &attr : nullptr, pos + 1,
+			   static_cast<fuse_fill_dir_flags>(attr_valid ? FUSE_FILL_DIR_PLUS : 0)))
+			break;
 	}
 }
 
 int local_mkdir(shared_ptr<inode> parent_i, std::string new_child_name, mode_t mode, std::shared_ptr<inode>& new_dir_inode, std::shared_ptr<dentry>& new_dir_dentry) {
 	global_logger.log(local_fs_op, "Called mkdir()");
 
-	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
-	shared_ptr<inode> new_i = std::make_shared<inode>(parent_i->get_ino(), this_client->get_client_uid(), this_client->get_client_gid(),mode | S_IFDIR);
+	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), new_child_name);
+	shared_ptr<inode> new_i = make_inode(parent_i->get_ino(), this_client->get_client_uid(), this_client->get_client_gid(),mode | S_IFDIR);
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		parent_dentry_table->create_child_inode(new_child_name, new_i);
+		if (parent_dentry_table->create_child_inode(new_child_name, new_i) != 0)
+			return -EEXIST;
 
 		struct timespec ts{};
 		timespec_get(&ts, TIME_UTC);
 		parent_i->set_mtime(ts);
 		parent_i->set_ctime(ts);
-		journalctl->mkdir(parent_i, new_child_name, new_i->get_ino());
+		journalctl->mkdir(parent_dentry_table->get_dir_ino(), parent_i, new_child_name, new_i->get_ino());
 
 		new_i->set_size(DIR_INODE_SIZE);
 		shared_ptr<dentry> new_d = std::make_shared<dentry>(new_i->get_ino(), true);
@@ -104,7 +139,7 @@ int local_rmdir_top(shared_ptr<inode> target_i, uuid target_ino) {
 int local_rmdir_down(shared_ptr<inode> parent_i, uuid target_ino, std::string target_name) {
 	global_logger.log(local_fs_op, "Called rmdir_down()");
 	int ret = 0;
-	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), target_name);
 	if (parent_dentry_table == nullptr) {
 		throw std::runtime_error("directory table is corrupted : Can't find leased directory");
 	}
@@ -117,7 +152,7 @@ int local_rmdir_down(shared_ptr<inode> parent_i, uuid target_ino, std::string ta
 		timespec_get(&ts, TIME_UTC);
 		parent_i->set_mtime(ts);
 		parent_i->set_ctime(ts);
-		journalctl->rmdir(parent_i, target_name, target_ino);
+		journalctl->rmdir(parent_dentry_table->get_dir_ino(), parent_i, target_name, target_ino);
 
 		/* It may be failed if top and down both are local */
 		ret = indexing_table->delete_dentry_table(target_ino);
@@ -130,15 +165,15 @@ int local_rmdir_down(shared_ptr<inode> parent_i, uuid target_ino, std::string ta
 
 int local_symlink(shared_ptr<inode> dst_parent_i, const char *src, const char *dst) {
 	global_logger.log(local_fs_op, "Called symlink()");
-	shared_ptr<dentry_table> dst_parent_dentry_table = indexing_table->get_dentry_table(dst_parent_i->get_ino());
-
 	unique_ptr<std::string> symlink_name = get_filename_from_path(dst);
+	shared_ptr<dentry_table> dst_parent_dentry_table = indexing_table->get_dentry_table_of(dst_parent_i->get_ino(), *symlink_name);
+
 	{
 		std::scoped_lock scl{dst_parent_dentry_table->dentry_table_mutex};
 		if (!dst_parent_dentry_table->check_child_inode(*symlink_name).is_nil())
 			return -EEXIST;
 
-		shared_ptr<inode> symlink_i = std::make_shared<inode>(dst_parent_i->get_ino(), this_client->get_client_uid(),
+		shared_ptr<inode> symlink_i = make_inode(dst_parent_i->get_ino(), this_client->get_client_uid(),
 								      this_client->get_client_gid(), S_IFLNK | 0777,
 								      src);
 
@@ -148,7 +183,7 @@ int local_symlink(shared_ptr<inode> dst_parent_i, const char *src, const char *d
 
 		struct timespec ts{};
 		timespec_get(&ts, TIME_UTC);
-		journalctl->mkreg(dst_parent_i, *symlink_name, symlink_i);
+		journalctl->mkreg(dst_parent_dentry_table->get_dir_ino(), dst_parent_i, *symlink_name, symlink_i);
 	}
 	return 0;
 }
@@ -161,7 +196,7 @@ int local_readlink(shared_ptr<inode> i, char *buf, size_t size) {
 			return -EINVAL;
 
 		size_t len = MIN(i->get_link_target_len(), size - 1);
-		memcpy(buf, i->get_link_target_name()->data(), len);
+		memcpy(buf, i->get_link_target_name(), len);
 		buf[len] = '\0';
 	}
 	return 0;
@@ -176,7 +211,8 @@ int local_rename_same_parent(shared_ptr<inode> parent_i, const char *old_path, c
 	unique_ptr<std::string> old_name = get_filename_from_path(old_path);
 	unique_ptr<std::string> new_name = get_filename_from_path(new_path);
 
-	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+	/* the caller makes sure both names are in the same table, see fuse_ops::rename() */
+	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), *old_name);
 	shared_ptr<inode> target_i;
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
@@ -185,6 +221,8 @@ int local_rename_same_parent(shared_ptr<inode> parent_i, const char *old_path, c
 
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex, target_i->inode_mutex};
+		if (parent_dentry_table->is_reserved(*new_name))
+			return -EEXIST;
 		uuid check_dst_ino = parent_dentry_table->check_child_inode(*new_name);
 
 		struct timespec ts{};
@@ -197,13 +235,13 @@ int local_rename_same_parent(shared_ptr<inode> parent_i, const char *old_path, c
 				/* TODO : directory inode location is different */
 				std::shared_ptr<inode> check_dst_inode = parent_dentry_table->get_child_inode(*new_name);
 				parent_dentry_table->delete_child_inode(*new_name);
-				journalctl->rmreg(parent_i, *new_name, check_dst_inode);
+				journalctl->rmreg(parent_dentry_table->get_dir_ino(), parent_i, *new_name, check_dst_inode);
 			}
 
 			parent_dentry_table->delete_child_inode(*old_name);
-			journalctl->rmreg(parent_i, *old_name, target_i);
+			journalctl->rmreg(parent_dentry_table->get_dir_ino(), parent_i, *old_name, target_i);
 			parent_dentry_table->create_child_inode(*new_name, target_i);
-			journalctl->mkreg(parent_i, *new_name, target_i);
+			journalctl->mkreg(parent_dentry_table->get_dir_ino(), parent_i, *new_name, target_i);
 		} else {
 			return -ENOSYS;
 		}
@@ -211,57 +249,6 @@ int local_rename_same_parent(shared_ptr<inode> parent_i, const char *old_path, c
 	return 0;
 }
 
-std::shared_ptr<inode> local_rename_not_same_parent_src(shared_ptr<inode> src_parent_i, const char *old_path, unsigned int flags) {
-	global_logger.log(local_fs_op, "Called rename_not_same_parent_src()");
-	unique_ptr<std::string> old_name = get_filename_from_path(old_path);
-
-	uuid target_ino;
-	shared_ptr<dentry_table> src_dentry_table = indexing_table->get_dentry_table(src_parent_i->get_ino());
-	shared_ptr<inode> target_i;
-	{
-		std::scoped_lock scl{src_dentry_table->dentry_table_mutex};
-		target_i = src_dentry_table->get_child_inode(*old_name);
-	}
-
-	{
-		std::scoped_lock scl{src_dentry_table->dentry_table_mutex, target_i->inode_mutex};
-		if (flags == 0) {
-			/* TODO : is it okay to delete inode which is locked? */
-			src_dentry_table->delete_child_inode(*old_name);
-			journalctl->rmreg(src_parent_i, *old_name, target_i);
-		} else {
-			throw std::runtime_error("NOT IMPLEMENTED");
-		}
-	}
-	return target_i;
-}
-
-int local_rename_not_same_parent_dst(shared_ptr<inode> dst_parent_i, std::shared_ptr<inode> target_inode, uuid check_dst_ino,
-				     const char *new_path, unsigned int flags) {
-	global_logger.log(local_fs_op, "Called rename_not_same_parent_dst()");
-	unique_ptr<std::string> new_name = get_filename_from_path(new_path);
-
-	shared_ptr<dentry_table> dst_dentry_table = indexing_table->get_dentry_table(dst_parent_i->get_ino());
-	target_inode->set_loc(LOCAL);
-	target_inode->set_p_ino(dst_parent_i->get_ino());
-	{
-		std::scoped_lock scl{dst_dentry_table->dentry_table_mutex, target_inode->inode_mutex};
-		if (flags == 0) {
-			if (!check_dst_ino.is_nil()) {
-				std::shared_ptr<inode> check_dst_inode = dst_dentry_table->get_child_inode(*new_name);
-				dst_dentry_table->delete_child_inode(*new_name);
-				journalctl->rmreg(dst_parent_i, *new_name, check_dst_inode);
-				/* TODO : is it okay to delete inode which is locked? */
-			}
-			dst_dentry_table->create_child_inode(*new_name, target_inode);
-			journalctl->mkreg(dst_parent_i, *new_name, target_inode);
-		} else {
-			throw std::runtime_error("NOT IMPLEMENTED");
-		}
-	}
-	return 0;
-}
-
 int local_open(shared_ptr<inode> i, struct fuse_file_info *file_info) {
 	global_logger.log(local_fs_op, "Called open()");
 	{
@@ -295,21 +282,22 @@ int local_release(shared_ptr<inode> i, struct fuse_file_info *file_info) {
 	return ret;
 }
 
-void local_create(shared_ptr<inode> parent_i, std::string new_child_name, mode_t mode, struct fuse_file_info *file_info) {
+int local_create(shared_ptr<inode> parent_i, std::string new_child_name, mode_t mode, struct fuse_file_info *file_info) {
 	global_logger.log(local_fs_op, "Called create()");
 
-	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
-	shared_ptr<inode> i = std::make_shared<inode>(parent_i->get_ino(), this_client->get_client_uid(), this_client->get_client_gid(),mode | S_IFREG);
+	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), new_child_name);
+	shared_ptr<inode> i = make_inode(parent_i->get_ino(), this_client->get_client_uid(), this_client->get_client_gid(),mode | S_IFREG);
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
 
-		parent_dentry_table->create_child_inode(new_child_name, i);
+		if (parent_dentry_table->create_child_inode(new_child_name, i) != 0)
+			return -EEXIST;
 
 		struct timespec ts{};
 		timespec_get(&ts, TIME_UTC);
 		parent_i->set_mtime(ts);
 		parent_i->set_ctime(ts);
-		journalctl->mkreg(parent_i, new_child_name, i);
+		journalctl->mkreg(parent_dentry_table->get_dir_ino(), parent_i, new_child_name, i);
 
 		shared_ptr<file_handler> fh = std::make_shared<file_handler>(i->get_ino());
 		fh->set_loc(LOCAL);
@@ -319,11 +307,12 @@ void local_create(shared_ptr<inode> parent_i, std::string new_child_name, mode_t
 
 		open_context->add_file_handler(file_info->fh, fh);
 	}
+	return 0;
 }
 
 void local_unlink(shared_ptr<inode> parent_i, std::string child_name) {
 	global_logger.log(local_fs_op, "Called unlink()");
-	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table(parent_i->get_ino());
+	shared_ptr<dentry_table> parent_dentry_table = indexing_table->get_dentry_table_of(parent_i->get_ino(), child_name);
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
 		shared_ptr<inode> target_i = parent_dentry_table->get_child_inode(child_name);
@@ -339,7 +328,7 @@ void local_unlink(shared_ptr<inode> parent_i, std::string child_name) {
 			timespec_get(&ts, TIME_UTC);
 			parent_i->set_mtime(ts);
 			parent_i->set_ctime(ts);
-			journalctl->rmreg(parent_i, child_name, target_i);
+			journalctl->rmreg(parent_dentry_table->get_dir_ino(), parent_i, child_name, target_i);
 		} else {
 			target_i->set_nlink(nlink);
 			journalctl->chreg(target_i->get_p_ino(), target_i);
@@ -359,14 +348,33 @@ ssize_t local_write(shared_ptr<inode> i, const char *buffer, size_t size, off_t
 	global_logger.log(local_fs_op, "Called write()");
 	size_t written_len = 0;
 
-	{
-		std::scoped_lock scl{i->inode_mutex};
-		if (flags & O_APPEND) {
-			offset = i->get_size();
+	std::optional<range_lock> range;
+	if (flags & O_APPEND) {
+		/* an append locks the tail from the current size on, the writes below it go on meanwhile */
+		while (true) {
+			off_t tail;
+			{
+				std::scoped_lock scl{i->inode_mutex};
+				tail = i->get_size();
+			}
+
+			range.emplace(i->get_ino(), tail, RANGE_LOCK_EOF);
+			std::scoped_lock scl{i->inode_mutex};
+			/* nothing can grow the file past a locked tail, only a truncate before the lock shrinks it */
+			if (i->get_size() >= tail) {
+				offset = i->get_size();
+				break;
+			}
+			range.reset();
 		}
+	} else {
+		range.emplace(i->get_ino(), offset, offset + static_cast<off_t>(size));
+	}
 
-		written_len = data_pool->write(obj_category::DATA, uuid_to_string(i->get_ino()), buffer, size, offset);
+	written_len = data_pool->write(obj_category::DATA, uuid_to_string(i->get_ino()), buffer, size, offset);
 
+	{
+		std::scoped_lock scl{i->inode_mutex};
 		if (i->get_size() < offset + size) {
 			i->set_size(offset + size);
 
@@ -444,6 +452,8 @@ int local_truncate(const shared_ptr<inode> i, off_t offset) {
 	/*TODO : clear setuid, setgid*/
 	int ret;
 	{
+		/* no write of the file is in flight while its data is cut */
+		range_lock range(i->get_ino(), 0, RANGE_LOCK_EOF);
 		std::scoped_lock scl{i->inode_mutex};
 		if (S_ISDIR(i->get_mode()))
 			return -EISDIR;
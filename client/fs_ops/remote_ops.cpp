@@ -1,13 +1,70 @@
 #include "remote_ops.hpp"
 
+#include <algorithm>
+
+#include "async_create.hpp"
+#include "write_delegation.hpp"
+
+#include "../in_memory/remote_attr_cache.hpp"
+#include "../rpc/invalidation.hpp"
+
+extern std::unique_ptr<async_create_queue> async_creates;
+extern std::unique_ptr<write_delegation_table> write_delegations;
+extern std::unique_ptr<remote_attr_cache> attr_cache;
+extern std::unique_ptr<invalidation_listener> invalidation_subscriptions;
+
+/* an operation on a name still being created asynchronously reaches the leader after the create */
+static void wait_async_create(const uuid &table_ino, const std::string &name) {
+	if (async_creates != nullptr)
+		async_creates->wait(table_ino, name);
+}
+
+/* the cached attributes of a name changed through the leader are dropped, with those of the directory holding it */
+static void forget_attr(const uuid &table_ino, const std::string &name) {
+	if (attr_cache != nullptr) {
+		attr_cache->invalidate(table_ino, name);
+		attr_cache->invalidate(table_ino, "");
+	}
+}
+
+static void forget_attr(const shared_ptr<remote_inode> &i) {
+	forget_attr(i->get_dentry_table_ino(), i->get_target_is_parent() ? "" : i->get_file_name());
+}
+
 int remote_getattr(shared_ptr<remote_inode> i, struct stat* stat) {
 	global_logger.log(remote_fs_op, "Called remote_getattr()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
-	std::string remote_address(i->get_address());
-	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
-
-	int ret = rc->getattr(i, stat);
+	if((async_creates != nullptr) && async_creates->fill_stat(i->get_dentry_table_ino(), i->get_file_name(), stat))
+		return 0;
+
+	uint64_t generation = 0;
+	uint64_t epoch = 0;
+	remote_attr_cache::lookup_result cached = remote_attr_cache::MISS;
+	if(attr_cache != nullptr) {
+		cached = attr_cache->lookup(*i, stat, generation);
+		epoch = attr_cache->get_epoch();
+	}
+
+	int ret = 0;
+	if(cached != remote_attr_cache::FRESH) {
+		std::string remote_address(i->get_address());
+		std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
+		bool watched = (invalidation_subscriptions != nullptr) && invalidation_subscriptions->subscribe(remote_address);
+
+		try {
+			ret = rc->getattr(i, stat, generation, watched);
+		} catch (inode::no_entry &e) {
+			forget_attr(i);
+			throw;
+		}
+		if((ret == 0) && (attr_cache != nullptr))
+			attr_cache->insert(*i, stat, generation, watched, epoch);
+	}
+
+	/* the leader doesn't know the size and mtime delegated to this client */
+	if((ret == 0) && (write_delegations != nullptr) && !i->get_target_is_parent())
+		write_delegations->fill_stat(i->get_ino(), stat);
 	return ret;
 }
 
@@ -15,6 +72,13 @@ int remote_access(shared_ptr<remote_inode> i, int mask) {
 	global_logger.log(remote_fs_op, "Called remote_access()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
+
+	struct stat s{};
+	uint64_t generation;
+	if((attr_cache != nullptr) && (attr_cache->lookup(*i, &s, generation) == remote_attr_cache::FRESH))
+		return inode::check_permission(s.st_mode, s.st_uid, s.st_gid, mask) ? 0 : -EACCES;
+
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
@@ -26,6 +90,7 @@ int remote_opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_info)
 	global_logger.log(remote_fs_op, "Called remote_opendir()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
@@ -33,14 +98,77 @@ int remote_opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_info)
 	return ret;
 }
 
-int remote_readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_t filler) {
+int remote_readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_t filler, off_t offset, shared_ptr<file_handler> fh, bool plus) {
 	global_logger.log(remote_fs_op, "Called remote_readdir()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
-	int ret = rc->readdir(i, buffer, filler);
+	/* readdir without an open handle keeps the fetched names only for this call */
+	if(fh == nullptr)
+		fh = std::make_shared<file_handler>(i->get_ino());
+
+	/* offset 0 and 1 are "." and "..", children start from 2 */
+	for(off_t pos = offset; ; pos++) {
+		const char *name;
+		const struct stat *attr = nullptr;
+		if(pos == 0) {
+			name = ".";
+		} else if(pos == 1) {
+			name = "..";
+		} else {
+			auto child = static_cast<uint64_t>(pos - 2);
+			if((child < fh->get_dir_cache_offset()) || (child >= fh->get_dir_cache_offset() + fh->get_dir_cache().size())
+			   || (plus && !fh->is_dir_cache_plus())) {
+				std::vector<dir_cache_entry> entries;
+				/* a rewind reads a new snapshot from its start if the leader pinned one */
+				if(child == 0)
+					fh->set_dir_shift(0);
+				uint64_t dir_handle = fh->get_dir_handle();
+				uint64_t snap_offset = static_cast<uint64_t>(std::max<int64_t>(0, static_cast<int64_t>(child) + fh->get_dir_shift()));
+				/* the name before 'child', the leader resumes after it if the snapshot was lost */
+				std::string resume_name;
+				if((child > 0) && (child - 1 >= fh->get_dir_cache_offset()) && (child - 1 < fh->get_dir_cache_offset() + fh->get_dir_cache().size()))
+					resume_name = fh->get_dir_cache()[child - 1 - fh->get_dir_cache_offset()].name;
+
+				int ret;
+				if(plus)
+					ret = rc->readdirplus(i, dir_handle, snap_offset, resume_name, READDIR_BATCH_SIZE, entries);
+				else
+					ret = rc->readdir(i, dir_handle, snap_offset, resume_name, READDIR_BATCH_SIZE, entries);
+				if(ret < 0)
+					return ret;
+				if(dir_handle != fh->get_dir_handle()) {
+					fh->set_dir_handle(dir_handle);
+					fh->set_dir_shift(static_cast<int64_t>(snap_offset) - static_cast<int64_t>(child));
+				}
+				if(entries.empty())
+					break;
+				fh->set_dir_cache(child, plus, std::move(entries));
+			}
+
+			const dir_cache_entry &e = fh->get_dir_cache()[child - fh->get_dir_cache_offset()];
+			name = e.name.c_str();
+			if(plus && e.attr_valid)
+				attr = &(e.attr);
+		}
+
+		if(filler(buffer, name, attr, pos + 1, static_cast<fuse_fill_dir_flags>(attr ? FUSE_FILL_DIR_PLUS : 0)))
+			break;
+	}
+
+	return 0;
+}
+
+int remote_releasedir(shared_ptr<remote_inode> i, uint64_t dir_handle) {
+	global_logger.log(remote_fs_op, "Called remote_releasedir()");
+	if(i == nullptr)
+		throw std::runtime_error("inode casting is failed");
+	std::string remote_address(i->get_address());
+	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
+
+	int ret = rc->releasedir(i, dir_handle);
 	return ret;
 }
 
@@ -52,6 +180,7 @@ int remote_mkdir(shared_ptr<remote_inode> parent_i, std::string new_child_name,
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->mkdir(parent_i, new_child_name, mode, new_dir_inode, new_dir_dentry);
+	forget_attr(parent_i->get_dentry_table_ino(), new_child_name);
 	return ret;
 }
 
@@ -63,6 +192,7 @@ int remote_rmdir_top(shared_ptr<remote_inode> target_i, uuid target_ino) {
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->rmdir_top(target_i, target_ino);
+	forget_attr(target_i);
 	return ret;
 }
 
@@ -70,10 +200,12 @@ int remote_rmdir_down(shared_ptr<remote_inode> parent_i, uuid target_ino, std::s
 	global_logger.log(remote_fs_op, "Called remote_rmdir_down()");
 	if(parent_i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(parent_i->get_dentry_table_ino(), target_name);
 	std::string remote_address(parent_i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->rmdir_down(parent_i, target_ino, target_name);
+	forget_attr(parent_i->get_dentry_table_ino(), target_name);
 	return ret;
 }
 
@@ -85,6 +217,7 @@ int remote_symlink(shared_ptr<remote_inode> dst_parent_i, const char *src, const
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->symlink(dst_parent_i, src, dst);
+	forget_attr(dst_parent_i->get_dentry_table_ino(), *get_filename_from_path(dst));
 	return ret;
 }
 
@@ -92,6 +225,7 @@ int remote_readlink(shared_ptr<remote_inode> i, char *buf, size_t size) {
 	global_logger.log(remote_fs_op, "Called remote_readlink()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
@@ -103,32 +237,42 @@ int remote_rename_same_parent(shared_ptr<remote_inode> parent_i, const char* old
 	global_logger.log(remote_fs_op, "Called remote_rename_same_parent()");
 	if(parent_i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(parent_i->get_dentry_table_ino(), *get_filename_from_path(old_path));
+	wait_async_create(parent_i->get_dentry_table_ino(), *get_filename_from_path(new_path));
 	std::string remote_address(parent_i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->rename_same_parent(parent_i, old_path, new_path, flags);
+	forget_attr(parent_i->get_dentry_table_ino(), *get_filename_from_path(old_path));
+	forget_attr(parent_i->get_dentry_table_ino(), *get_filename_from_path(new_path));
 	return ret;
 }
 
-int remote_rename_not_same_parent_src(shared_ptr<remote_inode> src_parent_i, const char* old_path, unsigned int flags, std::shared_ptr<inode>& target_inode) {
-	global_logger.log(remote_fs_op, "Called remote_rename_not_same_parent_src()");
+int remote_rename_across(shared_ptr<remote_inode> src_parent_i, const char* old_path, const uuid &dst_parent_ino, const uuid &dst_table_ino, const char* new_path, unsigned int flags) {
+	global_logger.log(remote_fs_op, "Called remote_rename_across()");
 	if(src_parent_i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(src_parent_i->get_dentry_table_ino(), *get_filename_from_path(old_path));
+	wait_async_create(dst_table_ino, *get_filename_from_path(new_path));
 	std::string remote_address(src_parent_i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
-	int ret = rc->rename_not_same_parent_src(src_parent_i, old_path, flags, target_inode);
+	int ret = rc->rename(src_parent_i, old_path, dst_parent_ino, new_path, flags);
+	forget_attr(src_parent_i->get_dentry_table_ino(), *get_filename_from_path(old_path));
+	forget_attr(dst_table_ino, *get_filename_from_path(new_path));
 	return ret;
 }
 
-int remote_rename_not_same_parent_dst(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode>& target_inode, uuid check_dst_ino, const char* new_path, unsigned int flags) {
-	global_logger.log(remote_fs_op, "Called remote_rename_not_same_parent_dst()");
+int remote_rename_link(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode> target_inode, unsigned int flags) {
+	global_logger.log(remote_fs_op, "Called remote_rename_link()");
 	if(dst_parent_i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(dst_parent_i->get_dentry_table_ino(), dst_parent_i->get_file_name());
 	std::string remote_address(dst_parent_i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
-	int ret = rc->rename_not_same_parent_dst(dst_parent_i, target_inode, check_dst_ino, new_path, flags);
+	int ret = rc->rename_link(dst_parent_i, target_inode, flags);
+	forget_attr(dst_parent_i);
 	return ret;
 }
 
@@ -136,10 +280,13 @@ int remote_open(shared_ptr<remote_inode> i, struct fuse_file_info* file_info) {
 	global_logger.log(remote_fs_op, "Called remote_open()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->open(i, file_info);
+	if(file_info->flags & O_TRUNC)
+		forget_attr(i);
 	return ret;
 }
 
@@ -151,6 +298,7 @@ int remote_create(shared_ptr<remote_inode> parent_i, std::string new_child_name,
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->create(parent_i, new_child_name, mode, file_info);
+	forget_attr(parent_i->get_dentry_table_ino(), new_child_name);
 	return ret;
 }
 
@@ -158,10 +306,12 @@ int remote_unlink(shared_ptr<remote_inode> parent_i, std::string child_name) {
 	global_logger.log(remote_fs_op, "Called remote_unlink()");
 	if(parent_i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(parent_i->get_dentry_table_ino(), child_name);
 	std::string remote_address(parent_i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->unlink(parent_i, child_name);
+	forget_attr(parent_i->get_dentry_table_ino(), child_name);
 	return ret;
 }
 
@@ -169,10 +319,12 @@ ssize_t remote_write(shared_ptr<remote_inode> i, const char* buffer, size_t size
 	global_logger.log(remote_fs_op, "Called remote_write()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	ssize_t written_len = rc->write(i, buffer, size, offset, flags);
+	forget_attr(i);
 	return written_len;
 }
 
@@ -180,10 +332,12 @@ int remote_chmod(shared_ptr<remote_inode> i, mode_t mode) {
 	global_logger.log(remote_fs_op, "Called remote_chmod()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->chmod(i, mode);
+	forget_attr(i);
 	return ret;
 }
 
@@ -191,10 +345,12 @@ int remote_chown(shared_ptr<remote_inode> i, uid_t uid, gid_t gid) {
 	global_logger.log(remote_fs_op, "Called remote_chown()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->chown(i, uid, gid);
+	forget_attr(i);
 	return ret;
 }
 
@@ -202,10 +358,12 @@ int remote_utimens(shared_ptr<remote_inode> i, const struct timespec tv[2]) {
 	global_logger.log(remote_fs_op, "Called remote_utimens()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->utimens(i, tv);
+	forget_attr(i);
 	return ret;
 }
 
@@ -213,9 +371,14 @@ int remote_truncate (shared_ptr<remote_inode> i, off_t offset) {
 	global_logger.log(remote_fs_op, "Called remote_truncate()");
 	if(i == nullptr)
 		throw std::runtime_error("inode casting is failed");
+	wait_async_create(i->get_dentry_table_ino(), i->get_file_name());
+	/* the leader sets the size from now on, the next write asks for the delegation again */
+	if((write_delegations != nullptr) && !i->get_target_is_parent())
+		write_delegations->flush(i, true);
 	std::string remote_address(i->get_address());
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	int ret = rc->truncate(i, offset);
+	forget_attr(i);
 	return ret;
 }
\ No newline at end of file
@@ -11,15 +11,18 @@
 int remote_getattr(shared_ptr<remote_inode> i, struct stat* stat);
 int remote_access(shared_ptr<remote_inode> i, int mask);
 int remote_opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_info);
-int remote_readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_t filler);
+int remote_readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_t filler, off_t offset, shared_ptr<file_handler> fh, bool plus);
+int remote_releasedir(shared_ptr<remote_inode> i, uint64_t dir_handle);
 int remote_mkdir(shared_ptr<remote_inode> parent_i, std::string new_child_name, mode_t mode, std::shared_ptr<inode>& new_dir_inode, std::shared_ptr<dentry>& new_dir_dentry);
 int remote_rmdir_top(shared_ptr<remote_inode> target_i, uuid target_ino);
 int remote_rmdir_down(shared_ptr<remote_inode> parent_i, uuid target_ino, std::string target_name);
 int remote_symlink(shared_ptr<remote_inode> dst_parent_i, const char *src, const char *dst);
 int remote_readlink(shared_ptr<remote_inode> i, char *buf, size_t size);
 int remote_rename_same_parent(shared_ptr<remote_inode> parent_i, const char* old_path, const char* new_path, unsigned int flags);
-int remote_rename_not_same_parent_src(shared_ptr<remote_inode> src_parent_i, const char* old_path, unsigned int flags, std::shared_ptr<inode>& target_inode);
-int remote_rename_not_same_parent_dst(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode>& target_inode, uuid check_dst_ino, const char* new_path, unsigned int flags);
+/* sent to the leader of the source, 'dst_table_ino' is the table holding the new name */
+int remote_rename_across(shared_ptr<remote_inode> src_parent_i, const char* old_path, const uuid &dst_parent_ino, const uuid &dst_table_ino, const char* new_path, unsigned int flags);
+/* sent by the leader of the source to the one of the destination, 'dst_parent_i' names the new name */
+int remote_rename_link(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode> target_inode, unsigned int flags);
 int remote_open(shared_ptr<remote_inode> i, struct fuse_file_info* file_info);
 int remote_create(shared_ptr<remote_inode> parent_i, std::string new_child_name, mode_t mode, struct fuse_file_info* file_info);
 int remote_unlink(shared_ptr<remote_inode> parent_i, std::string child_name);
@@ -0,0 +1,218 @@
+#include "write_delegation.hpp"
+
+#include <algorithm>
+
+#include "../in_memory/directory_table.hpp"
+#include "../journal/journal.hpp"
+#include "../rpc/rpc_client.hpp"
+
+extern std::shared_ptr<rados_io> data_pool;
+extern std::unique_ptr<directory_table> indexing_table;
+extern std::unique_ptr<journal> journalctl;
+
+shared_ptr<write_delegation_table::delegation> write_delegation_table::find(const uuid &ino) {
+	std::scoped_lock lock(this->table_mutex);
+	auto it = this->delegations.find(ino);
+	if (it == this->delegations.end())
+		return nullptr;
+
+	return it->second;
+}
+
+void write_delegation_table::wait_idle(std::unique_lock<std::mutex> &lock, delegation &d) {
+	d.idle_cv.wait(lock, [&d]() { return d.in_flight == 0; });
+}
+
+int write_delegation_table::acquire(const shared_ptr<remote_inode> &i, delegation &d) {
+	global_logger.log(remote_fs_op, "Called write_delegation_table::acquire(" + i->get_file_name() + ")");
+	while (true) {
+		std::shared_ptr<rpc_client> rc = get_rpc_client(i->get_address());
+		int ret = rc->delegate(i, d.size, d.mtime);
+		if (ret == -ENOTLEADER) {
+			indexing_table->find_remote_dentry_table_again(i);
+			continue;
+		}
+
+		if (ret == 0) {
+			d.held = true;
+			d.dirty = false;
+			d.reserved = d.size;
+		}
+		return ret;
+	}
+}
+
+int write_delegation_table::report(const shared_ptr<remote_inode> &i, delegation &d, bool release) {
+	global_logger.log(remote_fs_op, "Called write_delegation_table::report(" + i->get_file_name() + ")");
+	while (true) {
+		std::shared_ptr<rpc_client> rc = get_rpc_client(i->get_address());
+		int ret = rc->return_delegation(i, d.size, d.mtime, release);
+		if (ret == -ENOTLEADER) {
+			indexing_table->find_remote_dentry_table_again(i);
+			continue;
+		} else if (ret == -ENEEDRECOV) {
+			ret = -EIO;
+		}
+
+		if (ret == 0)
+			d.dirty = false;
+		if (release)
+			d.held = false;
+		return ret;
+	}
+}
+
+void write_delegation_table::open(const uuid &ino) {
+	std::scoped_lock lock(this->table_mutex);
+	auto ret = this->delegations.insert({ino, nullptr});
+	if (ret.second)
+		ret.first.value() = std::make_shared<delegation>();
+	ret.first->second->open_num++;
+}
+
+int write_delegation_table::release(const shared_ptr<remote_inode> &i) {
+	global_logger.log(remote_fs_op, "Called write_delegation_table::release(" + i->get_file_name() + ")");
+	shared_ptr<delegation> d;
+	{
+		std::scoped_lock lock(this->table_mutex);
+		auto it = this->delegations.find(i->get_ino());
+		if (it == this->delegations.end())
+			return 0;
+		if (--it->second->open_num > 0)
+			return 0;
+		d = it->second;
+	}
+
+	int ret = 0;
+	{
+		std::unique_lock dl(d->delegation_mutex);
+		wait_idle(dl, *d);
+		if (d->held)
+			ret = this->report(i, *d, true);
+	}
+
+	/* the entry is reused if the file was opened again meanwhile */
+	std::scoped_lock lock(this->table_mutex);
+	auto it = this->delegations.find(i->get_ino());
+	if ((it != this->delegations.end()) && (it->second == d) && (d->open_num == 0))
+		this->delegations.erase(it);
+
+	return ret;
+}
+
+bool write_delegation_table::write(const shared_ptr<remote_inode> &i, const char *buffer, size_t size, off_t offset, int flags, ssize_t &written_len) {
+	shared_ptr<delegation> d = this->find(i->get_ino());
+	if (d == nullptr)
+		return false;
+
+	{
+		std::scoped_lock dl(d->delegation_mutex);
+		if (d->revoked)
+			return false;
+		if (!d->held && (this->acquire(i, *d) != 0)) {
+			d->revoked = true;
+			return false;
+		}
+
+		/* the offset of an append is ordered by the delegation as the leader would order it, past the writes in flight */
+		if (flags & O_APPEND)
+			offset = std::max<off_t>(d->size, d->reserved);
+		d->reserved = std::max<off_t>(d->reserved, offset + static_cast<off_t>(size));
+		d->in_flight++;
+	}
+
+	size_t written = 0;
+	try {
+		written = data_pool->write(obj_category::DATA, uuid_to_string(i->get_ino()), buffer, size, offset);
+	} catch (...) {
+		std::scoped_lock dl(d->delegation_mutex);
+		if (--d->in_flight == 0) {
+			d->reserved = d->size;
+			d->idle_cv.notify_all();
+		}
+		throw;
+	}
+
+	{
+		std::scoped_lock dl(d->delegation_mutex);
+		if (written > 0) {
+			d->size = std::max<off_t>(d->size, offset + static_cast<off_t>(written));
+			timespec_get(&d->mtime, TIME_UTC);
+			d->dirty = true;
+		}
+		/* what a failed write reserved is given back once nothing else is in flight */
+		if (--d->in_flight == 0) {
+			d->reserved = d->size;
+			d->idle_cv.notify_all();
+		}
+	}
+
+	written_len = static_cast<ssize_t>(written);
+	return true;
+}
+
+void write_delegation_table::fill_stat(const uuid &ino, struct stat *s) {
+	shared_ptr<delegation> d = this->find(ino);
+	if (d == nullptr)
+		return;
+
+	std::scoped_lock dl(d->delegation_mutex);
+	if (!d->held)
+		return;
+
+	s->st_size = d->size;
+	s->st_mtim.tv_sec = d->mtime.tv_sec;
+	s->st_mtim.tv_nsec = d->mtime.tv_nsec;
+}
+
+int write_delegation_table::flush(const shared_ptr<remote_inode> &i, bool release) {
+	global_logger.log(remote_fs_op, "Called write_delegation_table::flush(" + i->get_file_name() + ")");
+	shared_ptr<delegation> d = this->find(i->get_ino());
+	if (d == nullptr)
+		return 0;
+
+	std::unique_lock dl(d->delegation_mutex);
+	wait_idle(dl, *d);
+	if (!d->held || (!release && !d->dirty))
+		return 0;
+
+	return this->report(i, *d, release);
+}
+
+int write_delegation_table::recall(const uuid &ino, off_t &size, struct timespec &mtime) {
+	global_logger.log(remote_fs_op, "Called write_delegation_table::recall(" + uuid_to_string(ino) + ")");
+	shared_ptr<delegation> d = this->find(ino);
+	if (d == nullptr)
+		return -ENOENT;
+
+	std::unique_lock dl(d->delegation_mutex);
+	wait_idle(dl, *d);
+	if (!d->held)
+		return -ENOENT;
+
+	size = d->size;
+	mtime = d->mtime;
+	d->held = false;
+	d->revoked = true;
+	d->dirty = false;
+	return 0;
+}
+
+void recall_write_delegation(const shared_ptr<dentry_table> &dtable, const shared_ptr<inode> &i, const std::string &requester) {
+	std::string holder = dtable->get_write_delegate(i->get_ino());
+	if (holder.empty() || (holder == requester))
+		return;
+	global_logger.log(remote_fs_op, "Called recall_write_delegation(" + uuid_to_string(i->get_ino()) + ", " + holder + ")");
+
+	off_t size;
+	struct timespec mtime{};
+	std::shared_ptr<rpc_client> rc = get_rpc_client(holder);
+	if (rc->recall_delegation(i->get_ino(), size, mtime) == 0) {
+		std::scoped_lock scl{i->inode_mutex};
+		i->set_size(size);
+		i->set_mtime(mtime);
+		journalctl->chreg(i->get_p_ino(), i);
+	}
+
+	dtable->drop_write_delegation(i->get_ino(), holder);
+}
@@ -0,0 +1,79 @@
+#ifndef _WRITE_DELEGATION_HPP_
+#define _WRITE_DELEGATION_HPP_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/functional/hash.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <tsl/robin_map.h>
+
+#include "../in_memory/dentry_table.hpp"
+#include "../meta/remote_inode.hpp"
+
+using std::shared_ptr;
+using namespace boost::uuids;
+
+/*
+ * Write delegations of the files this client has open for writing in REMOTE directories.
+ *
+ * The first write of a file asks its leader for the delegation. While it is held, the size and mtime
+ * are kept here, writes (O_APPEND too) go straight to the data pool and the leader hears of them only on
+ * fsync, on the last release of the file, or when it recalls the delegation for another client.
+ * A recalled delegation isn't asked for again before every handle of the file is released, the writes go to the leader.
+ */
+class write_delegation_table {
+private:
+	struct delegation {
+		std::mutex delegation_mutex;
+		/* writable handles open on the file */
+		uint64_t open_num = 0;
+		bool held = false;
+		bool revoked = false;
+		/* written since the last report to the leader */
+		bool dirty = false;
+		/* published once the data is written, as local_write() does */
+		off_t size = 0;
+		struct timespec mtime{};
+		/* writes between their offset and their data, 'reserved' is the end the next append starts from */
+		uint64_t in_flight = 0;
+		off_t reserved = 0;
+		std::condition_variable idle_cv;
+	};
+
+	std::mutex table_mutex;
+	tsl::robin_map<uuid, shared_ptr<delegation>, boost::hash<uuid>> delegations;
+
+	shared_ptr<delegation> find(const uuid &ino);
+	/* the size and mtime are reported or recalled only after the writes in flight */
+	static void wait_idle(std::unique_lock<std::mutex> &lock, delegation &d);
+	/* the caller holds the lock of 'd' */
+	int acquire(const shared_ptr<remote_inode> &i, delegation &d);
+	int report(const shared_ptr<remote_inode> &i, delegation &d, bool release);
+
+public:
+	/* a handle is opened for writing */
+	void open(const uuid &ino);
+	/* a writable handle is released, the last one gives the delegation back */
+	int release(const shared_ptr<remote_inode> &i);
+
+	/* false if the write has to go through the leader, 'written_len' is set otherwise */
+	bool write(const shared_ptr<remote_inode> &i, const char *buffer, size_t size, off_t offset, int flags, ssize_t &written_len);
+	/* overrides the size and mtime in 's' while the delegation of 'ino' is held */
+	void fill_stat(const uuid &ino, struct stat *s);
+	/* reports the size and mtime to the leader, the delegation is given back if 'release' */
+	int flush(const shared_ptr<remote_inode> &i, bool release);
+
+	/* the leader takes the delegation back, -ENOENT if it isn't held */
+	int recall(const uuid &ino, off_t &size, struct timespec &mtime);
+};
+
+/*
+ * Run by the leader before it uses the size or mtime of 'i' for 'requester'.
+ * The size and mtime kept by another holder are applied, the delegation is dropped even if the holder is gone.
+ */
+void recall_write_delegation(const shared_ptr<dentry_table> &dtable, const shared_ptr<inode> &i, const std::string &requester);
+
+#endif /* _WRITE_DELEGATION_HPP_ */
@@ -0,0 +1,173 @@
+#include "child_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+child_index::name_arena::name_arena(size_t first_chunk_size) : chunk_size(first_chunk_size), chunk_used(0) {
+}
+
+const char *child_index::name_arena::store(std::string_view name) {
+	if (this->chunks.empty() || (this->chunk_used + name.size() > this->chunk_size)) {
+		if (!this->chunks.empty())
+			this->chunk_size *= 2;
+		this->chunk_size = std::max(this->chunk_size, name.size());
+		this->chunks.push_back(std::make_unique<char[]>(this->chunk_size));
+		this->chunk_used = 0;
+	}
+
+	char *stored = this->chunks.back().get() + this->chunk_used;
+	memcpy(stored, name.data(), name.size());
+	this->chunk_used += name.size();
+
+	return stored;
+}
+
+child_index::slot_array::slot_array(size_t slot_num, size_t arena_size)
+	: slot_num(slot_num), slots(std::make_unique<slot[]>(slot_num)), names(arena_size), used(0) {
+}
+
+child_index::child_index() : table(new slot_array(CHILD_INDEX_INIT_SLOT_NUM, CHILD_INDEX_INIT_ARENA_SIZE)), child_num(0), version(0) {
+}
+
+child_index::~child_index() {
+	delete this->table.load();
+}
+
+uint64_t child_index::hash_name(std::string_view name) {
+	return std::hash<std::string_view>()(name);
+}
+
+const child_index::slot *child_index::probe(const slot_array *t, std::string_view name, uint64_t h) {
+	size_t mask = t->slot_num - 1;
+
+	for (size_t n = 0, idx = h & mask; n < t->slot_num; n++, idx = (idx + 1) & mask) {
+		const slot &s = t->slots[idx];
+		uint8_t state = s.state.load(std::memory_order_acquire);
+		if (state == EMPTY)
+			return nullptr;
+		if ((state == FULL) && (s.hash == static_cast<uint32_t>(h)) && (s.name_len == name.size())
+		    && (memcmp(s.name, name.data(), name.size()) == 0))
+			return &s;
+	}
+
+	return nullptr;
+}
+
+void child_index::place(slot_array *t, std::string_view name, uint64_t h, uuid ino, shared_ptr<inode> i) {
+	size_t mask = t->slot_num - 1;
+	size_t idx = h & mask;
+
+	/* DEAD slots are not reused, a reader may still be copying their payload */
+	while (t->slots[idx].state.load(std::memory_order_relaxed) != EMPTY)
+		idx = (idx + 1) & mask;
+
+	slot &s = t->slots[idx];
+	s.name = t->names.store(name);
+	s.name_len = static_cast<uint32_t>(name.size());
+	s.hash = static_cast<uint32_t>(h);
+	s.ino = ino;
+	s.i = std::move(i);
+	s.state.store(FULL, std::memory_order_release);
+	t->used++;
+}
+
+bool child_index::find(std::string_view name, uuid &ino, shared_ptr<inode> &i) const {
+	rcu_read_guard guard;
+	const slot_array *t = this->table.load(std::memory_order_acquire);
+
+	const slot *s = probe(t, name, hash_name(name));
+	if (s == nullptr)
+		return false;
+
+	ino = s->ino;
+	i = s->i;
+	return true;
+}
+
+void child_index::collect(std::vector<child_entry> &entries) const {
+	rcu_read_guard guard;
+	const slot_array *t = this->table.load(std::memory_order_acquire);
+
+	entries.reserve(entries.size() + this->size());
+	for (size_t idx = 0; idx < t->slot_num; idx++) {
+		const slot &s = t->slots[idx];
+		if (s.state.load(std::memory_order_acquire) == FULL)
+			entries.push_back({std::string(s.name, s.name_len), s.ino, s.i});
+	}
+}
+
+uint64_t child_index::size() const {
+	return this->child_num.load(std::memory_order_acquire);
+}
+
+uint64_t child_index::get_version() const {
+	return this->version.load(std::memory_order_acquire);
+}
+
+bool child_index::insert(std::string_view name, uuid ino, shared_ptr<inode> i) {
+	uint64_t h = hash_name(name);
+	slot_array *t = this->table.load(std::memory_order_relaxed);
+
+	if (probe(t, name, h) != nullptr)
+		return false;
+
+	/* keep the load factor under 3/4 so that probing for EMPTY stays short */
+	if ((t->used + 1) * 4 > t->slot_num * 3) {
+		this->rebuild();
+		t = this->table.load(std::memory_order_relaxed);
+	}
+
+	place(t, name, h, ino, std::move(i));
+	this->child_num.fetch_add(1, std::memory_order_release);
+	this->version.fetch_add(1, std::memory_order_release);
+
+	return true;
+}
+
+bool child_index::erase(std::string_view name) {
+	slot_array *t = this->table.load(std::memory_order_relaxed);
+
+	auto *s = const_cast<slot *>(probe(t, name, hash_name(name)));
+	if (s == nullptr)
+		return false;
+
+	s->state.store(DEAD, std::memory_order_release);
+	this->child_num.fetch_sub(1, std::memory_order_release);
+	this->version.fetch_add(1, std::memory_order_release);
+
+	/* dead slots still hold their inodes, drop them once they outnumber the live ones */
+	uint64_t live = this->child_num.load(std::memory_order_relaxed);
+	if ((t->used - live > live) && (t->used - live >= CHILD_INDEX_INIT_SLOT_NUM / 2))
+		this->rebuild();
+
+	return true;
+}
+
+void child_index::rebuild() {
+	slot_array *old_t = this->table.load(std::memory_order_relaxed);
+	uint64_t live = this->child_num.load(std::memory_order_relaxed);
+
+	size_t slot_num = CHILD_INDEX_INIT_SLOT_NUM;
+	while (slot_num < (live + 1) * 2)
+		slot_num *= 2;
+
+	size_t name_bytes = 0;
+	for (size_t idx = 0; idx < old_t->slot_num; idx++) {
+		if (old_t->slots[idx].state.load(std::memory_order_relaxed) == FULL)
+			name_bytes += old_t->slots[idx].name_len;
+	}
+
+	/* the entries are copied, the old slots stay intact for the readers still probing them */
+	auto *new_t = new slot_array(slot_num, std::max<size_t>(name_bytes * 2, CHILD_INDEX_INIT_ARENA_SIZE));
+	for (size_t idx = 0; idx < old_t->slot_num; idx++) {
+		const slot &s = old_t->slots[idx];
+		if (s.state.load(std::memory_order_relaxed) != FULL)
+			continue;
+
+		std::string_view name(s.name, s.name_len);
+		place(new_t, name, hash_name(name), s.ino, s.i);
+	}
+
+	this->table.store(new_t, std::memory_order_release);
+	rcu_retire([old_t]() { delete old_t; });
+}
@@ -0,0 +1,102 @@
+#ifndef NMFS0_CHILD_INDEX_HPP
+#define NMFS0_CHILD_INDEX_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "rcu.hpp"
+#include "../meta/inode.hpp"
+
+#define CHILD_INDEX_INIT_SLOT_NUM (16)
+#define CHILD_INDEX_INIT_ARENA_SIZE (256)
+
+using std::shared_ptr;
+using namespace boost::uuids;
+
+struct child_entry {
+	std::string name;
+	uuid ino;
+	shared_ptr<inode> i;
+};
+
+/*
+ * Name to (ino, inode) index of a directory, the only in-memory copy of its names.
+ *
+ * The names are appended to an arena owned by the slot array and the slots are
+ * probed linearly. A slot goes from EMPTY to FULL to DEAD and its payload is never
+ * modified while the slot array is reachable, so readers never take a lock,
+ * they probe under an rcu_read_guard.
+ * Writers must be serialized by the caller (dentry_table_mutex). A new entry is
+ * published by a single store of its state. Erased entries stay DEAD until the
+ * array is rebuilt into a new one, which also drops the dead names from the arena.
+ * The old array is handed to rcu_retire().
+ */
+class child_index {
+private:
+	enum slot_state : uint8_t {
+		EMPTY = 0,
+		FULL,
+		DEAD
+	};
+
+	struct slot {
+		std::atomic<uint8_t> state;
+		uint32_t name_len;
+		uint32_t hash;
+		const char *name;
+		uuid ino;
+		shared_ptr<inode> i;
+	};
+
+	/* chunks never move, so the names handed out stay valid until the arena is destroyed */
+	class name_arena {
+	private:
+		std::vector<std::unique_ptr<char[]>> chunks;
+		size_t chunk_size;
+		size_t chunk_used;
+
+	public:
+		explicit name_arena(size_t first_chunk_size);
+		const char *store(std::string_view name);
+	};
+
+	struct slot_array {
+		size_t slot_num;
+		std::unique_ptr<slot[]> slots;
+		name_arena names;
+		/* FULL and DEAD slots, touched only by the writer */
+		size_t used;
+
+		slot_array(size_t slot_num, size_t arena_size);
+	};
+
+	std::atomic<slot_array *> table;
+	std::atomic<uint64_t> child_num;
+	std::atomic<uint64_t> version;
+
+	static uint64_t hash_name(std::string_view name);
+	static const slot *probe(const slot_array *t, std::string_view name, uint64_t h);
+	static void place(slot_array *t, std::string_view name, uint64_t h, uuid ino, shared_ptr<inode> i);
+	void rebuild();
+
+public:
+	child_index();
+	~child_index();
+
+	bool find(std::string_view name, uuid &ino, shared_ptr<inode> &i) const;
+	void collect(std::vector<child_entry> &entries) const;
+	uint64_t size() const;
+	/* bumped by every insert and erase */
+	uint64_t get_version() const;
+
+	bool insert(std::string_view name, uuid ino, shared_ptr<inode> i);
+	bool erase(std::string_view name);
+};
+
+#endif //NMFS0_CHILD_INDEX_HPP
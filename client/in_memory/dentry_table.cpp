@@ -1,5 +1,17 @@
 #include "dentry_table.hpp"
 
+#include <algorithm>
+#include <random>
+
+#include "remote_attr_cache.hpp"
+#include "../fs_ops/async_create.hpp"
+#include "../rpc/invalidation.hpp"
+
+extern std::shared_ptr<rados_io> meta_pool;
+extern std::unique_ptr<async_create_queue> async_creates;
+extern std::unique_ptr<remote_attr_cache> attr_cache;
+extern std::unique_ptr<invalidation_listener> invalidation_subscriptions;
+
 dentry_table::not_leader::not_leader(const string &msg) : runtime_error(msg) {
 
 }
@@ -8,9 +20,17 @@ const char *dentry_table::not_leader::what(void) {
 	return nullptr;
 }
 
-dentry_table::dentry_table(uuid dir_ino, enum meta_location loc) : dir_ino(dir_ino), loc(loc){
-	if(loc == LOCAL) {
-		this->this_dir_inode = std::make_shared<inode>(dir_ino);
+static uint64_t first_dir_handle() {
+	static thread_local std::mt19937_64 gen(std::random_device{}());
+	return (gen() >> 1) | 1;
+}
+
+dentry_table::dentry_table(uuid dir_ino, enum meta_location loc) : dir_ino(dir_ino), loc(loc), snapshot_version(0), next_dir_handle(first_dir_handle()),
+								     frag_depth(0), frag_parent(nil_uuid()), remote_op_count(0), fragment_requested(false), local_op_count(0), hot_windows(0), referenced(true),
+								     last_local_use(std::chrono::steady_clock::now().time_since_epoch().count()), reserved_num(0) {
+	/* the inodes of a SHARED table are read locally like those of a LOCAL one */
+	if((loc == LOCAL) || (loc == SHARED)) {
+		this->this_dir_inode = make_inode(dir_ino);
 		this->this_dir_inode->set_loc(LOCAL);
 	}
 	/*
@@ -19,10 +39,21 @@ dentry_table::dentry_table(uuid dir_ino, enum meta_location loc) : dir_ino(dir_i
 	 */
 }
 
-dentry_table::dentry_table(std::shared_ptr<inode> new_dir_inode, std::shared_ptr<dentry> new_dir_dentry, enum meta_location loc) : loc(loc){
+dentry_table::dentry_table(uuid frag_ino, uuid parent_ino, enum meta_location loc) : dir_ino(frag_ino), loc(loc), snapshot_version(0), next_dir_handle(first_dir_handle()),
+										   frag_depth(0), frag_parent(parent_ino), remote_op_count(0), fragment_requested(false), local_op_count(0), hot_windows(0), referenced(true),
+										   last_local_use(std::chrono::steady_clock::now().time_since_epoch().count()), reserved_num(0) {
+	/* the directory inode is owned by the leader of the directory, this copy only serves the permission checks */
+	if((loc == LOCAL) || (loc == SHARED)) {
+		this->this_dir_inode = make_inode(parent_ino);
+		this->this_dir_inode->set_loc(LOCAL);
+	}
+}
+
+dentry_table::dentry_table(std::shared_ptr<inode> new_dir_inode, enum meta_location loc) : loc(loc), snapshot_version(0), next_dir_handle(first_dir_handle()),
+																    frag_depth(0), frag_parent(nil_uuid()), remote_op_count(0), fragment_requested(false), local_op_count(0), hot_windows(0), referenced(true),
+																    last_local_use(std::chrono::steady_clock::now().time_since_epoch().count()), reserved_num(0) {
 	if(loc == LOCAL) {
 		this->this_dir_inode = new_dir_inode;
-		this->dentries = new_dir_dentry;
 		this->dir_ino = new_dir_inode->get_ino();
 		this->this_dir_inode->set_loc(LOCAL);
 	}
@@ -30,20 +61,20 @@ dentry_table::dentry_table(std::shared_ptr<inode> new_dir_inode, std::shared_ptr
 
 dentry_table::~dentry_table() {
 	global_logger.log(dentry_table_ops, "Called ~dentry_table(" + uuid_to_string(this->dir_ino)+")");
-
-	this->child_inodes.clear();
 }
 
 int dentry_table::create_child_inode(std::string filename, shared_ptr<inode> inode){
 	global_logger.log(dentry_table_ops, "Called create_child_ino(" + filename + ")");
+	this->check_fragmented();
 
-	auto ret = this->child_inodes.insert(std::make_pair(filename, nullptr));
-	if (ret.second) {
-		ret.first->second = inode;
+	if (this->is_reserved(filename)) {
+		global_logger.log(dentry_table_ops, "A name reserved by a rename is tried to inserted");
+		return -1;
+	}
 
-		this->dentries->add_child(filename, inode->get_ino());
-		//this->dentries->sync();
-	} else {
+	/* the journal of a child inode is keyed by the table holding its name */
+	inode->set_p_ino(this->dir_ino);
+	if (!this->child_inodes.insert(filename, inode->get_ino(), inode)) {
 		global_logger.log(dentry_table_ops, "Already added file is tried to inserted");
 		return -1;
 	}
@@ -54,10 +85,7 @@ int dentry_table::create_child_inode(std::string filename, shared_ptr<inode> ino
 int dentry_table::add_child_inode(std::string filename, shared_ptr<inode> inode){
 	global_logger.log(dentry_table_ops, "Called add_child_ino(" + filename + ")");
 
-	auto ret = this->child_inodes.insert(std::make_pair(filename, nullptr));
-	if(ret.second) {
-		ret.first->second = inode;
-	} else {
+	if(!this->child_inodes.insert(filename, inode->get_ino(), inode)) {
 		global_logger.log(dentry_table_ops, "Already added file is tried to inserted");
 		return -1;
 	}
@@ -66,17 +94,13 @@ int dentry_table::add_child_inode(std::string filename, shared_ptr<inode> inode)
 
 int dentry_table::delete_child_inode(std::string filename) {
 	global_logger.log(dentry_table_ops, "Called delete_child_inode(" + filename + ")");
+	this->check_fragmented();
 
-	auto it = this->child_inodes.find(filename);
-	if (it == this->child_inodes.end()) {
+	/* TODO : get a lock of delete child inode */
+	if (!this->child_inodes.erase(filename)) {
 		global_logger.log(dentry_table_ops, "Non-existing file is tried to deleted");
 		return -1;
 	}
-	/* TODO : get a lock of delete child inode */
-	this->child_inodes.erase(it);
-
-	this->dentries->delete_child(filename);
-	//this->dentries->sync();
 
 	return 0;
 }
@@ -84,13 +108,15 @@ int dentry_table::delete_child_inode(std::string filename) {
 shared_ptr<inode> dentry_table::get_child_inode(std::string filename, uuid target_ino){
 	global_logger.log(dentry_table_ops, "Called get_child_inode(" + filename + ", " + uuid_to_string(target_ino) + ")");
 
-	if(this->get_loc() == LOCAL) {
-		auto it = this->child_inodes.find(filename);
-		if(it == this->child_inodes.end()) {
+	if((this->get_loc() == LOCAL) || (this->get_loc() == SHARED)) {
+		this->check_fragmented();
+		uuid child_ino;
+		shared_ptr<inode> child_i;
+		if(!this->child_inodes.find(filename, child_ino, child_i)) {
 			throw inode::no_entry("No such file or directory : get_child_inode");
 		}
-		it->second->set_loc(LOCAL);
-		return it->second;
+		child_i->set_loc(LOCAL);
+		return child_i;
 	} else if (this->get_loc() == REMOTE) {
 		shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(this->leader_ip, this->dir_ino, filename);
 		remote_i->inode::set_ino(target_ino);
@@ -104,16 +130,45 @@ shared_ptr<inode> dentry_table::get_child_inode(std::string filename, uuid targe
 uuid dentry_table::check_child_inode(std::string filename){
 	global_logger.log(dentry_table_ops, "Called check_child_inode(" + filename + ")");
 
-	if(this->loc == LOCAL) {
+	if((this->loc == LOCAL) || (this->loc == SHARED)) {
 		if(filename == "/")
 			return get_root_ino();
-
-		return this->dentries->get_child_ino(filename);
+		this->check_fragmented();
+
+		uuid child_ino;
+		shared_ptr<inode> child_i;
+		if(this->child_inodes.find(filename, child_ino, child_i))
+			return child_ino;
+
+		/* a name detached by a rename in flight is still taken */
+		if(this->reserved_num > 0) {
+			std::scoped_lock scl{this->reserve_mutex};
+			auto it = this->reserved_names.find(filename);
+			if(it != this->reserved_names.end())
+				return it->second;
+		}
+		return nil_uuid();
 	} else if (this->loc == REMOTE) {
+		/* a name this client is still creating there is known without asking the leader */
+		uuid ino;
+		if ((async_creates != nullptr) && async_creates->find(this->dir_ino, filename, ino))
+			return ino;
+
 		std::string remote_address(this->leader_ip);
 		std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
-		uuid ino = rc->check_child_inode(this->dir_ino, filename);
+		/* the modes come along for the permission checks of the path walk */
+		bool watch = (attr_cache != nullptr) && (invalidation_subscriptions != nullptr) && invalidation_subscriptions->subscribe(remote_address);
+		uint64_t epoch = (attr_cache != nullptr) ? attr_cache->get_epoch() : 0;
+		perm_attr child_attr, dir_attr;
+		ino = rc->check_child_inode(this->dir_ino, filename, watch, child_attr, dir_attr);
+
+		if (attr_cache != nullptr) {
+			if (child_attr.valid)
+				attr_cache->insert_perm(this->dir_ino, filename, remote_address, &child_attr.s, child_attr.generation, child_attr.watched, epoch);
+			if (dir_attr.valid)
+				attr_cache->insert_perm(this->dir_ino, "", remote_address, &dir_attr.s, dir_attr.generation, dir_attr.watched, epoch);
+		}
 		return ino;
 	}
 
@@ -123,18 +178,38 @@ uuid dentry_table::check_child_inode(std::string filename){
 int dentry_table::pull_child_metadata() {
 	global_logger.log(dentry_table_ops, "Called pull_child_metadata()");
 
-	this->dentries = std::make_shared<dentry>(this->dir_ino);
+	/* the names go from the object buffers to child_inodes, the dentry object isn't materialized */
+	std::vector<std::string> names;
+	std::vector<std::string> keys;
+	this->frag_depth = dentry::scan(this->dir_ino, [this, &names, &keys](const dentry_view::entry &e) {
+		/* inodes embedded in the dentry object need no further read */
+		if(e.inode != nullptr) {
+			shared_ptr<inode> child_i = make_inode(e.inode, static_cast<size_t>(e.inode_len));
+			child_i->set_p_ino(this->dir_ino);
+			child_i->set_loc(LOCAL);
+			this->add_child_inode(std::string(e.name), child_i);
+			return;
+		}
+
+		names.emplace_back(e.name);
+		keys.push_back(uuid_to_string(e.ino));
+	});
 
-	for(auto it = this->dentries->child_list.begin(); it != this->dentries->child_list.end(); it++) {
-		shared_ptr<inode> child_i = std::make_shared<inode>(it->second);
+	/* the other child inodes are fetched with a bounded window of asynchronous reads instead of one blocking read each */
+	meta_pool->read_window(obj_category::INODE, keys, inode::get_max_obj_size(), PULL_WINDOW_DEPTH,
+			       [this, &names](size_t index, const char *raw, int len) {
+		if(len < 0)
+			throw inode::no_entry("No such file or Directory: in pull_child_metadata()");
+
+		shared_ptr<inode> child_i = make_inode(raw, static_cast<size_t>(len));
 		child_i->set_p_ino(this->dir_ino);
 		if(S_ISDIR(child_i->get_mode())){
 			child_i->set_loc(UNKNOWN);
 		} else {
 			child_i->set_loc(LOCAL);
 		}
-		this->add_child_inode(it->first, child_i);
-	}
+		this->add_child_inode(names[index], child_i);
+	});
 
 	return 0;
 }
@@ -148,20 +223,265 @@ void dentry_table::set_leader_ip(std::string new_leader_ip) {
 	this->leader_ip = new_leader_ip;
 }
 
-void dentry_table::fill_filler(void *buffer, fuse_fill_dir_t filler) {
-	this->dentries->fill_filler(buffer, filler);
+uint32_t dentry_table::get_frag_depth() {
+	return this->frag_depth;
+}
+
+void dentry_table::set_frag_depth(uint32_t depth) {
+	this->frag_depth = depth;
+}
+
+uuid dentry_table::get_frag_parent() {
+	return this->frag_parent;
+}
+
+void dentry_table::drop_children() {
+	global_logger.log(dentry_table_ops, "Called drop_children()");
+	shared_ptr<const dentry_snapshot> snap = this->get_snapshot();
+	for (const child_entry &e : *snap)
+		this->child_inodes.erase(e.name);
+}
+
+void dentry_table::check_fragmented() {
+	if (this->frag_depth > 0)
+		throw not_leader("The names of this directory are served by its fragments");
+}
+
+bool dentry_table::count_remote_op() {
+	if (this->frag_depth > 0 || !this->frag_parent.is_nil())
+		return false;
+
+	std::scoped_lock scl{this->remote_op_mutex};
+	auto now = std::chrono::steady_clock::now();
+	if (now - this->remote_op_window > std::chrono::milliseconds(DIRECTORY_FRAGMENT_WINDOW_MS)) {
+		this->remote_op_window = now;
+		this->remote_op_count = 0;
+	}
+
+	if (++this->remote_op_count < DIRECTORY_FRAGMENT_THRESHOLD)
+		return false;
+
+	return !this->fragment_requested.exchange(true);
+}
+
+bool dentry_table::count_peer_op(const std::string &peer, std::string &migrate_to) {
+	if (peer.empty())
+		return false;
+
+	std::scoped_lock scl{this->remote_op_mutex};
+	auto now = std::chrono::steady_clock::now();
+	auto window = std::chrono::milliseconds(DIRECTORY_FRAGMENT_WINDOW_MS);
+	if (now - this->peer_op_window > window) {
+		/* an idle window breaks the streak */
+		if (now - this->peer_op_window > 2 * window)
+			this->hot_windows = 0;
+		else
+			this->close_peer_op_window();
+		this->peer_op_window = now;
+		this->peer_ops.clear();
+		this->local_op_count.store(0, std::memory_order_relaxed);
+	}
+
+	auto ret = this->peer_ops.insert({peer, 0});
+	ret.first.value()++;
+
+	if (this->hot_windows < DIRECTORY_MIGRATE_WINDOWS)
+		return false;
+
+	this->hot_windows = 0;
+	migrate_to = this->hot_peer;
+	return true;
+}
+
+void dentry_table::close_peer_op_window() {
+	uint64_t total = this->local_op_count.load(std::memory_order_relaxed);
+	uint64_t top_ops = 0;
+	std::string top_peer;
+	for (auto &p : this->peer_ops) {
+		total += p.second;
+		if (p.second > top_ops) {
+			top_ops = p.second;
+			top_peer = p.first;
+		}
+	}
+
+	if ((top_ops < DIRECTORY_MIGRATE_MIN_OPS) || (top_ops * 100 < total * DIRECTORY_MIGRATE_SHARE_PERCENT)) {
+		this->hot_windows = 0;
+		return;
+	}
+
+	if (top_peer != this->hot_peer) {
+		this->hot_peer = top_peer;
+		this->hot_windows = 0;
+	}
+	this->hot_windows++;
+}
+
+void dentry_table::touch() {
+	this->referenced.store(true, std::memory_order_relaxed);
+}
+
+bool dentry_table::clear_referenced() {
+	return this->referenced.exchange(false, std::memory_order_relaxed);
+}
+
+void dentry_table::note_local_use() {
+	this->last_local_use.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	this->local_op_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool dentry_table::used_within(std::chrono::milliseconds period) {
+	std::chrono::steady_clock::time_point last{std::chrono::steady_clock::duration{this->last_local_use.load(std::memory_order_relaxed)}};
+	return std::chrono::steady_clock::now() - last < period;
 }
 
 uint64_t dentry_table::get_child_num() {
-	return this->dentries->get_child_num();
+	return this->child_inodes.size();
+}
+
+bool dentry_table::grant_write_delegation(const uuid &ino, const std::string &holder) {
+	std::scoped_lock scl{this->delegation_mutex};
+	auto ret = this->write_delegates.insert({ino, holder});
+	return ret.first->second == holder;
+}
+
+std::string dentry_table::get_write_delegate(const uuid &ino) {
+	std::scoped_lock scl{this->delegation_mutex};
+	auto it = this->write_delegates.find(ino);
+	if (it == this->write_delegates.end())
+		return "";
+
+	return it->second;
+}
+
+void dentry_table::drop_write_delegation(const uuid &ino, const std::string &holder) {
+	std::scoped_lock scl{this->delegation_mutex};
+	auto it = this->write_delegates.find(ino);
+	if ((it != this->write_delegates.end()) && (it->second == holder))
+		this->write_delegates.erase(it);
+}
+
+bool dentry_table::has_write_delegations() {
+	std::scoped_lock scl{this->delegation_mutex};
+	return !this->write_delegates.empty();
+}
+
+void dentry_table::reserve_name(const std::string &filename, const uuid &ino) {
+	std::scoped_lock scl{this->reserve_mutex};
+	if (this->reserved_names.insert({filename, ino}).second)
+		this->reserved_num++;
+}
+
+void dentry_table::release_name(const std::string &filename) {
+	std::scoped_lock scl{this->reserve_mutex};
+	if (this->reserved_names.erase(filename) > 0)
+		this->reserved_num--;
+}
+
+bool dentry_table::is_reserved(const std::string &filename) {
+	if (this->reserved_num == 0)
+		return false;
+
+	std::scoped_lock scl{this->reserve_mutex};
+	return this->reserved_names.find(filename) != this->reserved_names.end();
 }
 
-std::map<std::string, shared_ptr<inode>>::iterator dentry_table::get_child_inode_begin() {
-	return this->child_inodes.begin();
+bool dentry_table::has_reserved_names() {
+	return this->reserved_num > 0;
+}
+
+void dentry_table::request_fragment_again() {
+	this->fragment_requested = false;
+}
+
+shared_ptr<const dentry_snapshot> dentry_table::get_snapshot() {
+	global_logger.log(dentry_table_ops, "Called get_snapshot()");
+	uint64_t version = this->child_inodes.get_version();
+	{
+		std::scoped_lock scl{this->snapshot_mutex};
+		if (this->snapshot != nullptr && this->snapshot_version == version)
+			return this->snapshot;
+	}
+
+	std::shared_ptr<dentry_snapshot> new_snapshot = std::make_shared<dentry_snapshot>();
+	this->child_inodes.collect(*new_snapshot);
+	std::sort(new_snapshot->begin(), new_snapshot->end(), [](const child_entry &a, const child_entry &b) { return a.name < b.name; });
+
+	{
+		std::scoped_lock scl{this->snapshot_mutex};
+		this->snapshot = new_snapshot;
+		this->snapshot_version = version;
+	}
+
+	return new_snapshot;
+}
+
+uint64_t snapshot_position_after(const dentry_snapshot &snap, const std::string &name) {
+	auto it = std::upper_bound(snap.begin(), snap.end(), name, [](const std::string &n, const child_entry &e) { return n < e.name; });
+	return static_cast<uint64_t>(it - snap.begin());
+}
+
+uint64_t dentry_table::open_snapshot() {
+	global_logger.log(dentry_table_ops, "Called open_snapshot()");
+	shared_ptr<const dentry_snapshot> snap = this->get_snapshot();
+	auto now = std::chrono::steady_clock::now();
+
+	std::scoped_lock scl{this->snapshot_mutex};
+	/* the handles of clients that never released them */
+	for (auto it = this->open_snapshots.begin(); it != this->open_snapshots.end();) {
+		if (now - it->second.second > std::chrono::milliseconds(DENTRY_TABLE_OPEN_SNAPSHOT_IDLE_MS))
+			it = this->open_snapshots.erase(it);
+		else
+			++it;
+	}
+	/* a handle dropped here resumes by name on its next readdir, one being read is kept beyond the count */
+	while (this->open_snapshots.size() >= DENTRY_TABLE_MAX_OPEN_SNAPSHOTS) {
+		auto oldest = std::min_element(this->open_snapshots.begin(), this->open_snapshots.end(),
+					       [](const auto &a, const auto &b) { return a.second.second < b.second.second; });
+		if (now - oldest->second.second < std::chrono::milliseconds(DENTRY_TABLE_OPEN_SNAPSHOT_BUSY_MS))
+			break;
+		this->open_snapshots.erase(oldest);
+	}
+
+	uint64_t dir_handle = this->next_dir_handle++;
+	if (dir_handle == 0)
+		dir_handle = this->next_dir_handle++;
+	this->open_snapshots.insert(std::make_pair(dir_handle, std::make_pair(snap, now)));
+
+	return dir_handle;
+}
+
+void dentry_table::get_open_snapshot(uint64_t &dir_handle, uint64_t &offset, const std::string &resume_name, shared_ptr<const dentry_snapshot> &snap) {
+	global_logger.log(dentry_table_ops, "Called get_open_snapshot(" + std::to_string(dir_handle) + ")");
+	if (dir_handle == 0) {
+		snap = this->get_snapshot();
+		return;
+	}
+
+	{
+		std::scoped_lock scl{this->snapshot_mutex};
+		auto it = this->open_snapshots.find(dir_handle);
+		if (it != this->open_snapshots.end()) {
+			it->second.second = std::chrono::steady_clock::now();
+			snap = it->second.first;
+			return;
+		}
+	}
+
+	/* expired, or opened at the previous leader, the names are sorted so the listing goes on after the last one read */
+	dir_handle = this->open_snapshot();
+	{
+		std::scoped_lock scl{this->snapshot_mutex};
+		snap = this->open_snapshots.find(dir_handle)->second.first;
+	}
+	if (!resume_name.empty())
+		offset = snapshot_position_after(*snap, resume_name);
 }
 
-std::map<std::string, shared_ptr<inode>>::iterator dentry_table::get_child_inode_end() {
-	return this->child_inodes.end();
+void dentry_table::release_open_snapshot(uint64_t dir_handle) {
+	global_logger.log(dentry_table_ops, "Called release_open_snapshot(" + std::to_string(dir_handle) + ")");
+	std::scoped_lock scl{this->snapshot_mutex};
+	this->open_snapshots.erase(dir_handle);
 }
 
 uuid dentry_table::get_dir_ino(){
@@ -171,7 +491,7 @@ uuid dentry_table::get_dir_ino(){
 shared_ptr<inode> dentry_table::get_this_dir_inode() {
 	global_logger.log(dentry_table_ops, "Called get_this_dir_inode(" + uuid_to_string(this->dir_ino) + ")");
 
-	if(this->loc == LOCAL) {
+	if((this->loc == LOCAL) || (this->loc == SHARED)) {
 		return this->this_dir_inode;
 	} else if (this->loc == REMOTE){
 		shared_ptr<remote_inode> remote_i = std::make_shared<remote_inode>(this->leader_ip, this->dir_ino, "", true);
@@ -1,29 +1,120 @@
 #ifndef NMFS0_DENTRY_TABLE_HPP
 #define NMFS0_DENTRY_TABLE_HPP
 
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <utility>
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include <tsl/robin_map.h>
+
+#include "child_index.hpp"
 #include "../meta/inode.hpp"
 #include "../meta/dentry.hpp"
 #include "../rpc/rpc_client.hpp"
 
+/* number of child inode reads kept in flight by pull_child_metadata() */
+#define PULL_WINDOW_DEPTH (128)
+
+/* a directory whose leader serves more remote name operations than this in a window is fragmented */
+#define DIRECTORY_FRAGMENT_THRESHOLD (4096)
+#define DIRECTORY_FRAGMENT_WINDOW_MS (1000)
+#define DIRECTORY_FRAGMENT_DEPTH (6)
+
+/*
+ * The leader hands a directory over to a peer issuing at least DIRECTORY_MIGRATE_SHARE_PERCENT of its operations,
+ * and at least DIRECTORY_MIGRATE_MIN_OPS of them, for DIRECTORY_MIGRATE_WINDOWS back to back windows
+ */
+#define DIRECTORY_MIGRATE_SHARE_PERCENT (90)
+#define DIRECTORY_MIGRATE_MIN_OPS (64)
+#define DIRECTORY_MIGRATE_WINDOWS (5)
+
+/*
+ * a snapshot pinned by a remote directory handle is dropped after this long without a readdir.
+ * Beyond the count, the handles idle for DENTRY_TABLE_OPEN_SNAPSHOT_BUSY_MS are dropped first, busy ones are kept.
+ */
+#define DENTRY_TABLE_OPEN_SNAPSHOT_IDLE_MS (60000)
+#define DENTRY_TABLE_MAX_OPEN_SNAPSHOTS (1024)
+#define DENTRY_TABLE_OPEN_SNAPSHOT_BUSY_MS (1000)
+
 using std::shared_ptr;
 
+/* sorted by name, so that a listing can be resumed after a name in a later snapshot */
+using dentry_snapshot = std::vector<child_entry>;
+
+/* the position of the first name after 'name' in 'snap' */
+uint64_t snapshot_position_after(const dentry_snapshot &snap, const std::string &name);
+
 class dentry_table {
 private:
 	uuid dir_ino;
 	shared_ptr<inode> this_dir_inode;
 
-	shared_ptr<dentry> dentries;
-	std::map<std::string, shared_ptr<inode>> child_inodes;
+	child_index child_inodes;
+
+	/* the last snapshot taken for readdir, reused while the index version doesn't change */
+	std::mutex snapshot_mutex;
+	uint64_t snapshot_version;
+	shared_ptr<const dentry_snapshot> snapshot;
+
+	/*
+	 * snapshots pinned by the directory handles of remote clients and the time they were last read, handle 0 is never used.
+	 * Handles start from a random number so that one opened at a previous leader is unknown here.
+	 */
+	uint64_t next_dir_handle;
+	std::map<uint64_t, std::pair<shared_ptr<const dentry_snapshot>, std::chrono::steady_clock::time_point>> open_snapshots;
 
 	enum meta_location loc;
 	std::string leader_ip;
 
+	/*
+	 * A fragmented directory keeps only its own inode in this table and frag_depth > 0.
+	 * The table of a fragment is keyed by the fragment ino and frag_parent is the directory.
+	 * Routing reads frag_depth without the table lock.
+	 */
+	std::atomic<uint32_t> frag_depth;
+	uuid frag_parent;
+
+	/* remote name operations counted by the leader to decide fragmentation */
+	std::mutex remote_op_mutex;
+	std::chrono::steady_clock::time_point remote_op_window;
+	uint64_t remote_op_count;
+	std::atomic<bool> fragment_requested;
+
+	/* operations of each peer and of this client in the current window, guarded by remote_op_mutex */
+	std::chrono::steady_clock::time_point peer_op_window;
+	tsl::robin_map<std::string, uint64_t> peer_ops;
+	std::atomic<uint64_t> local_op_count;
+	/* the peer which dominated the last 'hot_windows' windows */
+	std::string hot_peer;
+	uint32_t hot_windows;
+
+	void close_peer_op_window();
+
+	/* reference bit of the CLOCK eviction in directory_table */
+	std::atomic<bool> referenced;
+	/* steady_clock ticks of the last lookup by this client, a recall leaves a directory in use alone */
+	std::atomic<int64_t> last_local_use;
+
+	/* <file ino, remote address of the client holding the write delegation of the file> */
+	std::mutex delegation_mutex;
+	tsl::robin_map<uuid, std::string, boost::hash<uuid>> write_delegates;
+
+	/* <name detached by a rename to another table, its ino>, kept until the destination linked it or failed */
+	std::mutex reserve_mutex;
+	tsl::robin_map<std::string, uuid> reserved_names;
+	std::atomic<uint32_t> reserved_num;
+
 public:
-	std::recursive_mutex dentry_table_mutex;
+	/*
+	 * Serializes the writers of this directory.
+	 * Lookups, get_child_num() and get_snapshot() don't need it.
+	 * Taken before the lock of any inode, see inode_lock.
+	 */
+	dentry_table_lock dentry_table_mutex;
 
 	class not_leader : public runtime_error {
     	public:
@@ -32,7 +123,10 @@ public:
 	};
 
 	explicit dentry_table(uuid dir_ino, enum meta_location loc);
-    	explicit dentry_table(std::shared_ptr<inode> new_dir_inode, std::shared_ptr<dentry> new_dir_dentry, enum meta_location loc);
+	/* a fragment of 'parent_ino', the inode of the directory is read from its object */
+	explicit dentry_table(uuid frag_ino, uuid parent_ino, enum meta_location loc);
+	/* a directory just made by this client, it has no child yet */
+	explicit dentry_table(std::shared_ptr<inode> new_dir_inode, enum meta_location loc);
 	~dentry_table();
 
 	int create_child_inode(std::string filename, shared_ptr<inode> inode);
@@ -52,13 +146,58 @@ public:
 
 	void set_leader_ip(std::string new_leader_ip);
 
-	/* wrapper of dentry class member functions */
-	void fill_filler(void *buffer, fuse_fill_dir_t filler);
+	uint32_t get_frag_depth();
+	void set_frag_depth(uint32_t depth);
+	uuid get_frag_parent();
+	/* forgets every child once the names moved to the fragments, the caller holds dentry_table_mutex */
+	void drop_children();
+	/* throws not_leader if the names of this directory are served by its fragments */
+	void check_fragmented();
+	/* true once per table when the remote name operations exceed DIRECTORY_FRAGMENT_THRESHOLD */
+	bool count_remote_op();
+	/* true if 'peer' has dominated the directory long enough, 'migrate_to' is then set to it */
+	bool count_peer_op(const std::string &peer, std::string &migrate_to);
+
+	void touch();
+	/* returns the reference bit and clears it */
+	bool clear_referenced();
+	void note_local_use();
+	bool used_within(std::chrono::milliseconds period);
+
 	uint64_t get_child_num();
 
-	/* only used in rpc_readdir */
-	std::map<std::string, shared_ptr<inode>>::iterator get_child_inode_begin();
-	std::map<std::string, shared_ptr<inode>>::iterator get_child_inode_end();
+	/* false if another client holds the write delegation of 'ino' */
+	bool grant_write_delegation(const uuid &ino, const std::string &holder);
+	/* empty if no client holds the write delegation of 'ino' */
+	std::string get_write_delegate(const uuid &ino);
+	void drop_write_delegation(const uuid &ino, const std::string &holder);
+	/* a table whose sizes are kept by delegates stays with this leader */
+	bool has_write_delegations();
+
+	/*
+	 * See rename_across(), the caller holds dentry_table_mutex.
+	 * A reserved name exists for check_child_inode() and can't be created or renamed onto, get_child_inode() doesn't find it.
+	 */
+	void reserve_name(const std::string &filename, const uuid &ino);
+	void release_name(const std::string &filename);
+	bool is_reserved(const std::string &filename);
+	/* the unlink of a reserved name isn't journaled yet, the dentry object still holds it */
+	bool has_reserved_names();
+	/* count_remote_op() asks for the fragmentation once more */
+	void request_fragment_again();
+
+	/* immutable copy of the children, iterated by readdir without holding any lock */
+	shared_ptr<const dentry_snapshot> get_snapshot();
+
+	/* used by the leader to keep readdir offsets of a remote handle stable */
+	uint64_t open_snapshot();
+	/*
+	 * Handle 0 reads the current snapshot.
+	 * A handle expired or opened at another leader is replaced by a new one, 'dir_handle' and 'offset' are then
+	 * moved to it: after 'resume_name' if one is given, otherwise the offset is kept.
+	 */
+	void get_open_snapshot(uint64_t &dir_handle, uint64_t &offset, const std::string &resume_name, shared_ptr<const dentry_snapshot> &snap);
+	void release_open_snapshot(uint64_t dir_handle);
 };
 
 #endif //NMFS0_DENTRY_TABLE_HPP
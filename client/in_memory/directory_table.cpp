@@ -1,7 +1,17 @@
 #include "directory_table.hpp"
 
-extern std::unique_ptr<lease_client> lc;
+#include <random>
+#include <thread>
+#include <tuple>
+
+#include "../fs_ops/cross_rename.hpp"
+#include "../rpc/invalidation.hpp"
+
+extern std::shared_ptr<rados_io> meta_pool;
+extern std::shared_ptr<lease_client> lc;
 extern std::unique_ptr<journal> journalctl;
+extern std::unique_ptr<file_handler_list> open_context;
+extern std::unique_ptr<invalidation_hub> invalidations;
 
 static int set_name_bound(int &start_name, int &end_name, const std::string &path, int path_len){
 	start_name = end_name + 2;
@@ -21,66 +31,147 @@ static int set_name_bound(int &start_name, int &end_name, const std::string &pat
 	return 0;
 }
 
-directory_table::directory_table() {
-	shared_ptr<dentry_table> root_dentry_table = this->get_dentry_table(get_root_ino());
+directory_table::directory_table(uint64_t max_cached_inodes) : max_cached_inodes(max_cached_inodes), cached_inodes(0), clock_hand(0),
+								 evict_requested(false), evictor_stopping(false) {
+	shared_ptr<dentry_table> root_dentry_table = this->get_dentry_table(get_root_ino(), false, false);
+	this->evictor = std::thread(&directory_table::evict_loop, this);
 }
 
 directory_table::~directory_table() {
 	global_logger.log(directory_table_ops, "Called ~directory_table()");
+	this->stop_evictor();
 
-	for(auto it = this->dentry_tables.begin(); it != this->dentry_tables.end(); it++) {
-		it.value() = nullptr;
+	for(shard &s : this->shards) {
+		std::scoped_lock scl{s.shard_mutex};
+		for(auto it = s.dentry_tables.begin(); it != s.dentry_tables.end(); it++) {
+			it.value() = nullptr;
+		}
 	}
 }
 
-shared_ptr<inode> directory_table::path_traversal(const std::string &path) {
-	global_logger.log(directory_table_ops, "Called path_traverse(" + path + ")");
+directory_table::shard &directory_table::get_shard(const uuid &ino) {
+	return this->shards[boost::hash<uuid>()(ino) % DIRECTORY_TABLE_SHARD_NUM];
+}
 
-	shared_ptr<dentry_table> parent_dentry_table = this->get_dentry_table(get_root_ino());
-	shared_ptr<inode> target_inode = parent_dentry_table->get_this_dir_inode();;
-	uuid check_target_ino;
+shared_ptr<inode> directory_table::path_traversal(const std::string &path, bool write) {
+	global_logger.log(directory_table_ops, "Called path_traverse(" + path + ")");
 
 	int start_name, end_name = -1;
 	int path_len = static_cast<int>(path.length());
 
+	/* only the table providing the last inode needs write intent, the directories above are just read */
+	uuid dir_ino = get_root_ino();
+	shared_ptr<dentry_table> parent_dentry_table = this->get_dentry_table(dir_ino, false, write && (path_len <= 1));
+	shared_ptr<inode> target_inode = parent_dentry_table->get_this_dir_inode();;
+	uuid check_target_ino;
+	/* a REMOTE directory whose search permission is checked with the mode its next lookup brings along */
+	shared_ptr<inode> pending_search = nullptr;
+
 	while(true){
 		// get new target name
 		if(set_name_bound(start_name, end_name, path, path_len) == -1)
 			break;
 
 		std::string target_name = path.substr(start_name, end_name - start_name + 1);
+		bool last = (end_name + 2 >= path_len);
 		global_logger.log(directory_table_ops, "Check target: " + target_name);
-		{
-			std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-			check_target_ino = parent_dentry_table->check_child_inode(target_name);
 
-			if (check_target_ino.is_nil())
-				throw inode::no_entry("No such file or Directory: in path traversal");
-			else
-				/* if target is dir, this child is just for checking mode.
-				 * if target is reg, this child is actual inode */
-				target_inode = parent_dentry_table->get_child_inode(target_name, check_target_ino);
+		bool write_target = false;
+		while(true) {
+			parent_dentry_table = this->get_dentry_table_of(dir_ino, target_name, write_target);
+			try {
+				check_target_ino = parent_dentry_table->check_child_inode(target_name);
+			} catch (dentry_table::not_leader &e) {
+				/* the directory was fragmented after its table was cached */
+				this->forget_remote_dentry_table(dir_ino);
+				this->forget_remote_dentry_table(parent_dentry_table->get_dir_ino());
+				continue;
+			}
+
+			/* a regular file to be modified is taken from the table its leader journals to */
+			if (write && last && !check_target_ino.is_nil() && (parent_dentry_table->get_loc() == SHARED) && !write_target) {
+				shared_ptr<inode> checked = parent_dentry_table->get_child_inode(target_name, check_target_ino);
+				if (!S_ISDIR(checked->get_mode())) {
+					write_target = true;
+					continue;
+				}
+			}
+			break;
+		}
 
-			if(target_inode == nullptr)
-				throw std::runtime_error("Failed to make remote_inode in path_traversal()");
+		if (pending_search != nullptr) {
+			pending_search->permission_check(X_OK);
+			pending_search = nullptr;
+		}
 
-			if (S_ISDIR(target_inode->get_mode())) {
-				parent_dentry_table = this->get_dentry_table(check_target_ino);
-				target_inode = parent_dentry_table->get_this_dir_inode();
+		if (check_target_ino.is_nil())
+			throw inode::no_entry("No such file or Directory: in path traversal");
+		else
+			/* if target is dir, this child is just for checking mode.
+			 * if target is reg, this child is actual inode */
+			target_inode = parent_dentry_table->get_child_inode(target_name, check_target_ino);
+
+		if(target_inode == nullptr)
+			throw std::runtime_error("Failed to make remote_inode in path_traversal()");
+
+		if (S_ISDIR(target_inode->get_mode())) {
+			/* the parent is passed so that the directory inherits the pin of its subtree */
+			parent_dentry_table = this->get_dentry_table(check_target_ino, false, write && last, dir_ino);
+			dir_ino = check_target_ino;
+			target_inode = parent_dentry_table->get_this_dir_inode();
+			if (!last && (target_inode->get_loc() == REMOTE))
+				pending_search = target_inode;
+			else
 				target_inode->permission_check(X_OK);
-			}
 		}
 	}
 
 	return target_inode;
 }
 
-shared_ptr<dentry_table> directory_table::lease_dentry_table(uuid ino){
+shared_ptr<inode> directory_table::reopen_inode(const shared_ptr<inode> &i, const std::string &name) {
+	global_logger.log(directory_table_ops, "Called reopen_inode(" + name + ")");
+	uuid ino = i->get_ino();
+	if (S_ISDIR(i->get_mode()))
+		return this->get_dentry_table(ino)->get_this_dir_inode();
+
+	uuid frag_parent = this->get_fragment_parent(i->get_p_ino());
+	uuid dir_ino = frag_parent.is_nil() ? i->get_p_ino() : frag_parent;
+	shared_ptr<dentry_table> dtable;
+	uuid found_ino;
+	while (true) {
+		dtable = this->get_dentry_table_of(dir_ino, name);
+		try {
+			found_ino = dtable->check_child_inode(name);
+			break;
+		} catch (dentry_table::not_leader &e) {
+			/* the directory was fragmented after its table was cached */
+			this->forget_remote_dentry_table(dir_ino);
+			this->forget_remote_dentry_table(dtable->get_dir_ino());
+		}
+	}
+
+	if (found_ino == ino)
+		return dtable->get_child_inode(name, ino);
+
+	/* renamed within the table, a REMOTE one can only be asked by name */
+	if (dtable->get_loc() == LOCAL) {
+		shared_ptr<const dentry_snapshot> snap = dtable->get_snapshot();
+		for (const child_entry &e : *snap)
+			if (e.ino == ino)
+				return dtable->get_child_inode(e.name, ino);
+	}
+
+	throw inode::no_entry("The open inode has no name in its table : reopen_inode");
+}
+
+shared_ptr<dentry_table> directory_table::lease_dentry_table(uuid ino, bool write, uuid parent_dir_ino){
 	global_logger.log(directory_table_ops, "Called lease_dentry_table(" + uuid_to_string(ino) + ")");
-	std::scoped_lock scl{this->directory_table_mutex};
 
 	std::string temp_address;
-	int ret = lc->acquire(ino, temp_address);
+	uint32_t frag_depth = 0;
+	int ret = lc->acquire(ino, temp_address, frag_depth, !write, parent_dir_ino);
+	uuid parent_ino = this->get_fragment_parent(ino);
 	shared_ptr<dentry_table> new_dentry_table = nullptr;
 	if(ret == 0) {
 		global_logger.log(directory_table_ops, "Success to acquire lease");
@@ -88,28 +179,59 @@ shared_ptr<dentry_table> directory_table::lease_dentry_table(uuid ino){
 		//journalctl->check(ino);
 
 		/* Success to acquire lease */
-		new_dentry_table = std::make_shared<dentry_table>(ino, LOCAL);
+		if(parent_ino.is_nil())
+			new_dentry_table = std::make_shared<dentry_table>(ino, LOCAL);
+		else
+			new_dentry_table = std::make_shared<dentry_table>(ino, parent_ino, LOCAL);
 		new_dentry_table->set_leader_ip(temp_address);
 		new_dentry_table->pull_child_metadata();
+
+		/* the previous leader may have fragmented the directory without telling the manager */
+		if(new_dentry_table->get_frag_depth() > frag_depth) {
+			uint32_t depth = new_dentry_table->get_frag_depth();
+			lc->fragment(ino, depth);
+		} else if(new_dentry_table->get_frag_depth() < frag_depth) {
+			/* or registered it after writing the fragments but before marking the dentry object */
+			dentry whole(ino);
+			whole.fragment(frag_depth);
+			whole.sync();
+			new_dentry_table->drop_children();
+			new_dentry_table->set_frag_depth(frag_depth);
+		}
+		/* before anyone reaches the names, a rename the previous leader left in doubt is resolved */
+		recover_renames(new_dentry_table);
+		this->add_dentry_table(ino, new_dentry_table);
+	} else if(ret == 1) {
+		global_logger.log(directory_table_ops, "Success to acquire shared lease");
+		/* nobody leads the directory, so its objects are up to date and may be cached read-only */
+		if(parent_ino.is_nil())
+			new_dentry_table = std::make_shared<dentry_table>(ino, SHARED);
+		else
+			new_dentry_table = std::make_shared<dentry_table>(ino, parent_ino, SHARED);
+		new_dentry_table->pull_child_metadata();
 		this->add_dentry_table(ino, new_dentry_table);
 	} else if(ret == -1) {
 		global_logger.log(directory_table_ops, "Fail to acquire lease, this dir already has the leader");
 		global_logger.log(directory_table_ops, "Leader Address: " + temp_address);
 		/* Fail to acquire lease, this dir already has the leader */
-		new_dentry_table = std::make_shared<dentry_table>(ino, REMOTE);
+		if(parent_ino.is_nil())
+			new_dentry_table = std::make_shared<dentry_table>(ino, REMOTE);
+		else
+			new_dentry_table = std::make_shared<dentry_table>(ino, parent_ino, REMOTE);
 		new_dentry_table->set_leader_ip(temp_address);
+		new_dentry_table->set_frag_depth(frag_depth);
 		this->add_dentry_table(ino, new_dentry_table);
 	}
 
 	return new_dentry_table;
 }
 
-shared_ptr<dentry_table> directory_table::lease_dentry_table_mkdir(std::shared_ptr<inode> new_dir_inode, std::shared_ptr<dentry> new_dir_dentry) {
+shared_ptr<dentry_table> directory_table::lease_dentry_table_mkdir(std::shared_ptr<inode> new_dir_inode) {
 	global_logger.log(directory_table_ops, "Called lease_dentry_table_mkdir(" + uuid_to_string(new_dir_inode->get_ino()) + ")");
-	std::scoped_lock scl{this->directory_table_mutex};
 
+	/* the ino comes from a prefix pre-leased to this client, the manager is asked only to renew the range */
 	std::string temp_address;
-	int ret = lc->acquire(new_dir_inode->get_ino(), temp_address);
+	int ret = lc->prelease(new_dir_inode->get_ino()) ? 0 : lc->acquire(new_dir_inode->get_ino(), temp_address);
 	shared_ptr<dentry_table> new_dentry_table = nullptr;
 	if(ret == 0) {
 		global_logger.log(directory_table_ops, "Success to acquire lease");
@@ -117,7 +239,7 @@ shared_ptr<dentry_table> directory_table::lease_dentry_table_mkdir(std::shared_p
 		//journalctl->check(ino);
 
 		/* Success to acquire lease */
-		new_dentry_table = std::make_shared<dentry_table>(new_dir_inode, new_dir_dentry, LOCAL);
+		new_dentry_table = std::make_shared<dentry_table>(new_dir_inode, LOCAL);
 		new_dentry_table->set_leader_ip(temp_address);
 		this->add_dentry_table(new_dir_inode->get_ino(), new_dentry_table);
 	} else if(ret == -1) {
@@ -127,83 +249,631 @@ shared_ptr<dentry_table> directory_table::lease_dentry_table_mkdir(std::shared_p
 	return new_dentry_table;
 }
 
-shared_ptr<dentry_table> directory_table::get_dentry_table(uuid ino, bool remote) {
+shared_ptr<dentry_table> directory_table::get_dentry_table(uuid ino, bool remote, bool write, uuid parent_ino) {
 	global_logger.log(directory_table_ops, "get_dentry_table(" + uuid_to_string(ino) + ")");
-	std::scoped_lock scl{this->directory_table_mutex};
+	shard &s = this->get_shard(ino);
+	std::promise<shared_ptr<dentry_table>> lease_promise;
+	std::shared_future<shared_ptr<dentry_table>> lease_future;
+	bool owner = false;
+	bool remote_miss = false;
+
+	{
+		std::scoped_lock scl{s.shard_mutex};
 
-	auto it = this->dentry_tables.find(ino);
-	if (remote) {
-		if (it != this->dentry_tables.end()) { /* LOCAL, REMOTE */
+		auto it = s.dentry_tables.find(ino);
+		if (it != s.dentry_tables.end()) { /* LOCAL, REMOTE, SHARED */
 			global_logger.log(directory_table_ops, "dentry_table : HIT");
 			bool valid = lc->is_valid(ino);
-			if (valid) {
+			bool shared = (it->second->get_loc() == SHARED);
+			if (valid && shared && remote)
+				throw dentry_table::not_leader("This client only reads this dentry table");
+			if (valid && !(shared && write)) {
+				it->second->touch();
+				if (!remote)
+					it->second->note_local_use();
 				return it->second;
-			} else {
-				this->dentry_tables.erase(it);
-				throw dentry_table::not_leader("Lease is expired at remote side");
 			}
+
+			/* an expired table, or a SHARED one upgraded to the exclusive lease */
+			s.dentry_tables.erase(it);
 		} else { /* UNKNOWN */
 			global_logger.log(directory_table_ops, "dentry_table : MISS");
-			throw dentry_table::not_leader("This client doesn't have lease of this dentry table");
 		}
-	} else {
-		if (it != this->dentry_tables.end()) { /* LOCAL, REMOTE */
-			global_logger.log(directory_table_ops, "dentry_table : HIT");
-			bool valid = lc->is_valid(ino);
-			if (valid) {
-				return it->second;
+
+		if (remote) {
+			remote_miss = true;
+		} else {
+			auto fit = s.in_flight.find(ino);
+			if (fit != s.in_flight.end()) {
+				global_logger.log(directory_table_ops, "dentry_table : lease is in flight");
+				lease_future = fit->second;
 			} else {
-				this->dentry_tables.erase(it);
-				shared_ptr<dentry_table> new_dentry_table = lease_dentry_table(ino);
-				return new_dentry_table;
+				lease_future = lease_promise.get_future().share();
+				s.in_flight.insert({ino, lease_future});
+				owner = true;
 			}
-		} else { /* UNKNOWN */
-			global_logger.log(directory_table_ops, "dentry_table : MISS");
-			shared_ptr<dentry_table> new_dentry_table = lease_dentry_table(ino);
-			return new_dentry_table;
 		}
 	}
+
+	/* the lease manager sends the other clients to the client a directory is pinned to, before it holds the lease */
+	if (remote_miss) {
+		if (!this->is_pinned_here(ino))
+			throw dentry_table::not_leader("This client doesn't have lease of this dentry table");
+		return this->get_dentry_table(ino);
+	}
+
+	if (!owner) {
+		shared_ptr<dentry_table> leased = lease_future.get();
+		/* the table was evicted or only a shared lease was taken, lease it again */
+		if ((leased == nullptr) || (write && (leased->get_loc() == SHARED)))
+			return this->get_dentry_table(ino, remote, write, parent_ino);
+		return leased;
+	}
+
+	/* No lock is held across the lease RPC and pulling child metadata */
+	shared_ptr<dentry_table> new_dentry_table;
+	try {
+		new_dentry_table = this->lease_dentry_table(ino, write, parent_ino);
+	} catch (...) {
+		{
+			std::scoped_lock scl{s.shard_mutex};
+			s.in_flight.erase(ino);
+		}
+		lease_promise.set_exception(std::current_exception());
+		throw;
+	}
+
+	{
+		std::scoped_lock scl{s.shard_mutex};
+		s.in_flight.erase(ino);
+	}
+	lease_promise.set_value(new_dentry_table);
+
+	return new_dentry_table;
 }
 
 int directory_table::add_dentry_table(uuid ino, shared_ptr<dentry_table> dtable){
 	global_logger.log(directory_table_ops, "Called add_dentry_table(" + uuid_to_string(ino) + ")");
-	std::scoped_lock scl{this->directory_table_mutex};
+	shard &s = this->get_shard(ino);
 
-	auto ret = dentry_tables.insert(std::make_pair(ino, nullptr));
-	if(ret.second) {
-		ret.first.value() = dtable;
-	} else {
-		global_logger.log(directory_table_ops, "Already added dentry table is tried to inserted");
-		return -1;
+	{
+		std::scoped_lock scl{s.shard_mutex};
+
+		auto ret = s.dentry_tables.insert(std::make_pair(ino, nullptr));
+		if(ret.second) {
+			ret.first.value() = dtable;
+		} else {
+			global_logger.log(directory_table_ops, "Already added dentry table is tried to inserted");
+			return -1;
+		}
 	}
+
+	uint64_t cached = this->cached_inodes.fetch_add(dtable->get_child_num() + 1) + dtable->get_child_num() + 1;
+	if(cached > this->max_cached_inodes) {
+		std::scoped_lock scl{this->evictor_mutex};
+		this->evict_requested = true;
+		this->evictor_cv.notify_one();
+	}
+
 	return 0;
 }
 
 int directory_table::delete_dentry_table(uuid ino){
 	global_logger.log(directory_table_ops, "Called delete_dentry_table(" + uuid_to_string(ino) + ")");
-	std::scoped_lock scl{this->directory_table_mutex};
+	shard &s = this->get_shard(ino);
+	std::scoped_lock scl{s.shard_mutex};
 
-	auto it = this->dentry_tables.find(ino);
-	if(it == this->dentry_tables.end()) {
+	auto it = s.dentry_tables.find(ino);
+	if(it == s.dentry_tables.end()) {
 		global_logger.log(directory_table_ops, "Non-existed dentry table is tried to delete");
 		return -1;
 	}
 
-	this->dentry_tables.erase(it);
+	s.dentry_tables.erase(it);
+
+	return 0;
+}
+
+void directory_table::evict_loop() {
+	std::unique_lock lock{this->evictor_mutex};
+	while(true) {
+		this->evictor_cv.wait(lock, [this]() { return this->evictor_stopping || this->evict_requested; });
+		if(this->evictor_stopping)
+			return;
+		this->evict_requested = false;
+
+		lock.unlock();
+		try {
+			this->evict();
+		} catch (std::exception &e) {
+			global_logger.log(directory_table_ops, "Failed to evict: " + std::string(e.what()));
+		}
+		lock.lock();
+	}
+}
+
+void directory_table::stop_evictor() {
+	{
+		std::scoped_lock scl{this->evictor_mutex};
+		if(this->evictor_stopping)
+			return;
+		this->evictor_stopping = true;
+	}
+	this->evictor_cv.notify_all();
+	if(this->evictor.joinable())
+		this->evictor.join();
+}
+
+void directory_table::evict() {
+	std::unique_lock evl{this->evict_mutex, std::try_to_lock};
+	if(!evl.owns_lock())
+		return;
+	global_logger.log(directory_table_ops, "Called evict()");
+
+	uint64_t cached = 0;
+	for(shard &s : this->shards) {
+		std::scoped_lock scl{s.shard_mutex};
+		for(auto &t : s.dentry_tables)
+			cached += t.second->get_child_num() + 1;
+	}
+	uint64_t low_watermark = this->max_cached_inodes - this->max_cached_inodes / DIRECTORY_TABLE_EVICT_FRACTION;
+
+	/* the hand sweeps at most twice, a table referenced in the first sweep loses its bit and may go in the second */
+	for(int swept = 0; (cached > low_watermark) && (swept < 2 * DIRECTORY_TABLE_SHARD_NUM); swept++) {
+		shard &s = this->shards[this->clock_hand];
+		this->clock_hand = (this->clock_hand + 1) % DIRECTORY_TABLE_SHARD_NUM;
+
+		std::vector<std::tuple<uuid, enum meta_location, std::promise<shared_ptr<dentry_table>>>> releasing;
+		{
+			std::scoped_lock scl{s.shard_mutex};
+
+			std::vector<uuid> victims;
+			for(auto &t : s.dentry_tables) {
+				if(cached <= low_watermark)
+					break;
+				if(t.first == get_root_ino())
+					continue;
+				if(t.second->clear_referenced())
+					continue;
+				/* an operation in progress holds the table */
+				if(t.second.use_count() > 1)
+					continue;
+				/* open LOCAL files keep their inode object, which must stay the one of the table, delegated sizes are only known here */
+				if((t.second->get_loc() == LOCAL) && (open_context->holds_child_of(t.first) || t.second->has_write_delegations()))
+					continue;
+
+				victims.push_back(t.first);
+				cached -= std::min(cached, t.second->get_child_num() + 1);
+			}
+
+			/* a LOCAL or SHARED victim holds a lease, the manager would count it until it expires */
+			for(const uuid &ino : victims) {
+				auto it = s.dentry_tables.find(ino);
+				enum meta_location loc = it->second->get_loc();
+				if((loc == LOCAL) || (loc == SHARED)) {
+					std::promise<shared_ptr<dentry_table>> evict_promise;
+					s.in_flight.insert({ino, evict_promise.get_future().share()});
+					releasing.emplace_back(ino, loc, std::move(evict_promise));
+				}
+				s.dentry_tables.erase(it);
+			}
+		}
+
+		/* no lock is held across the checkpoint and the release RPC */
+		for(auto &[ino, loc, evict_promise] : releasing) {
+			this->release_dentry_table(ino, loc);
+			{
+				std::scoped_lock scl{s.shard_mutex};
+				s.in_flight.erase(ino);
+			}
+			evict_promise.set_value(nullptr);
+		}
+	}
+
+	this->cached_inodes.store(cached);
+}
+
+void directory_table::release_dentry_table(const uuid &ino, enum meta_location loc) {
+	global_logger.log(directory_table_ops, "Called release_dentry_table(" + uuid_to_string(ino) + ")");
+
+	/* if the checkpoint fails the lease is kept, whoever leases the directory after it expires replays the journal */
+	try {
+		if(loc == LOCAL) {
+			invalidations->leader_changed(ino);
+			journalctl->flush(ino);
+		}
+		if(lc->release(ino) != 0)
+			global_logger.log(directory_table_ops, "The lease of the dropped directory was already lost");
+	} catch (std::exception &e) {
+		global_logger.log(directory_table_ops, "Failed to release the dropped directory: " + std::string(e.what()));
+	}
+}
+
+int directory_table::recall_dentry_table(const uuid &ino) {
+	global_logger.log(directory_table_ops, "Called recall_dentry_table(" + uuid_to_string(ino) + ")");
+	shard &s = this->get_shard(ino);
+	std::promise<shared_ptr<dentry_table>> recall_promise;
+	enum meta_location loc = lc->is_mine(ino) ? LOCAL : SHARED;
+
+	{
+		std::scoped_lock scl{s.shard_mutex};
+		if(s.in_flight.find(ino) != s.in_flight.end())
+			return -1;
+
+		auto it = s.dentry_tables.find(ino);
+		if(it != s.dentry_tables.end()) {
+			loc = it->second->get_loc();
+			if(loc == REMOTE)
+				return -1;
+
+			/* the lease stays with a client using the directory, the manager asks again later */
+			if(loc == LOCAL) {
+				if((it->second.use_count() > 1) || it->second->used_within(std::chrono::milliseconds(DIRECTORY_TABLE_RECALL_IDLE_MS))
+				   || open_context->holds_child_of(ino) || it->second->has_write_delegations())
+					return -1;
+				s.in_flight.insert({ino, recall_promise.get_future().share()});
+			}
+			s.dentry_tables.erase(it);
+		} else if(loc == LOCAL) {
+			/* the table is gone but the journal may not be, e.g. a release after eviction failed */
+			s.in_flight.insert({ino, recall_promise.get_future().share()});
+		}
+	}
+
+	/* as in evict(), the lookups of the directory wait until the lease is given up */
+	this->release_dentry_table(ino, loc);
+	if(loc == LOCAL) {
+		{
+			std::scoped_lock scl{s.shard_mutex};
+			s.in_flight.erase(ino);
+		}
+		recall_promise.set_value(nullptr);
+	}
+
+	return 0;
+}
+
+int directory_table::migrate_dentry_table(const uuid &ino, const std::string &new_leader) {
+	global_logger.log(directory_table_ops, "Called migrate_dentry_table(" + uuid_to_string(ino) + ", " + new_leader + ")");
+	shard &s = this->get_shard(ino);
+	std::promise<shared_ptr<dentry_table>> migrate_promise;
+
+	/* a pinned directory stays with its pin however hot it is elsewhere */
+	std::string pin_addr;
+	lc->get_pin(ino, pin_addr);
+	if(!pin_addr.empty() && (pin_addr != new_leader))
+		return -1;
+
+	{
+		std::scoped_lock scl{s.shard_mutex};
+		if(s.in_flight.find(ino) != s.in_flight.end())
+			return -1;
+
+		auto it = s.dentry_tables.find(ino);
+		if((it == s.dentry_tables.end()) || (it->second->get_loc() != LOCAL))
+			return -1;
+		if((it->second.use_count() > 1) || open_context->holds_child_of(ino) || it->second->has_write_delegations())
+			return -1;
+
+		s.in_flight.insert({ino, migrate_promise.get_future().share()});
+		s.dentry_tables.erase(it);
+	}
+
+	/* the lease moves only after the journal is checkpointed, the next leader reads the names from the objects */
+	try {
+		invalidations->leader_changed(ino);
+		journalctl->flush(ino);
+		std::chrono::system_clock::time_point due = lc->get_due(ino);
+		if(lc->transfer(ino, new_leader) != 0) {
+			global_logger.log(directory_table_ops, "The lease of the migrated directory was already lost");
+			lc->release(ino);
+		} else {
+			/* the new lease lasts at least as long as the one handed over */
+			this->note_handoff(ino, new_leader, due);
+		}
+	} catch (std::exception &e) {
+		global_logger.log(directory_table_ops, "Failed to migrate the directory: " + std::string(e.what()));
+	}
+
+	{
+		std::scoped_lock scl{s.shard_mutex};
+		s.in_flight.erase(ino);
+	}
+	migrate_promise.set_value(nullptr);
+
+	return 0;
+}
+
+void directory_table::release_all() {
+	global_logger.log(directory_table_ops, "Called release_all()");
+	this->stop_evictor();
+
+	std::vector<std::pair<uuid, enum meta_location>> held;
+	for(shard &s : this->shards) {
+		std::scoped_lock scl{s.shard_mutex};
+		for(auto &t : s.dentry_tables) {
+			if(t.second->get_loc() != REMOTE)
+				held.emplace_back(t.first, t.second->get_loc());
+		}
+		s.dentry_tables.clear();
+	}
+
+	for(auto &h : held)
+		this->release_dentry_table(h.first, h.second);
+	lc->release_ranges();
+}
+
+shared_ptr<dentry_table> directory_table::get_fragment_dentry_table(uuid dir_ino, uint64_t frag_id, bool write) {
+	uuid frag_ino = get_frag_ino(dir_ino, frag_id);
+	{
+		std::scoped_lock scl{this->fragment_mutex};
+		this->fragment_parents.insert({frag_ino, dir_ino});
+	}
+
+	return this->get_dentry_table(frag_ino, false, write);
+}
+
+shared_ptr<dentry_table> directory_table::get_dentry_table_of(uuid dir_ino, const std::string &name, bool write) {
+	shared_ptr<dentry_table> dir_dentry_table = this->get_dentry_table(dir_ino, false, write);
+	uint32_t depth = dir_dentry_table->get_frag_depth();
+	if(depth == 0)
+		return dir_dentry_table;
+
+	return this->get_fragment_dentry_table(dir_ino, get_frag_id_of(name, depth), write);
+}
+
+uuid directory_table::get_fragment_parent(const uuid &ino) {
+	std::scoped_lock scl{this->fragment_mutex};
+	auto it = this->fragment_parents.find(ino);
+	if(it == this->fragment_parents.end())
+		return nil_uuid();
+
+	return it->second;
+}
+
+void directory_table::forget_remote_dentry_table(const uuid &ino) {
+	shard &s = this->get_shard(ino);
+	std::scoped_lock scl{s.shard_mutex};
+
+	auto it = s.dentry_tables.find(ino);
+	if((it != s.dentry_tables.end()) && (it->second->get_loc() != LOCAL))
+		s.dentry_tables.erase(it);
+}
+
+/* fragments fitting in one object are written concurrently, nobody reads them before the manager routes to them */
+static void write_fragments(uuid ino, uint32_t depth, const std::vector<std::shared_ptr<dentry>> &frags) {
+	std::vector<std::string> keys;
+	std::vector<std::vector<char>> values;
+	for(uint64_t bits = 0; bits < frags.size(); bits++) {
+		if(frags[bits]->get_raw_size() > DENTRY_SHARD_SPLIT_SIZE) {
+			frags[bits]->sync();
+			continue;
+		}
+		keys.push_back(uuid_to_string(get_frag_ino(ino, make_frag_id(depth, bits))));
+		values.push_back(frags[bits]->serialize());
+	}
+	meta_pool->write_window(obj_category::DENTRY, keys, values, DENTRY_SHARD_WINDOW_DEPTH);
+}
+
+static void remove_fragments(const std::vector<std::shared_ptr<dentry>> &frags) {
+	for(auto &f : frags)
+		f->remove();
+}
+
+int directory_table::fragment_directory(uuid ino, uint32_t depth) {
+	global_logger.log(directory_table_ops, "Called fragment_directory(" + uuid_to_string(ino) + ", " + std::to_string(depth) + ")");
+
+	shared_ptr<dentry_table> dir_dentry_table;
+	{
+		shard &s = this->get_shard(ino);
+		std::scoped_lock scl{s.shard_mutex};
+		auto it = s.dentry_tables.find(ino);
+		if(it == s.dentry_tables.end())
+			return -1;
+		dir_dentry_table = it->second;
+	}
+	if((dir_dentry_table->get_loc() != LOCAL) || (dir_dentry_table->get_frag_depth() > 0))
+		return -1;
+
+	/* most of the journaled names reach the dentry object before the writers of the table are stalled */
+	journalctl->flush(ino);
+
+	std::unique_lock lock{dir_dentry_table->dentry_table_mutex};
+	if((dir_dentry_table->get_loc() != LOCAL) || (dir_dentry_table->get_frag_depth() > 0))
+		return -1;
+	/* a name detached by a rename in flight would be split into a fragment, the next remote operation asks again */
+	if(dir_dentry_table->has_reserved_names()) {
+		dir_dentry_table->request_fragment_again();
+		return -1;
+	}
+	journalctl->flush(ino);
+
+	/* prepare : the fragments are written before the manager routes anybody to them */
+	dentry whole(ino);
+	std::vector<std::shared_ptr<dentry>> frags = whole.fragment(depth);
+	write_fragments(ino, depth, frags);
+
+	uint32_t registered_depth = depth;
+	if(lc->fragment(ino, registered_depth) != 0) {
+		remove_fragments(frags);
+		if(registered_depth <= depth) {
+			global_logger.log(directory_table_ops, "The manager refused the fragmentation");
+			return -1;
+		}
+
+		/*
+		 * registered deeper already, the names are routed by that depth. Its fragments were written by whoever
+		 * registered it and may be leased and modified by now, only the dentry object is marked as lease_dentry_table() does.
+		 */
+		global_logger.log(directory_table_ops, "The directory is fragmented by depth " + std::to_string(registered_depth));
+		depth = registered_depth;
+		whole = dentry(ino);
+		whole.fragment(depth);
+	}
+
+	/* commit */
+	whole.sync();
+	shared_ptr<const dentry_snapshot> snap = dir_dentry_table->get_snapshot();
+	dir_dentry_table->drop_children();
+	dir_dentry_table->set_frag_depth(depth);
+
+	/* open files of this client journal their updates under the fragment which now holds their name */
+	for(const child_entry &e : *snap) {
+		std::scoped_lock scl{e.i->inode_mutex};
+		e.i->set_p_ino(get_frag_ino(ino, get_frag_id_of(e.name, depth)));
+	}
+	lock.unlock();
+
+	/* the names are served from the fragments now, what the followers cached under the whole table is stale */
+	invalidations->leader_changed(ino);
 
 	return 0;
 }
 
+void directory_table::note_handoff(const uuid &ino, const std::string &new_leader, std::chrono::system_clock::time_point due) {
+	auto now = std::chrono::steady_clock::now();
+	std::scoped_lock scl{this->handoff_mutex};
+	if(this->handoffs.size() >= DIRECTORY_TABLE_MAX_HANDOFF_HINTS) {
+		for(auto it = this->handoffs.begin(); it != this->handoffs.end();) {
+			if(it->second.expires <= now)
+				it = this->handoffs.erase(it);
+			else
+				++it;
+		}
+		if(this->handoffs.size() >= DIRECTORY_TABLE_MAX_HANDOFF_HINTS)
+			this->handoffs.clear();
+	}
+
+	this->handoffs.insert_or_assign(ino, handoff{new_leader, due, now + std::chrono::milliseconds(DIRECTORY_TABLE_HANDOFF_HINT_MS)});
+}
+
+bool directory_table::get_leader_hint(const uuid &ino, std::string &leader, std::chrono::system_clock::time_point &due) {
+	{
+		std::scoped_lock scl{this->handoff_mutex};
+		auto it = this->handoffs.find(ino);
+		if(it != this->handoffs.end()) {
+			if(std::chrono::steady_clock::now() < it->second.expires) {
+				leader = it->second.leader;
+				due = it->second.due;
+				return true;
+			}
+			this->handoffs.erase(it);
+		}
+	}
+
+	/* this client follows the directory too */
+	shard &s = this->get_shard(ino);
+	std::scoped_lock scl{s.shard_mutex};
+	auto it = s.dentry_tables.find(ino);
+	if((it == s.dentry_tables.end()) || (it->second->get_loc() != REMOTE) || !lc->is_valid(ino))
+		return false;
+
+	leader = it->second->get_leader_ip();
+	due = lc->get_due(ino);
+	return true;
+}
+
+bool directory_table::is_pinned_here(const uuid &ino) {
+	auto now = std::chrono::steady_clock::now();
+	{
+		std::scoped_lock scl{this->pin_miss_mutex};
+		auto it = this->pin_misses.find(ino);
+		if(it != this->pin_misses.end()) {
+			if(now < it->second)
+				return false;
+			this->pin_misses.erase(it);
+		}
+	}
+
+	std::string pin_addr;
+	lc->get_pin(ino, pin_addr);
+	if(pin_addr == lc->get_self_remote())
+		return true;
+
+	std::scoped_lock scl{this->pin_miss_mutex};
+	if(this->pin_misses.size() >= DIRECTORY_TABLE_MAX_PIN_MISSES) {
+		for(auto it = this->pin_misses.begin(); it != this->pin_misses.end();) {
+			if(it->second <= now)
+				it = this->pin_misses.erase(it);
+			else
+				++it;
+		}
+		if(this->pin_misses.size() >= DIRECTORY_TABLE_MAX_PIN_MISSES)
+			this->pin_misses.clear();
+	}
+	this->pin_misses.insert_or_assign(ino, now + std::chrono::milliseconds(DIRECTORY_TABLE_PIN_MISS_MS));
+	return false;
+}
+
+void directory_table::forget_pin_misses() {
+	std::scoped_lock scl{this->pin_miss_mutex};
+	this->pin_misses.clear();
+}
+
+void directory_table::redirect_remote_dentry_table(const uuid &ino, const std::string &leader, std::chrono::system_clock::time_point due) {
+	lc->note_remote(ino, due);
+	uuid parent_ino = this->get_fragment_parent(ino);
+
+	/* the table is replaced rather than changed, the operations in progress keep the one they have */
+	shard &s = this->get_shard(ino);
+	std::scoped_lock scl{s.shard_mutex};
+	auto it = s.dentry_tables.find(ino);
+	if((it == s.dentry_tables.end()) || (it->second->get_loc() != REMOTE))
+		return;
+
+	shared_ptr<dentry_table> redirected;
+	if(parent_ino.is_nil())
+		redirected = std::make_shared<dentry_table>(ino, REMOTE);
+	else
+		redirected = std::make_shared<dentry_table>(ino, parent_ino, REMOTE);
+	redirected->set_leader_ip(leader);
+	redirected->set_frag_depth(it->second->get_frag_depth());
+	it.value() = redirected;
+}
+
 void directory_table::find_remote_dentry_table_again(const std::shared_ptr<remote_inode>& remote_i) {
 	global_logger.log(directory_table_ops, "Called find_remote_dentry_table_again()");
 
-	shared_ptr<dentry_table> target_dentry_table = this->get_dentry_table(remote_i->get_dentry_table_ino());
+	/* leadership moving costs one more hop, a leader moving on and on is backed off from */
+	int redirects = remote_i->count_redirect(std::chrono::milliseconds(LEADER_REDIRECT_RESET_MS));
+	if(redirects > 1) {
+		thread_local std::mt19937 jitter{std::random_device{}()};
+		int64_t backoff = LEADER_REDIRECT_BACKOFF_BASE_MS << std::min(redirects - 2, 16);
+		backoff = std::min<int64_t>(backoff, LEADER_REDIRECT_BACKOFF_MAX_MS);
+		std::uniform_int_distribution<int64_t> dist(backoff / 2, backoff);
+		std::this_thread::sleep_for(std::chrono::milliseconds(dist(jitter)));
+	}
+
+	std::string hinted_leader;
+	std::chrono::system_clock::time_point hinted_due;
+	if(remote_i->take_leader_hint(hinted_leader, hinted_due) && (redirects <= LEADER_REDIRECT_MAX_HINTS)
+	   && (hinted_leader != lc->get_self_remote()) && (hinted_leader != remote_i->get_address())) {
+		global_logger.log(directory_table_ops, "Redirected to " + hinted_leader);
+		this->redirect_remote_dentry_table(remote_i->get_dentry_table_ino(), hinted_leader, hinted_due);
+		remote_i->set_leader_ip(hinted_leader);
+		return;
+	}
+
+	/* the leader may have fragmented the directory, so the name is routed again */
+	uuid table_ino = remote_i->get_dentry_table_ino();
+	uuid dir_ino = this->get_fragment_parent(table_ino);
+	if(dir_ino.is_nil())
+		dir_ino = table_ino;
+	this->forget_remote_dentry_table(table_ino);
+	this->forget_remote_dentry_table(dir_ino);
+
+	shared_ptr<dentry_table> target_dentry_table;
+	if(remote_i->get_target_is_parent())
+		target_dentry_table = this->get_dentry_table(dir_ino);
+	else
+		target_dentry_table = this->get_dentry_table_of(dir_ino, remote_i->get_file_name());
+
 	if(target_dentry_table->get_loc() == REMOTE) {
 		global_logger.log(directory_table_ops, "Remote dentry table moves to other leader");
 	} else if (target_dentry_table->get_loc() == LOCAL) {
 		global_logger.log(directory_table_ops, "Remote dentry table becomes Local dentry table");
 	}
 
+	remote_i->set_dentry_table_ino(target_dentry_table->get_dir_ino());
 	remote_i->set_leader_ip(target_dentry_table->get_leader_ip());
 }
-
@@ -1,10 +1,17 @@
 #ifndef NMFS0_DIRECTORY_TABLE_HPP
 #define NMFS0_DIRECTORY_TABLE_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
 #include <map>
 #include <utility>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #include <boost/functional/hash.hpp>
 #include <boost/uuid/uuid.hpp>
@@ -12,6 +19,7 @@
 #include <tsl/robin_map.h>
 
 #include "lib/logger/logger.hpp"
+#include "util/frag.hpp"
 
 #include "dentry_table.hpp"
 #include "../meta/inode.hpp"
@@ -19,27 +27,150 @@
 #include "../client/client.hpp"
 #include "../lease/lease_client.hpp"
 #include "../journal/journal.hpp"
+#include "../meta/file_handler.hpp"
+
+#define DIRECTORY_TABLE_SHARD_NUM (64)
+
+/* default budget of the cached inodes, the eviction stops 1/DIRECTORY_TABLE_EVICT_FRACTION below it */
+#define DIRECTORY_TABLE_DEFAULT_MAX_INODES (1048576)
+#define DIRECTORY_TABLE_EVICT_FRACTION (8)
+
+/* a recalled LOCAL table is kept if this client looked it up more recently than this */
+#define DIRECTORY_TABLE_RECALL_IDLE_MS (1000)
+
+/* a client names the one it handed a directory over to in its -ENOTLEADER replies for this long */
+#define DIRECTORY_TABLE_HANDOFF_HINT_MS (10000)
+#define DIRECTORY_TABLE_MAX_HANDOFF_HINTS (4096)
+
+/* a remote lookup of a directory found not pinned here is refused without asking the lease manager for this long */
+#define DIRECTORY_TABLE_PIN_MISS_MS (1000)
+#define DIRECTORY_TABLE_MAX_PIN_MISSES (4096)
+
+/* the leader named by an -ENOTLEADER reply is followed this many times in a row before the manager is asked */
+#define LEADER_REDIRECT_MAX_HINTS (3)
+/* the redirects after the first back off exponentially up to the max, each by a random half to whole of it */
+#define LEADER_REDIRECT_BACKOFF_BASE_MS (2)
+#define LEADER_REDIRECT_BACKOFF_MAX_MS (256)
+/* a redirect this long after the previous one of the same inode counts as the first */
+#define LEADER_REDIRECT_RESET_MS (1000)
 
 using std::shared_ptr;
 using namespace boost::uuids;
 
 class directory_table {
 private:
-	tsl::robin_map<uuid, shared_ptr<dentry_table>, boost::hash<uuid>> dentry_tables;
+	/*
+	 * The table is split into shards by the hash of ino so that lookups of
+	 * unrelated directories do not contend on a single lock.
+	 * 'in_flight' holds the lease acquisitions in progress: only the first caller
+	 * of get_dentry_table() for an ino acquires the lease and pulls the metadata,
+	 * the others wait on its future without holding the shard lock.
+	 * A LOCAL table being evicted also stays in 'in_flight' until its lease is released,
+	 * its future yields nullptr and the waiters lease the directory again.
+	 * Lookups without write intent take a shared lease and cache a SHARED table,
+	 * the first lookup with write intent drops it and asks for the exclusive lease.
+	 */
+	struct shard {
+		std::mutex shard_mutex;
+		tsl::robin_map<uuid, shared_ptr<dentry_table>, boost::hash<uuid>> dentry_tables;
+		tsl::robin_map<uuid, std::shared_future<shared_ptr<dentry_table>>, boost::hash<uuid>> in_flight;
+	};
 
-public:
-	std::recursive_mutex directory_table_mutex;
+	std::array<shard, DIRECTORY_TABLE_SHARD_NUM> shards;
+
+	/* <fragment ino, directory ino> of the fragments routed by this client */
+	std::mutex fragment_mutex;
+	tsl::robin_map<uuid, uuid, boost::hash<uuid>> fragment_parents;
+
+	struct handoff {
+		std::string leader;
+		std::chrono::system_clock::time_point due;
+		std::chrono::steady_clock::time_point expires;
+	};
 
-	directory_table();
+	/* <ino, where it went> of the directories migrated away by this client */
+	std::mutex handoff_mutex;
+	tsl::robin_map<uuid, handoff, boost::hash<uuid>> handoffs;
+
+	/* <ino, until when> of the directories the lease manager didn't pin to this client */
+	std::mutex pin_miss_mutex;
+	tsl::robin_map<uuid, std::chrono::steady_clock::time_point, boost::hash<uuid>> pin_misses;
+
+	/*
+	 * Tables are evicted by CLOCK once the cached inodes exceed max_cached_inodes.
+	 * 'cached_inodes' is counted when a table is added and recomputed by evict().
+	 * evict() runs on 'evictor', a FUSE thread adding a table only wakes it up.
+	 */
+	uint64_t max_cached_inodes;
+	std::atomic<uint64_t> cached_inodes;
+	std::mutex evict_mutex;
+	size_t clock_hand;
+
+	std::mutex evictor_mutex;
+	std::condition_variable evictor_cv;
+	bool evict_requested;
+	bool evictor_stopping;
+	std::thread evictor;
+
+	shard &get_shard(const uuid &ino);
+	void evict();
+	void evict_loop();
+	void stop_evictor();
+	/* gives up the lease of a table dropped from the cache, the journal of a LOCAL one is checkpointed first */
+	void release_dentry_table(const uuid &ino, enum meta_location loc);
+	uuid get_fragment_parent(const uuid &ino);
+	/* drops a cached REMOTE or SHARED table so that the next lookup asks the lease manager again */
+	void forget_remote_dentry_table(const uuid &ino);
+	void note_handoff(const uuid &ino, const std::string &new_leader, std::chrono::system_clock::time_point due);
+	/* the cached REMOTE table of 'ino' is led by 'leader' until 'due', as an -ENOTLEADER reply said */
+	void redirect_remote_dentry_table(const uuid &ino, const std::string &leader, std::chrono::system_clock::time_point due);
+	/* whether 'ino' is pinned to this client, a recent miss is answered from 'pin_misses' */
+	bool is_pinned_here(const uuid &ino);
+
+public:
+	explicit directory_table(uint64_t max_cached_inodes = DIRECTORY_TABLE_DEFAULT_MAX_INODES);
 	~directory_table();
 	int add_dentry_table(uuid ino, shared_ptr<dentry_table> dtable);
 	int delete_dentry_table(uuid ino);
 
-	shared_ptr<inode> path_traversal(const std::string &path);
-	shared_ptr<dentry_table> lease_dentry_table(uuid ino);
-	shared_ptr<dentry_table> lease_dentry_table_mkdir(std::shared_ptr<inode> new_dir_inode, std::shared_ptr<dentry> new_dir_dentry);
-	shared_ptr<dentry_table> get_dentry_table(uuid ino, bool remote = false);
+	/* with 'write', the returned inode comes from a LOCAL or REMOTE table and may be modified */
+	shared_ptr<inode> path_traversal(const std::string &path, bool write = false);
+	/*
+	 * 'i' again, with write intent, from the table holding it now. The path may name another file by now,
+	 * so 'name' is only tried first and a LOCAL table is searched by ino if it changed.
+	 */
+	shared_ptr<inode> reopen_inode(const shared_ptr<inode> &i, const std::string &name);
+	/* 'parent_dir_ino' is the directory holding 'ino', nil if unknown */
+	shared_ptr<dentry_table> lease_dentry_table(uuid ino, bool write = true, uuid parent_dir_ino = nil_uuid());
+	shared_ptr<dentry_table> lease_dentry_table_mkdir(std::shared_ptr<inode> new_dir_inode);
+	/*
+	 * without 'write' the table may be SHARED, which is read-only
+	 * with 'remote' a missing table is leased only if the directory is pinned to this client
+	 */
+	shared_ptr<dentry_table> get_dentry_table(uuid ino, bool remote = false, bool write = true, uuid parent_ino = nil_uuid());
+	/* the table holding 'name' of directory 'dir_ino', which is a fragment if the directory is fragmented */
+	shared_ptr<dentry_table> get_dentry_table_of(uuid dir_ino, const std::string &name, bool write = true);
+	shared_ptr<dentry_table> get_fragment_dentry_table(uuid dir_ino, uint64_t frag_id, bool write = true);
+
+	/* the lease manager asks for the lease of 'ino', returns 0 if it is given up and -1 if the directory is in use */
+	int recall_dentry_table(const uuid &ino);
+	/* gives up every lease on unmount */
+	void release_all();
+	/* hands the LOCAL table of 'ino' over to the client at 'new_leader', returns -1 if it is in use or pinned elsewhere */
+	int migrate_dentry_table(const uuid &ino, const std::string &new_leader);
+
+	/* called by the leader of 'ino', moves every name to 2^depth fragments leased on their own */
+	int fragment_directory(uuid ino, uint32_t depth);
+	/*
+	 * Called when the leader of 'remote_i' replied -ENOTLEADER.
+	 * The leader named in the reply is tried directly, a redirect in a row backs off first
+	 * and without a usable name the table is looked up again through the lease manager.
+	 */
 	void find_remote_dentry_table_again(const std::shared_ptr<remote_inode>& remote_i);
+	/* the leader of 'ino' as best known here for an -ENOTLEADER reply, false if unknown */
+	bool get_leader_hint(const uuid &ino, std::string &leader, std::chrono::system_clock::time_point &due);
+	/* a subtree was pinned to this client, the directories found not pinned here are asked again */
+	void forget_pin_misses();
 };
 
 #endif //NMFS0_DIRECTORY_TABLE_HPP
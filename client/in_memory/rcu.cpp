@@ -0,0 +1,102 @@
+#include "rcu.hpp"
+
+namespace {
+	/* epoch 0 means the thread is out of any read-side section */
+	struct alignas(64) reader_slot {
+		std::atomic<uint64_t> epoch{0};
+		std::atomic<bool> in_use{false};
+		reader_slot *next = nullptr;
+		uint32_t nesting = 0;
+	};
+
+	std::atomic<uint64_t> global_epoch{1};
+	std::atomic<reader_slot *> slot_list{nullptr};
+
+	std::mutex retire_mutex;
+	std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+
+	/* slots are never freed, a slot released by an exited thread is reused by the next one */
+	struct slot_owner {
+		reader_slot *slot = nullptr;
+
+		~slot_owner() {
+			if (slot)
+				slot->in_use.store(false, std::memory_order_release);
+		}
+
+		reader_slot *get() {
+			if (slot)
+				return slot;
+
+			for (reader_slot *s = slot_list.load(std::memory_order_acquire); s != nullptr; s = s->next) {
+				bool expected = false;
+				if (s->in_use.compare_exchange_strong(expected, true)) {
+					slot = s;
+					return slot;
+				}
+			}
+
+			auto *new_slot = new reader_slot;
+			new_slot->in_use.store(true, std::memory_order_relaxed);
+			new_slot->next = slot_list.load(std::memory_order_relaxed);
+			while (!slot_list.compare_exchange_weak(new_slot->next, new_slot));
+
+			slot = new_slot;
+			return slot;
+		}
+	};
+
+	thread_local slot_owner this_thread_slot;
+
+	uint64_t min_active_epoch() {
+		uint64_t min_epoch = UINT64_MAX;
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		for (reader_slot *s = slot_list.load(std::memory_order_acquire); s != nullptr; s = s->next) {
+			uint64_t e = s->epoch.load(std::memory_order_acquire);
+			if (e != 0 && e < min_epoch)
+				min_epoch = e;
+		}
+
+		return min_epoch;
+	}
+}
+
+rcu_read_guard::rcu_read_guard() {
+	reader_slot *s = this_thread_slot.get();
+	if (s->nesting++ == 0) {
+		s->epoch.store(global_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+rcu_read_guard::~rcu_read_guard() {
+	reader_slot *s = this_thread_slot.get();
+	if (--s->nesting == 0)
+		s->epoch.store(0, std::memory_order_release);
+}
+
+void rcu_retire(std::function<void()> reclaim) {
+	std::vector<std::function<void()>> ready;
+
+	{
+		std::scoped_lock scl{retire_mutex};
+		/* readers entered with an epoch later than this tag can't see the unlinked objects */
+		retired.emplace_back(global_epoch.fetch_add(1), std::move(reclaim));
+		if (retired.size() < RCU_RECLAIM_THRESHOLD)
+			return;
+
+		uint64_t min_epoch = min_active_epoch();
+		std::vector<std::pair<uint64_t, std::function<void()>>> remain;
+		for (auto &r : retired) {
+			if (r.first < min_epoch)
+				ready.push_back(std::move(r.second));
+			else
+				remain.push_back(std::move(r));
+		}
+		retired.swap(remain);
+	}
+
+	for (auto &r : ready)
+		r();
+}
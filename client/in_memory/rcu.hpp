@@ -0,0 +1,32 @@
+#ifndef NMFS0_RCU_HPP
+#define NMFS0_RCU_HPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#define RCU_RECLAIM_THRESHOLD (64)
+
+/*
+ * Epoch based reclamation for the in-memory indexes.
+ *
+ * Readers wrap every access to an RCU protected structure with rcu_read_guard,
+ * which only touches a per-thread slot and never blocks.
+ * Writers serialize among themselves with their own lock, unlink the old
+ * objects and pass the reclaim routine to rcu_retire().
+ * The routine runs once every reader which could still see the objects has left.
+ */
+class rcu_read_guard {
+public:
+	rcu_read_guard();
+	~rcu_read_guard();
+
+	rcu_read_guard(const rcu_read_guard &) = delete;
+	rcu_read_guard &operator=(const rcu_read_guard &) = delete;
+};
+
+void rcu_retire(std::function<void()> reclaim);
+
+#endif //NMFS0_RCU_HPP
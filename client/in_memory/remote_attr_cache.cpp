@@ -0,0 +1,124 @@
+#include "remote_attr_cache.hpp"
+
+#include <algorithm>
+
+#include "../lease/lease_client.hpp"
+
+extern std::shared_ptr<lease_client> lc;
+
+remote_attr_cache::remote_attr_cache(std::chrono::milliseconds ttl) : epoch(0), ttl(ttl) {
+}
+
+remote_attr_cache::entry_key remote_attr_cache::get_key(const remote_inode &i) {
+	return entry_key{i.get_dentry_table_ino(), i.get_target_is_parent() ? "" : i.get_file_name()};
+}
+
+remote_attr_cache::lookup_result remote_attr_cache::lookup(const remote_inode &i, struct stat *s, uint64_t &generation) {
+	std::scoped_lock lock(this->cache_mutex);
+	auto it = this->entries.find(get_key(i));
+	if (it == this->entries.end())
+		return MISS;
+
+	/* the directory moved to another leader, whose generations have nothing to do with the cached one */
+	if (it->second.leader != i.get_address()) {
+		this->entries.erase(it);
+		return MISS;
+	}
+
+	if (it->second.partial)
+		return MISS;
+
+	*s = it->second.attr;
+	generation = it->second.generation;
+	return (std::chrono::system_clock::now() < it->second.expires) ? FRESH : STALE;
+}
+
+uint64_t remote_attr_cache::get_epoch() const {
+	return this->epoch;
+}
+
+void remote_attr_cache::put(const entry_key &key, entry &&e, bool watched, uint64_t epoch) {
+	/* under the lock, an invalidation racing with the reply either bumps the epoch first or erases the entry after */
+	std::scoped_lock lock(this->cache_mutex);
+	auto now = std::chrono::system_clock::now();
+	e.expires = lc->get_due(key.first);
+	if (!watched || (epoch != this->epoch))
+		e.expires = std::min(now + this->ttl, e.expires);
+
+	if (this->entries.size() >= REMOTE_ATTR_CACHE_MAX_ENTRIES) {
+		for (auto it = this->entries.begin(); it != this->entries.end();) {
+			if (it->second.expires <= now)
+				it = this->entries.erase(it);
+			else
+				++it;
+		}
+		if (this->entries.size() >= REMOTE_ATTR_CACHE_MAX_ENTRIES)
+			this->entries.clear();
+	}
+
+	/* the full attributes of the same generation serve the permission checks as well */
+	if (e.partial) {
+		auto it = this->entries.find(key);
+		if ((it != this->entries.end()) && !it->second.partial && (it->second.leader == e.leader) &&
+		    (it->second.generation == e.generation) && (now < it->second.expires))
+			return;
+	}
+
+	this->entries.insert_or_assign(key, std::move(e));
+}
+
+void remote_attr_cache::insert(const remote_inode &i, const struct stat *s, uint64_t generation, bool watched, uint64_t epoch) {
+	this->put(get_key(i), entry{*s, generation, i.get_address(), {}, false}, watched, epoch);
+}
+
+bool remote_attr_cache::lookup_perm(const remote_inode &i, struct stat *s) {
+	std::scoped_lock lock(this->cache_mutex);
+	auto it = this->entries.find(get_key(i));
+	if (it == this->entries.end())
+		return false;
+
+	if (it->second.leader != i.get_address()) {
+		this->entries.erase(it);
+		return false;
+	}
+	if (std::chrono::system_clock::now() >= it->second.expires)
+		return false;
+
+	s->st_mode = it->second.attr.st_mode;
+	s->st_uid = it->second.attr.st_uid;
+	s->st_gid = it->second.attr.st_gid;
+	return true;
+}
+
+void remote_attr_cache::insert_perm(const uuid &table_ino, const std::string &name, const std::string &leader, const struct stat *s,
+				    uint64_t generation, bool watched, uint64_t epoch) {
+	this->put(entry_key{table_ino, name}, entry{*s, generation, leader, {}, true}, watched, epoch);
+}
+
+void remote_attr_cache::invalidate(const uuid &table_ino, const std::string &name) {
+	std::scoped_lock lock(this->cache_mutex);
+	this->epoch++;
+	this->entries.erase(entry_key{table_ino, name});
+}
+
+void remote_attr_cache::invalidate_table(const uuid &table_ino) {
+	std::scoped_lock lock(this->cache_mutex);
+	this->epoch++;
+	for (auto it = this->entries.begin(); it != this->entries.end();) {
+		if (it->first.first == table_ino)
+			it = this->entries.erase(it);
+		else
+			++it;
+	}
+}
+
+void remote_attr_cache::invalidate_leader(const std::string &leader) {
+	std::scoped_lock lock(this->cache_mutex);
+	this->epoch++;
+	for (auto it = this->entries.begin(); it != this->entries.end();) {
+		if (it->second.leader == leader)
+			it = this->entries.erase(it);
+		else
+			++it;
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef NMFS_REMOTE_ATTR_CACHE_HPP
+#define NMFS_REMOTE_ATTR_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include <boost/functional/hash.hpp>
+#include <tsl/robin_map.h>
+
+#include "../meta/remote_inode.hpp"
+
+/* the expired entries are dropped once the cache holds this many, every entry if none has expired */
+#define REMOTE_ATTR_CACHE_MAX_ENTRIES (65536)
+
+/*
+ * Attributes of REMOTE inodes returned by getattr, keyed by (dentry table, name), the name of the directory of the table is "".
+ * An entry is served without asking the leader for 'ttl', never past the lease of the leader it came from.
+ * After that it is revalidated by its generation, the leader sends the attributes again only if they changed.
+ * The changes this client makes through a leader drop the entries they touch.
+ * An entry the leader watches for this client is served until the lease of the leader is due,
+ * it is dropped when the leader pushes its invalidation or the subscription to the leader breaks.
+ * The lookups of path walks bring the mode, uid and gid of the names and directories along,
+ * they are kept as partial entries which serve the permission checks but not getattr.
+ */
+class remote_attr_cache {
+public:
+	enum lookup_result {
+		MISS = 0,
+		FRESH,
+		/* to be revalidated with the generation returned along */
+		STALE
+	};
+
+private:
+	struct entry {
+		struct stat attr;
+		uint64_t generation;
+		std::string leader;
+		std::chrono::system_clock::time_point expires;
+		/* only st_mode, st_uid and st_gid are set */
+		bool partial;
+	};
+
+	/* counts the invalidations, an entry watched since before the last one may have missed it */
+	std::atomic<uint64_t> epoch;
+
+	using entry_key = std::pair<uuid, std::string>;
+
+	std::mutex cache_mutex;
+	tsl::robin_map<entry_key, entry, boost::hash<entry_key>> entries;
+	std::chrono::milliseconds ttl;
+
+	static entry_key get_key(const remote_inode &i);
+	void put(const entry_key &key, entry &&e, bool watched, uint64_t epoch);
+
+public:
+	explicit remote_attr_cache(std::chrono::milliseconds ttl);
+
+	/* FRESH and STALE fill 's' */
+	lookup_result lookup(const remote_inode &i, struct stat *s, uint64_t &generation);
+	/* read before the getattr whose attributes are inserted */
+	uint64_t get_epoch() const;
+	/* 'watched' if the leader pushes the invalidation of the attributes */
+	void insert(const remote_inode &i, const struct stat *s, uint64_t generation, bool watched, uint64_t epoch);
+	/* true if a FRESH entry fills st_mode, st_uid and st_gid of 's' */
+	bool lookup_perm(const remote_inode &i, struct stat *s);
+	/* 'name' of 'table_ino' was looked up at 'leader', 's' holds its mode, uid and gid */
+	void insert_perm(const uuid &table_ino, const std::string &name, const std::string &leader, const struct stat *s,
+			 uint64_t generation, bool watched, uint64_t epoch);
+	void invalidate(const uuid &table_ino, const std::string &name);
+	void invalidate_table(const uuid &table_ino);
+	void invalidate_leader(const std::string &leader);
+};
+
+#endif //NMFS_REMOTE_ATTR_CACHE_HPP
@@ -2,6 +2,7 @@
 #define _COMMIT_HPP_
 
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include "lib/rados_io/rados_io.hpp"
@@ -16,11 +17,12 @@ class commit {
 private:
 	bool *stopped;
 	std::shared_ptr<rados_io> meta;
+	std::mutex *cycle_mutex;
 	journal_table *table;
 	mqueue<std::shared_ptr<transaction>> *q;
 
 public:
-	commit(bool *stopped_flag, std::shared_ptr<rados_io> meta_pool, journal_table *jtable, mqueue<std::shared_ptr<transaction>> *queue);
+	commit(bool *stopped_flag, std::shared_ptr<rados_io> meta_pool, std::mutex *cycle, journal_table *jtable, mqueue<std::shared_ptr<transaction>> *queue);
 	~commit(void) = default;
 
 	void operator()(void);
@@ -1,8 +1,15 @@
 #include "journal.hpp"
 
+#include <algorithm>
+
+#include "../rpc/invalidation.hpp"
+
+/* the followers watching what changes below are told from the same hooks */
+extern std::unique_ptr<invalidation_hub> invalidations;
+
 journal::journal(std::shared_ptr<rados_io> meta_pool, std::shared_ptr<lease_client> lease) : meta(meta_pool), lc(lease), stopped(false)
 {
-	commit_thr = std::make_unique<std::thread>(commit(&stopped, meta, &jtable, q));
+	commit_thr = std::make_unique<std::thread>(commit(&stopped, meta, &cycle_mutex, &jtable, q));
 	for (int i = 0; i < NUM_CP_THREAD; i++)
 		checkpoint_thr[i] = std::make_unique<std::thread>(checkpoint(meta, &q[i]));
 }
@@ -37,9 +44,127 @@ void journal::check(const uuid &self_ino)
 	}
 }
 
+void journal::flush(const uuid &self_ino)
+{
+	global_logger.log(journal_ops, "Called journal::flush(" + uuid_to_string(self_ino) + ")");
+	std::shared_ptr<transaction> tx;
+
+	{
+		std::scoped_lock lock(cycle_mutex);
+		tx = jtable.take_entry(self_ino);
+		if (tx == nullptr)
+			tx = std::make_shared<transaction>(self_ino);
+		tx->commit(meta);
+
+		/* the queue of an ino is FIFO, so the earlier transactions are checkpointed before this one */
+		unsigned i = (*((uint64_t *)self_ino.data)) % NUM_CP_THREAD;
+		q[i].issue(tx);
+	}
+
+	tx->wait_checkpoint();
+}
+
+static std::string get_intent_key(const uuid &table_ino)
+{
+	return uuid_to_string(table_ino) + ".rename";
+}
+
+static void put_string(std::vector<char> &raw, const std::string &str)
+{
+	uint32_t len = static_cast<uint32_t>(str.size());
+	raw.insert(raw.end(), reinterpret_cast<char *>(&len), reinterpret_cast<char *>(&len) + sizeof(uint32_t));
+	raw.insert(raw.end(), str.begin(), str.end());
+}
+
+static std::string get_string(const char *raw, size_t &index)
+{
+	uint32_t len = *(reinterpret_cast<const uint32_t *>(raw + index));
+	index += sizeof(uint32_t);
+	std::string str(raw + index, len);
+	index += len;
+	return str;
+}
+
+/* the count leads the object, so the bytes left from a longer list are ignored */
+void journal::write_intents(const uuid &table_ino)
+{
+	auto it = intents.find(table_ino);
+	if (it == intents.end() || it->second.empty()) {
+		if (it != intents.end())
+			intents.erase(it);
+		if (meta->exist(obj_category::JOURNAL, get_intent_key(table_ino)))
+			meta->remove(obj_category::JOURNAL, get_intent_key(table_ino));
+		return;
+	}
+
+	std::vector<char> raw;
+	uint32_t num = static_cast<uint32_t>(it->second.size());
+	raw.insert(raw.end(), reinterpret_cast<char *>(&num), reinterpret_cast<char *>(&num) + sizeof(uint32_t));
+	for (const rename_intent &r : it->second) {
+		put_string(raw, r.name);
+		raw.insert(raw.end(), r.ino.begin(), r.ino.end());
+		raw.insert(raw.end(), r.dst_parent_ino.begin(), r.dst_parent_ino.end());
+		put_string(raw, r.dst_name);
+	}
+	meta->write(obj_category::JOURNAL, get_intent_key(table_ino), raw.data(), raw.size(), 0);
+}
+
+void journal::prepare_rename(const uuid &table_ino, const rename_intent &intent)
+{
+	global_logger.log(journal_ops, "Called journal::prepare_rename(" + intent.name + ", " + intent.dst_name + ")");
+	std::scoped_lock lock(intent_mutex);
+	intents[table_ino].push_back(intent);
+	write_intents(table_ino);
+}
+
+void journal::resolve_rename(const uuid &table_ino, const std::string &name)
+{
+	global_logger.log(journal_ops, "Called journal::resolve_rename(" + name + ")");
+	std::scoped_lock lock(intent_mutex);
+	auto it = intents.find(table_ino);
+	if (it == intents.end())
+		return;
+
+	std::vector<rename_intent> &list = it.value();
+	list.erase(std::remove_if(list.begin(), list.end(), [&name](const rename_intent &r) { return r.name == name; }), list.end());
+	write_intents(table_ino);
+}
+
+std::vector<rename_intent> journal::pending_renames(const uuid &table_ino)
+{
+	global_logger.log(journal_ops, "Called journal::pending_renames(" + uuid_to_string(table_ino) + ")");
+	std::vector<rename_intent> list;
+	librados::bufferlist bl;
+	try {
+		meta->read_head(obj_category::JOURNAL, get_intent_key(table_ino), bl);
+	} catch (rados_io::no_such_object &e) {
+		return list;
+	}
+
+	const char *raw = bl.c_str();
+	size_t index = 0;
+	uint32_t num = *(reinterpret_cast<const uint32_t *>(raw));
+	index += sizeof(uint32_t);
+	for (uint32_t n = 0; n < num; n++) {
+		rename_intent r;
+		r.name = get_string(raw, index);
+		std::copy(raw + index, raw + index + r.ino.size(), r.ino.begin());
+		index += r.ino.size();
+		std::copy(raw + index, raw + index + r.dst_parent_ino.size(), r.dst_parent_ino.begin());
+		index += r.dst_parent_ino.size();
+		r.dst_name = get_string(raw, index);
+		list.push_back(std::move(r));
+	}
+
+	std::scoped_lock lock(intent_mutex);
+	intents.insert_or_assign(table_ino, list);
+	return list;
+}
+
 void journal::mkself(std::shared_ptr<inode> self_inode)
 {
 	global_logger.log(journal_ops, "Called journal::mkself(" + uuid_to_string(self_inode->get_ino()) + ")");
+	self_inode->bump_generation();
 	while (true) {
 		auto tx = jtable.get_entry(self_inode->get_ino());
 		if (!tx->mkself(self_inode))
@@ -50,6 +175,7 @@ void journal::mkself(std::shared_ptr<inode> self_inode)
 void journal::rmself(const uuid &self_ino)
 {
 	global_logger.log(journal_ops, "Called journal::rmself(" + uuid_to_string(self_ino) + ")");
+	invalidations->attr_changed(self_ino);
 	while (true) {
 		auto tx = jtable.get_entry(self_ino);
 		if (!tx->rmself(self_ino))
@@ -60,6 +186,8 @@ void journal::rmself(const uuid &self_ino)
 void journal::chself(std::shared_ptr<inode> self_inode)
 {
 	global_logger.log(journal_ops, "Called journal::chself(" + uuid_to_string(self_inode->get_ino()) + ")");
+	self_inode->bump_generation();
+	invalidations->attr_changed(self_inode->get_ino());
 	while (true) {
 		auto tx = jtable.get_entry(self_inode->get_ino());
 		if (!tx->chself(self_inode))
@@ -67,61 +195,85 @@ void journal::chself(std::shared_ptr<inode> self_inode)
 	}
 }
 
-void journal::mkdir(std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino)
+void journal::mkdir(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino)
 {
 	global_logger.log(journal_ops, "Called journal::mkdir(" + uuid_to_string(self_inode->get_ino()) + d_name + ")");
+	self_inode->bump_generation();
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, d_name, true);
 	while (true) {
-		auto tx = jtable.get_entry(self_inode->get_ino());
+		auto tx = jtable.get_entry(table_ino);
 		if (!tx->mkdir(self_inode, d_name, d_ino))
 			break;
 	}
 }
 
-void journal::rmdir(std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino)
+void journal::rmdir(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino)
 {
 	global_logger.log(journal_ops, "Called journal::rmdir(" + uuid_to_string(self_inode->get_ino()) + d_name + ")");
+	self_inode->bump_generation();
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, d_name, false);
+	invalidations->attr_changed(d_ino);
 	while (true) {
-		auto tx = jtable.get_entry(self_inode->get_ino());
+		auto tx = jtable.get_entry(table_ino);
 		if (!tx->rmdir(self_inode, d_name, d_ino))
 			break;
 	}
 }
 
-void journal::mvdir(std::shared_ptr<inode> self_inode, const std::string &src_d_name, const uuid &src_d_ino, const std::string &dst_d_name, const uuid &dst_d_ino)
+void journal::mvdir(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &src_d_name, const uuid &src_d_ino, const std::string &dst_d_name, const uuid &dst_d_ino)
 {
 	global_logger.log(journal_ops, "Called journal::mvdir(" + src_d_name + ", " + uuid_to_string(src_d_ino) + ", " + dst_d_name + ", " + uuid_to_string(dst_d_ino) + ")");
+	self_inode->bump_generation();
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, src_d_name, false);
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, dst_d_name, true);
+	invalidations->attr_changed(src_d_ino);
+	if (!dst_d_ino.is_nil())
+		invalidations->attr_changed(dst_d_ino);
 	while (true) {
-		auto tx = jtable.get_entry(self_inode->get_ino());
+		auto tx = jtable.get_entry(table_ino);
 		if (!tx->mvdir(self_inode, src_d_name, src_d_ino, dst_d_name, dst_d_ino))
 			break;
 	}
 }
 
-void journal::mkreg(std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode)
+void journal::mkreg(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode)
 {
 	global_logger.log(journal_ops, "Called journal::mkreg(" + uuid_to_string(f_inode->get_ino()) + f_name + ")");
+	self_inode->bump_generation();
+	f_inode->bump_generation();
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, f_name, true);
 	while (true) {
-		auto tx = jtable.get_entry(self_inode->get_ino());
+		auto tx = jtable.get_entry(table_ino);
 		if (!tx->mkreg(self_inode, f_name, f_inode))
 			break;
 	}
 }
 
-void journal::rmreg(std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode)
+void journal::rmreg(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode)
 {
 	global_logger.log(journal_ops, "Called journal::rmreg(" + uuid_to_string(f_inode->get_ino()) + f_name + ")");
+	self_inode->bump_generation();
+	f_inode->bump_generation();
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, f_name, false);
+	invalidations->attr_changed(f_inode->get_ino());
 	while (true) {
-		auto tx = jtable.get_entry(self_inode->get_ino());
+		auto tx = jtable.get_entry(table_ino);
 		if (!tx->rmreg(self_inode, f_name, f_inode))
 			break;
 	}
 }
 
-void journal::mvreg(std::shared_ptr<inode> self_inode, const std::string &src_f_name, const uuid &src_f_ino, const std::string &dst_f_name, const uuid &dst_f_ino)
+void journal::mvreg(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &src_f_name, const uuid &src_f_ino, const std::string &dst_f_name, const uuid &dst_f_ino)
 {
 	global_logger.log(journal_ops, "Called journal::mvreg(" + src_f_name + ", " + uuid_to_string(src_f_ino) + ", " + dst_f_name + ", " + uuid_to_string(dst_f_ino) + ")");
+	self_inode->bump_generation();
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, src_f_name, false);
+	invalidations->dentry_changed(self_inode->get_ino(), table_ino, dst_f_name, true);
+	invalidations->attr_changed(src_f_ino);
+	if (!dst_f_ino.is_nil())
+		invalidations->attr_changed(dst_f_ino);
 	while (true) {
-		auto tx = jtable.get_entry(self_inode->get_ino());
+		auto tx = jtable.get_entry(table_ino);
 		if (!tx->mvreg(self_inode, src_f_name, src_f_ino, dst_f_name, dst_f_ino))
 			break;
 	}
@@ -130,6 +282,8 @@ void journal::mvreg(std::shared_ptr<inode> self_inode, const std::string &src_f_
 void journal::chreg(const uuid &self_ino, std::shared_ptr<inode> f_inode)
 {
 	global_logger.log(journal_ops, "Called journal::chreg(" + uuid_to_string(self_ino) + ")");
+	f_inode->bump_generation();
+	invalidations->attr_changed(f_inode->get_ino());
 	while (true) {
 		auto tx = jtable.get_entry(self_ino);
 		if (!tx->chreg(f_inode))
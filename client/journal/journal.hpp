@@ -11,36 +11,67 @@
 
 #define NUM_CP_THREAD 8
 
+/* a rename of 'name' to 'dst_name' of 'dst_parent_ino', in doubt from its prepare until the destination answers */
+struct rename_intent {
+	std::string name;
+	uuid ino;
+	uuid dst_parent_ino;
+	std::string dst_name;
+};
+
 class journal {
 private:
 	std::shared_ptr<rados_io> meta;
 	std::shared_ptr<lease_client> lc;
 
 	bool stopped;
+	/* held by the commit thread for a whole cycle, flush() takes it to order its transaction after the cycle */
+	std::mutex cycle_mutex;
 	journal_table jtable;
 	mqueue<std::shared_ptr<transaction>> q[NUM_CP_THREAD];
 	std::unique_ptr<std::thread> commit_thr, checkpoint_thr[NUM_CP_THREAD];
 
+	/* <source table, renames in doubt>, kept in an object next to the journal of the table until resolved */
+	std::mutex intent_mutex;
+	tsl::robin_map<uuid, std::vector<rename_intent>, boost::hash<uuid>> intents;
+	void write_intents(const uuid &table_ino);
+
 public:
 	journal(std::shared_ptr<rados_io> meta_pool, std::shared_ptr<lease_client> lease);
 	~journal(void);
 
 	void check(const uuid &self_ino);
 
+	/* commit and checkpoint the transaction of 'self_ino' and every earlier one now */
+	void flush(const uuid &self_ino);
+
+	/* every change below stamps a new generation on the inodes it is given */
+
 	/* self */
 	void mkself(std::shared_ptr<inode> self_inode);
 	void rmself(const uuid &self_ino);
 	void chself(std::shared_ptr<inode> self_inode);
 
+	/*
+	 * The entries of a directory are journaled under the ino of the dentry table holding them,
+	 * which is the directory itself or one of its fragments.
+	 */
+
 	/* directories */
-	void mkdir(std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino);
-	void rmdir(std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino);
-	void mvdir(std::shared_ptr<inode> self_inode, const std::string &src_d_name, const uuid &src_d_ino, const std::string &dst_d_name, const uuid &dst_d_ino = nil_uuid());
+	void mkdir(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino);
+	void rmdir(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &d_name, const uuid &d_ino);
+	void mvdir(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &src_d_name, const uuid &src_d_ino, const std::string &dst_d_name, const uuid &dst_d_ino = nil_uuid());
+
+	/* renames across tables, the intent is durable when prepare_rename() returns */
+	void prepare_rename(const uuid &table_ino, const rename_intent &intent);
+	void resolve_rename(const uuid &table_ino, const std::string &name);
+	/* the intents a previous leader of 'table_ino' left unresolved */
+	std::vector<rename_intent> pending_renames(const uuid &table_ino);
 
 	/* regular files */
-	void mkreg(std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode);
-	void rmreg(std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode);
-	void mvreg(std::shared_ptr<inode> self_inode, const std::string &src_f_name, const uuid &src_f_ino, const std::string &dst_f_name, const uuid &dst_f_ino = nil_uuid());
+	void mkreg(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode);
+	void rmreg(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &f_name, std::shared_ptr<inode> f_inode);
+	void mvreg(const uuid &table_ino, std::shared_ptr<inode> self_inode, const std::string &src_f_name, const uuid &src_f_ino, const std::string &dst_f_name, const uuid &dst_f_ino = nil_uuid());
 	void chreg(const uuid &self_ino, std::shared_ptr<inode> f_inode);
 };
 
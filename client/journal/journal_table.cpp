@@ -35,6 +35,20 @@ std::shared_ptr<transaction> journal_table::get_entry(const uuid &ino)
 	}
 }
 
+std::shared_ptr<transaction> journal_table::take_entry(const uuid &ino)
+{
+	global_logger.log(journal_table_ops, "Called take_entry(" + to_string(ino) + ")");
+
+	std::unique_lock lock(sm);
+	auto it = map->find(ino);
+	if (it == map->end())
+		return nullptr;
+
+	auto tx = it->second;
+	map->erase(it);
+	return tx;
+}
+
 std::unique_ptr<journal_map> journal_table::replace_map(void)
 {
 	global_logger.log(journal_table_ops, "Called replace_map()");
@@ -26,6 +26,7 @@ public:
 
 	void delete_entry(const uuid &ino);				/* for check */
 	std::shared_ptr<transaction> get_entry(const uuid &ino);	/* for operation */
+	std::shared_ptr<transaction> take_entry(const uuid &ino);	/* for flush */
 	std::unique_ptr<journal_map> replace_map(void);			/* for commit */
 };
 
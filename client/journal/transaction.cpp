@@ -1,5 +1,7 @@
 #include "transaction.hpp"
 
+extern bool embedded_reg_inode;
+
 std::vector<char> transaction::serialize(void)
 {
 	global_logger.log(transaction_ops, "Called serialize()");
@@ -392,16 +394,19 @@ void transaction::sync(std::shared_ptr<rados_io> meta)
 
 	if (status == self_status::S_DELETED) {
 		meta->remove(obj_category::INODE, to_string(s_ino));
-		meta->remove(obj_category::DENTRY, to_string(s_ino));
+		if (meta->exist(obj_category::DENTRY, to_string(s_ino))) {
+			dentry d(s_ino, false, true);
+			d.remove();
+		}
 		return;
 	}
 
-	/* s_inode */
-	if (s_inode)
+	/* s_inode, a fragment of the directory leaves the inode to the leader of the directory */
+	if (s_inode && (s_inode->get_ino() == s_ino))
 		s_inode->sync();
 
-	/* dentries */
-	dentry d(s_ino, status == self_status::S_CREATED);
+	/* dentries, only the shards of the touched names are read */
+	dentry d(s_ino, status == self_status::S_CREATED, true);
 	for (const auto &p : dentries) {
 		bool alive = p.second.first;
 		std::string name = p.first;
@@ -413,12 +418,55 @@ void transaction::sync(std::shared_ptr<rados_io> meta)
 			d.delete_child(name);
 		}
 	}
-	d.sync();
 
-	/* f_inodes */
+	/* f_inodes
+	 * With embedded_reg_inode, regular files still linked here are written within the dentry object.
+	 * The others keep their own inode object, and a stale embedded copy must not shadow it.
+	 */
+	tsl::robin_map<uuid, inode *, boost::hash<uuid>> own_objects;
 	for (const auto &p : f_inodes)
 		if (p.second)
-			p.second->sync();
+			own_objects.insert({p.first, p.second.get()});
+
+	/* chreg() records no name, the shard of such an inode is found by loading every shard */
+	d.load_shards_linking(own_objects, embedded_reg_inode);
+
+	if (embedded_reg_inode) {
+		tsl::robin_map<uuid, inode *, boost::hash<uuid>> candidates;
+		for (auto it = own_objects.begin(); it != own_objects.end();) {
+			if (S_ISREG(it->second->get_mode())) {
+				candidates.insert({it->first, it->second});
+				it = own_objects.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		d.embed_child_inodes(candidates);
+		for (const auto &c : candidates)
+			own_objects.insert(c);
+	}
+
+	for (const auto &p : own_objects)
+		d.drop_embedded_inode(p.first);
+	d.sync();
+
+	/* a chreg() journaled here while the directory was fragmented, the name is held by a fragment now */
+	uint32_t depth = d.get_frag_depth();
+	if ((depth > 0) && !own_objects.empty()) {
+		for (uint64_t bits = 0; bits < (1ULL << depth); bits++) {
+			dentry f(get_frag_ino(s_ino, make_frag_id(depth, bits)), false, true);
+			f.load_shards_linking(own_objects, false);
+			bool dropped = false;
+			for (const auto &p : own_objects)
+				dropped |= f.drop_embedded_inode(p.first);
+			if (dropped)
+				f.sync();
+		}
+	}
+
+	for (const auto &p : own_objects)
+		p.second->sync();
 }
 
 void transaction::commit(std::shared_ptr<rados_io> meta)
@@ -452,4 +500,11 @@ void transaction::checkpoint(std::shared_ptr<rados_io> meta)
 
 	/* Clear the checkpoint bit */
 	meta->write(obj_category::JOURNAL, to_string(s_ino), "\0", 1, offset);
+
+	checkpointed.set_value();
+}
+
+void transaction::wait_checkpoint(void)
+{
+	checkpointed.get_future().wait();
 }
@@ -2,6 +2,7 @@
 #define _TRANSACTION_HPP_
 
 #include <atomic>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
@@ -36,6 +37,9 @@ private:
 	/* the offset for this transaction in the journal object */
 	off_t offset;
 
+	/* fulfilled once checkpoint() is done */
+	std::promise<void> checkpointed;
+
 	/* the status of the directory itself
 	 *   mkself -> S_CREATED
 	 *   rmself -> S_DELETED
@@ -83,6 +87,7 @@ public:
 
 	void commit(std::shared_ptr<rados_io> meta);
 	void checkpoint(std::shared_ptr<rados_io> meta);
+	void wait_checkpoint(void);
 };
 
 #endif /* _TRANSACTION_HPP_ */
@@ -0,0 +1,13 @@
+#include "lease_callback_impl.hpp"
+
+extern std::unique_ptr<directory_table> indexing_table;
+
+Status lease_callback_impl::recall(ServerContext *context, const recall_request *request, release_response *response)
+{
+	uuid ino = uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix());
+	global_logger.log(lease_ops, "Called recall(" + uuid_to_string(ino) + ")");
+
+	response->set_ret(indexing_table->recall_dentry_table(ino));
+
+	return Status::OK;
+}
@@ -0,0 +1,20 @@
+#ifndef _LEASE_CALLBACK_IMPL_HPP_
+#define _LEASE_CALLBACK_IMPL_HPP_
+
+#include <grpcpp/grpcpp.h>
+
+using grpc::ServerContext;
+using grpc::Status;
+
+#include "lease.pb.h"
+#include "lease.grpc.pb.h"
+
+#include "../in_memory/directory_table.hpp"
+
+/* requests of the lease manager, served next to the remote operations */
+class lease_callback_impl final : public lease_callback::Service {
+private:
+	Status recall(ServerContext *context, const recall_request *request, release_response *response) override;
+};
+
+#endif /* _LEASE_CALLBACK_IMPL_HPP_ */
@@ -18,8 +18,27 @@ bool lease_client::is_mine(uuid ino)
 	return table.is_mine(ino);
 }
 
+system_clock::time_point lease_client::get_due(uuid ino)
+{
+	return table.get_due(ino);
+}
+
+void lease_client::note_remote(uuid ino, const system_clock::time_point &due)
+{
+	if ((due > table.get_due(ino)) && !table.is_mine(ino))
+		table.update(ino, due, false);
+}
+
 int lease_client::acquire(uuid ino, std::string &remote_addr)
 {
+	uint32_t frag_depth;
+	return acquire(ino, remote_addr, frag_depth);
+}
+
+int lease_client::acquire(uuid ino, std::string &remote_addr, uint32_t &frag_depth, bool shared, const uuid &parent_ino)
+{
+	/* the leader reads the fragmentation depth of its own directory from the dentry object */
+	frag_depth = 0;
 	if (table.is_mine(ino))
 		return 0;
 
@@ -27,25 +46,214 @@ int lease_client::acquire(uuid ino, std::string &remote_addr)
 	request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
 	request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
 	request.set_remote_addr(remote);
+	request.set_shared(shared);
+	if (!parent_ino.is_nil()) {
+		request.set_parent_ino_prefix(uuid_controller::get_prefix_from_uuid(parent_ino));
+		request.set_parent_ino_postfix(uuid_controller::get_postfix_from_uuid(parent_ino));
+	}
 
-	lease_response response;
+	while (true) {
+		lease_response response;
 
-	ClientContext context;
+		ClientContext context;
 
-	Status status = stub->acquire(&context, request, &response);
+		Status status = stub->acquire(&context, request, &response);
 
-	if (status.ok()) {
-		int ret = response.ret();
+		if (!status.ok()) {
+			std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+			throw std::runtime_error("lease_client::acquire() failed");
+		}
 
+		int ret = response.ret();
 		system_clock::time_point due{system_clock::duration{response.due()}};
-		table.update(ino, due, static_cast<bool>(!ret));
 
-		if (ret)
+		/* the readers of the directory drop their copies by then, or earlier once recalled */
+		if (ret == -2) {
+			std::this_thread::sleep_until(std::min(due, system_clock::now() + milliseconds(LEASE_WAIT_RETRY_MS)));
+			continue;
+		}
+
+		table.update(ino, due, ret == 0);
+
+		if (ret == -1)
 			remote_addr = response.remote_addr();
+		frag_depth = response.frag_depth();
 
 		return ret;
+	}
+}
+
+int lease_client::fragment(uuid ino, uint32_t &frag_depth)
+{
+	fragment_request request;
+	request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
+	request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
+	request.set_frag_depth(frag_depth);
+	request.set_remote_addr(remote);
+
+	fragment_response response;
+
+	ClientContext context;
+
+	Status status = stub->fragment(&context, request, &response);
+
+	if (status.ok()) {
+		frag_depth = response.frag_depth();
+		return response.ret();
+	} else {
+		std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+		throw std::runtime_error("lease_client::fragment() failed");
+	}
+}
+
+int lease_client::release(uuid ino)
+{
+	table.expire(ino);
+
+	lease_request request;
+	request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
+	request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
+	request.set_remote_addr(remote);
+
+	release_response response;
+
+	ClientContext context;
+
+	Status status = stub->release(&context, request, &response);
+
+	if (status.ok()) {
+		return response.ret();
+	} else {
+		std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+		throw std::runtime_error("lease_client::release() failed");
+	}
+}
+
+int lease_client::transfer(uuid ino, const std::string &new_addr)
+{
+	table.expire(ino);
+
+	transfer_request request;
+	request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
+	request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
+	request.set_remote_addr(remote);
+	request.set_new_addr(new_addr);
+
+	release_response response;
+
+	ClientContext context;
+
+	Status status = stub->transfer(&context, request, &response);
+
+	if (status.ok()) {
+		return response.ret();
+	} else {
+		std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+		throw std::runtime_error("lease_client::transfer() failed");
+	}
+}
+
+int lease_client::pin(uuid ino, const std::string &pin_addr)
+{
+	pin_request request;
+	request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
+	request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
+	request.set_pin_addr(pin_addr);
+
+	pin_response response;
+
+	ClientContext context;
+
+	Status status = stub->pin(&context, request, &response);
+
+	if (status.ok()) {
+		return response.ret();
+	} else {
+		std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+		throw std::runtime_error("lease_client::pin() failed");
+	}
+}
+
+int lease_client::get_pin(uuid ino, std::string &pin_addr)
+{
+	lease_request request;
+	request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
+	request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
+	request.set_remote_addr(remote);
+
+	pin_response response;
+
+	ClientContext context;
+
+	Status status = stub->get_pin(&context, request, &response);
+
+	if (status.ok()) {
+		pin_addr = response.pin_addr();
+		return response.ret();
 	} else {
 		std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
-		throw std::runtime_error("lease_client::acquire() failed");
+		throw std::runtime_error("lease_client::get_pin() failed");
 	}
 }
+
+bool lease_client::prelease(uuid ino)
+{
+	uint64_t prefix = uuid_controller::get_prefix_from_uuid(ino);
+	system_clock::time_point now = system_clock::now();
+	system_clock::time_point due;
+
+	std::scoped_lock lock(range_mutex);
+	auto it = ranges.find(prefix);
+	if ((it != ranges.end()) && (now < it->second.renew)) {
+		due = it->second.due;
+	} else {
+		range_request request;
+		request.set_ino_prefix(prefix);
+		request.set_remote_addr(remote);
+
+		range_response response;
+
+		ClientContext context;
+
+		Status status = stub->lease_range(&context, request, &response);
+
+		if (!status.ok()) {
+			std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+			throw std::runtime_error("lease_client::prelease() failed");
+		}
+
+		if (response.ret() != 0)
+			return false;
+
+		due = system_clock::time_point{system_clock::duration{response.due()}};
+		ranges[prefix] = {now + (due - now) / 2, due};
+	}
+
+	table.update(ino, due, true);
+	return true;
+}
+
+void lease_client::release_ranges(void)
+{
+	std::scoped_lock lock(range_mutex);
+
+	for (auto &r : ranges) {
+		range_request request;
+		request.set_ino_prefix(r.first);
+		request.set_remote_addr(remote);
+
+		release_response response;
+
+		ClientContext context;
+
+		Status status = stub->release_range(&context, request, &response);
+		if (!status.ok())
+			std::cerr << "[" << status.error_code() << "] " << status.error_message() << std::endl;
+	}
+	ranges.clear();
+}
+
+const std::string &lease_client::get_self_remote(void)
+{
+	return remote;
+}
@@ -1,26 +1,44 @@
 #ifndef _LEASE_CLIENT_HPP_
 #define _LEASE_CLIENT_HPP_
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_generators.hpp>
 #include <grpcpp/grpcpp.h>
+#include <tsl/robin_map.h>
 
 #include "lease.pb.h"
 #include "lease.grpc.pb.h"
 
 #include "lease_table_client.hpp"
 
+/* a client waiting for the readers of a directory asks again this often, recalled readers leave early */
+#define LEASE_WAIT_RETRY_MS (50)
+
 using grpc::Channel;
 using namespace boost::uuids;
 
 class lease_client {
 private:
+	struct ino_range {
+		/* renewed once half of the lease has passed, so that new directories get most of a period */
+		system_clock::time_point renew;
+		system_clock::time_point due;
+	};
+
 	std::unique_ptr<lease::Stub> stub;
 	std::string remote;
 	lease_table_client table;
 
+	/* <ino prefix, range lease> of the prefixes this client allocates from */
+	std::mutex range_mutex;
+	tsl::robin_map<uint64_t, ino_range> ranges;
+
 public:
 	/*
 	 * lease_client()
@@ -57,17 +75,121 @@ public:
 	 */
 	bool is_mine(uuid ino);
 
+	/*
+	 * get_due()
+	 *
+	 * Return the due of the lease on the ino as last heard, whoever holds it.
+	 * Return the epoch if nothing is known about the lease.
+	 */
+	system_clock::time_point get_due(uuid ino);
+
+	/*
+	 * note_remote()
+	 *
+	 * Record the due of a lease held by another client, as heard from a peer rather than from the manager.
+	 * It is ignored unless it is later than the due already known.
+	 */
+	void note_remote(uuid ino, const system_clock::time_point &due);
+
 	/*
 	 * acquire()
 	 *
 	 * On success
 	 * - Return 0
+	 * - Return 1 if 'shared' and a shared lease is granted, other readers may cache the directory too
 	 *
 	 * On failure
 	 * - Return -1
 	 * - 'remote_addr' is changed to the address of the directory leader'
+	 *
+	 * The exclusive lease waits until the shared leases of the other clients expire.
 	 */
 	int acquire(uuid ino, std::string &remote_addr);
+	/*
+	 * 'frag_depth' is set to the fragmentation depth of the directory
+	 * 'parent_ino' is the directory holding it, the pin of the parent is inherited through it
+	 */
+	int acquire(uuid ino, std::string &remote_addr, uint32_t &frag_depth, bool shared = false, const uuid &parent_ino = nil_uuid());
+
+	/*
+	 * fragment()
+	 *
+	 * Ask the manager to split the directory into 2^frag_depth fragments.
+	 * The caller must be the leader of the directory.
+	 *
+	 * On success
+	 * - Return 0
+	 *
+	 * On failure
+	 * - Return -1
+	 * - 'frag_depth' is changed to the current depth
+	 */
+	int fragment(uuid ino, uint32_t &frag_depth);
+
+	/*
+	 * release()
+	 *
+	 * Give up the lease of a directory whose journal is checkpointed.
+	 * The lease is forgotten locally even if the manager refuses it.
+	 *
+	 * On success
+	 * - Return 0
+	 *
+	 * On failure (this client holds no lease)
+	 * - Return -1
+	 */
+	int release(uuid ino);
+
+	/*
+	 * transfer()
+	 *
+	 * Hand the lease of a directory whose journal is checkpointed over to 'new_addr'.
+	 * The lease is forgotten locally even if the manager refuses it.
+	 *
+	 * On success
+	 * - Return 0
+	 *
+	 * On failure (this client isn't the leader)
+	 * - Return -1
+	 */
+	int transfer(uuid ino, const std::string &new_addr);
+
+	/*
+	 * pin()
+	 *
+	 * Pin the leases of the directory subtree to 'pin_addr', an empty address unpins it.
+	 *
+	 * Return 0
+	 * Return -1 if the directory is to be unpinned but the pin is set on a directory above it, or nowhere
+	 */
+	int pin(uuid ino, const std::string &pin_addr);
+
+	/*
+	 * get_pin()
+	 *
+	 * 'pin_addr' is set to the client the directory is pinned to, inherited pins included.
+	 * It is empty if the directory isn't pinned.
+	 *
+	 * Return 0
+	 */
+	int get_pin(uuid ino, std::string &pin_addr);
+
+	/*
+	 * prelease()
+	 *
+	 * Lead the new directory 'ino' under the range lease of its ino prefix.
+	 * The range is leased or renewed here when needed, which is once in a while per prefix.
+	 *
+	 * Return true if this client leads the directory now
+	 * Otherwise return false, the directory has to be acquired
+	 */
+	bool prelease(uuid ino);
+
+	/* give up the range leases on unmount */
+	void release_ranges(void);
+
+	/* the remote server address of this client */
+	const std::string &get_self_remote(void);
 };
 
 #endif /* _LEASE_CLIENT_HPP_ */
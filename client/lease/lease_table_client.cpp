@@ -28,10 +28,16 @@ std::tuple<system_clock::time_point, bool> lease_table_client::lease_entry::get_
 void lease_table_client::lease_entry::set_info(const system_clock::time_point &new_due, bool mine)
 {
 	std::unique_lock lock(sm);
-	if (new_due > due) {
-		due = new_due;
-		leader = mine;
-	}
+	/* the manager has the last word, a shared lease may end earlier than the lease it replaces */
+	due = new_due;
+	leader = mine;
+}
+
+void lease_table_client::lease_entry::expire(void)
+{
+	std::unique_lock lock(sm);
+	due = system_clock::time_point::min();
+	leader = false;
 }
 
 lease_table_client::~lease_table_client(void)
@@ -90,6 +96,21 @@ bool lease_table_client::is_mine(uuid ino)
 	return mine && (system_clock::now() < latest_due);
 }
 
+system_clock::time_point lease_table_client::get_due(uuid ino)
+{
+	lease_entry *e;
+
+	{
+		std::shared_lock lock(sm);
+		auto it = map.find(ino);
+		if (it == map.end())
+			return system_clock::time_point{};
+		e = it->second;
+	}
+
+	return e->get_due();
+}
+
 void lease_table_client::update(uuid ino, const system_clock::time_point &new_due, bool mine)
 {
 	global_logger.log(lease_ops, "Called update(" + to_string(ino) + ")");
@@ -122,3 +143,19 @@ void lease_table_client::update(uuid ino, const system_clock::time_point &new_du
 		}
 	}
 }
+
+void lease_table_client::expire(uuid ino)
+{
+	global_logger.log(lease_ops, "Called expire(" + to_string(ino) + ")");
+	lease_entry *e;
+
+	{
+		std::shared_lock lock(sm);
+		auto it = map.find(ino);
+		if (it == map.end())
+			return;
+		e = it->second;
+	}
+
+	e->expire();
+}
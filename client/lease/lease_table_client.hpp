@@ -34,6 +34,7 @@ private:
 		system_clock::time_point get_due(void);
 		std::tuple<system_clock::time_point, bool> get_info(void);
 		void set_info(const system_clock::time_point &new_due, bool mine);
+		void expire(void);
 	};
 
 	std::shared_mutex sm;
@@ -45,7 +46,11 @@ public:
 
 	bool is_valid(uuid ino);
 	bool is_mine(uuid ino);
+	/* the epoch if the lease of 'ino' isn't known */
+	system_clock::time_point get_due(uuid ino);
 	void update(uuid ino, const system_clock::time_point &new_due, bool mine);
+	/* forget a lease given up by this client */
+	void expire(uuid ino);
 };
 
 #endif /* _LEASE_TABLE_CLIENT_HPP_ */
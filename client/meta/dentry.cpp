@@ -1,118 +1,636 @@
 #include "dentry.hpp"
 
+#include <algorithm>
+
 extern std::shared_ptr<rados_io> meta_pool;
 
-dentry::dentry(uuid ino, bool mkdir) : this_ino(ino)
+dentry_view::dentry_view() : entries(nullptr), child_num(0), embedded(false), sorted_offsets(nullptr)
+{
+}
+
+bool dentry_view::parse(const char *raw, size_t len)
+{
+	if(len < sizeof(size_t))
+		throw std::runtime_error("Dentry Corrupted: too short dentry object");
+
+	const char *pointer = raw;
+	size_t header;
+	memcpy(&header, pointer, sizeof(size_t));
+	pointer += sizeof(size_t);
+
+	if(header & (DENTRY_SHARDED_FLAG | DENTRY_FRAGMENTED_FLAG))
+		return false;
+
+	this->embedded = (header & DENTRY_EMBEDDED_FLAG) != 0;
+	this->child_num = header & ~(DENTRY_EMBEDDED_FLAG | DENTRY_SORTED_FLAG);
+
+	if(header & DENTRY_SORTED_FLAG) {
+		uint32_t version;
+		memcpy(&version, pointer, sizeof(uint32_t));
+		pointer += sizeof(uint32_t);
+		if(version != DENTRY_FORMAT_VERSION)
+			throw std::runtime_error("Dentry Corrupted: unknown format version " + std::to_string(version));
+
+		this->sorted_offsets = pointer;
+		this->entries = pointer + this->child_num * sizeof(uint32_t);
+		return true;
+	}
+
+	/* unsorted objects of older clients are indexed here */
+	this->entries = pointer;
+	this->legacy_offsets.reserve(this->child_num);
+	for(uint64_t i = 0; i < this->child_num; i++) {
+		this->legacy_offsets.push_back(static_cast<uint32_t>(pointer - this->entries));
+
+		int name_length;
+		memcpy(&name_length, pointer, sizeof(int));
+		pointer += sizeof(int) + name_length + sizeof(uuid);
+
+		if(this->embedded) {
+			uint32_t inode_length;
+			memcpy(&inode_length, pointer, sizeof(uint32_t));
+			pointer += sizeof(uint32_t) + inode_length;
+		}
+	}
+
+	return true;
+}
+
+uint32_t dentry_view::get_offset(uint64_t index) const
+{
+	if(this->sorted_offsets == nullptr)
+		return this->legacy_offsets[index];
+
+	uint32_t offset;
+	memcpy(&offset, this->sorted_offsets + index * sizeof(uint32_t), sizeof(uint32_t));
+	return offset;
+}
+
+uint64_t dentry_view::size() const
+{
+	return this->child_num;
+}
+
+dentry_view::entry dentry_view::get(uint64_t index) const
+{
+	const char *pointer = this->entries + this->get_offset(index);
+	entry e{};
+
+	int name_length;
+	memcpy(&name_length, pointer, sizeof(int));
+	pointer += sizeof(int);
+
+	e.name = std::string_view(pointer, static_cast<size_t>(name_length));
+	pointer += name_length;
+
+	memcpy(&(e.ino), pointer, sizeof(uuid));
+	pointer += sizeof(uuid);
+
+	e.inode = nullptr;
+	e.inode_len = 0;
+	if(this->embedded) {
+		memcpy(&(e.inode_len), pointer, sizeof(uint32_t));
+		pointer += sizeof(uint32_t);
+		if(e.inode_len > 0)
+			e.inode = pointer;
+	}
+
+	return e;
+}
+
+bool dentry_view::find(std::string_view name, entry &e) const
+{
+	if(this->sorted_offsets == nullptr) {
+		for(uint64_t i = 0; i < this->child_num; i++) {
+			e = this->get(i);
+			if(e.name == name)
+				return true;
+		}
+		return false;
+	}
+
+	uint64_t low = 0, high = this->child_num;
+	while(low < high) {
+		uint64_t mid = low + (high - low) / 2;
+		e = this->get(mid);
+		int cmp = e.name.compare(name);
+		if(cmp == 0)
+			return true;
+		if(cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return false;
+}
+
+void dentry_view::for_each(const std::function<void(const entry &)> &visit) const
+{
+	for(uint64_t i = 0; i < this->child_num; i++)
+		visit(this->get(i));
+}
+
+dentry::dentry(uuid ino, bool mkdir, bool lazy) : this_ino(ino), sharded(false), root_dirty(false), shards_embedded(false), frag_depth(0)
 {
 	if(mkdir){
 		global_logger.log(dentry_ops, "Called dentry(" + uuid_to_string(ino) +") from mkdir");
 	} else {
 		global_logger.log(dentry_ops, "Called dentry(" + uuid_to_string(ino) +")");
-		unique_ptr<char[]> raw_data = std::make_unique<char[]>(MAX_DENTRY_OBJ_SIZE);
+		librados::bufferlist bl;
 		try {
-			meta_pool->read(obj_category::DENTRY, uuid_to_string(ino), raw_data.get(), MAX_DENTRY_OBJ_SIZE, 0);
-			this->deserialize(raw_data.get());
+			size_t len = meta_pool->read_head(obj_category::DENTRY, uuid_to_string(ino), bl);
+			this->deserialize(bl.c_str(), len);
 		} catch(rados_io::no_such_object &e){
 			throw std::runtime_error("Dentry Corrupted: inode number " + uuid_to_string(ino));
 		}
+
+		if(this->sharded && !lazy)
+			this->load_all();
 	}
 }
 
+std::string dentry::get_shard_key(uint64_t id) const
+{
+	return uuid_to_string(this->this_ino) + ":" + std::to_string(::get_frag_depth(id)) + ":" + std::to_string(get_frag_bits(id));
+}
+
+uint64_t dentry::find_shard(const std::string &name) const
+{
+	for(uint64_t depth = 0; depth <= FRAG_MAX_DEPTH; depth++){
+		uint64_t id = get_frag_id_of(name, depth);
+		if(this->shards.find(id) != this->shards.end())
+			return id;
+	}
+
+	throw std::runtime_error("Dentry Corrupted: no shard covers " + name + " in " + uuid_to_string(this->this_ino));
+}
+
+void dentry::load_shards(const std::vector<uint64_t> &ids)
+{
+	global_logger.log(dentry_ops, "Called dentry.load_shards(" + std::to_string(ids.size()) + ")");
+
+	std::vector<std::string> keys;
+	keys.reserve(ids.size());
+	for(uint64_t id : ids)
+		keys.push_back(this->get_shard_key(id));
+
+	meta_pool->read_window(obj_category::DENTRY, keys, 0, DENTRY_SHARD_WINDOW_DEPTH,
+			       [this, &ids, &keys](size_t index, const char *raw, int len) {
+		if(len < 0)
+			throw std::runtime_error("Dentry Corrupted: missing shard " + keys[index]);
+
+		this->deserialize(raw, static_cast<size_t>(len));
+		this->shards[ids[index]].loaded = true;
+	});
+}
+
+void dentry::load_shard_of(const std::string &name)
+{
+	if(!this->sharded)
+		return;
+
+	uint64_t id = this->find_shard(name);
+	if(!this->shards[id].loaded)
+		this->load_shards({id});
+}
+
+void dentry::load_all()
+{
+	std::vector<uint64_t> ids;
+	for(auto & it : this->shards){
+		if(!it.second.loaded)
+			ids.push_back(it.first);
+	}
+
+	if(!ids.empty())
+		this->load_shards(ids);
+}
+
+std::vector<std::shared_ptr<dentry>> dentry::fragment(uint32_t depth)
+{
+	global_logger.log(dentry_ops, "Called dentry.fragment(" + std::to_string(depth) + ")");
+	this->load_all();
+
+	std::vector<std::shared_ptr<dentry>> frags;
+	for(uint64_t bits = 0; bits < (1ULL << depth); bits++)
+		frags.push_back(std::make_shared<dentry>(get_frag_ino(this->this_ino, make_frag_id(depth, bits)), true));
+
+	for(auto & it : this->child_list){
+		std::shared_ptr<dentry> &f = frags[get_frag_bits(get_frag_id_of(it.first, depth))];
+		f->child_list.insert({it.first, it.second});
+
+		auto e = this->embedded_inodes.find(it.second);
+		if(e != this->embedded_inodes.end())
+			f->embedded_inodes.insert({it.second, e->second});
+	}
+
+	/* the shards are removed once the dentry object stops listing them */
+	for(auto & it : this->shards)
+		this->retired_shards.push_back(it.first);
+	this->shards.clear();
+	this->sharded = false;
+	this->child_list.clear();
+	this->embedded_inodes.clear();
+	this->frag_depth = depth;
+
+	return frags;
+}
+
+uint32_t dentry::get_frag_depth() const
+{
+	return this->frag_depth;
+}
+
+void dentry::mark_dirty(const std::string &name)
+{
+	if(this->sharded)
+		this->shards[this->find_shard(name)].dirty = true;
+}
+
 void dentry::add_child(const std::string &filename, uuid ino){
 	global_logger.log(dentry_ops, "Called dentry.add_child()");
 	global_logger.log(dentry_ops, "file : " + filename + " inode number : " + uuid_to_string(ino));
 
+	this->load_shard_of(filename);
 	auto ret = this->child_list.insert(std::make_pair(filename, ino));
 	if(!ret.second) {
 		global_logger.log(dentry_ops, "Replace file with new ino");
 		ret.first.value() = ino;
 	}
+	this->mark_dirty(filename);
 }
 
 void dentry::delete_child(const std::string &filename) {
 	global_logger.log(dentry_ops, "Called dentry.delete_child()");
 	global_logger.log(dentry_ops, "file : " + filename);
 
+	this->load_shard_of(filename);
 	auto it = this->child_list.find(filename);
 	if(it != this->child_list.end()) {
 		this->child_list.erase(it);
+		this->mark_dirty(filename);
 	} else {
 		global_logger.log(dentry_ops, "delete_child called for nonexistent file");
 	}
 }
 
-unique_ptr<char[]> dentry::serialize()
+void dentry::embed_child_inodes(tsl::robin_map<uuid, inode *, boost::hash<uuid>> &candidates)
 {
-	global_logger.log(dentry_ops, "Called dentry.serialize()");
-	size_t child_num = this->child_list.size();
-	size_t raw_size = sizeof(size_t) + (child_num) * sizeof(int) + (this->get_total_name_length()) + (child_num)*sizeof(uuid);
-	unique_ptr<char[]> raw = std::make_unique<char[]>(raw_size + 1);
-	char *pointer = raw.get();
+	global_logger.log(dentry_ops, "Called dentry.embed_child_inodes()");
 
-	memcpy(pointer, &(child_num), sizeof(size_t));
-	pointer += sizeof(size_t);
+	for(auto & it : this->child_list){
+		auto c = candidates.find(it.second);
+		if(c == candidates.end())
+			continue;
+
+		auto ret = this->embedded_inodes.insert({it.second, {}});
+		ret.first.value() = c->second->serialize();
+		candidates.erase(c);
+		this->mark_dirty(it.first);
+	}
+}
+
+bool dentry::drop_embedded_inode(const uuid &ino)
+{
+	if(this->embedded_inodes.erase(ino) == 0)
+		return false;
+	if(!this->sharded)
+		return true;
 
 	for(auto & it : this->child_list){
+		if(it.second == ino)
+			this->mark_dirty(it.first);
+	}
+	return true;
+}
+
+void dentry::load_shards_linking(const tsl::robin_map<uuid, inode *, boost::hash<uuid>> &inos, bool embedding)
+{
+	if(!this->sharded || inos.empty() || (!embedding && !this->shards_embedded))
+		return;
+
+	size_t linked = 0;
+	for(auto & it : this->child_list){
+		if(inos.find(it.second) != inos.end())
+			linked++;
+	}
+
+	if(linked < inos.size())
+		this->load_all();
+}
+
+size_t dentry::get_entry_size(const dentry_entry &entry) const
+{
+	/* with its slot in the offset index */
+	size_t entry_size = sizeof(uint32_t) + sizeof(int) + entry.first.size() + sizeof(uuid);
+
+	auto e = this->embedded_inodes.find(entry.second);
+	if(e != this->embedded_inodes.end())
+		entry_size += e->second.size();
+
+	return entry_size;
+}
+
+std::vector<char> dentry::serialize_entries(std::vector<const dentry_entry *> &entries) const
+{
+	std::sort(entries.begin(), entries.end(), [](const dentry_entry *a, const dentry_entry *b) {
+		return std::string_view(a->first) < std::string_view(b->first);
+	});
+
+	size_t child_num = entries.size();
+	size_t raw_size = sizeof(size_t) + sizeof(uint32_t);
+	bool embedded = false;
+	for(auto entry : entries){
+		raw_size += this->get_entry_size(*entry);
+		if(this->embedded_inodes.find(entry->second) != this->embedded_inodes.end())
+			embedded = true;
+	}
+	if(embedded)
+		raw_size += child_num * sizeof(uint32_t);
+
+	std::vector<char> raw(raw_size);
+	char *pointer = raw.data();
+
+	size_t header = (embedded ? (child_num | DENTRY_EMBEDDED_FLAG) : child_num) | DENTRY_SORTED_FLAG;
+	memcpy(pointer, &(header), sizeof(size_t));
+	pointer += sizeof(size_t);
+
+	uint32_t version = DENTRY_FORMAT_VERSION;
+	memcpy(pointer, &(version), sizeof(uint32_t));
+	pointer += sizeof(uint32_t);
+
+	char *offsets = pointer;
+	pointer += child_num * sizeof(uint32_t);
+	const char *entries_start = pointer;
+
+	for(auto entry : entries){
+		uint32_t offset = static_cast<uint32_t>(pointer - entries_start);
+		memcpy(offsets, &(offset), sizeof(uint32_t));
+		offsets += sizeof(uint32_t);
+
 		/* serialiize name length */
-		int name_length = static_cast<int>(it.first.length());
+		int name_length = static_cast<int>(entry->first.length());
 		memcpy(pointer, &(name_length), sizeof(int));
 		pointer += sizeof(int);
 
 		/* serialize name */
-		memcpy(pointer, it.first.data(), static_cast<size_t>(name_length));
+		memcpy(pointer, entry->first.data(), static_cast<size_t>(name_length));
 		pointer += name_length;
 
 		/* serialize ino */
-		memcpy(pointer, &(it.second), sizeof(uuid));
+		memcpy(pointer, &(entry->second), sizeof(uuid));
 		pointer += sizeof(uuid);
+
+		if(!embedded)
+			continue;
+
+		/* serialize embedded inode, zero length if the inode has its own object */
+		auto e = this->embedded_inodes.find(entry->second);
+		uint32_t inode_length = (e != this->embedded_inodes.end()) ? static_cast<uint32_t>(e->second.size()) : 0;
+		memcpy(pointer, &(inode_length), sizeof(uint32_t));
+		pointer += sizeof(uint32_t);
+		if(inode_length > 0) {
+			memcpy(pointer, e->second.data(), inode_length);
+			pointer += inode_length;
+		}
+	}
+
+	return raw;
+}
+
+std::vector<char> dentry::serialize()
+{
+	global_logger.log(dentry_ops, "Called dentry.serialize()");
+
+	if(this->frag_depth > 0) {
+		std::vector<char> raw(sizeof(size_t) + sizeof(uint32_t));
+		size_t header = DENTRY_FRAGMENTED_FLAG;
+		memcpy(raw.data(), &(header), sizeof(size_t));
+		memcpy(raw.data() + sizeof(size_t), &(this->frag_depth), sizeof(uint32_t));
+		return raw;
+	}
+
+	if(!this->sharded) {
+		std::vector<const dentry_entry *> entries;
+		entries.reserve(this->child_list.size());
+		for(auto & it : this->child_list)
+			entries.push_back(&it);
+
+		return this->serialize_entries(entries);
+	}
+
+	/* the dentry object of a sharded directory only lists the shards */
+	std::vector<char> raw(sizeof(size_t) + sizeof(uint32_t) + this->shards.size() * sizeof(uint64_t));
+	char *pointer = raw.data();
+
+	size_t header = DENTRY_SHARDED_FLAG | (this->shards_embedded ? DENTRY_EMBEDDED_FLAG : 0);
+	memcpy(pointer, &(header), sizeof(size_t));
+	pointer += sizeof(size_t);
+
+	uint32_t shard_num = static_cast<uint32_t>(this->shards.size());
+	memcpy(pointer, &(shard_num), sizeof(uint32_t));
+	pointer += sizeof(uint32_t);
+
+	for(auto & it : this->shards){
+		memcpy(pointer, &(it.first), sizeof(uint64_t));
+		pointer += sizeof(uint64_t);
 	}
 
 	return raw;
 }
 
-void dentry::deserialize(char *raw)
+void dentry::deserialize(const char *raw, size_t len)
 {
 	global_logger.log(dentry_ops, "Called dentry.deserialize()");
 
-	char *pointer = raw;
+	const char *pointer = raw;
 	size_t child_num;
 	memcpy(&(child_num), pointer, sizeof(size_t));
 	pointer = pointer + sizeof(size_t);
 
-	global_logger.log(dentry_ops, "dentry child num : " + std::to_string(child_num));
+	bool embedded = (child_num & DENTRY_EMBEDDED_FLAG) != 0;
 
-	for(int i = 0; i < child_num; i++){
-		int name_length;
-		memcpy(&name_length, pointer, sizeof(int));
-		pointer += sizeof(int);
+	if(child_num & DENTRY_FRAGMENTED_FLAG) {
+		memcpy(&(this->frag_depth), pointer, sizeof(uint32_t));
+		global_logger.log(dentry_ops, "dentry frag depth : " + std::to_string(this->frag_depth));
+		return;
+	}
 
-		unique_ptr<char[]> name = std::make_unique<char[]>(static_cast<size_t>(name_length) + 1);
-		memcpy(name.get(), pointer, static_cast<size_t>(name_length));
-		pointer += name_length;
+	if(child_num & DENTRY_SHARDED_FLAG) {
+		uint32_t shard_num;
+		memcpy(&(shard_num), pointer, sizeof(uint32_t));
+		pointer += sizeof(uint32_t);
 
-		uuid ino{};
-		memcpy(&ino, pointer, sizeof(uuid));
-		pointer += sizeof(uuid);
+		for(uint32_t i = 0; i < shard_num; i++){
+			uint64_t id;
+			memcpy(&id, pointer, sizeof(uint64_t));
+			pointer += sizeof(uint64_t);
+			this->shards.insert({id, {false, false}});
+		}
 
-		this->child_list.insert(std::pair<std::string, uuid>(name.get(), ino));
-		global_logger.log(dentry_ops, "name_length : " + std::to_string(name_length) + "child name : " + std::string(name.get()) + " child ino : " + uuid_to_string(ino));
+		this->sharded = true;
+		this->shards_embedded = embedded;
+		global_logger.log(dentry_ops, "dentry shard num : " + std::to_string(shard_num));
+		return;
 	}
 
+	dentry_view view;
+	view.parse(raw, len);
+	global_logger.log(dentry_ops, "dentry child num : " + std::to_string(view.size()));
+
+	this->child_list.reserve(this->child_list.size() + view.size());
+	view.for_each([this](const dentry_view::entry &e) {
+		this->child_list.insert({std::string(e.name), e.ino});
+		if(e.inode != nullptr)
+			this->embedded_inodes.insert({e.ino, std::vector<char>(e.inode, e.inode + e.inode_len)});
+	});
+}
+
+void dentry::split_shards()
+{
+	bool split = true;
+
+	while(split) {
+		split = false;
+
+		tsl::robin_map<uint64_t, size_t> shard_size;
+		for(auto & it : this->child_list){
+			uint64_t id = this->find_shard(it.first);
+			if(this->shards[id].dirty)
+				shard_size[id] += this->get_entry_size(it);
+		}
+
+		for(auto & it : shard_size){
+			uint64_t depth = ::get_frag_depth(it.first);
+			if(it.second <= DENTRY_SHARD_SPLIT_SIZE || depth == FRAG_MAX_DEPTH)
+				continue;
+
+			uint64_t bits = get_frag_bits(it.first);
+			this->shards.erase(it.first);
+			this->shards.insert({make_frag_id(depth + 1, bits), {true, true}});
+			this->shards.insert({make_frag_id(depth + 1, bits | (1ULL << depth)), {true, true}});
+			this->retired_shards.push_back(it.first);
+			this->root_dirty = true;
+			split = true;
+		}
+	}
+}
+
+void dentry::sync_shards()
+{
+	this->split_shards();
+
+	tsl::robin_map<uint64_t, std::vector<const dentry_entry *>> entries;
+	for(auto & it : this->shards){
+		if(it.second.dirty)
+			entries[it.first];
+	}
+	for(auto & it : this->child_list){
+		auto e = entries.find(this->find_shard(it.first));
+		if(e != entries.end())
+			e.value().push_back(&it);
+	}
+
+	std::vector<std::string> keys;
+	std::vector<std::vector<char>> values;
+	for(auto it = entries.begin(); it != entries.end(); it++){
+		keys.push_back(this->get_shard_key(it->first));
+		values.push_back(this->serialize_entries(it.value()));
+
+		size_t header;
+		memcpy(&header, values.back().data(), sizeof(size_t));
+		if((header & DENTRY_EMBEDDED_FLAG) && !this->shards_embedded) {
+			this->shards_embedded = true;
+			this->root_dirty = true;
+		}
+	}
+
+	/* shards first, the dentry object must never list a shard which isn't written yet */
+	meta_pool->write_window(obj_category::DENTRY, keys, values, DENTRY_SHARD_WINDOW_DEPTH);
+	if(this->root_dirty) {
+		std::vector<char> raw = this->serialize();
+		meta_pool->write(obj_category::DENTRY, uuid_to_string(this->this_ino), raw.data(), raw.size(), 0);
+	}
+
+	for(uint64_t id : this->retired_shards)
+		meta_pool->remove(obj_category::DENTRY, this->get_shard_key(id));
+
+	for(auto it = this->shards.begin(); it != this->shards.end(); it++)
+		it.value().dirty = false;
+	this->retired_shards.clear();
+	this->root_dirty = false;
 }
 
 void dentry::sync()
 {
 	global_logger.log(dentry_ops,"Called dentry.sync()");
-	size_t child_num = this->child_list.size();
-	size_t raw_size = sizeof(size_t) + (child_num) * sizeof(int) + (this->get_total_name_length()) + (child_num)*sizeof(uuid);
-	unique_ptr<char[]> raw = this->serialize();
-	meta_pool->write(obj_category::DENTRY, uuid_to_string(this->this_ino), raw.get(), raw_size, 0);
+
+	/* names journaled here before the directory was fragmented already live in the fragments */
+	if(this->frag_depth > 0) {
+		std::vector<char> raw = this->serialize();
+		meta_pool->write(obj_category::DENTRY, uuid_to_string(this->this_ino), raw.data(), raw.size(), 0);
+
+		for(uint64_t id : this->retired_shards)
+			meta_pool->remove(obj_category::DENTRY, this->get_shard_key(id));
+		this->retired_shards.clear();
+		return;
+	}
+
+	if(!this->sharded) {
+		size_t raw_size = this->get_raw_size();
+		if(raw_size <= DENTRY_SHARD_SPLIT_SIZE) {
+			std::vector<char> raw = this->serialize();
+			meta_pool->write(obj_category::DENTRY, uuid_to_string(this->this_ino), raw.data(), raw.size(), 0);
+			return;
+		}
+
+		/* the directory outgrew a single object, continue as one shard covering every name and split it */
+		global_logger.log(dentry_ops, "dentry " + uuid_to_string(this->this_ino) + " is sharded");
+		this->sharded = true;
+		this->root_dirty = true;
+		this->shards.insert({make_frag_id(0, 0), {true, true}});
+	}
+
+	this->sync_shards();
 }
 
-uuid dentry::get_child_ino(const std::string& child_name) const
+void dentry::remove()
+{
+	global_logger.log(dentry_ops,"Called dentry.remove()");
+
+	for(uint64_t bits = 0; this->frag_depth > 0 && bits < (1ULL << this->frag_depth); bits++){
+		uuid frag_ino = get_frag_ino(this->this_ino, make_frag_id(this->frag_depth, bits));
+		if(meta_pool->exist(obj_category::DENTRY, uuid_to_string(frag_ino))) {
+			dentry f(frag_ino, false, true);
+			f.remove();
+		}
+	}
+
+	for(auto & it : this->shards)
+		meta_pool->remove(obj_category::DENTRY, this->get_shard_key(it.first));
+	meta_pool->remove(obj_category::DENTRY, uuid_to_string(this->this_ino));
+}
+
+uuid dentry::get_child_ino(const std::string& child_name)
 {
 	global_logger.log(dentry_ops, "Called dentry.get_child_ino(" + child_name + ")");
 
+	/* a shard not loaded yet is searched in its buffer instead of being loaded */
+	if(this->sharded) {
+		uint64_t id = this->find_shard(child_name);
+		if(!this->shards[id].loaded) {
+			librados::bufferlist bl;
+			size_t len = meta_pool->read_head(obj_category::DENTRY, this->get_shard_key(id), bl);
+
+			dentry_view view;
+			dentry_view::entry e{};
+			if(view.parse(bl.c_str(), len) && view.find(child_name, e))
+				return e.ino;
+			return nil_uuid();
+		}
+	}
+
 	auto ret = child_list.find(child_name);
 	if(ret == child_list.end())
 		return nil_uuid();
@@ -120,12 +638,45 @@ uuid dentry::get_child_ino(const std::string& child_name) const
 		return ret->second;
 }
 
-void dentry::fill_filler(void *buffer, fuse_fill_dir_t filler) const
+uint32_t dentry::scan(uuid ino, const std::function<void(const dentry_view::entry &)> &visit)
 {
-	filler(buffer, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
-	filler(buffer, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
-	for (auto & it : this->child_list)
-		filler(buffer, it.first.c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+	global_logger.log(dentry_ops, "Called dentry::scan(" + uuid_to_string(ino) + ")");
+
+	librados::bufferlist bl;
+	size_t len;
+	try {
+		len = meta_pool->read_head(obj_category::DENTRY, uuid_to_string(ino), bl);
+	} catch(rados_io::no_such_object &e){
+		throw std::runtime_error("Dentry Corrupted: inode number " + uuid_to_string(ino));
+	}
+
+	dentry_view view;
+	if(view.parse(bl.c_str(), len)) {
+		view.for_each(visit);
+		return 0;
+	}
+
+	/* only the shard list or the fragmentation depth is read into this dentry */
+	dentry root(ino, true);
+	root.deserialize(bl.c_str(), len);
+	if(root.frag_depth > 0)
+		return root.frag_depth;
+
+	std::vector<std::string> keys;
+	for(auto & it : root.shards)
+		keys.push_back(root.get_shard_key(it.first));
+
+	meta_pool->read_window(obj_category::DENTRY, keys, 0, DENTRY_SHARD_WINDOW_DEPTH,
+			       [&keys, &visit](size_t index, const char *raw, int raw_len) {
+		if(raw_len < 0)
+			throw std::runtime_error("Dentry Corrupted: missing shard " + keys[index]);
+
+		dentry_view shard_view;
+		shard_view.parse(raw, static_cast<size_t>(raw_len));
+		shard_view.for_each(visit);
+	});
+
+	return 0;
 }
 
 uint64_t dentry::get_child_num() const
@@ -143,3 +694,21 @@ uint64_t dentry::get_total_name_length() const
 
 	return total_name_length;
 }
+
+size_t dentry::get_raw_size() const
+{
+	size_t child_num = this->child_list.size();
+	size_t raw_size = sizeof(size_t) + sizeof(uint32_t);
+	bool embedded = false;
+
+	for(auto& ret : this->child_list){
+		raw_size += this->get_entry_size(ret);
+		if(this->embedded_inodes.find(ret.second) != this->embedded_inodes.end())
+			embedded = true;
+	}
+
+	if(embedded)
+		raw_size += child_num * sizeof(uint32_t);
+
+	return raw_size;
+}
@@ -1,46 +1,162 @@
 #ifndef NMFS0_DENTRY_HPP
 #define NMFS0_DENTRY_HPP
 
+#include <functional>
 #include <map>
 #include <mutex>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include <boost/functional/hash.hpp>
 #include <tsl/robin_map.h>
 
 #include "lib/logger/logger.hpp"
 #include "lib/rados_io/rados_io.hpp"
+#include "util/frag.hpp"
 
 #include "inode.hpp"
 #include "../fs_ops/fuse_ops.hpp"
 
-#define MAX_DENTRY_OBJ_SIZE OBJ_SIZE
+/* set in the child number field when every entry carries an (optionally empty) embedded inode */
+#define DENTRY_EMBEDDED_FLAG (1ULL << 63)
+/* set in the child number field of the dentry object when the entries live in shard objects */
+#define DENTRY_SHARDED_FLAG (1ULL << 62)
+/* set in the child number field of the dentry object when the entries live in directory fragments */
+#define DENTRY_FRAGMENTED_FLAG (1ULL << 61)
+/* set in the child number field when a format version and an offset index follow it and the entries are sorted by name */
+#define DENTRY_SORTED_FLAG (1ULL << 60)
+#define DENTRY_FORMAT_VERSION (1)
+
+/* a directory object or shard is split in two once its serialized size exceeds this */
+#define DENTRY_SHARD_SPLIT_SIZE (1UL << 20)
+#define DENTRY_SHARD_WINDOW_DEPTH (16)
 
 using std::unique_ptr;
 using namespace boost::uuids;
 
 class dentry_table;
 
-/*TODO : when total dentries size exceed single object size */
+/*
+ * Read-only view over a serialized object holding entries, either a whole dentry object or a shard.
+ * The sorted format is binary searched through its offset index,
+ * objects written before it are indexed on parse() and searched linearly.
+ * The view doesn't own the buffer.
+ */
+class dentry_view {
+public:
+	struct entry {
+		std::string_view name;
+		uuid ino;
+		/* the embedded inode, nullptr if the inode has its own object */
+		const char *inode;
+		uint32_t inode_len;
+	};
+
+private:
+	const char *entries;
+	uint64_t child_num;
+	bool embedded;
+	/* the offset index of the object, unaligned */
+	const char *sorted_offsets;
+	std::vector<uint32_t> legacy_offsets;
+
+	uint32_t get_offset(uint64_t index) const;
+
+public:
+	dentry_view();
+
+	/* false if the object lists shards or fragments instead of entries */
+	bool parse(const char *raw, size_t len);
+
+	uint64_t size() const;
+	entry get(uint64_t index) const;
+	bool find(std::string_view name, entry &e) const;
+	void for_each(const std::function<void(const entry &)> &visit) const;
+};
+
+/*
+ * A directory starts as a single dentry object.
+ * Once it outgrows DENTRY_SHARD_SPLIT_SIZE, the entries move to shard objects partitioned by the hash of the name
+ * and the dentry object only lists the shards.
+ * Shard (depth, bits) holds the names whose hash ends with the lowest 'depth' bits of 'bits',
+ * and is split into (depth + 1, bits) and (depth + 1, bits | 1 << depth) when it outgrows the threshold again.
+ * A fragmented directory keeps only its fragmentation depth, each fragment is a dentry of its own keyed by get_frag_ino().
+ */
 class dentry {
 private:
+	using dentry_entry = tsl::robin_map<std::string, uuid>::value_type;
+
+	struct shard {
+		bool loaded;
+		bool dirty;
+	};
+
 	uuid this_ino;
+	/* entries of the loaded shards, every entry unless the dentry is constructed lazily */
 	tsl::robin_map<std::string, uuid> child_list;
+	/* serialized inodes of regular files stored inside this object, entries of unlinked inos are dropped on serialize() */
+	tsl::robin_map<uuid, std::vector<char>, boost::hash<uuid>> embedded_inodes;
+
+	bool sharded;
+	bool root_dirty;
+	/* some shard may carry embedded inodes */
+	bool shards_embedded;
+	tsl::robin_map<uint64_t, shard> shards;
+	/* shards replaced by a split, removed once the dentry object lists their children */
+	std::vector<uint64_t> retired_shards;
+	uint32_t frag_depth;
+
+	std::string get_shard_key(uint64_t id) const;
+	uint64_t find_shard(const std::string &name) const;
+
+	void load_shards(const std::vector<uint64_t> &ids);
+	void load_shard_of(const std::string &name);
+	void mark_dirty(const std::string &name);
+	void split_shards();
+	size_t get_entry_size(const dentry_entry &entry) const;
+	/* sorts 'entries' by name */
+	std::vector<char> serialize_entries(std::vector<const dentry_entry *> &entries) const;
+	void sync_shards();
 
 public:
-	explicit dentry(uuid ino, bool mkdir = false);
+	/* a lazy dentry reads a shard only when one of its names is touched */
+	explicit dentry(uuid ino, bool mkdir = false, bool lazy = false);
 
 	void add_child(const std::string &filename, uuid ino);
 	void delete_child(const std::string &filename);
 
-	unique_ptr<char[]> serialize();
-	void deserialize(char *raw);
+	/* embeds the candidates linked in this directory and removes them from 'candidates' */
+	void embed_child_inodes(tsl::robin_map<uuid, inode *, boost::hash<uuid>> &candidates);
+	/* false if no embedded copy of 'ino' was held */
+	bool drop_embedded_inode(const uuid &ino);
+	/* loads every shard unless the loaded ones already link all of 'inos', or no embedded copy of them can exist */
+	void load_shards_linking(const tsl::robin_map<uuid, inode *, boost::hash<uuid>> &inos, bool embedding);
+	void load_all();
+
+	/*
+	 * Move every entry to 2^depth new fragment dentries, which are returned unsynced.
+	 * This dentry is left with the fragmentation depth only.
+	 */
+	std::vector<std::shared_ptr<dentry>> fragment(uint32_t depth);
+	uint32_t get_frag_depth() const;
+
+	/*
+	 * Visit every entry of the directory 'ino' straight from the object buffers, no child_list is built.
+	 * Returns the fragmentation depth, the entries of a fragmented directory are in its fragments.
+	 */
+	static uint32_t scan(uuid ino, const std::function<void(const dentry_view::entry &)> &visit);
+
+	std::vector<char> serialize();
+	void deserialize(const char *raw, size_t len);
 	void sync();
+	void remove();
 
-	uuid get_child_ino(const std::string& child_name) const;
-	void fill_filler(void *buffer, fuse_fill_dir_t filler) const;
+	uuid get_child_ino(const std::string& child_name);
 
 	uint64_t get_child_num() const;
 	uint64_t get_total_name_length() const;
+	size_t get_raw_size() const;
 
 	friend class dentry_table;
 };
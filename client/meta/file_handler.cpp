@@ -1,6 +1,6 @@
 #include "file_handler.hpp"
 
-file_handler::file_handler(uuid ino) : ino(ino), fhno(0) {
+file_handler::file_handler(uuid ino) : ino(ino), fhno(0), dir_handle(0), dir_shift(0), dir_cache_offset(0), dir_cache_plus(false) {
 
 }
 
@@ -12,6 +12,10 @@ uuid  file_handler::get_ino() {
 	return this->ino;
 }
 
+uint64_t file_handler::get_loc() {
+	return this->loc;
+}
+
 std::shared_ptr<inode> file_handler::get_open_inode_info() {
 	global_logger.log(file_handler_ops, "Called get_open_inode_info()");
 	if(this->loc == LOCAL){
@@ -35,6 +39,52 @@ void file_handler::set_remote_i(const std::shared_ptr<remote_inode> &open_remote
 	file_handler::remote_i = open_remote_i;
 }
 
+std::shared_ptr<const std::vector<child_entry>> file_handler::get_dir_snapshot() {
+	return this->dir_snapshot;
+}
+
+void file_handler::set_dir_snapshot(const std::shared_ptr<const std::vector<child_entry>> &snapshot) {
+	file_handler::dir_snapshot = snapshot;
+}
+
+uint64_t file_handler::get_dir_handle() {
+	return this->dir_handle;
+}
+
+void file_handler::set_dir_handle(uint64_t handle) {
+	file_handler::dir_handle = handle;
+}
+
+int64_t file_handler::get_dir_shift() {
+	return this->dir_shift;
+}
+
+void file_handler::set_dir_shift(int64_t shift) {
+	file_handler::dir_shift = shift;
+}
+
+uint64_t file_handler::get_dir_cache_offset() {
+	return this->dir_cache_offset;
+}
+
+bool file_handler::is_dir_cache_plus() {
+	return this->dir_cache_plus;
+}
+
+std::vector<dir_cache_entry> &file_handler::get_dir_cache() {
+	return this->dir_cache;
+}
+
+void file_handler::set_dir_cache(uint64_t offset, bool plus, std::vector<dir_cache_entry> &&entries) {
+	file_handler::dir_cache_offset = offset;
+	file_handler::dir_cache_plus = plus;
+	file_handler::dir_cache = std::move(entries);
+}
+
+std::map<uint64_t, frag_pin> &file_handler::get_frag_pins() {
+	return this->frag_pins;
+}
+
 void file_handler_list::add_file_handler(uint64_t key, std::shared_ptr<file_handler> fh) {
 	global_logger.log(file_handler_ops, "Called add_file_handler()");
 	std::scoped_lock scl{this->file_handler_mutex};
@@ -71,3 +121,21 @@ int file_handler_list::delete_file_handler(uint64_t key) {
 	fh_list.erase(it);
 	return 0;
 }
+
+bool file_handler_list::holds_child_of(const uuid &dir_ino) {
+	global_logger.log(file_handler_ops, "Called holds_child_of()");
+	std::scoped_lock scl{this->file_handler_mutex};
+
+	for(auto &fh : this->fh_list) {
+		if(fh.second->get_loc() != LOCAL)
+			continue;
+		if(fh.second->get_ino() == dir_ino)
+			return true;
+
+		std::shared_ptr<inode> open_i = fh.second->get_open_inode_info();
+		if((open_i != nullptr) && (open_i->get_p_ino() == dir_ino))
+			return true;
+	}
+
+	return false;
+}
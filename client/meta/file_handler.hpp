@@ -1,10 +1,33 @@
 #ifndef NMFS0_FILE_HANDLER_HPP
 #define NMFS0_FILE_HANDLER_HPP
 
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 #include <sys/stat.h>
 
 #include "remote_inode.hpp"
+#include "../in_memory/child_index.hpp"
+
+/* a name fetched by remote readdir, 'attr' is valid only if it came from readdirplus */
+struct dir_cache_entry {
+	std::string name;
+	bool attr_valid;
+	struct stat attr;
+};
+
+/* a fragment pinned by the readdir of a fragmented directory, a LOCAL snapshot or a handle at the leader of the fragment */
+struct frag_pin {
+	std::shared_ptr<const std::vector<child_entry>> snapshot;
+	std::string leader_ip;
+	uuid frag_ino;
+	uint64_t dir_handle;
+	/* snapshot offset minus readdir offset, moved when the snapshot is pinned again after 'last_name' */
+	int64_t shift = 0;
+	uint64_t next_child = 0;
+	std::string last_name;
+};
 
 class file_handler {
 private:
@@ -14,10 +37,23 @@ private:
 
 	std::shared_ptr<inode> i;
 	std::shared_ptr<remote_inode> remote_i;
+
+	/* readdir state of an opened directory */
+	std::shared_ptr<const std::vector<child_entry>> dir_snapshot;
+	uint64_t dir_handle;
+	/* snapshot offset minus readdir offset, the leader may pin a new snapshot for a handle it lost */
+	int64_t dir_shift;
+	uint64_t dir_cache_offset;
+	bool dir_cache_plus;
+	std::vector<dir_cache_entry> dir_cache;
+
+	/* <fragment bits, pin>, the offsets of a fragmented directory index these snapshots */
+	std::map<uint64_t, frag_pin> frag_pins;
 public:
 	explicit file_handler(uuid ino);
 
 	uuid get_ino();
+	uint64_t get_loc();
 
 	std::shared_ptr<inode> get_open_inode_info();
 
@@ -28,6 +64,23 @@ public:
 	void set_i(const std::shared_ptr<inode> &open_i);
 
 	void set_remote_i(const std::shared_ptr<remote_inode> &open_remote_i);
+
+	/* LOCAL directory : snapshot taken at the first readdir from offset 0 */
+	std::shared_ptr<const std::vector<child_entry>> get_dir_snapshot();
+	void set_dir_snapshot(const std::shared_ptr<const std::vector<child_entry>> &snapshot);
+
+	/* REMOTE directory : handle of the snapshot at the leader and the last fetched batch of names */
+	uint64_t get_dir_handle();
+	void set_dir_handle(uint64_t handle);
+	int64_t get_dir_shift();
+	void set_dir_shift(int64_t shift);
+	uint64_t get_dir_cache_offset();
+	bool is_dir_cache_plus();
+	std::vector<dir_cache_entry> &get_dir_cache();
+	void set_dir_cache(uint64_t offset, bool plus, std::vector<dir_cache_entry> &&entries);
+
+	/* fragmented directory : the pins are opened by readdir and released with the handle */
+	std::map<uint64_t, frag_pin> &get_frag_pins();
 };
 
 class file_handler_list {
@@ -43,6 +96,9 @@ public:
 	std::shared_ptr<file_handler> get_file_handler(uint64_t key);
 
 	int delete_file_handler(uint64_t key);
+
+	/* true if a LOCAL handle is open on the directory 'dir_ino' or on one of its children */
+	bool holds_child_of(const uuid &dir_ino);
 };
 
 #endif //NMFS0_FILE_HANDLER_HPP
@@ -1,11 +1,133 @@
 #include "inode.hpp"
 
+#include <algorithm>
+#include <random>
+
 using std::runtime_error;
 
 extern std::shared_ptr<rados_io> meta_pool;
 extern std::unique_ptr<client> this_client;
 extern std::unique_ptr<uuid_controller> ino_controller;
 
+std::recursive_mutex &inode_lock::get_stripe()
+{
+	static std::recursive_mutex stripes[INODE_LOCK_STRIPE_NUM];
+	/* the low bits of an object address are always zero */
+	return stripes[(reinterpret_cast<uintptr_t>(this) >> 4) % INODE_LOCK_STRIPE_NUM];
+}
+
+/* the stripe held by this thread and how many times it is held */
+static thread_local std::recursive_mutex *held_stripe = nullptr;
+static thread_local uint32_t held_depth = 0;
+
+static void check_inode_lock_order(std::recursive_mutex &stripe)
+{
+	if ((held_depth > 0) && (held_stripe != &stripe))
+		throw runtime_error("Lock Order Violated: the lock of another inode is held");
+}
+
+void inode_lock::lock()
+{
+	std::recursive_mutex &stripe = get_stripe();
+	check_inode_lock_order(stripe);
+	stripe.lock();
+	held_stripe = &stripe;
+	held_depth++;
+}
+
+void inode_lock::unlock()
+{
+	get_stripe().unlock();
+	if (--held_depth == 0)
+		held_stripe = nullptr;
+}
+
+bool inode_lock::try_lock()
+{
+	std::recursive_mutex &stripe = get_stripe();
+	check_inode_lock_order(stripe);
+	if (!stripe.try_lock())
+		return false;
+	held_stripe = &stripe;
+	held_depth++;
+	return true;
+}
+
+bool inode_lock::held()
+{
+	return held_depth > 0;
+}
+
+void dentry_table_lock::lock()
+{
+	/* a try_lock can't deadlock, std::scoped_lock of a table and an inode only blocks with nothing held */
+	if (inode_lock::held())
+		throw runtime_error("Lock Order Violated: a dentry table is locked under an inode lock");
+	this->table_mutex.lock();
+}
+
+void dentry_table_lock::unlock()
+{
+	this->table_mutex.unlock();
+}
+
+bool dentry_table_lock::try_lock()
+{
+	return this->table_mutex.try_lock();
+}
+
+uint64_t new_inode_generation()
+{
+	/* a random start keeps the generations stamped by the successive leaders of an inode apart */
+	static std::atomic<uint64_t> next_generation{(static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}()};
+
+	uint64_t generation = next_generation.fetch_add(1, std::memory_order_relaxed);
+	return (generation == 0) ? next_generation.fetch_add(1, std::memory_order_relaxed) : generation;
+}
+
+range_lock::stripe &range_lock::get_stripe(const uuid &ino)
+{
+	static stripe stripes[RANGE_LOCK_STRIPE_NUM];
+	return stripes[boost::hash<uuid>()(ino) % RANGE_LOCK_STRIPE_NUM];
+}
+
+range_lock::range_lock(const uuid &ino, off_t start, off_t end) : ino(ino), start(start), end(end)
+{
+	stripe &s = get_stripe(ino);
+	std::unique_lock lock(s.stripe_mutex);
+
+	auto overlaps = [this, &s]() {
+		auto it = s.held.find(this->ino);
+		if (it == s.held.end())
+			return false;
+
+		for (const auto &r : it->second) {
+			if ((r.first < this->end) && (this->start < r.second))
+				return true;
+		}
+		return false;
+	};
+	s.released.wait(lock, [&overlaps]() { return !overlaps(); });
+
+	auto ret = s.held.insert({ino, {}});
+	ret.first.value().emplace_back(start, end);
+}
+
+range_lock::~range_lock()
+{
+	stripe &s = get_stripe(this->ino);
+	{
+		std::scoped_lock lock(s.stripe_mutex);
+		auto it = s.held.find(this->ino);
+		std::vector<std::pair<off_t, off_t>> &ranges = it.value();
+
+		ranges.erase(std::find(ranges.begin(), ranges.end(), std::make_pair(this->start, this->end)));
+		if (ranges.empty())
+			s.held.erase(it);
+	}
+	s.released.notify_all();
+}
+
 inode::no_entry::no_entry(const string &msg) : runtime_error(msg)
 {
 }
@@ -24,7 +146,7 @@ const char *inode::permission_denied::what()
 	return runtime_error::what();
 }
 
-inode::inode(const inode &copy)
+inode::inode(const inode &copy) : p_ino(copy.p_ino), loc(copy.loc)
 {
 	core.i_mode = copy.core.i_mode;
 	core.i_uid = copy.core.i_uid;
@@ -38,11 +160,8 @@ inode::inode(const inode &copy)
 	core.i_ctime = copy.core.i_ctime;
 
 	core.link_target_len = copy.core.link_target_len;
-	if (S_ISLNK(this->core.i_mode) && (this->core.link_target_len > 0)) {
-		link_target_name = copy.link_target_name;
-		//link_target_name = reinterpret_cast<char *>(calloc(this->core.link_target_len + 1, sizeof(char)));
-		//memcpy(link_target_name, copy.link_target_name, core.link_target_len);
-	}
+	if (S_ISLNK(this->core.i_mode) && (copy.link_target_name != nullptr))
+		this->set_link_target_name(copy.link_target_name.get(), copy.core.link_target_len);
 }
 
 inode::inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, bool root) {
@@ -66,7 +185,6 @@ inode::inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, bool root)
 	};
 
 	loc = LOCAL;
-	link_target_name = nullptr;
 }
 
 inode::inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, uuid &predefined_ino) {
@@ -90,10 +208,8 @@ inode::inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, uuid &prede
 	};
 
 	loc = LOCAL;
-	link_target_name = nullptr;
 }
 
-/* TODO : allocated target name should be freed later */
 inode::inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, const char *passed_link_target_name) {
 	uint32_t passed_link_target_len = strlen(passed_link_target_name);
 
@@ -118,8 +234,7 @@ inode::inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, const char
 
 	loc = LOCAL;
 
-	this->set_link_target_len(passed_link_target_len);
-	this->set_link_target_name(std::make_shared<std::string>(passed_link_target_name));
+	this->set_link_target_name(passed_link_target_name, passed_link_target_len);
 }
 
 
@@ -135,6 +250,19 @@ inode::inode(uuid ino)
 	}
 }
 
+size_t inode::get_max_obj_size() {
+	return MAX_INODE_OBJ_SIZE;
+}
+
+inode::inode(const char *raw, size_t len)
+{
+	global_logger.log(inode_ops, "Called inode(raw)");
+	if (len < REG_INODE_SIZE)
+		throw runtime_error("Inode Corrupted: too short inode object");
+
+	this->deserialize(raw, len);
+}
+
 inode::inode(enum meta_location loc) : loc(loc){
 }
 
@@ -166,21 +294,24 @@ std::vector<char> inode::serialize()
 
 	if(S_ISLNK(this->core.i_mode) && (this->core.link_target_len > 0)){
 		global_logger.log(inode_ops, "serialize symbolic link inode");
-		memcpy(value.data() + REG_INODE_SIZE, (this->link_target_name->data()), this->core.link_target_len);
+		memcpy(value.data() + REG_INODE_SIZE, this->link_target_name.get(), this->core.link_target_len);
 	}
 	return value;
 }
 
-void inode::deserialize(const char *value)
+void inode::deserialize(const char *value, size_t len)
 {
 	global_logger.log(inode_ops, "Called inode.deserialize()");
 	memcpy(&core, value, REG_INODE_SIZE);
 
 	if(S_ISLNK(this->core.i_mode)){
-		this->link_target_name = std::make_shared<std::string>();
-		(*this->link_target_name).resize(this->core.link_target_len);
-		meta_pool->read(obj_category::INODE, uuid_to_string(this->core.i_ino), &((*this->link_target_name)[0]), this->core.link_target_len, REG_INODE_SIZE);
-		global_logger.log(inode_ops, "deserialized link target name : " + *this->link_target_name);
+		this->link_target_name = std::make_unique<char[]>(this->core.link_target_len + 1);
+		/* the target follows the core, read it again only if the caller didn't */
+		if(len >= REG_INODE_SIZE + this->core.link_target_len)
+			memcpy(this->link_target_name.get(), value + REG_INODE_SIZE, this->core.link_target_len);
+		else
+			meta_pool->read(obj_category::INODE, uuid_to_string(this->core.i_ino), this->link_target_name.get(), this->core.link_target_len, REG_INODE_SIZE);
+		global_logger.log(inode_ops, "deserialized link target name : " + std::string(this->link_target_name.get()));
 	}
 
 	global_logger.log(inode_ops, "deserialized ino : " + uuid_to_string(this->core.i_ino));
@@ -196,6 +327,11 @@ void inode::sync()
 
 void inode::permission_check(int mask){
 	global_logger.log(inode_ops, "Called permission_check");
+	if(!check_permission(this->core.i_mode, this->core.i_uid, this->core.i_gid, mask))
+		throw permission_denied("Permission Denied: Local");
+}
+
+bool inode::check_permission(mode_t mode, uid_t uid, gid_t gid, int mask){
 	bool check_read = (mask & R_OK) ? true : false;
 	bool check_write = (mask & W_OK) ? true : false;
 	bool check_exec = (mask & X_OK) ? true : false;
@@ -203,12 +339,12 @@ void inode::permission_check(int mask){
 
 	mode_t target_mode;
 
-	if(this_client->get_client_uid() == this->core.i_uid){
-		target_mode = (this->core.i_mode & S_IRWXU) >> 6;
-	} else if (this_client->get_client_gid() == this->core.i_gid){
-		target_mode = (this->core.i_mode & S_IRWXG) >> 3;
+	if(this_client->get_client_uid() == uid){
+		target_mode = (mode & S_IRWXU) >> 6;
+	} else if (this_client->get_client_gid() == gid){
+		target_mode = (mode & S_IRWXG) >> 3;
 	} else {
-		target_mode = this->core.i_mode & S_IRWXO;
+		target_mode = mode & S_IRWXO;
 	}
 
 	if(check_read){
@@ -221,8 +357,7 @@ void inode::permission_check(int mask){
 		ret = ret && (target_mode & X_OK);
 	}
 
-	if(!ret)
-		throw permission_denied("Permission Denied: Local");
+	return ret;
 }
 
 // getter
@@ -260,11 +395,14 @@ struct timespec inode::get_ctime(){
 uint64_t inode::get_loc() {
 	return this->loc;
 }
+uint64_t inode::get_generation() {
+	return this->generation.load(std::memory_order_acquire);
+}
 uint32_t inode::get_link_target_len(){
 	return this->core.link_target_len;
 }
-std::shared_ptr<std::string> inode::get_link_target_name(){
-	return this->link_target_name;
+const char *inode::get_link_target_name(){
+	return this->link_target_name.get();
 }
 
 // setter
@@ -299,61 +437,23 @@ void inode::set_ctime(struct timespec ctime){
 void inode::set_loc(uint64_t loc) {
 	this->loc = loc;
 }
+void inode::bump_generation() {
+	this->generation.store(new_inode_generation(), std::memory_order_release);
+}
 void inode::set_link_target_len(uint32_t len){
 	this->core.link_target_len = len;
 }
-void inode::set_link_target_name(const std::shared_ptr<std::string> name){
-	this->link_target_name = name;
-	//this->link_target_name = (char *)calloc(this->core.link_target_len + 1, sizeof(char));
-	//memcpy(this->link_target_name, name, this->core.link_target_len);
+void inode::set_link_target_name(const char *name, uint32_t len){
+	this->core.link_target_len = len;
+	this->link_target_name = std::make_unique<char[]>(len + 1);
+	memcpy(this->link_target_name.get(), name, len);
 }
 
 void inode::set_p_ino(const uuid &p_ino) {
 	inode::p_ino = p_ino;
 }
 
-void inode::inode_to_rename_src_response(::rpc_rename_not_same_parent_src_respond *response) {
-	response->set_target_i_mode(this->core.i_mode);
-	response->set_target_i_uid(this->core.i_uid);
-	response->set_target_i_gid(this->core.i_gid);
-	response->set_target_i_ino_prefix(ino_controller->get_prefix_from_uuid(this->core.i_ino));
-	response->set_target_i_ino_postfix(ino_controller->get_postfix_from_uuid(this->core.i_ino));
-	response->set_target_i_nlink(this->core.i_nlink);
-	response->set_target_i_size(this->core.i_size);
-	response->set_target_a_sec(this->core.i_atime.tv_sec);
-	response->set_target_a_nsec(this->core.i_atime.tv_nsec);
-	response->set_target_m_sec(this->core.i_mtime.tv_sec);
-	response->set_target_m_nsec(this->core.i_mtime.tv_nsec);
-	response->set_target_c_sec(this->core.i_ctime.tv_sec);
-	response->set_target_c_nsec(this->core.i_ctime.tv_nsec);
-	response->set_target_i_link_target_len(this->core.link_target_len);
-	if(S_ISLNK(this->core.i_mode)) {
-		response->set_target_i_link_target_name(this->link_target_name->data());
-	}
-}
-
-void inode::rename_src_response_to_inode(::rpc_rename_not_same_parent_src_respond &response) {
-	this->core.i_mode = response.target_i_mode();
-	this->core.i_uid = response.target_i_uid();
-	this->core.i_gid = response.target_i_gid();
-	this->core.i_ino = ino_controller->splice_prefix_and_postfix(response.target_i_ino_prefix(), response.target_i_ino_postfix());
-	this->core.i_nlink = response.target_i_nlink();
-	this->core.i_size = response.target_i_size();
-	this->core.i_atime.tv_sec = response.target_a_sec();
-	this->core.i_atime.tv_nsec = response.target_a_nsec();
-	this->core.i_mtime.tv_sec = response.target_m_sec();
-	this->core.i_mtime.tv_nsec = response.target_m_nsec();
-	this->core.i_ctime.tv_sec = response.target_c_sec();
-	this->core.i_ctime.tv_nsec = response.target_c_nsec();
-	this->core.link_target_len = response.target_i_link_target_len();
-	if(S_ISLNK(response.target_i_mode())) {
-		this->link_target_name = std::make_shared<std::string>(response.target_i_link_target_name());
-		//this->link_target_name = reinterpret_cast<char *>(calloc(response.target_i_link_target_len() + 1 , sizeof(char)));
-		//memcpy(this->link_target_name, response.target_i_link_target_name().data(), response.target_i_link_target_len());
-	}
-}
-
-void inode::inode_to_rename_dst_request(::rpc_rename_not_same_parent_dst_request &request) {
+void inode::inode_to_rename_link_request(::rpc_rename_link_request &request) {
 	request.set_target_i_mode(this->core.i_mode);
 	request.set_target_i_uid(this->core.i_uid);
 	request.set_target_i_gid(this->core.i_gid);
@@ -369,11 +469,11 @@ void inode::inode_to_rename_dst_request(::rpc_rename_not_same_parent_dst_request
 	request.set_target_c_nsec(this->core.i_ctime.tv_nsec);
 	request.set_target_i_link_target_len(this->core.link_target_len);
 	if(S_ISLNK(this->core.i_mode)) {
-		request.set_target_i_link_target_name(this->link_target_name->data());
+		request.set_target_i_link_target_name(this->link_target_name.get());
 	}
 }
 
-void inode::rename_dst_request_to_inode(const ::rpc_rename_not_same_parent_dst_request *request) {
+void inode::rename_link_request_to_inode(const ::rpc_rename_link_request *request) {
 	this->core.i_mode = request->target_i_mode();
 	this->core.i_uid = request->target_i_uid();
 	this->core.i_gid = request->target_i_gid();
@@ -388,9 +488,7 @@ void inode::rename_dst_request_to_inode(const ::rpc_rename_not_same_parent_dst_r
 	this->core.i_ctime.tv_nsec = request->target_c_nsec();
 	this->core.link_target_len = request->target_i_link_target_len();
 	if(S_ISLNK(request->target_i_mode())) {
-		this->link_target_name = std::make_shared<std::string>(request->target_i_link_target_name());
-		//this->link_target_name = reinterpret_cast<char *>(calloc(request->target_i_link_target_len() + 1 , sizeof(char)));
-		//memcpy(this->link_target_name, request->target_i_link_target_name().data(), request->target_i_link_target_len());
+		this->set_link_target_name(request->target_i_link_target_name().data(), request->target_i_link_target_name().size());
 	}
 }
 
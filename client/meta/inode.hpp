@@ -1,18 +1,27 @@
 #ifndef _INODE_HPP_
 #define _INODE_HPP_
 
+#include <atomic>
+#include <climits>
+#include <condition_variable>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <sys/stat.h>
 
+#include <boost/functional/hash.hpp>
+#include <tsl/robin_map.h>
+
 #include "lib/logger/logger.hpp"
 #include "lib/rados_io/rados_io.hpp"
 #include "util/path.hpp"
+#include "util/slab.hpp"
 #include "util/uuid.hpp"
 
 #include "rpc.grpc.pb.h"
@@ -21,9 +30,16 @@
 
 #define REG_INODE_SIZE (sizeof(struct _core))
 #define DIR_INODE_SIZE 4096
+/* enough for the core and the longest symlink target */
+#define MAX_INODE_OBJ_SIZE (REG_INODE_SIZE + PATH_MAX)
 #define ENOTLEADER 8000
 #define ENEEDRECOV 8001
 
+#define INODE_LOCK_STRIPE_NUM (4096)
+#define RANGE_LOCK_STRIPE_NUM (256)
+/* end of a range locked up to the end of the file, whatever its size becomes */
+#define RANGE_LOCK_EOF (std::numeric_limits<off_t>::max())
+
 using std::unique_ptr;
 using std::runtime_error;
 using std::string;
@@ -34,9 +50,74 @@ enum meta_location {
 	REMOTE,
 	UNKNOWN,
 	JOURNAL,
-	NOBODY /* temporaly status */
+	NOBODY, /* temporaly status */
+	SHARED /* dentry tables only, a read-only copy kept under a shared lease */
+};
+
+/*
+ * Lock of an inode borrowed from a striped pool by the address of the inode,
+ * so that a cached inode doesn't carry a mutex of its own.
+ * Inodes sharing a stripe serialize each other, the stripes are recursive so one thread may hold both.
+ *
+ * A stripe aliases inodes of unrelated directories, so inode locks are the innermost locks of the dentry tables :
+ * a dentry table lock is taken before any inode lock and a thread holds the lock of one inode at a time.
+ * Both are checked when locking, a violation throws instead of risking a deadlock through an aliased stripe.
+ */
+class inode_lock {
+private:
+	std::recursive_mutex &get_stripe();
+
+public:
+	void lock();
+	void unlock();
+	bool try_lock();
+
+	/* whether this thread holds any inode lock */
+	static bool held();
+};
+
+/* lock of a dentry table, refuses to block while this thread holds an inode lock, see inode_lock */
+class dentry_table_lock {
+private:
+	std::recursive_mutex table_mutex;
+
+public:
+	void lock();
+	void unlock();
+	bool try_lock();
 };
 
+/*
+ * Lock of the bytes [start, end) of the file 'ino', held while its data is written or truncated.
+ * Writes to disjoint ranges of one file go to the data pool in parallel and overlapping ones in turn,
+ * the inode lock is only taken to update the size.
+ * The locked ranges are kept in stripes by ino, a file has an entry only while a range of it is locked.
+ */
+class range_lock {
+private:
+	struct stripe {
+		std::mutex stripe_mutex;
+		std::condition_variable released;
+		tsl::robin_map<uuid, std::vector<std::pair<off_t, off_t>>, boost::hash<uuid>> held;
+	};
+
+	static stripe &get_stripe(const uuid &ino);
+
+	uuid ino;
+	off_t start;
+	off_t end;
+
+public:
+	range_lock(const uuid &ino, off_t start, off_t end);
+	~range_lock();
+
+	range_lock(const range_lock &) = delete;
+	range_lock &operator=(const range_lock &) = delete;
+};
+
+/* a generation never handed out before by this client, 0 is never returned */
+uint64_t new_inode_generation();
+
 class inode {
 private:
 	uuid p_ino;
@@ -55,13 +136,17 @@ private:
 		uint32_t link_target_len;
 	} core;
 
-	uint64_t loc;
+	/* meta_location */
+	uint8_t loc;
 
+	/* null terminated, core.link_target_len bytes long, only for symlinks */
+	std::unique_ptr<char[]> link_target_name;
 
-	std::shared_ptr<std::string> link_target_name;
+	/* stamped anew by the journal on every change, in memory only, remote clients revalidate cached attributes with it */
+	std::atomic<uint64_t> generation{new_inode_generation()};
 
 public:
-	std::recursive_mutex inode_mutex;
+	[[no_unique_address]] inode_lock inode_mutex;
 	class no_entry : public runtime_error {
 	public:
 		explicit no_entry(const string &msg);
@@ -84,14 +169,21 @@ public:
 	inode(uuid parent_ino, uid_t owner, gid_t group, mode_t mode, const char *link_target_name);
 	/* for pull metadata */
 	inode(uuid ino);
+	/* for pull metadata, the head of the inode object is already read into 'raw' */
+	inode(const char *raw, size_t len);
 	/* parent constructor for remote_inode and dummy_inode which used with file_handler */
 	inode(enum meta_location loc);
 
+	/* largest object a single inode can occupy, for callers sizing their reads */
+	static size_t get_max_obj_size();
+
 	void fill_stat(struct stat *s);
 	std::vector<char> serialize();
-	void deserialize(const char *value);
+	void deserialize(const char *value, size_t len = REG_INODE_SIZE);
 	void sync();
 	virtual void permission_check(int mask);
+	/* permission of this client to an inode of 'mode' owned by 'uid' and 'gid' */
+	static bool check_permission(mode_t mode, uid_t uid, gid_t gid, int mask);
 
 	// getter
 	uuid get_p_ino();
@@ -106,9 +198,10 @@ public:
 	struct timespec get_ctime();
 
 	uint64_t get_loc();
+	uint64_t get_generation();
 
 	uint32_t get_link_target_len();
-	std::shared_ptr<std::string> get_link_target_name();
+	const char *get_link_target_name();
 
 	// setter
 	void set_p_ino(const uuid &p_ino);
@@ -124,15 +217,22 @@ public:
 	void set_ctime(struct timespec ctime);
 
 	void set_loc(uint64_t loc);
+	void bump_generation();
 	void set_link_target_len(uint32_t len);
-	void set_link_target_name(const std::shared_ptr<std::string> name);
+	/* also sets link_target_len */
+	void set_link_target_name(const char *name, uint32_t len);
 
-	void inode_to_rename_src_response(::rpc_rename_not_same_parent_src_respond *response);
-	void rename_src_response_to_inode(::rpc_rename_not_same_parent_src_respond &response);
-	void inode_to_rename_dst_request(::rpc_rename_not_same_parent_dst_request &request);
-	void rename_dst_request_to_inode(const ::rpc_rename_not_same_parent_dst_request *request);
+	void inode_to_rename_link_request(::rpc_rename_link_request &request);
+	void rename_link_request_to_inode(const ::rpc_rename_link_request *request);
 };
 
 uuid alloc_new_ino();
 
+/* cached inodes share their slot with the shared_ptr control block */
+template <typename... Args>
+std::shared_ptr<inode> make_inode(Args &&...args)
+{
+	return std::allocate_shared<inode>(slab_allocator<inode>(), std::forward<Args>(args)...);
+}
+
 #endif /* _INODE_HPP_ */
@@ -1,6 +1,11 @@
 #include "remote_inode.hpp"
 
 #include "../rpc/rpc_client.hpp"
+#include "../fs_ops/async_create.hpp"
+#include "../in_memory/remote_attr_cache.hpp"
+
+extern std::unique_ptr<async_create_queue> async_creates;
+extern std::unique_ptr<remote_attr_cache> attr_cache;
 
 /* <address, channel> */
 std::map<std::string, std::shared_ptr<rpc_client>> rc_list;
@@ -28,7 +33,7 @@ std::shared_ptr<rpc_client> get_rpc_client(const std::string& remote_address) {
 }
 
 remote_inode::remote_inode(std::string leader_ip, uuid dentry_table_ino, std::string file_name, bool target_is_parent ) \
-: inode(REMOTE), leader_ip(leader_ip), dentry_table_ino(dentry_table_ino), file_name(file_name), target_is_parent(target_is_parent) {
+: inode(REMOTE), leader_ip(leader_ip), dentry_table_ino(dentry_table_ino), file_name(file_name), target_is_parent(target_is_parent), redirect_num(0) {
 }
 
 const string &remote_inode::get_address() const {
@@ -48,6 +53,19 @@ bool remote_inode::get_target_is_parent() const {
 }
 
 mode_t remote_inode::get_mode() {
+	/* a name created asynchronously has the mode it was created with */
+	mode_t provisional_mode;
+	if ((async_creates != nullptr) && async_creates->get_mode(this->dentry_table_ino, this->file_name, provisional_mode)) {
+		this->inode::set_mode(provisional_mode);
+		return provisional_mode;
+	}
+
+	struct stat s{};
+	if ((attr_cache != nullptr) && !this->target_is_parent && attr_cache->lookup_perm(*this, &s)) {
+		this->inode::set_mode(s.st_mode);
+		return s.st_mode;
+	}
+
 	std::string remote_address(this->leader_ip);
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
@@ -63,9 +81,48 @@ void remote_inode::set_leader_ip(const string &leader_ip) {
 	remote_inode::leader_ip = leader_ip;
 }
 
+void remote_inode::set_dentry_table_ino(const uuid &ino) {
+	remote_inode::dentry_table_ino = ino;
+}
+
 void remote_inode::permission_check(int mask) {
+	if (async_creates != nullptr)
+		async_creates->wait(this->dentry_table_ino, this->file_name);
+
+	/* the mode came along with a lookup, the leader is asked only if it isn't cached */
+	struct stat s{};
+	if ((attr_cache != nullptr) && attr_cache->lookup_perm(*this, &s)) {
+		if (!inode::check_permission(s.st_mode, s.st_uid, s.st_gid, mask))
+			throw inode::permission_denied("Permission Denied: Remote");
+		return;
+	}
+
 	std::string remote_address(this->leader_ip);
 	std::shared_ptr<rpc_client> rc = get_rpc_client(remote_address);
 
 	rc->permission_check(this->dentry_table_ino, this->file_name, mask, this->target_is_parent);
 }
+
+void remote_inode::set_leader_hint(const string &leader, std::chrono::system_clock::time_point due) {
+	this->hinted_leader = leader;
+	this->hinted_due = due;
+}
+
+bool remote_inode::take_leader_hint(string &leader, std::chrono::system_clock::time_point &due) {
+	if (this->hinted_leader.empty())
+		return false;
+
+	leader = std::move(this->hinted_leader);
+	due = this->hinted_due;
+	this->hinted_leader.clear();
+	return true;
+}
+
+int remote_inode::count_redirect(std::chrono::milliseconds reset) {
+	auto now = std::chrono::steady_clock::now();
+	if (now - this->last_redirect > reset)
+		this->redirect_num = 0;
+
+	this->last_redirect = now;
+	return ++this->redirect_num;
+}
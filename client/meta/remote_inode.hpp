@@ -1,6 +1,8 @@
 #ifndef NMFS_REMOTE_INODE_H
 #define NMFS_REMOTE_INODE_H
 
+#include <chrono>
+
 #include "inode.hpp"
 
 class rpc_client;
@@ -16,6 +18,13 @@ private :
     	/* not necessary */
 	std::string file_name;
 
+	/* the leader named by the last -ENOTLEADER reply, empty if the replier didn't know */
+	std::string hinted_leader;
+	std::chrono::system_clock::time_point hinted_due;
+	/* redirects in a row, see find_remote_dentry_table_again() */
+	int redirect_num;
+	std::chrono::steady_clock::time_point last_redirect;
+
 public:
 	remote_inode(std::string leader_ip, uuid dentry_table_ino, std::string file_name, bool target_is_parent = false);
 
@@ -27,8 +36,15 @@ public:
 	mode_t get_mode() override;
 
     void set_leader_ip(const string &leader_ip);
+	void set_dentry_table_ino(const uuid &ino);
 
     void permission_check(int mask) override;
+
+	void set_leader_hint(const string &leader, std::chrono::system_clock::time_point due);
+	/* false if there is no hint, it is taken once */
+	bool take_leader_hint(string &leader, std::chrono::system_clock::time_point &due);
+	/* the redirects in a row including this one, a redirect 'reset' after the previous one counts as the first */
+	int count_redirect(std::chrono::milliseconds reset);
 };
 
 #endif //NMFS_REMOTE_INODE_H
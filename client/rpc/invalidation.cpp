@@ -0,0 +1,262 @@
+#include "invalidation.hpp"
+
+#include <algorithm>
+
+#include "rpc_client.hpp"
+
+#include "../in_memory/remote_attr_cache.hpp"
+
+extern std::unique_ptr<uuid_controller> ino_controller;
+extern std::unique_ptr<remote_attr_cache> attr_cache;
+
+invalidation_hub::invalidation_hub() : watch_num(0) {
+}
+
+rpc_invalidation invalidation_hub::make_invalidation(rpc_invalidation_kind kind, const uuid &table_ino, const std::string &name) {
+	rpc_invalidation inv;
+	inv.set_kind(kind);
+	inv.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(table_ino));
+	inv.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(table_ino));
+	inv.set_filename(name);
+	return inv;
+}
+
+void invalidation_hub::push(const std::string &origin, const rpc_invalidation &inv) {
+	auto it = this->subscribers.find(origin);
+	if (it == this->subscribers.end())
+		return;
+
+	subscriber &s = *it->second;
+	std::scoped_lock lock(s.queue_mutex);
+	if (s.closed)
+		return;
+	if (s.queue.size() >= INVALIDATION_MAX_QUEUED) {
+		global_logger.log(rpc_server_ops, "The subscription of " + origin + " fell behind, it is cut off");
+		s.closed = true;
+	} else {
+		s.queue.push_back(inv);
+	}
+	s.queue_cv.notify_one();
+}
+
+void invalidation_hub::fire(const uuid &ino) {
+	auto it = this->watches.find(ino);
+	if (it == this->watches.end())
+		return;
+
+	for (const watch &w : it->second)
+		this->push(w.origin, make_invalidation(INVALIDATE_ATTR, w.table_ino, w.name));
+	this->watch_num -= it->second.size();
+	this->watches.erase(it);
+}
+
+void invalidation_hub::drop_watches_if(const std::function<bool(const watch &)> &pred) {
+	for (auto it = this->watches.begin(); it != this->watches.end();) {
+		std::vector<watch> &ws = it.value();
+		size_t before = ws.size();
+		ws.erase(std::remove_if(ws.begin(), ws.end(), pred), ws.end());
+		this->watch_num -= before - ws.size();
+
+		if (ws.empty())
+			it = this->watches.erase(it);
+		else
+			++it;
+	}
+}
+
+bool invalidation_hub::add_watch(const std::string &origin, const uuid &ino, const uuid &table_ino, const std::string &name) {
+	std::scoped_lock lock(this->hub_mutex);
+	auto sit = this->subscribers.find(origin);
+	if (sit == this->subscribers.end())
+		return false;
+	{
+		std::scoped_lock ql(sit->second->queue_mutex);
+		if (sit->second->closed)
+			return false;
+	}
+
+	auto ret = this->watches.insert({ino, {}});
+	std::vector<watch> &ws = ret.first.value();
+	for (const watch &w : ws) {
+		if ((w.origin == origin) && (w.table_ino == table_ino) && (w.name == name))
+			return true;
+	}
+
+	if (this->watch_num >= INVALIDATION_MAX_WATCHES) {
+		if (ws.empty())
+			this->watches.erase(ino);
+		return false;
+	}
+
+	ws.push_back(watch{origin, table_ino, name});
+	this->watch_num++;
+	return true;
+}
+
+void invalidation_hub::serve(const std::string &origin, grpc::ServerContext *context, grpc::ServerWriter<rpc_invalidation> *writer) {
+	global_logger.log(rpc_server_ops, "Called invalidation_hub::serve(" + origin + ")");
+	auto s = std::make_shared<subscriber>();
+	{
+		std::scoped_lock lock(this->hub_mutex);
+		auto it = this->subscribers.find(origin);
+		if (it != this->subscribers.end()) {
+			std::scoped_lock ql(it->second->queue_mutex);
+			it->second->closed = true;
+			it->second->queue_cv.notify_one();
+		}
+		this->subscribers.insert_or_assign(origin, s);
+	}
+
+	while (true) {
+		std::deque<rpc_invalidation> batch;
+		{
+			std::unique_lock ql(s->queue_mutex);
+			s->queue_cv.wait_for(ql, std::chrono::milliseconds(INVALIDATION_POLL_MS), [&s]() { return s->closed || !s->queue.empty(); });
+			if (s->closed)
+				break;
+			batch.swap(s->queue);
+		}
+		if (context->IsCancelled())
+			break;
+
+		bool written = true;
+		for (const rpc_invalidation &inv : batch) {
+			if (!writer->Write(inv)) {
+				written = false;
+				break;
+			}
+		}
+		if (!written)
+			break;
+	}
+
+	/* the watches of a subscriber which went away would never be told */
+	std::scoped_lock lock(this->hub_mutex);
+	auto it = this->subscribers.find(origin);
+	if ((it != this->subscribers.end()) && (it->second == s)) {
+		this->subscribers.erase(it);
+		this->drop_watches_if([&origin](const watch &w) { return w.origin == origin; });
+	}
+}
+
+void invalidation_hub::stop() {
+	std::scoped_lock lock(this->hub_mutex);
+	for (auto &sub : this->subscribers) {
+		std::scoped_lock ql(sub.second->queue_mutex);
+		sub.second->closed = true;
+		sub.second->queue_cv.notify_one();
+	}
+}
+
+void invalidation_hub::attr_changed(const uuid &ino) {
+	if (this->watch_num == 0)
+		return;
+
+	std::scoped_lock lock(this->hub_mutex);
+	this->fire(ino);
+}
+
+void invalidation_hub::dentry_changed(const uuid &dir_ino, const uuid &table_ino, const std::string &name, bool added) {
+	if (this->watch_num == 0)
+		return;
+
+	std::scoped_lock lock(this->hub_mutex);
+	auto it = this->watches.find(dir_ino);
+	if (it == this->watches.end())
+		return;
+
+	/* the watchers of the directory hear of the name once each, then of the attributes of the directory */
+	std::vector<std::string> told;
+	for (const watch &w : it->second) {
+		if (std::find(told.begin(), told.end(), w.origin) != told.end())
+			continue;
+		this->push(w.origin, make_invalidation(added ? INVALIDATE_DENTRY_ADDED : INVALIDATE_DENTRY_REMOVED, table_ino, name));
+		told.push_back(w.origin);
+	}
+	this->fire(dir_ino);
+}
+
+void invalidation_hub::leader_changed(const uuid &table_ino) {
+	std::scoped_lock lock(this->hub_mutex);
+	if (this->subscribers.empty())
+		return;
+	global_logger.log(rpc_server_ops, "Called invalidation_hub::leader_changed(" + uuid_to_string(table_ino) + ")");
+
+	rpc_invalidation inv = make_invalidation(INVALIDATE_LEADER_CHANGED, table_ino, "");
+	for (auto &sub : this->subscribers)
+		this->push(sub.first, inv);
+	this->drop_watches_if([&table_ino](const watch &w) { return w.table_ino == table_ino; });
+}
+
+invalidation_listener::invalidation_listener() : stopping(false) {
+}
+
+invalidation_listener::~invalidation_listener() {
+	this->stop();
+}
+
+bool invalidation_listener::subscribe(const std::string &leader) {
+	std::scoped_lock lock(this->listener_mutex);
+	if (this->stopping)
+		return false;
+
+	subscription &sub = this->subscriptions[leader];
+	if (sub.up)
+		return true;
+	if (std::chrono::steady_clock::now() < sub.retry_after)
+		return false;
+
+	if (sub.listener.joinable())
+		sub.listener.join();
+	sub.context = std::make_shared<origin_context>();
+	sub.up = true;
+	sub.listener = std::thread(&invalidation_listener::listen, this, leader, sub.context);
+	return true;
+}
+
+void invalidation_listener::listen(const std::string &leader, shared_ptr<origin_context> context) {
+	global_logger.log(rpc_client_ops, "Called invalidation_listener::listen(" + leader + ")");
+	std::shared_ptr<rpc_client> rc = get_rpc_client(leader);
+
+	rc->subscribe(*context, [](const rpc_invalidation &inv) {
+		uuid table_ino = ino_controller->splice_prefix_and_postfix(inv.dentry_table_ino_prefix(), inv.dentry_table_ino_postfix());
+		switch (inv.kind()) {
+		case INVALIDATE_DENTRY_ADDED:
+		case INVALIDATE_DENTRY_REMOVED:
+			attr_cache->invalidate(table_ino, inv.filename());
+			attr_cache->invalidate(table_ino, "");
+			break;
+		case INVALIDATE_LEADER_CHANGED:
+			attr_cache->invalidate_table(table_ino);
+			break;
+		default:
+			attr_cache->invalidate(table_ino, inv.filename());
+			break;
+		}
+	});
+
+	/* the changes made while the stream was down are unknown */
+	attr_cache->invalidate_leader(leader);
+
+	std::scoped_lock lock(this->listener_mutex);
+	subscription &sub = this->subscriptions[leader];
+	sub.up = false;
+	sub.retry_after = std::chrono::steady_clock::now() + std::chrono::milliseconds(INVALIDATION_RESUBSCRIBE_MS);
+}
+
+void invalidation_listener::stop() {
+	std::vector<std::thread> listeners;
+	{
+		std::scoped_lock lock(this->listener_mutex);
+		this->stopping = true;
+		for (auto &sub : this->subscriptions) {
+			if (sub.second.context != nullptr)
+				sub.second.context->TryCancel();
+			if (sub.second.listener.joinable())
+				listeners.push_back(std::move(sub.second.listener));
+		}
+	}
+
+	for (std::thread &t : listeners)
+		t.join();
+}
@@ -0,0 +1,121 @@
+#ifndef NMFS_INVALIDATION_HPP
+#define NMFS_INVALIDATION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#include <boost/functional/hash.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <tsl/robin_map.h>
+
+#include "rpc.grpc.pb.h"
+
+/* a getattr beyond this many watches kept by the leader isn't watched */
+#define INVALIDATION_MAX_WATCHES (1048576)
+/* a subscriber this many invalidations behind is cut off, it drops what it cached from the leader */
+#define INVALIDATION_MAX_QUEUED (4096)
+/* how often a subscription stream checks that its subscriber is still there */
+#define INVALIDATION_POLL_MS (1000)
+/* a subscription that broke is opened again no sooner than this */
+#define INVALIDATION_RESUBSCRIBE_MS (1000)
+
+using std::shared_ptr;
+using namespace boost::uuids;
+
+class origin_context;
+
+/*
+ * Kept by the leader, it tells the subscribed followers which attributes they cached became stale.
+ *
+ * A getattr asking for it leaves a watch on the inode, keyed by the (dentry table, name) the follower cached it under.
+ * The journal hooks of the leader fire the watches of the inodes they change, a watch fires once and
+ * the next getattr of the follower leaves a new one. Handing a table over to another leader is told to every subscriber.
+ */
+class invalidation_hub {
+private:
+	struct subscriber {
+		std::mutex queue_mutex;
+		std::condition_variable queue_cv;
+		std::deque<rpc_invalidation> queue;
+		bool closed = false;
+	};
+
+	struct watch {
+		std::string origin;
+		uuid table_ino;
+		std::string name;
+	};
+
+	std::mutex hub_mutex;
+	/* <remote service address, its stream> */
+	tsl::robin_map<std::string, shared_ptr<subscriber>> subscribers;
+	/* <watched ino, watches> */
+	tsl::robin_map<uuid, std::vector<watch>, boost::hash<uuid>> watches;
+	/* the journal hooks skip the hub while nothing is watched */
+	std::atomic<uint64_t> watch_num;
+
+	static rpc_invalidation make_invalidation(rpc_invalidation_kind kind, const uuid &table_ino, const std::string &name);
+	/* the caller holds hub_mutex */
+	void push(const std::string &origin, const rpc_invalidation &inv);
+	void fire(const uuid &ino);
+	void drop_watches_if(const std::function<bool(const watch &)> &pred);
+
+public:
+	invalidation_hub();
+
+	/* 'origin' is told when 'ino', cached under 'name' of 'table_ino', changes. false if it isn't subscribed */
+	bool add_watch(const std::string &origin, const uuid &ino, const uuid &table_ino, const std::string &name);
+	/* streams the invalidations of 'origin' until it goes away */
+	void serve(const std::string &origin, grpc::ServerContext *context, grpc::ServerWriter<rpc_invalidation> *writer);
+	/* ends every stream, on unmount */
+	void stop();
+
+	/* journal hooks */
+	void attr_changed(const uuid &ino);
+	/* 'name' of the table 'table_ino', which holds the entries of directory 'dir_ino', is added or removed */
+	void dentry_changed(const uuid &dir_ino, const uuid &table_ino, const std::string &name, bool added);
+	/* the table is led by another client from now on */
+	void leader_changed(const uuid &table_ino);
+};
+
+/*
+ * Kept by a follower, one stream per leader it caches attributes from.
+ * The invalidations are applied to the attribute cache, which drops what it has from a leader whose stream broke.
+ */
+class invalidation_listener {
+private:
+	struct subscription {
+		shared_ptr<origin_context> context;
+		std::thread listener;
+		bool up = false;
+		std::chrono::steady_clock::time_point retry_after;
+	};
+
+	std::mutex listener_mutex;
+	/* <leader address, subscription> */
+	std::map<std::string, subscription> subscriptions;
+	bool stopping;
+
+	void listen(const std::string &leader, shared_ptr<origin_context> context);
+
+public:
+	invalidation_listener();
+	~invalidation_listener();
+
+	/* opens the stream to 'leader' if there is none, true if it is open */
+	bool subscribe(const std::string &leader);
+	void stop();
+};
+
+#endif //NMFS_INVALIDATION_HPP
@@ -1,28 +1,67 @@
 #include "rpc_client.hpp"
+#include "../in_memory/dentry_table.hpp"
 
 extern std::shared_ptr<rados_io> data_pool;
 extern std::unique_ptr<file_handler_list> open_context;
 extern std::unique_ptr<uuid_controller> ino_controller;
 extern std::unique_ptr<client> this_client;
 extern std::unique_ptr<journal> journalctl;
+extern std::shared_ptr<lease_client> lc;
+
+origin_context::origin_context() {
+	this->AddMetadata(RPC_ORIGIN_METADATA_KEY, lc->get_self_remote());
+}
 
 rpc_client::rpc_client(std::shared_ptr<Channel> channel) : stub_(remote_ops::NewStub(channel)){}
 
+/* keeps the leader named by an -ENOTLEADER reply in 'i', find_remote_dentry_table_again() goes there directly */
+static int redirected(const ClientContext &context, const shared_ptr<remote_inode> &i) {
+	const auto &trailers = context.GetServerTrailingMetadata();
+	auto leader = trailers.find(RPC_LEADER_HINT_METADATA_KEY);
+	if (leader == trailers.end()) {
+		i->set_leader_hint("", system_clock::time_point());
+		return -ENOTLEADER;
+	}
+
+	system_clock::time_point due;
+	auto due_ms = trailers.find(RPC_LEASE_DUE_METADATA_KEY);
+	if (due_ms != trailers.end())
+		due = system_clock::time_point(milliseconds(std::stoll(std::string(due_ms->second.data(), due_ms->second.length()))));
+
+	i->set_leader_hint(std::string(leader->second.data(), leader->second.length()), due);
+	return -ENOTLEADER;
+}
+
 /* dentry_table operations */
-uuid rpc_client::check_child_inode(uuid dentry_table_ino, std::string filename){
+static void get_perm_attr(const rpc_perm_attr &attr, perm_attr &out) {
+	out.valid = true;
+	out.s.st_mode = attr.i_mode();
+	out.s.st_uid = attr.i_uid();
+	out.s.st_gid = attr.i_gid();
+	out.generation = attr.generation();
+	out.watched = attr.watched();
+}
+
+uuid rpc_client::check_child_inode(uuid dentry_table_ino, std::string filename, bool watch, perm_attr &child_attr, perm_attr &dir_attr){
 	global_logger.log(rpc_client_ops, "Called check_child_inode()");
-	ClientContext context;
+	origin_context context;
 	rpc_dentry_table_request Input;
 	rpc_dentry_table_respond Output;
 
 	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(dentry_table_ino));
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(dentry_table_ino));
 	Input.set_filename(filename);
+	Input.set_watch(watch);
 
 	Status status = stub_->rpc_check_child_inode(&context, Input, &Output);
 	if(status.ok()){
+		/* the caller routes the name again */
 		if(Output.ret() == -ENOTLEADER)
-			throw std::runtime_error("ACCESS IMPROPER LEADER");
+			throw dentry_table::not_leader("ACCESS IMPROPER LEADER");
+		if(Output.has_child_attr())
+			get_perm_attr(Output.child_attr(), child_attr);
+		if(Output.has_dir_attr())
+			get_perm_attr(Output.dir_attr(), dir_attr);
 		return ino_controller->splice_prefix_and_postfix(Output.checked_ino_prefix(), Output.checked_ino_postfix());
 	} else {
 		global_logger.log(rpc_client_ops, status.error_message());
@@ -33,7 +72,7 @@ uuid rpc_client::check_child_inode(uuid dentry_table_ino, std::string filename){
 /* inode operations */
 mode_t rpc_client::get_mode(uuid dentry_table_ino, std::string filename){
 	global_logger.log(rpc_client_ops, "Called get_mode()");
-	ClientContext context;
+	origin_context context;
 	rpc_inode_request Input;
 	rpc_inode_respond Output;
 
@@ -54,7 +93,7 @@ mode_t rpc_client::get_mode(uuid dentry_table_ino, std::string filename){
 
 void rpc_client::permission_check(uuid dentry_table_ino, std::string filename, int mask, bool target_is_parent){
 	global_logger.log(rpc_client_ops, "Called permission_check()");
-	ClientContext context;
+	origin_context context;
 	rpc_inode_request Input;
 	rpc_inode_respond Output;
 
@@ -78,9 +117,9 @@ void rpc_client::permission_check(uuid dentry_table_ino, std::string filename, i
 }
 
 /* file system operations */
-int rpc_client::getattr(shared_ptr<remote_inode> i, struct stat* s) {
+int rpc_client::getattr(shared_ptr<remote_inode> i, struct stat* s, uint64_t &generation, bool &watched) {
 	global_logger.log(rpc_client_ops, "Called getattr()");
-	ClientContext context;
+	origin_context context;
 	rpc_getattr_request Input;
 	rpc_getattr_respond Output;
 
@@ -89,15 +128,22 @@ int rpc_client::getattr(shared_ptr<remote_inode> i, struct stat* s) {
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
 	Input.set_filename(i->get_file_name());
 	Input.set_target_is_parent(i->get_target_is_parent());
+	Input.set_known_generation(generation);
+	Input.set_watch(watched);
 
 	Status status = stub_->rpc_getattr(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
 		if(Output.ret() == -EACCES)
 			throw inode::no_entry("No such file or directory: rpc_client::getattr()");
 
+		generation = Output.generation();
+		watched = Output.watched();
+		if(Output.unchanged())
+			return Output.ret();
+
 		s->st_mode	= Output.i_mode();
 		s->st_uid	= Output.i_uid();
 		s->st_gid	= Output.i_gid();
@@ -122,7 +168,7 @@ int rpc_client::getattr(shared_ptr<remote_inode> i, struct stat* s) {
 
 int rpc_client::access(shared_ptr<remote_inode> i, int mask) {
 	global_logger.log(rpc_client_ops, "Called access()");
-	ClientContext context;
+	origin_context context;
 	rpc_access_request Input;
 	rpc_common_respond Output;
 
@@ -136,7 +182,7 @@ int rpc_client::access(shared_ptr<remote_inode> i, int mask) {
 	Status status = stub_->rpc_access(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
 		if(Output.ret() == -EACCES)
 			throw inode::permission_denied("Permission Denied: Remote");
@@ -151,9 +197,26 @@ int rpc_client::access(shared_ptr<remote_inode> i, int mask) {
 
 int rpc_client::opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_info) {
 	global_logger.log(rpc_client_ops, "Called opendir()");
-	ClientContext context;
+	uint64_t dir_handle = 0;
+	int ret = this->opendir(i, dir_handle);
+	if(ret == 0) {
+		shared_ptr<file_handler> fh = std::make_shared<file_handler>(i->get_ino());
+		fh->set_loc(REMOTE);
+		fh->set_remote_i(i);
+		fh->set_dir_handle(dir_handle);
+		file_info->fh = reinterpret_cast<uint64_t>(fh.get());
+		fh->set_fhno(file_info->fh);
+
+		open_context->add_file_handler(file_info->fh, fh);
+	}
+	return ret;
+}
+
+int rpc_client::opendir(shared_ptr<remote_inode> i, uint64_t &dir_handle) {
+	global_logger.log(rpc_client_ops, "Called opendir()");
+	origin_context context;
 	rpc_open_opendir_request Input;
-	rpc_common_respond Output;
+	rpc_opendir_respond Output;
 
 	/* prepare Input */
 	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_dentry_table_ino()));
@@ -164,18 +227,9 @@ int rpc_client::opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_
 	Status status = stub_->rpc_opendir(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
-		if(Output.ret() == 0) {
-			shared_ptr<file_handler> fh = std::make_shared<file_handler>(i->get_ino());
-			fh->set_loc(REMOTE);
-			fh->set_remote_i(i);
-			file_info->fh = reinterpret_cast<uint64_t>(fh.get());
-			fh->set_fhno(file_info->fh);
-
-			open_context->add_file_handler(file_info->fh, fh);
-			return Output.ret();
-		}
+		dir_handle = Output.dir_handle();
 		return Output.ret();
 	} else {
 		global_logger.log(rpc_client_ops, status.error_message());
@@ -184,27 +238,41 @@ int rpc_client::opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_
 	}
 }
 
-int rpc_client::readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_t filler) {
+int rpc_client::readdir(shared_ptr<remote_inode> i, uint64_t &dir_handle, uint64_t &offset, const std::string &resume_name, uint64_t max_entries,
+			std::vector<dir_cache_entry> &entries) {
 	global_logger.log(rpc_client_ops, "Called readdir()");
-	ClientContext context;
+	origin_context context;
 	rpc_readdir_request Input;
-	rpc_name_respond Output;
+	rpc_readdir_respond Output;
 
 	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_dentry_table_ino()));
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
-	std::unique_ptr<ClientReader<rpc_name_respond>> reader(stub_->rpc_readdir(&context, Input));
+	Input.set_dir_handle(dir_handle);
+	Input.set_offset(offset);
+	Input.set_max_entries(max_entries);
+	Input.set_resume_name(resume_name);
+	std::unique_ptr<ClientReader<rpc_readdir_respond>> reader(stub_->rpc_readdir(&context, Input));
 
+	/* each message carries a chunk of names */
+	bool read_any = false;
 	while(reader->Read(&Output)){
-		if(Output.ret() == 0)
-			filler(buffer, Output.filename().c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
-		else
+		if(Output.ret() != 0)
 			break;
+		if(!read_any && (Output.dir_handle() != 0)) {
+			dir_handle = Output.dir_handle();
+			offset = Output.offset();
+		}
+		read_any = true;
+		for(const std::string &name : Output.filename())
+			entries.push_back({name, false, {}});
 	}
 
 	Status status = reader->Finish();
 	if(status.ok()){
-		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+		if(Output.ret() == -ENOTLEADER) {
+			entries.clear();
+			return redirected(context, i);
+		}
 
 		return Output.ret();
 	} else {
@@ -214,9 +282,92 @@ int rpc_client::readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_
 	}
 }
 
+int rpc_client::readdirplus(shared_ptr<remote_inode> i, uint64_t &dir_handle, uint64_t &offset, const std::string &resume_name, uint64_t max_entries,
+			std::vector<dir_cache_entry> &entries) {
+	global_logger.log(rpc_client_ops, "Called readdirplus()");
+	origin_context context;
+	rpc_readdir_request Input;
+	rpc_readdirplus_respond Output;
+
+	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_dir_handle(dir_handle);
+	Input.set_offset(offset);
+	Input.set_max_entries(max_entries);
+	Input.set_resume_name(resume_name);
+	std::unique_ptr<ClientReader<rpc_readdirplus_respond>> reader(stub_->rpc_readdirplus(&context, Input));
+
+	bool read_any = false;
+	while(reader->Read(&Output)){
+		if(Output.ret() != 0)
+			break;
+		if(!read_any && (Output.dir_handle() != 0)) {
+			dir_handle = Output.dir_handle();
+			offset = Output.offset();
+		}
+		read_any = true;
+		for(const rpc_dirent &d : Output.dirent()) {
+			dir_cache_entry e{d.filename(), d.attr_valid(), {}};
+			if(d.attr_valid()) {
+				e.attr.st_mode	= d.i_mode();
+				e.attr.st_uid	= d.i_uid();
+				e.attr.st_gid	= d.i_gid();
+				e.attr.st_ino	= d.i_ino_postfix();
+				e.attr.st_nlink	= d.i_nlink();
+				e.attr.st_size	= d.i_size();
+
+				e.attr.st_atim.tv_sec	= d.a_sec();
+				e.attr.st_atim.tv_nsec	= d.a_nsec();
+				e.attr.st_mtim.tv_sec	= d.m_sec();
+				e.attr.st_mtim.tv_nsec	= d.m_nsec();
+				e.attr.st_ctim.tv_sec	= d.c_sec();
+				e.attr.st_ctim.tv_nsec	= d.c_nsec();
+			}
+			entries.push_back(std::move(e));
+		}
+	}
+
+	Status status = reader->Finish();
+	if(status.ok()){
+		if(Output.ret() == -ENOTLEADER) {
+			entries.clear();
+			return redirected(context, i);
+		}
+
+		return Output.ret();
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::readdirplus() failed");
+		return -ENEEDRECOV;
+	}
+}
+
+int rpc_client::releasedir(shared_ptr<remote_inode> i, uint64_t dir_handle) {
+	global_logger.log(rpc_client_ops, "Called releasedir()");
+	origin_context context;
+	rpc_releasedir_request Input;
+	rpc_common_respond Output;
+
+	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_dir_handle(dir_handle);
+
+	Status status = stub_->rpc_releasedir(&context, Input, &Output);
+	if(status.ok()){
+		if(Output.ret() == -ENOTLEADER)
+			return redirected(context, i);
+
+		return Output.ret();
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::releasedir() failed");
+		return -ENEEDRECOV;
+	}
+}
+
 int rpc_client::mkdir(shared_ptr<remote_inode> parent_i, std::string new_child_name, mode_t mode, std::shared_ptr<inode>& new_dir_inode, std::shared_ptr<dentry>& new_dir_dentry) {
 	global_logger.log(rpc_client_ops, "Called mkdir()");
-	ClientContext context;
+	origin_context context;
 	rpc_mkdir_request Input;
 	rpc_mkdir_respond Output;
 
@@ -232,12 +383,12 @@ int rpc_client::mkdir(shared_ptr<remote_inode> parent_i, std::string new_child_n
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER) {
 			new_dir_inode = nullptr;
-			return -ENOTLEADER;
+			return redirected(context, parent_i);
 		}
 
 		if(Output.ret() == 0){
 			uuid returned_dir_ino = ino_controller->splice_prefix_and_postfix(Output.new_dir_ino_prefix(), Output.new_dir_ino_postfix());
-			shared_ptr<inode> new_i = std::make_shared<inode>(parent_i->get_ino(), this_client->get_client_uid(), this_client->get_client_gid(), mode | S_IFDIR, returned_dir_ino);
+			shared_ptr<inode> new_i = make_inode(parent_i->get_ino(), this_client->get_client_uid(), this_client->get_client_gid(), mode | S_IFDIR, returned_dir_ino);
 			new_i->set_size(DIR_INODE_SIZE);
 
 			shared_ptr<dentry> new_d = std::make_shared<dentry>(new_i->get_ino(), true);
@@ -258,7 +409,7 @@ int rpc_client::mkdir(shared_ptr<remote_inode> parent_i, std::string new_child_n
 
 int rpc_client::rmdir_top(shared_ptr<remote_inode> target_i, uuid target_ino) {
 	global_logger.log(rpc_client_ops, "Called rmdir_top()");
-	ClientContext context;
+	origin_context context;
 	rpc_rmdir_request Input;
 	rpc_common_respond Output;
 
@@ -271,7 +422,7 @@ int rpc_client::rmdir_top(shared_ptr<remote_inode> target_i, uuid target_ino) {
 	Status status = stub_->rpc_rmdir_top(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, target_i);
 
 		return Output.ret();
 	} else {
@@ -283,7 +434,7 @@ int rpc_client::rmdir_top(shared_ptr<remote_inode> target_i, uuid target_ino) {
 
 int rpc_client::rmdir_down(shared_ptr<remote_inode> parent_i, uuid target_ino, std::string target_name) {
 	global_logger.log(rpc_client_ops, "Called rmdir_down()");
-	ClientContext context;
+	origin_context context;
 	rpc_rmdir_request Input;
 	rpc_common_respond Output;
 
@@ -296,7 +447,7 @@ int rpc_client::rmdir_down(shared_ptr<remote_inode> parent_i, uuid target_ino, s
 	Status status = stub_->rpc_rmdir_down(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, parent_i);
 
 		return Output.ret();
 	} else {
@@ -308,7 +459,7 @@ int rpc_client::rmdir_down(shared_ptr<remote_inode> parent_i, uuid target_ino, s
 
 int rpc_client::symlink(shared_ptr<remote_inode> dst_parent_i, const char *src, const char *dst) {
 	global_logger.log(rpc_client_ops, "Called symlink()");
-	ClientContext context;
+	origin_context context;
 	rpc_symlink_request Input;
 	rpc_common_respond Output;
 
@@ -322,7 +473,7 @@ int rpc_client::symlink(shared_ptr<remote_inode> dst_parent_i, const char *src,
 	Status status = stub_->rpc_symlink(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, dst_parent_i);
 
 		return Output.ret();
 	} else {
@@ -334,7 +485,7 @@ int rpc_client::symlink(shared_ptr<remote_inode> dst_parent_i, const char *src,
 
 int rpc_client::readlink(shared_ptr<remote_inode> i, char *buf, size_t size) {
 	global_logger.log(rpc_client_ops, "Called readlink()");
-	ClientContext context;
+	origin_context context;
 	rpc_readlink_request Input;
 	rpc_name_respond Output;
 
@@ -347,7 +498,7 @@ int rpc_client::readlink(shared_ptr<remote_inode> i, char *buf, size_t size) {
 	Status status = stub_->rpc_readlink(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
 		if(Output.ret() == 0) {
 			/* fill buffer */
@@ -366,7 +517,7 @@ int rpc_client::readlink(shared_ptr<remote_inode> i, char *buf, size_t size) {
 
 int rpc_client::rename_same_parent(shared_ptr<remote_inode> parent_i, const char* old_path, const char* new_path, unsigned int flags) {
 	global_logger.log(rpc_client_ops, "Called access()");
-	ClientContext context;
+	origin_context context;
 	rpc_rename_same_parent_request Input;
 	rpc_common_respond Output;
 
@@ -380,7 +531,7 @@ int rpc_client::rename_same_parent(shared_ptr<remote_inode> parent_i, const char
 	Status status = stub_->rpc_rename_same_parent(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, parent_i);
 
 		return Output.ret();
 	} else {
@@ -390,72 +541,61 @@ int rpc_client::rename_same_parent(shared_ptr<remote_inode> parent_i, const char
 	}
 }
 
-int rpc_client::rename_not_same_parent_src(shared_ptr<remote_inode> src_parent_i, const char* old_path, unsigned int flags, std::shared_ptr<inode>& target_inode) {
-	global_logger.log(rpc_client_ops, "Called remote_rename_not_same_parent_src()");
-	ClientContext context;
-	rpc_rename_not_same_parent_src_request Input;
-	rpc_rename_not_same_parent_src_respond Output;
+int rpc_client::rename(shared_ptr<remote_inode> src_parent_i, const char* old_path, const uuid &dst_parent_ino, const char* new_path, unsigned int flags) {
+	global_logger.log(rpc_client_ops, "Called rename()");
+	origin_context context;
+	rpc_rename_request Input;
+	rpc_common_respond Output;
 
 	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(src_parent_i->get_dentry_table_ino()));
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(src_parent_i->get_dentry_table_ino()));
 	Input.set_old_path(old_path);
+	Input.set_dst_parent_ino_prefix(ino_controller->get_prefix_from_uuid(dst_parent_ino));
+	Input.set_dst_parent_ino_postfix(ino_controller->get_postfix_from_uuid(dst_parent_ino));
+	Input.set_new_path(new_path);
 	Input.set_flags(flags);
 
-	Status status = stub_->rpc_rename_not_same_parent_src(&context, Input, &Output);
+	Status status = stub_->rpc_rename(&context, Input, &Output);
 	if(status.ok()){
-		if(Output.ret() == -ENOTLEADER) {
-			target_inode = nullptr;
-			return -ENOTLEADER;
-		}
-
-		if(Output.ret() == -ENOSYS) {
-			throw std::runtime_error("Flag specific behaviors of rename operation are not implemented");
-		}
-
-		if(Output.ret() == 0) {
-			target_inode = std::make_shared<inode>(NOBODY);
-			target_inode->rename_src_response_to_inode(Output);
-		}
+		if(Output.ret() == -ENOTLEADER)
+			return redirected(context, src_parent_i);
 
 		return Output.ret();
 	} else {
 		global_logger.log(rpc_client_ops, status.error_message());
-		global_logger.log(rpc_client_ops, "rpc_client::remote_rename_not_same_parent_src() failed");
-		target_inode = nullptr;
+		global_logger.log(rpc_client_ops, "rpc_client::rename() failed");
 		return -ENEEDRECOV;
 	}
 }
 
-int rpc_client::rename_not_same_parent_dst(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode>& target_inode, uuid check_dst_ino, const char* new_path, unsigned int flags) {
-	global_logger.log(rpc_client_ops, "Called remote_rename_not_same_parent_dst()");
-	ClientContext context;
-	rpc_rename_not_same_parent_dst_request Input;
+int rpc_client::rename_link(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode> target_inode, unsigned int flags) {
+	global_logger.log(rpc_client_ops, "Called rename_link()");
+	origin_context context;
+	rpc_rename_link_request Input;
 	rpc_common_respond Output;
 
-	target_inode->inode_to_rename_dst_request(Input);
+	target_inode->inode_to_rename_link_request(Input);
 	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(dst_parent_i->get_dentry_table_ino()));
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(dst_parent_i->get_dentry_table_ino()));
-	Input.set_check_dst_ino_prefix(ino_controller->get_prefix_from_uuid(check_dst_ino));
-	Input.set_check_dst_ino_postfix(ino_controller->get_postfix_from_uuid(check_dst_ino));
-	Input.set_new_path(new_path);
+	Input.set_new_name(dst_parent_i->get_file_name());
 	Input.set_flags(flags);
 
-	Status status = stub_->rpc_rename_not_same_parent_dst(&context, Input, &Output);
+	Status status = stub_->rpc_rename_link(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, dst_parent_i);
 
 		return Output.ret();
 	} else {
 		global_logger.log(rpc_client_ops, status.error_message());
-		global_logger.log(rpc_client_ops, "rpc_client::remote_rename_not_same_parent_dst() failed");
+		global_logger.log(rpc_client_ops, "rpc_client::rename_link() failed");
 		return -ENEEDRECOV;
 	}
 }
 
 int rpc_client::open(shared_ptr<remote_inode> i, struct fuse_file_info* file_info) {
 	global_logger.log(rpc_client_ops, "Called open()");
-	ClientContext context;
+	origin_context context;
 	rpc_open_opendir_request Input;
 	rpc_common_respond Output;
 
@@ -468,7 +608,7 @@ int rpc_client::open(shared_ptr<remote_inode> i, struct fuse_file_info* file_inf
 	Status status = stub_->rpc_open(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 		else if(Output.ret() == 0) {
 			shared_ptr<file_handler> fh = std::make_shared<file_handler>(i->get_ino());
 			fh->set_loc(REMOTE);
@@ -488,7 +628,7 @@ int rpc_client::open(shared_ptr<remote_inode> i, struct fuse_file_info* file_inf
 
 int rpc_client::create(shared_ptr<remote_inode> parent_i, std::string new_child_name, mode_t mode, struct fuse_file_info* file_info) {
 	global_logger.log(rpc_client_ops, "Called create()");
-	ClientContext context;
+	origin_context context;
 	rpc_create_request Input;
 	rpc_create_respond Output;
 
@@ -497,11 +637,13 @@ int rpc_client::create(shared_ptr<remote_inode> parent_i, std::string new_child_
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(parent_i->get_dentry_table_ino()));
 	Input.set_new_file_name(new_child_name);
 	Input.set_new_mode(mode);
+	Input.set_uid(this_client->get_client_uid());
+	Input.set_gid(this_client->get_client_gid());
 
 	Status status = stub_->rpc_create(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, parent_i);
 		else if(Output.ret() == 0) {
 			uuid new_ino = ino_controller->splice_prefix_and_postfix(Output.new_ino_prefix(), Output.new_ino_postfix());
 			shared_ptr<file_handler> fh = std::make_shared<file_handler>(new_ino);
@@ -522,9 +664,37 @@ int rpc_client::create(shared_ptr<remote_inode> parent_i, std::string new_child_
 	}
 }
 
+int rpc_client::create(shared_ptr<remote_inode> parent_i, const std::string &new_child_name, std::shared_ptr<inode> new_i) {
+	global_logger.log(rpc_client_ops, "Called create(" + new_child_name + ")");
+	origin_context context;
+	rpc_create_request Input;
+	rpc_create_respond Output;
+
+	/* prepare Input */
+	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(parent_i->get_dentry_table_ino()));
+	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(parent_i->get_dentry_table_ino()));
+	Input.set_new_file_name(new_child_name);
+	Input.set_new_mode(new_i->get_mode());
+	Input.set_uid(new_i->get_uid());
+	Input.set_gid(new_i->get_gid());
+	Input.set_new_ino_prefix(ino_controller->get_prefix_from_uuid(new_i->get_ino()));
+	Input.set_new_ino_postfix(ino_controller->get_postfix_from_uuid(new_i->get_ino()));
+
+	Status status = stub_->rpc_create(&context, Input, &Output);
+	if(status.ok()){
+		if(Output.ret() == -ENOTLEADER)
+			return redirected(context, parent_i);
+		return Output.ret();
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::create() failed");
+		return -ENEEDRECOV;
+	}
+}
+
 int rpc_client::unlink(shared_ptr<remote_inode> parent_i, std::string child_name) {
 	global_logger.log(rpc_client_ops, "Called unlink()");
-	ClientContext context;
+	origin_context context;
 	rpc_unlink_request Input;
 	rpc_common_respond Output;
 
@@ -536,7 +706,7 @@ int rpc_client::unlink(shared_ptr<remote_inode> parent_i, std::string child_name
 	Status status = stub_->rpc_unlink(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, parent_i);
 
 		return Output.ret();
 	} else {
@@ -549,7 +719,7 @@ int rpc_client::unlink(shared_ptr<remote_inode> parent_i, std::string child_name
 
 ssize_t rpc_client::write(shared_ptr<remote_inode> i, const char* buffer, size_t size, off_t offset, int flags) {
 	global_logger.log(rpc_client_ops, "Called write()");
-	ClientContext context;
+	origin_context context;
 	rpc_write_request Input;
 	rpc_write_respond Output;
 
@@ -564,7 +734,7 @@ ssize_t rpc_client::write(shared_ptr<remote_inode> i, const char* buffer, size_t
 	Status status = stub_->rpc_write(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 		else if(Output.ret() == 0) {
 			size_t written_len = data_pool->write(obj_category::DATA, uuid_to_string(i->get_ino()), buffer, Output.size(), Output.offset());
 			return static_cast<ssize_t>(written_len);
@@ -579,7 +749,7 @@ ssize_t rpc_client::write(shared_ptr<remote_inode> i, const char* buffer, size_t
 
 int rpc_client::chmod(shared_ptr<remote_inode> i, mode_t mode) {
 	global_logger.log(rpc_client_ops, "Called chmod()");
-	ClientContext context;
+	origin_context context;
 	rpc_chmod_request Input;
 	rpc_common_respond Output;
 
@@ -588,11 +758,12 @@ int rpc_client::chmod(shared_ptr<remote_inode> i, mode_t mode) {
 	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
 	Input.set_filename(i->get_file_name());
 	Input.set_mode(mode);
+	Input.set_target_is_parent(i->get_target_is_parent());
 
 	Status status = stub_->rpc_chmod(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
 		return Output.ret();
 	} else {
@@ -604,7 +775,7 @@ int rpc_client::chmod(shared_ptr<remote_inode> i, mode_t mode) {
 
 int rpc_client::chown(shared_ptr<remote_inode> i, uid_t uid, gid_t gid) {
 	global_logger.log(rpc_client_ops, "Called chown()");
-	ClientContext context;
+	origin_context context;
 	rpc_chown_request Input;
 	rpc_common_respond Output;
 
@@ -619,7 +790,7 @@ int rpc_client::chown(shared_ptr<remote_inode> i, uid_t uid, gid_t gid) {
 	Status status = stub_->rpc_chown(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
 		return Output.ret();
 	} else {
@@ -631,7 +802,7 @@ int rpc_client::chown(shared_ptr<remote_inode> i, uid_t uid, gid_t gid) {
 
 int rpc_client::utimens(shared_ptr<remote_inode> i, const struct timespec tv[2]) {
 	global_logger.log(rpc_client_ops, "Called utimens()");
-	ClientContext context;
+	origin_context context;
 	rpc_utimens_request Input;
 	rpc_common_respond Output;
 
@@ -648,7 +819,7 @@ int rpc_client::utimens(shared_ptr<remote_inode> i, const struct timespec tv[2])
 	Status status = stub_->rpc_utimens(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 
 		return Output.ret();
 	} else {
@@ -660,7 +831,7 @@ int rpc_client::utimens(shared_ptr<remote_inode> i, const struct timespec tv[2])
 
 int rpc_client::truncate(shared_ptr<remote_inode> i, off_t offset) {
 	global_logger.log(rpc_client_ops, "Called truncate()");
-	ClientContext context;
+	origin_context context;
 	rpc_truncate_request Input;
 	rpc_common_respond Output;
 
@@ -674,7 +845,7 @@ int rpc_client::truncate(shared_ptr<remote_inode> i, off_t offset) {
 	Status status = stub_->rpc_truncate(&context, Input, &Output);
 	if(status.ok()){
 		if(Output.ret() == -ENOTLEADER)
-			return -ENOTLEADER;
+			return redirected(context, i);
 		else if(Output.ret() == 0) {
 			int ret = data_pool->truncate(obj_category::DATA, uuid_to_string(i->get_ino()), offset);
 			return ret;
@@ -686,3 +857,107 @@ int rpc_client::truncate(shared_ptr<remote_inode> i, off_t offset) {
 		return -ENEEDRECOV;
 	}
 }
+
+int rpc_client::delegate(shared_ptr<remote_inode> i, off_t &size, struct timespec &mtime) {
+	global_logger.log(rpc_client_ops, "Called delegate()");
+	origin_context context;
+	rpc_delegate_request Input;
+	rpc_delegation_respond Output;
+
+	/* prepare Input */
+	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_filename(i->get_file_name());
+
+	Status status = stub_->rpc_delegate(&context, Input, &Output);
+	if(status.ok()){
+		if(Output.ret() == -ENOTLEADER)
+			return redirected(context, i);
+		else if(Output.ret() == 0) {
+			size = Output.i_size();
+			mtime.tv_sec = Output.m_sec();
+			mtime.tv_nsec = Output.m_nsec();
+		}
+		return Output.ret();
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::delegate() failed");
+		return -ENEEDRECOV;
+	}
+}
+
+int rpc_client::return_delegation(shared_ptr<remote_inode> i, off_t size, struct timespec mtime, bool release) {
+	global_logger.log(rpc_client_ops, "Called return_delegation()");
+	origin_context context;
+	rpc_return_delegation_request Input;
+	rpc_common_respond Output;
+
+	/* prepare Input */
+	Input.set_dentry_table_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_dentry_table_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_dentry_table_ino()));
+	Input.set_filename(i->get_file_name());
+	Input.set_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_ino()));
+	Input.set_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_ino()));
+	Input.set_i_size(size);
+	Input.set_m_sec(mtime.tv_sec);
+	Input.set_m_nsec(mtime.tv_nsec);
+	Input.set_release(release);
+
+	Status status = stub_->rpc_return_delegation(&context, Input, &Output);
+	if(status.ok()){
+		if(Output.ret() == -ENOTLEADER)
+			return redirected(context, i);
+
+		return Output.ret();
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::return_delegation() failed");
+		return -ENEEDRECOV;
+	}
+}
+
+int rpc_client::recall_delegation(uuid ino, off_t &size, struct timespec &mtime) {
+	global_logger.log(rpc_client_ops, "Called recall_delegation()");
+	origin_context context;
+	rpc_recall_delegation_request Input;
+	rpc_delegation_respond Output;
+	/* the leader doesn't wait on a holder which is gone, the delegation is dropped instead */
+	context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(DELEGATION_RECALL_TIMEOUT_MS));
+
+	/* prepare Input */
+	Input.set_ino_prefix(ino_controller->get_prefix_from_uuid(ino));
+	Input.set_ino_postfix(ino_controller->get_postfix_from_uuid(ino));
+
+	Status status = stub_->rpc_recall_delegation(&context, Input, &Output);
+	if(status.ok()){
+		if(Output.ret() == 0) {
+			size = Output.i_size();
+			mtime.tv_sec = Output.m_sec();
+			mtime.tv_nsec = Output.m_nsec();
+		}
+		return Output.ret();
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::recall_delegation() failed");
+		return -ENEEDRECOV;
+	}
+}
+
+int rpc_client::subscribe(origin_context &context, const std::function<void(const rpc_invalidation &)> &apply) {
+	global_logger.log(rpc_client_ops, "Called subscribe()");
+	rpc_subscribe_request Input;
+	rpc_invalidation Output;
+
+	std::unique_ptr<ClientReader<rpc_invalidation>> reader(stub_->rpc_subscribe(&context, Input));
+	while(reader->Read(&Output))
+		apply(Output);
+
+	Status status = reader->Finish();
+	if(status.ok()){
+		return 0;
+	} else {
+		global_logger.log(rpc_client_ops, status.error_message());
+		global_logger.log(rpc_client_ops, "rpc_client::subscribe() ended");
+		return -ENEEDRECOV;
+	}
+}
@@ -1,6 +1,8 @@
 #ifndef NMFS_RPC_CLIENT_HPP
 #define NMFS_RPC_CLIENT_HPP
 
+#include <functional>
+
 #include <grpcpp/grpcpp.h>
 
 #include "rpc.grpc.pb.h"
@@ -15,8 +17,31 @@ using grpc::ClientContext;
 using grpc::Status;
 using grpc::ClientReader;
 
+#define READDIR_BATCH_SIZE (4096)
+/* how long the leader waits for the holder of a write delegation to give it back */
+#define DELEGATION_RECALL_TIMEOUT_MS (1000)
+
+/* metadata key of the remote service address of the caller, the leader accounts the operation to it */
+#define RPC_ORIGIN_METADATA_KEY "nmfs-origin"
+/* trailing metadata keys of an -ENOTLEADER reply, the leader of the table as known by the replier and its lease due in ms since the epoch */
+#define RPC_LEADER_HINT_METADATA_KEY "nmfs-leader"
+#define RPC_LEASE_DUE_METADATA_KEY "nmfs-lease-due"
+
 using std::shared_ptr;
 
+class origin_context : public ClientContext {
+public:
+	origin_context();
+};
+
+/* the permission attributes returned along with a lookup, only st_mode, st_uid and st_gid of 's' are set */
+struct perm_attr {
+	bool valid = false;
+	struct stat s{};
+	uint64_t generation = 0;
+	bool watched = false;
+};
+
 class rpc_client {
 private:
 	std::unique_ptr<remote_ops::Stub> stub_;
@@ -25,32 +50,58 @@ public:
 	rpc_client(std::shared_ptr<Channel> channel);
 
 	/* dentry_table operations */
-	uuid check_child_inode(uuid dentry_table_ino, std::string filename);
+	/* 'watch' asks the leader to push the invalidation of the attributes returned in 'child_attr' and 'dir_attr' */
+	uuid check_child_inode(uuid dentry_table_ino, std::string filename, bool watch, perm_attr &child_attr, perm_attr &dir_attr);
 
 	/* inode operations */
 	mode_t get_mode(uuid dentry_table_ino, std::string filename);
 	void permission_check(uuid dentry_table_ino, std::string filename, int mask, bool target_is_parent);
 	/* file system operations */
-	int getattr(shared_ptr<remote_inode> i, struct stat* s);
+	/*
+	 * 'generation' is the one of the attributes already in 's', 0 if there are none.
+	 * 's' is left as is if they are current, 'generation' is set to the current one either way.
+	 * 'watched' asks the leader to push the invalidation of the attributes, it is left set if it will.
+	 */
+	int getattr(shared_ptr<remote_inode> i, struct stat* s, uint64_t &generation, bool &watched);
 	int access(shared_ptr<remote_inode> i, int mask);
 	int opendir(shared_ptr<remote_inode> i, struct fuse_file_info* file_info);
-	int readdir(shared_ptr<remote_inode> i, void* buffer, fuse_fill_dir_t filler);
+	/* pins a snapshot of the table of 'i' at its leader without opening a handle here */
+	int opendir(shared_ptr<remote_inode> i, uint64_t &dir_handle);
+	/* 'dir_handle' and 'offset' are moved if the leader pinned the snapshot again, see dentry_table::get_open_snapshot() */
+	int readdir(shared_ptr<remote_inode> i, uint64_t &dir_handle, uint64_t &offset, const std::string &resume_name, uint64_t max_entries,
+		    std::vector<dir_cache_entry> &entries);
+	int readdirplus(shared_ptr<remote_inode> i, uint64_t &dir_handle, uint64_t &offset, const std::string &resume_name, uint64_t max_entries,
+			std::vector<dir_cache_entry> &entries);
+	int releasedir(shared_ptr<remote_inode> i, uint64_t dir_handle);
 	int mkdir(shared_ptr<remote_inode> parent_i, std::string new_child_name, mode_t mode, std::shared_ptr<inode>& new_dir_inode, std::shared_ptr<dentry>& new_dir_dentry);
 	int rmdir_top(shared_ptr<remote_inode> target_i, uuid target_ino);
 	int rmdir_down(shared_ptr<remote_inode> parent_i, uuid target_ino, std::string target_name);
 	int symlink(shared_ptr<remote_inode> dst_parent_i, const char *src, const char *dst);
 	int readlink(shared_ptr<remote_inode> i, char *buf, size_t size);
 	int rename_same_parent(shared_ptr<remote_inode> parent_i, const char* old_path, const char* new_path, unsigned int flags);
-	int rename_not_same_parent_src(shared_ptr<remote_inode> src_parent_i, const char* old_path, unsigned int flags, std::shared_ptr<inode>& target_inode);
-	int rename_not_same_parent_dst(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode>& target_inode, uuid check_dst_ino, const char* new_path, unsigned int flags);
+	/* to the leader of the source, which has the name linked in 'dst_parent_ino' by the leader of the destination */
+	int rename(shared_ptr<remote_inode> src_parent_i, const char* old_path, const uuid &dst_parent_ino, const char* new_path, unsigned int flags);
+	/* to the leader of the destination, the new name is the one of 'dst_parent_i' */
+	int rename_link(shared_ptr<remote_inode> dst_parent_i, std::shared_ptr<inode> target_inode, unsigned int flags);
 	int open(shared_ptr<remote_inode> i, struct fuse_file_info* file_info);
 	int create(shared_ptr<remote_inode> parent_i, std::string new_child_name, mode_t mode, struct fuse_file_info* file_info);
+	/* creates 'new_i', whose ino is allocated by this client, without opening it */
+	int create(shared_ptr<remote_inode> parent_i, const std::string &new_child_name, std::shared_ptr<inode> new_i);
 	int unlink(shared_ptr<remote_inode> parent_i, std::string child_name);
 	ssize_t write(shared_ptr<remote_inode>i, const char* buffer, size_t size, off_t offset, int flags);
 	int chmod(shared_ptr<remote_inode> i, mode_t mode);
 	int chown(shared_ptr<remote_inode> i, uid_t uid, gid_t gid);
 	int utimens(shared_ptr<remote_inode> i, const struct timespec tv[2]);
 	int truncate(shared_ptr<remote_inode> i, off_t offset);
+
+	/* write delegation of the file 'i', the size and mtime known by the leader are returned */
+	int delegate(shared_ptr<remote_inode> i, off_t &size, struct timespec &mtime);
+	int return_delegation(shared_ptr<remote_inode> i, off_t size, struct timespec mtime, bool release);
+	/* sent by the leader to the holder of the delegation of 'ino' */
+	int recall_delegation(uuid ino, off_t &size, struct timespec &mtime);
+
+	/* passes the invalidations pushed by the leader to 'apply' until the stream ends or 'context' is cancelled */
+	int subscribe(origin_context &context, const std::function<void(const rpc_invalidation &)> &apply);
 };
 
 
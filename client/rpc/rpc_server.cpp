@@ -1,5 +1,10 @@
 #include "rpc_server.hpp"
 
+#include "invalidation.hpp"
+
+#include "../fs_ops/cross_rename.hpp"
+#include "../fs_ops/write_delegation.hpp"
+
 /* TODO : thread cannot read fuse_ctx, so only work with root uid and gid*/
 extern std::shared_ptr<rados_io> meta_pool;
 extern std::shared_ptr<rados_io> data_pool;
@@ -10,16 +15,90 @@ extern std::unique_ptr<Server> remote_handle;
 extern std::unique_ptr<client> this_client;
 
 extern std::unique_ptr<journal> journalctl;
+/* nullptr if the writes of this client in REMOTE directories always go through the leader */
+extern std::unique_ptr<write_delegation_table> write_delegations;
+extern std::unique_ptr<invalidation_hub> invalidations;
+
 void run_rpc_server(const std::string& remote_address){
 	rpc_server rpc_service;
+	lease_callback_impl lease_callback_service;
 	ServerBuilder builder;
 	builder.AddListeningPort(remote_address, grpc::InsecureServerCredentials());
 	builder.RegisterService(&rpc_service);
+	builder.RegisterService(&lease_callback_service);
 	remote_handle = builder.BuildAndStart();
 
 	remote_handle->Wait();
 }
 
+static std::string get_origin(::grpc::ServerContext *context) {
+	auto it = context->client_metadata().find(RPC_ORIGIN_METADATA_KEY);
+	if (it == context->client_metadata().end())
+		return "";
+
+	return std::string(it->second.data(), it->second.length());
+}
+
+/* an -ENOTLEADER reply names the leader of 'ino' as best known here, the caller goes there without asking the manager */
+static void add_leader_hint(uuid ino, ::grpc::ServerContext *context) {
+	std::string leader;
+	std::chrono::system_clock::time_point due;
+	if (!indexing_table->get_leader_hint(ino, leader, due))
+		return;
+
+	context->AddTrailingMetadata(RPC_LEADER_HINT_METADATA_KEY, leader);
+	context->AddTrailingMetadata(RPC_LEASE_DUE_METADATA_KEY,
+				     std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(due.time_since_epoch()).count()));
+}
+
+/*
+ * The table of a directory this client leads, the operation is accounted to the calling peer.
+ * A directory dominated by a peer is handed over to it off the rpc thread, once the handlers drop the table.
+ */
+static std::shared_ptr<dentry_table> get_served_dentry_table(uuid ino, ::grpc::ServerContext *context) {
+	std::shared_ptr<dentry_table> dtable;
+	try {
+		dtable = indexing_table->get_dentry_table(ino, true);
+		/* a follower of the directory too */
+		if (dtable->get_loc() != LOCAL)
+			throw dentry_table::not_leader("This client doesn't lead this dentry table");
+	} catch (dentry_table::not_leader &e) {
+		add_leader_hint(ino, context);
+		throw;
+	}
+
+	std::string migrate_to;
+	if (dtable->count_peer_op(get_origin(context), migrate_to)) {
+		std::thread([ino, migrate_to]() {
+			for (int retry = 0; retry < DIRECTORY_MIGRATE_RETRY; retry++) {
+				if (indexing_table->migrate_dentry_table(ino, migrate_to) == 0)
+					break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(DIRECTORY_MIGRATE_RETRY_MS));
+			}
+		}).detach();
+	}
+
+	return dtable;
+}
+
+/* the leader splits a directory whose names are hot for the other clients, no lock of the table may be held */
+static void count_remote_op(const std::shared_ptr<dentry_table> &dtable) {
+	if (dtable->count_remote_op())
+		indexing_table->fragment_directory(dtable->get_dir_ino(), DIRECTORY_FRAGMENT_DEPTH);
+}
+
+/* the permission attributes a lookup returns along, watched for the caller like the ones of getattr */
+static void set_perm_attr(::grpc::ServerContext *context, const std::shared_ptr<inode> &i, const uuid &table_ino, const std::string &name,
+			  bool watch, rpc_perm_attr *attr) {
+	std::scoped_lock scl{i->inode_mutex};
+	if (watch)
+		attr->set_watched(invalidations->add_watch(get_origin(context), i->get_ino(), table_ino, name));
+	attr->set_generation(i->get_generation());
+	attr->set_i_mode(i->get_mode());
+	attr->set_i_uid(i->get_uid());
+	attr->set_i_gid(i->get_gid());
+}
+
 Status rpc_server::rpc_check_child_inode(::grpc::ServerContext *context, const ::rpc_dentry_table_request *request,
 										 ::rpc_dentry_table_respond *response) {
 	global_logger.log(rpc_server_ops, "Called rpc_check_child_inode()");
@@ -27,21 +106,35 @@ Status rpc_server::rpc_check_child_inode(::grpc::ServerContext *context, const :
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
-	uuid check_target_ino{};
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		check_target_ino = parent_dentry_table->check_child_inode(request->filename());
-	}
+	uuid check_target_ino = parent_dentry_table->check_child_inode(request->filename());
 
 	response->set_checked_ino_prefix(ino_controller->get_prefix_from_uuid(check_target_ino));
 	response->set_checked_ino_postfix(ino_controller->get_postfix_from_uuid(check_target_ino));
+
+	/* the caller walks on without asking for the modes it would check next */
+	if (!check_target_ino.is_nil()) {
+		try {
+			std::shared_ptr<inode> i = parent_dentry_table->get_child_inode(request->filename(), check_target_ino);
+			set_perm_attr(context, i, dentry_table_ino, request->filename(), request->watch(), response->mutable_child_attr());
+		} catch (inode::no_entry &e) {
+			/* removed since the lookup, the caller asks for the mode itself */
+		}
+	}
+	if (parent_dentry_table->get_frag_parent().is_nil()) {
+		std::shared_ptr<inode> dir_i = parent_dentry_table->get_this_dir_inode();
+		if (dir_i != nullptr)
+			set_perm_attr(context, dir_i, dentry_table_ino, "", request->watch(), response->mutable_dir_attr());
+	}
+
 	response->set_ret(0);
+	count_remote_op(parent_dentry_table);
 	return Status::OK;
 }
 
@@ -52,17 +145,14 @@ Status rpc_server::rpc_get_mode(::grpc::ServerContext *context, const ::rpc_inod
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
-	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		i = parent_dentry_table->get_child_inode(request->filename());
-	}
+	std::shared_ptr<inode> i = parent_dentry_table->get_child_inode(request->filename());
 
 	{
 		std::scoped_lock scl{i->inode_mutex};
@@ -80,22 +170,21 @@ Status rpc_server::rpc_permission_check(::grpc::ServerContext *context, const ::
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
 	}
 
 	try {
@@ -118,7 +207,9 @@ Status rpc_server::rpc_getattr(::grpc::ServerContext *context, const ::rpc_getat
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -126,7 +217,6 @@ Status rpc_server::rpc_getattr(::grpc::ServerContext *context, const ::rpc_getat
 
 	std::shared_ptr<inode> i;
 	try {
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
 		if(request->target_is_parent()) {
 			global_logger.log(rpc_server_ops, "target is parent");
 			i = parent_dentry_table->get_this_dir_inode();
@@ -139,8 +229,24 @@ Status rpc_server::rpc_getattr(::grpc::ServerContext *context, const ::rpc_getat
 		return Status::OK;
 	}
 
+	/* the size and mtime of a file written under a delegation are the ones of its holder */
+	if (!request->target_is_parent())
+		recall_write_delegation(parent_dentry_table, i, get_origin(context));
+
 	{
 		std::scoped_lock scl{i->inode_mutex};
+		/* watched before the attributes are read, a change right after them is pushed */
+		if (request->watch())
+			response->set_watched(invalidations->add_watch(get_origin(context), i->get_ino(), dentry_table_ino,
+								       request->target_is_parent() ? "" : request->filename()));
+		response->set_generation(i->get_generation());
+		/* the attributes cached by the caller are current, they aren't sent again */
+		if ((request->known_generation() != 0) && (request->known_generation() == i->get_generation())) {
+			response->set_unchanged(true);
+			response->set_ret(0);
+			return Status::OK;
+		}
+
 		response->set_i_mode(i->get_mode());
 		response->set_i_uid(i->get_uid());
 		response->set_i_gid(i->get_gid());
@@ -167,22 +273,21 @@ Status rpc_server::rpc_access(::grpc::ServerContext *context, const ::rpc_access
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
 	}
 
 	try{
@@ -198,28 +303,27 @@ Status rpc_server::rpc_access(::grpc::ServerContext *context, const ::rpc_access
 }
 
 Status rpc_server::rpc_opendir(::grpc::ServerContext *context, const ::rpc_open_opendir_request *request,
-							   ::rpc_common_respond *response) {
+							   ::rpc_opendir_respond *response) {
 	global_logger.log(rpc_server_ops, "Called rpc_opendir(" + request->filename() + ")");
 	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
 	}
 
 	{
@@ -229,36 +333,133 @@ Status rpc_server::rpc_opendir(::grpc::ServerContext *context, const ::rpc_open_
 			return Status::OK;
 		}
 	}
+
+	/* pin the children of this directory so that later readdir offsets stay valid */
+	if (request->target_is_parent())
+		response->set_dir_handle(parent_dentry_table->open_snapshot());
+
 	response->set_ret(0);
 	return Status::OK;
 }
 
 Status rpc_server::rpc_readdir(::grpc::ServerContext *context, const ::rpc_readdir_request *request,
-							   ::grpc::ServerWriter<::rpc_name_respond> *writer) {
+							   ::grpc::ServerWriter<::rpc_readdir_respond> *writer) {
 	global_logger.log(rpc_server_ops, "Called rpc_readdir()");
-	rpc_name_respond response;
+	rpc_readdir_respond response;
 	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response.set_ret(-ENOTLEADER);
+		writer->Write(response);
 		return Status::OK;
 	}
 
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		std::map<std::string, shared_ptr<inode>>::iterator it;
-		response.set_filename(".");
+	/* stream from a snapshot, creates in this directory are not blocked during the transfer */
+	shared_ptr<const dentry_snapshot> snap;
+	uint64_t dir_handle = request->dir_handle();
+	uint64_t offset = request->offset();
+	parent_dentry_table->get_open_snapshot(dir_handle, offset, request->resume_name(), snap);
+	uint64_t end = std::min(static_cast<uint64_t>(snap->size()), offset + request->max_entries());
+
+	response.set_ret(0);
+	response.set_dir_handle(dir_handle);
+	response.set_offset(offset);
+	/* the end of the listing still tells the client the handle it reads */
+	if (offset >= end)
 		writer->Write(response);
-		response.set_filename("..");
+	for (uint64_t pos = offset; pos < end;) {
+		response.clear_filename();
+		for (int n = 0; (n < READDIR_CHUNK_SIZE) && (pos < end); n++, pos++)
+			response.add_filename((*snap)[pos].name);
+
+		if (!writer->Write(response))
+			break;
+	}
+	return Status::OK;
+}
+
+Status rpc_server::rpc_readdirplus(::grpc::ServerContext *context, const ::rpc_readdir_request *request,
+								   ::grpc::ServerWriter<::rpc_readdirplus_respond> *writer) {
+	global_logger.log(rpc_server_ops, "Called rpc_readdirplus()");
+	rpc_readdirplus_respond response;
+	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
+
+	std::shared_ptr<dentry_table> parent_dentry_table;
+	try {
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
+	} catch (dentry_table::not_leader &e){
+		response.set_ret(-ENOTLEADER);
+		writer->Write(response);
+		return Status::OK;
+	}
+
+	shared_ptr<const dentry_snapshot> snap;
+	uint64_t dir_handle = request->dir_handle();
+	uint64_t offset = request->offset();
+	parent_dentry_table->get_open_snapshot(dir_handle, offset, request->resume_name(), snap);
+	uint64_t end = std::min(static_cast<uint64_t>(snap->size()), offset + request->max_entries());
+
+	response.set_ret(0);
+	response.set_dir_handle(dir_handle);
+	response.set_offset(offset);
+	/* the end of the listing still tells the client the handle it reads */
+	if (offset >= end)
 		writer->Write(response);
-		for (it = parent_dentry_table->get_child_inode_begin(); it != parent_dentry_table->get_child_inode_end(); it++) {
-			response.set_filename(it->first);
-			writer->Write(response);
+	for (uint64_t pos = offset; pos < end;) {
+		response.clear_dirent();
+		for (int n = 0; (n < READDIR_CHUNK_SIZE) && (pos < end); n++, pos++) {
+			const child_entry &e = (*snap)[pos];
+			rpc_dirent *d = response.add_dirent();
+			d->set_filename(e.name);
+
+			/* the attributes of a child directory belong to its own leader */
+			std::scoped_lock scl{e.i->inode_mutex};
+			if (S_ISDIR(e.i->get_mode()))
+				continue;
+
+			d->set_attr_valid(true);
+			d->set_i_mode(e.i->get_mode());
+			d->set_i_uid(e.i->get_uid());
+			d->set_i_gid(e.i->get_gid());
+			d->set_i_ino_prefix(ino_controller->get_prefix_from_uuid(e.i->get_ino()));
+			d->set_i_ino_postfix(ino_controller->get_postfix_from_uuid(e.i->get_ino()));
+			d->set_i_nlink(e.i->get_nlink());
+			d->set_i_size(e.i->get_size());
+
+			d->set_a_sec(e.i->get_atime().tv_sec);
+			d->set_a_nsec(e.i->get_atime().tv_nsec);
+			d->set_m_sec(e.i->get_mtime().tv_sec);
+			d->set_m_nsec(e.i->get_mtime().tv_nsec);
+			d->set_c_sec(e.i->get_ctime().tv_sec);
+			d->set_c_nsec(e.i->get_ctime().tv_nsec);
 		}
+
+		if (!writer->Write(response))
+			break;
+	}
+	return Status::OK;
+}
+
+Status rpc_server::rpc_releasedir(::grpc::ServerContext *context, const ::rpc_releasedir_request *request,
+							      ::rpc_common_respond *response) {
+	global_logger.log(rpc_server_ops, "Called rpc_releasedir()");
+	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
+
+	std::shared_ptr<dentry_table> parent_dentry_table;
+	try {
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+	} catch (dentry_table::not_leader &e){
+		response->set_ret(-ENOTLEADER);
+		return Status::OK;
 	}
+
+	parent_dentry_table->release_open_snapshot(request->dir_handle());
+	response->set_ret(0);
 	return Status::OK;
 }
 
@@ -269,7 +470,8 @@ Status rpc_server::rpc_mkdir(::grpc::ServerContext *context, const ::rpc_mkdir_r
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -278,8 +480,11 @@ Status rpc_server::rpc_mkdir(::grpc::ServerContext *context, const ::rpc_mkdir_r
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
 		shared_ptr<inode> parent_i = parent_dentry_table->get_this_dir_inode();
-		shared_ptr<inode> i = std::make_shared<inode>(dentry_table_ino, request->uid(), request->gid(), request->new_mode() | S_IFDIR);
-		parent_dentry_table->create_child_inode(request->new_dir_name(), i);
+		shared_ptr<inode> i = make_inode(dentry_table_ino, request->uid(), request->gid(), request->new_mode() | S_IFDIR);
+		if (parent_dentry_table->create_child_inode(request->new_dir_name(), i) != 0) {
+			response->set_ret(-EEXIST);
+			return Status::OK;
+		}
 
 		i->set_size(DIR_INODE_SIZE);
 
@@ -287,12 +492,13 @@ Status rpc_server::rpc_mkdir(::grpc::ServerContext *context, const ::rpc_mkdir_r
 		timespec_get(&ts, TIME_UTC);
 		parent_i->set_mtime(ts);
 		parent_i->set_ctime(ts);
-		journalctl->mkdir(parent_i, request->new_dir_name(), i->get_ino());
+		journalctl->mkdir(dentry_table_ino, parent_i, request->new_dir_name(), i->get_ino());
 
 		response->set_new_dir_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_ino()));
 		response->set_new_dir_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_ino()));
 	}
 	response->set_ret(0);
+	count_remote_op(parent_dentry_table);
 	return Status::OK;
 }
 
@@ -303,7 +509,7 @@ Status rpc_server::rpc_rmdir_top(::grpc::ServerContext *context, const ::rpc_rmd
 
 	std::shared_ptr<dentry_table> target_dentry_table;
 	try {
-		target_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		target_dentry_table = get_served_dentry_table(dentry_table_ino, context);
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -336,7 +542,8 @@ Status rpc_server::rpc_rmdir_down(::grpc::ServerContext *context, const ::rpc_rm
 	int ret = 0;
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -352,7 +559,7 @@ Status rpc_server::rpc_rmdir_down(::grpc::ServerContext *context, const ::rpc_rm
 		timespec_get(&ts, TIME_UTC);
 		parent_i->set_mtime(ts);
 		parent_i->set_ctime(ts);
-		journalctl->rmdir(parent_i, request->target_name(), target_ino);
+		journalctl->rmdir(dentry_table_ino, parent_i, request->target_name(), target_ino);
 
 		/* It may be failed if parent and child dir is located in same leader */
 		ret = indexing_table->delete_dentry_table(target_ino);
@@ -372,7 +579,8 @@ Status rpc_server::rpc_symlink(::grpc::ServerContext *context, const ::rpc_symli
 
 	std::shared_ptr<dentry_table> dst_parent_dentry_table;
 	try {
-		dst_parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		dst_parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		dst_parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -387,7 +595,7 @@ Status rpc_server::rpc_symlink(::grpc::ServerContext *context, const ::rpc_symli
 		}
 
 		shared_ptr<inode> dst_parent_i = dst_parent_dentry_table->get_this_dir_inode();
-		shared_ptr<inode> symlink_i = std::make_shared<inode>(dentry_table_ino, this_client->get_client_uid(), this_client->get_client_gid(), S_IFLNK | 0777, request->src().c_str());
+		shared_ptr<inode> symlink_i = make_inode(dentry_table_ino, this_client->get_client_uid(), this_client->get_client_gid(), S_IFLNK | 0777, request->src().c_str());
 
 		symlink_i->set_size(static_cast<off_t>(request->src().length()));
 
@@ -395,9 +603,10 @@ Status rpc_server::rpc_symlink(::grpc::ServerContext *context, const ::rpc_symli
 
 		struct timespec ts{};
 		timespec_get(&ts, TIME_UTC);
-		journalctl->mkreg(dst_parent_i, *symlink_name, symlink_i);
+		journalctl->mkreg(dentry_table_ino, dst_parent_i, *symlink_name, symlink_i);
 	}
 	response->set_ret(0);
+	count_remote_op(dst_parent_dentry_table);
 	return Status::OK;
 }
 
@@ -408,17 +617,14 @@ Status rpc_server::rpc_readlink(::grpc::ServerContext *context, const ::rpc_read
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
-	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		i = parent_dentry_table->get_child_inode(request->filename());
-	}
+	std::shared_ptr<inode> i = parent_dentry_table->get_child_inode(request->filename());
 
 	{
 		std::scoped_lock scl{i->inode_mutex};
@@ -427,7 +633,7 @@ Status rpc_server::rpc_readlink(::grpc::ServerContext *context, const ::rpc_read
 			return Status::OK;
 		}
 
-		response->set_filename(i->get_link_target_name()->data());
+		response->set_filename(i->get_link_target_name());
 	}
 	response->set_ret(0);
 	return Status::OK;
@@ -443,7 +649,8 @@ Status rpc_server::rpc_rename_same_parent(::grpc::ServerContext *context, const
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -458,18 +665,22 @@ Status rpc_server::rpc_rename_same_parent(::grpc::ServerContext *context, const
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex, target_i->inode_mutex};
 		std::shared_ptr<inode> parent_i = parent_dentry_table->get_this_dir_inode();
+		if (parent_dentry_table->is_reserved(*new_name)) {
+			response->set_ret(-EEXIST);
+			return Status::OK;
+		}
 		uuid check_dst_ino = parent_dentry_table->check_child_inode(*new_name);
 
 		if (request->flags() == 0) {
 			if (!check_dst_ino.is_nil()) {
 				std::shared_ptr<inode> check_dst_inode = parent_dentry_table->get_child_inode(*new_name);
 				parent_dentry_table->delete_child_inode(*new_name);
-				journalctl->rmreg(parent_i, *new_name, check_dst_inode);
+				journalctl->rmreg(dentry_table_ino, parent_i, *new_name, check_dst_inode);
 			}
 			parent_dentry_table->delete_child_inode(*old_name);
-			journalctl->rmreg(parent_i, *old_name, target_i);
+			journalctl->rmreg(dentry_table_ino, parent_i, *old_name, target_i);
 			parent_dentry_table->create_child_inode(*new_name, target_i);
-			journalctl->mkreg(parent_i, *new_name, target_i);
+			journalctl->mkreg(dentry_table_ino, parent_i, *new_name, target_i);
 
 		} else {
 			response->set_ret(-ENOSYS);
@@ -480,88 +691,60 @@ Status rpc_server::rpc_rename_same_parent(::grpc::ServerContext *context, const
 	return Status::OK;
 }
 
-Status rpc_server::rpc_rename_not_same_parent_src(::grpc::ServerContext *context,
-						  const ::rpc_rename_not_same_parent_src_request *request,
-						  ::rpc_rename_not_same_parent_src_respond *response) {
-	global_logger.log(rpc_server_ops, "Called rpc_rename_not_same_parent_src()");
+Status rpc_server::rpc_rename(::grpc::ServerContext *context, const ::rpc_rename_request *request,
+			      ::rpc_common_respond *response) {
+	global_logger.log(rpc_server_ops, "Called rpc_rename()");
 	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
+	uuid dst_parent_ino = ino_controller->splice_prefix_and_postfix(request->dst_parent_ino_prefix(), request->dst_parent_ino_postfix());
 
 	unique_ptr<std::string> old_name = get_filename_from_path(request->old_path());
+	unique_ptr<std::string> new_name = get_filename_from_path(request->new_path());
 
 	std::shared_ptr<dentry_table> src_dentry_table;
 	try {
-		src_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		src_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		src_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
-	shared_ptr<inode> target_i;
-	{
-		std::scoped_lock scl{src_dentry_table->dentry_table_mutex};
-		target_i = src_dentry_table->get_child_inode(*old_name);
-	}
-
-	{
-		std::scoped_lock scl{src_dentry_table->dentry_table_mutex, target_i->inode_mutex};
-		std::shared_ptr<inode> src_parent_i = src_dentry_table->get_this_dir_inode();
-
-		if (request->flags() == 0) {
-			src_dentry_table->delete_child_inode(*old_name);
-			journalctl->rmreg(src_parent_i, *old_name, target_i);
-		} else {
-			response->set_ret(-ENOSYS);
-			return Status::OK;
-		}
+	/* the destination is linked by this leader, the caller waits for a single reply */
+	try {
+		response->set_ret(rename_across(src_dentry_table, src_dentry_table->get_this_dir_inode(), *old_name, dst_parent_ino, *new_name, request->flags()));
+	} catch (inode::no_entry &e) {
+		response->set_ret(-ENOENT);
+	} catch (dentry_table::not_leader &e) {
+		response->set_ret(-ENOTLEADER);
 	}
-
-	target_i->inode_to_rename_src_response(response);
-	response->set_ret(0);
 	return Status::OK;
 }
 
-Status rpc_server::rpc_rename_not_same_parent_dst(::grpc::ServerContext *context,
-						  const ::rpc_rename_not_same_parent_dst_request *request,
-						  ::rpc_common_respond *response) {
-	global_logger.log(rpc_server_ops, "Called rpc_rename_not_same_parent_dst()");
+Status rpc_server::rpc_rename_link(::grpc::ServerContext *context, const ::rpc_rename_link_request *request,
+				   ::rpc_common_respond *response) {
+	global_logger.log(rpc_server_ops, "Called rpc_rename_link()");
 	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
 
-	unique_ptr<std::string> new_name = get_filename_from_path(request->new_path());
-	uuid check_dst_ino = ino_controller->splice_prefix_and_postfix(request->check_dst_ino_prefix(), request->check_dst_ino_postfix());
-
 	std::shared_ptr<dentry_table> dst_dentry_table;
 	try {
-		dst_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		dst_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		dst_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
-	shared_ptr<inode> target_inode = std::make_shared<inode>(LOCAL);
-	target_inode->rename_dst_request_to_inode(request);
-	target_inode->set_p_ino(dentry_table_ino);
+	shared_ptr<inode> target_inode = make_inode(LOCAL);
+	target_inode->rename_link_request_to_inode(request);
 
-	{
-		std::scoped_lock scl{dst_dentry_table->dentry_table_mutex, target_inode->inode_mutex};
-		std::shared_ptr<inode> dst_parent_i = dst_dentry_table->get_this_dir_inode();
-		if (request->flags() == 0) {
-			if (!check_dst_ino.is_nil()) {
-				std::shared_ptr<inode> check_dst_inode = dst_dentry_table->get_child_inode(*new_name);
-				dst_dentry_table->delete_child_inode(*new_name);
-				journalctl->rmreg(dst_parent_i, *new_name, check_dst_inode);
-			}
-			dst_dentry_table->create_child_inode(*new_name, target_inode);
-			journalctl->mkreg(dst_parent_i, *new_name, target_inode);
-		} else {
-			response->set_ret(-ENOSYS);
-			return Status::OK;
-		}
+	try {
+		response->set_ret(link_renamed(dst_dentry_table, dst_dentry_table->get_this_dir_inode(), request->new_name(), target_inode, request->flags()));
+	} catch (dentry_table::not_leader &e) {
+		response->set_ret(-ENOTLEADER);
 	}
-	response->set_ret(0);
 	return Status::OK;
 }
 
-
 Status rpc_server::rpc_open(::grpc::ServerContext *context, const ::rpc_open_opendir_request *request,
 							::rpc_common_respond *response) {
 	global_logger.log(rpc_server_ops, "Called rpc_open()");
@@ -569,17 +752,16 @@ Status rpc_server::rpc_open(::grpc::ServerContext *context, const ::rpc_open_ope
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
-	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		i = parent_dentry_table->get_child_inode(request->filename());
-	}
+	std::shared_ptr<inode> i = parent_dentry_table->get_child_inode(request->filename());
+	if ((request->flags() & O_TRUNC) && !(request->flags() & O_PATH))
+		recall_write_delegation(parent_dentry_table, i, get_origin(context));
 
 	{
 		std::scoped_lock scl{i->inode_mutex};
@@ -609,7 +791,8 @@ Status rpc_server::rpc_create(::grpc::ServerContext *context, const ::rpc_create
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -618,19 +801,26 @@ Status rpc_server::rpc_create(::grpc::ServerContext *context, const ::rpc_create
 	{
 		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
 		shared_ptr<inode> parent_i = parent_dentry_table->get_this_dir_inode();
-		shared_ptr<inode> i = std::make_shared<inode>(dentry_table_ino, this_client->get_client_uid(), this_client->get_client_gid(), request->new_mode() | S_IFREG);
-		parent_dentry_table->create_child_inode(request->new_file_name(), i);
+		uuid new_ino = ino_controller->splice_prefix_and_postfix(request->new_ino_prefix(), request->new_ino_postfix());
+		shared_ptr<inode> i = new_ino.is_nil()
+			? make_inode(dentry_table_ino, request->uid(), request->gid(), request->new_mode() | S_IFREG)
+			: make_inode(dentry_table_ino, request->uid(), request->gid(), request->new_mode() | S_IFREG, new_ino);
+		if (parent_dentry_table->create_child_inode(request->new_file_name(), i) != 0) {
+			response->set_ret(-EEXIST);
+			return Status::OK;
+		}
 
 		struct timespec ts{};
 		timespec_get(&ts, TIME_UTC);
 		parent_i->set_mtime(ts);
 		parent_i->set_ctime(ts);
-		journalctl->mkreg(parent_i, request->new_file_name(), i);
+		journalctl->mkreg(dentry_table_ino, parent_i, request->new_file_name(), i);
 
 		response->set_new_ino_prefix(ino_controller->get_prefix_from_uuid(i->get_ino()));
 		response->set_new_ino_postfix(ino_controller->get_postfix_from_uuid(i->get_ino()));
 	}
 	response->set_ret(0);
+	count_remote_op(parent_dentry_table);
 	return Status::OK;
 }
 
@@ -641,7 +831,8 @@ Status rpc_server::rpc_unlink(::grpc::ServerContext *context, const ::rpc_unlink
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -654,6 +845,8 @@ Status rpc_server::rpc_unlink(::grpc::ServerContext *context, const ::rpc_unlink
 		nlink_t nlink = target_i->get_nlink() - 1;
 		if (nlink == 0) {
 			uuid target_ino = target_i->get_ino();
+			/* a delegate of the file has nothing to report anymore */
+			parent_dentry_table->drop_write_delegation(target_ino, parent_dentry_table->get_write_delegate(target_ino));
 			/* data */
 			data_pool->remove(obj_category::DATA, uuid_to_string(target_ino));
 
@@ -664,13 +857,14 @@ Status rpc_server::rpc_unlink(::grpc::ServerContext *context, const ::rpc_unlink
 			timespec_get(&ts, TIME_UTC);
 			parent_i->set_mtime(ts);
 			parent_i->set_ctime(ts);
-			journalctl->rmreg(parent_i, request->filename(), target_i);
+			journalctl->rmreg(dentry_table_ino, parent_i, request->filename(), target_i);
 		} else {
 			target_i->set_nlink(nlink);
 			journalctl->chreg(target_i->get_p_ino(), target_i);
 		}
 	}
 	response->set_ret(0);
+	count_remote_op(parent_dentry_table);
 	return Status::OK;
 }
 
@@ -681,7 +875,8 @@ Status rpc_server::rpc_write(::grpc::ServerContext *context, const ::rpc_write_r
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
@@ -690,6 +885,7 @@ Status rpc_server::rpc_write(::grpc::ServerContext *context, const ::rpc_write_r
 	off_t offset;
 	size_t size;
 	std::shared_ptr<inode> i = parent_dentry_table->get_child_inode(request->filename());
+	recall_write_delegation(parent_dentry_table, i, get_origin(context));
 	{
 		std::scoped_lock scl{i->inode_mutex};
 		offset = request->offset();
@@ -708,6 +904,7 @@ Status rpc_server::rpc_write(::grpc::ServerContext *context, const ::rpc_write_r
 	response->set_offset(offset);
 	response->set_size(size);
 	response->set_ret(0);
+	count_remote_op(parent_dentry_table);
 	return Status::OK;
 }
 
@@ -718,22 +915,21 @@ Status rpc_server::rpc_chmod(::grpc::ServerContext *context, const ::rpc_chmod_r
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
 	}
 
 	{
@@ -758,22 +954,21 @@ Status rpc_server::rpc_chown(::grpc::ServerContext *context, const ::rpc_chown_r
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
 	}
 
 	{
@@ -800,22 +995,21 @@ Status rpc_server::rpc_utimens(::grpc::ServerContext *context, const ::rpc_utime
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
 	}
 
 	{
@@ -862,22 +1056,22 @@ Status rpc_server::rpc_truncate(::grpc::ServerContext *context, const ::rpc_trun
 
 	std::shared_ptr<dentry_table> parent_dentry_table;
 	try {
-		parent_dentry_table = indexing_table->get_dentry_table(dentry_table_ino, true);
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		if (!request->target_is_parent())
+			parent_dentry_table->check_fragmented();
 	} catch (dentry_table::not_leader &e){
 		response->set_ret(-ENOTLEADER);
 		return Status::OK;
 	}
 
 	std::shared_ptr<inode> i;
-	{
-		std::scoped_lock scl{parent_dentry_table->dentry_table_mutex};
-		if (request->target_is_parent()) {
-			global_logger.log(rpc_server_ops, "target is parent");
-			i = parent_dentry_table->get_this_dir_inode();
-		} else {
-			global_logger.log(rpc_server_ops, "target is child");
-			i = parent_dentry_table->get_child_inode(request->filename());
-		}
+	if (request->target_is_parent()) {
+		global_logger.log(rpc_server_ops, "target is parent");
+		i = parent_dentry_table->get_this_dir_inode();
+	} else {
+		global_logger.log(rpc_server_ops, "target is child");
+		i = parent_dentry_table->get_child_inode(request->filename());
+		recall_write_delegation(parent_dentry_table, i, get_origin(context));
 	}
 
 	{
@@ -897,3 +1091,141 @@ Status rpc_server::rpc_truncate(::grpc::ServerContext *context, const ::rpc_trun
 	response->set_ret(0);
 	return Status::OK;
 }
+
+Status rpc_server::rpc_delegate(::grpc::ServerContext *context, const ::rpc_delegate_request *request,
+				::rpc_delegation_respond *response) {
+	global_logger.log(rpc_server_ops, "Called rpc_delegate(" + request->filename() + ")");
+	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
+
+	std::shared_ptr<dentry_table> parent_dentry_table;
+	try {
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
+	} catch (dentry_table::not_leader &e){
+		response->set_ret(-ENOTLEADER);
+		return Status::OK;
+	}
+
+	std::shared_ptr<inode> i;
+	try {
+		i = parent_dentry_table->get_child_inode(request->filename());
+	} catch (inode::no_entry &e){
+		response->set_ret(-ENOENT);
+		return Status::OK;
+	}
+
+	if (!S_ISREG(i->get_mode())) {
+		response->set_ret(-EINVAL);
+		return Status::OK;
+	}
+
+	/* the delegation moves to the last writer, a holder which lost it writes through the leader */
+	std::string origin = get_origin(context);
+	recall_write_delegation(parent_dentry_table, i, origin);
+	if (!parent_dentry_table->grant_write_delegation(i->get_ino(), origin)) {
+		response->set_ret(-EBUSY);
+		return Status::OK;
+	}
+
+	{
+		std::scoped_lock scl{i->inode_mutex};
+		response->set_i_size(i->get_size());
+		response->set_m_sec(i->get_mtime().tv_sec);
+		response->set_m_nsec(i->get_mtime().tv_nsec);
+	}
+	response->set_ret(0);
+	count_remote_op(parent_dentry_table);
+	return Status::OK;
+}
+
+Status rpc_server::rpc_return_delegation(::grpc::ServerContext *context, const ::rpc_return_delegation_request *request,
+					 ::rpc_common_respond *response) {
+	global_logger.log(rpc_server_ops, "Called rpc_return_delegation(" + request->filename() + ")");
+	uuid dentry_table_ino = ino_controller->splice_prefix_and_postfix(request->dentry_table_ino_prefix(), request->dentry_table_ino_postfix());
+	uuid ino = ino_controller->splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix());
+
+	std::shared_ptr<dentry_table> parent_dentry_table;
+	try {
+		parent_dentry_table = get_served_dentry_table(dentry_table_ino, context);
+		parent_dentry_table->check_fragmented();
+	} catch (dentry_table::not_leader &e){
+		response->set_ret(-ENOTLEADER);
+		return Status::OK;
+	}
+
+	/*
+	 * A leader which took the directory over after the delegation was granted doesn't know the holder,
+	 * its report is applied all the same and a report without release registers it again.
+	 */
+	std::string origin = get_origin(context);
+	std::string holder = parent_dentry_table->get_write_delegate(ino);
+	if (!holder.empty() && (holder != origin)) {
+		response->set_ret(-EBUSY);
+		return Status::OK;
+	}
+
+	std::shared_ptr<inode> i;
+	try {
+		i = parent_dentry_table->get_child_inode(request->filename());
+	} catch (inode::no_entry &e){
+		i = nullptr;
+	}
+
+	if ((i == nullptr) || (i->get_ino() != ino)) {
+		parent_dentry_table->drop_write_delegation(ino, origin);
+		response->set_ret(-ENOENT);
+		return Status::OK;
+	}
+
+	{
+		std::scoped_lock scl{i->inode_mutex};
+		struct timespec mtime{};
+		mtime.tv_sec = request->m_sec();
+		mtime.tv_nsec = request->m_nsec();
+
+		i->set_size(request->i_size());
+		i->set_mtime(mtime);
+		journalctl->chreg(i->get_p_ino(), i);
+	}
+
+	if (request->release())
+		parent_dentry_table->drop_write_delegation(ino, origin);
+	else
+		parent_dentry_table->grant_write_delegation(ino, origin);
+
+	response->set_ret(0);
+	return Status::OK;
+}
+
+Status rpc_server::rpc_recall_delegation(::grpc::ServerContext *context, const ::rpc_recall_delegation_request *request,
+					 ::rpc_delegation_respond *response) {
+	global_logger.log(rpc_server_ops, "Called rpc_recall_delegation()");
+	uuid ino = ino_controller->splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix());
+
+	if (write_delegations == nullptr) {
+		response->set_ret(-ENOENT);
+		return Status::OK;
+	}
+
+	off_t size;
+	struct timespec mtime{};
+	int ret = write_delegations->recall(ino, size, mtime);
+	if (ret == 0) {
+		response->set_i_size(size);
+		response->set_m_sec(mtime.tv_sec);
+		response->set_m_nsec(mtime.tv_nsec);
+	}
+	response->set_ret(ret);
+	return Status::OK;
+}
+
+Status rpc_server::rpc_subscribe(::grpc::ServerContext *context, const ::rpc_subscribe_request *request,
+				 ::grpc::ServerWriter<::rpc_invalidation> *writer) {
+	global_logger.log(rpc_server_ops, "Called rpc_subscribe()");
+	std::string origin = get_origin(context);
+	if (origin.empty())
+		return Status(grpc::StatusCode::INVALID_ARGUMENT, "The subscriber has no remote service address");
+
+	invalidations->serve(origin, context, writer);
+	return Status::OK;
+}
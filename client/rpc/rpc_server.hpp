@@ -6,6 +6,7 @@
 #include "rpc.grpc.pb.h"
 
 #include "../in_memory/directory_table.hpp"
+#include "../lease/lease_callback_impl.hpp"
 #include "../meta/file_handler.hpp"
 
 using grpc::Server;
@@ -13,6 +14,13 @@ using grpc::ServerBuilder;
 using grpc::ServerContext;
 using grpc::Status;
 
+/* number of names in a single rpc_readdir message */
+#define READDIR_CHUNK_SIZE (256)
+
+/* a migration waits this many times for the operations in progress on the directory to finish */
+#define DIRECTORY_MIGRATE_RETRY (20)
+#define DIRECTORY_MIGRATE_RETRY_MS (5)
+
 void run_rpc_server(const std::string& remote_address);
 
 class rpc_server : public remote_ops::Service {
@@ -33,10 +41,16 @@ public:
 		      ::rpc_common_respond *response) override;
 
     Status rpc_opendir(::grpc::ServerContext *context, const ::rpc_open_opendir_request *request,
-		       ::rpc_common_respond *response) override;
+		       ::rpc_opendir_respond *response) override;
 
     Status rpc_readdir(::grpc::ServerContext *context, const ::rpc_readdir_request *request,
-		       ::grpc::ServerWriter<::rpc_name_respond> *writer) override;
+		       ::grpc::ServerWriter<::rpc_readdir_respond> *writer) override;
+
+    Status rpc_readdirplus(::grpc::ServerContext *context, const ::rpc_readdir_request *request,
+			   ::grpc::ServerWriter<::rpc_readdirplus_respond> *writer) override;
+
+    Status rpc_releasedir(::grpc::ServerContext *context, const ::rpc_releasedir_request *request,
+			  ::rpc_common_respond *response) override;
 
     Status rpc_mkdir(::grpc::ServerContext *context, const ::rpc_mkdir_request *request,
 		     ::rpc_mkdir_respond *response) override;
@@ -56,11 +70,11 @@ public:
     Status rpc_rename_same_parent(::grpc::ServerContext *context, const ::rpc_rename_same_parent_request *request,
 				  ::rpc_common_respond *response) override;
 
-    Status rpc_rename_not_same_parent_src(::grpc::ServerContext *context, const ::rpc_rename_not_same_parent_src_request *request,
-				      ::rpc_rename_not_same_parent_src_respond *response) override;
+    Status rpc_rename(::grpc::ServerContext *context, const ::rpc_rename_request *request,
+		      ::rpc_common_respond *response) override;
 
-    Status rpc_rename_not_same_parent_dst(::grpc::ServerContext *context, const ::rpc_rename_not_same_parent_dst_request *request,
-					  ::rpc_common_respond *response) override;
+    Status rpc_rename_link(::grpc::ServerContext *context, const ::rpc_rename_link_request *request,
+			   ::rpc_common_respond *response) override;
 
     Status rpc_open(::grpc::ServerContext *context, const ::rpc_open_opendir_request *request,
 		    ::rpc_common_respond *response) override;
@@ -86,6 +100,18 @@ public:
     Status rpc_truncate(::grpc::ServerContext *context, const ::rpc_truncate_request *request,
 			::rpc_common_respond *response) override;
 
+    Status rpc_delegate(::grpc::ServerContext *context, const ::rpc_delegate_request *request,
+			::rpc_delegation_respond *response) override;
+
+    Status rpc_return_delegation(::grpc::ServerContext *context, const ::rpc_return_delegation_request *request,
+				 ::rpc_common_respond *response) override;
+
+    Status rpc_recall_delegation(::grpc::ServerContext *context, const ::rpc_recall_delegation_request *request,
+				 ::rpc_delegation_respond *response) override;
+
+    Status rpc_subscribe(::grpc::ServerContext *context, const ::rpc_subscribe_request *request,
+			 ::grpc::ServerWriter<::rpc_invalidation> *writer) override;
+
 };
 
 
@@ -1,3 +1,5 @@
+#include <deque>
+
 #include "rados_io.hpp"
 #include "../logger/logger.hpp"
 
@@ -188,6 +190,22 @@ size_t rados_io::read(obj_category category, const string &key, char *value, siz
 	return sum;
 }
 
+size_t rados_io::read_head(obj_category category, const string &key, librados::bufferlist &bl)
+{
+	global_logger.log(rados_io_ops, "Called rados_io::read_head()");
+	global_logger.log(rados_io_ops, "key : " + key);
+
+	/* length 0 makes the OSD return the object up to its real size */
+	int ret = ioctx.read(get_prefix(category) + key + get_postfix(0), bl, 0, 0);
+
+	if (ret == -ENOENT)
+		throw no_such_object("rados_io::read_head() failed (key: \"" + key + "\")");
+	else if (ret < 0)
+		throw runtime_error("rados_io::read_head() failed");
+
+	return ret;
+}
+
 size_t rados_io::write(obj_category category, const string &key, const char *value, size_t len, off_t offset)
 {
 	global_logger.log(rados_io_ops, "Called rados_io::write()");
@@ -384,3 +402,130 @@ int rados_io::truncate(obj_category category, const string &key, size_t offset){
 
 	return 0;
 }
+
+void rados_io::read_window(obj_category category, const std::vector<string> &keys, size_t len, size_t depth,
+			   const std::function<void(size_t, const char *, int)> &done)
+{
+	global_logger.log(rados_io_ops, "Called rados_io::read_window()");
+	global_logger.log(rados_io_ops, "keys : " + std::to_string(keys.size()) + " length : " + std::to_string(len) + " depth : " + std::to_string(depth));
+
+	if (len > OBJ_SIZE)
+		throw logic_error("rados_io::read_window() failed (len exceeds OBJ_SIZE)");
+
+	struct in_flight {
+		size_t index;
+		librados::AioCompletion *completion;
+		librados::bufferlist bl;
+	};
+
+	/* deque never moves its elements, so the bufferlists stay valid while being read into */
+	std::deque<in_flight> window;
+	string prefix = get_prefix(category);
+	size_t next = 0;
+
+	auto reap = [&]() {
+		in_flight &f = window.front();
+		f.completion->wait_for_complete();
+		int ret = f.completion->get_return_value();
+		f.completion->release();
+
+		size_t index = f.index;
+		librados::bufferlist bl = std::move(f.bl);
+		window.pop_front();
+
+		if (ret >= 0 || ret == -ENOENT)
+			done(index, bl.c_str(), ret);
+		else
+			throw runtime_error("rados_io::read_window() failed (key: \"" + keys[index] + "\")");
+	};
+
+	try {
+		while (next < keys.size() || !window.empty()) {
+			if (next < keys.size() && window.size() < depth) {
+				window.emplace_back();
+				in_flight &f = window.back();
+				f.index = next;
+				f.completion = librados::Rados::aio_create_completion();
+
+				int ret = ioctx.aio_read(prefix + keys[next] + get_postfix(0), f.completion, &f.bl, len, 0);
+				if (ret < 0) {
+					f.completion->release();
+					window.pop_back();
+					throw runtime_error("rados_io::read_window() failed (aio_read() failed)");
+				}
+				next++;
+			} else {
+				reap();
+			}
+		}
+	} catch (...) {
+		for (in_flight &f : window) {
+			f.completion->wait_for_complete();
+			f.completion->release();
+		}
+		throw;
+	}
+}
+
+void rados_io::write_window(obj_category category, const std::vector<string> &keys, const std::vector<std::vector<char>> &values, size_t depth)
+{
+	global_logger.log(rados_io_ops, "Called rados_io::write_window()");
+	global_logger.log(rados_io_ops, "keys : " + std::to_string(keys.size()) + " depth : " + std::to_string(depth));
+
+	if (keys.size() != values.size())
+		throw logic_error("rados_io::write_window() failed (keys and values mismatch)");
+
+	struct in_flight {
+		size_t index;
+		librados::AioCompletion *completion;
+		librados::bufferlist bl;
+	};
+
+	std::deque<in_flight> window;
+	string prefix = get_prefix(category);
+	size_t next = 0;
+
+	auto reap = [&]() {
+		in_flight &f = window.front();
+		f.completion->wait_for_complete();
+		int ret = f.completion->get_return_value();
+		f.completion->release();
+
+		size_t index = f.index;
+		window.pop_front();
+
+		if (ret < 0)
+			throw runtime_error("rados_io::write_window() failed (key: \"" + keys[index] + "\")");
+	};
+
+	try {
+		while (next < keys.size() || !window.empty()) {
+			if (next < keys.size() && window.size() < depth) {
+				if (values[next].size() > OBJ_SIZE)
+					throw logic_error("rados_io::write_window() failed (value exceeds OBJ_SIZE)");
+
+				window.emplace_back();
+				in_flight &f = window.back();
+				f.index = next;
+				f.completion = librados::Rados::aio_create_completion();
+				f.bl.append(values[next].data(), static_cast<unsigned>(values[next].size()));
+
+				int ret = ioctx.aio_write(prefix + keys[next] + get_postfix(0), f.completion, f.bl, values[next].size(), 0);
+				if (ret < 0) {
+					f.completion->release();
+					window.pop_back();
+					throw runtime_error("rados_io::write_window() failed (aio_write() failed)");
+				}
+				next++;
+			} else {
+				reap();
+			}
+		}
+	} catch (...) {
+		for (in_flight &f : window) {
+			f.completion->wait_for_complete();
+			f.completion->release();
+		}
+		throw;
+	}
+}
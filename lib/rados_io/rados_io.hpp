@@ -1,8 +1,10 @@
 #ifndef _RADOS_IO_HPP_
 #define _RADOS_IO_HPP_
 
+#include <functional>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <rados/librados.hpp>
 
 using std::logic_error;
@@ -51,10 +53,41 @@ public:
 
 	size_t read(obj_category category, const string &key, char *value, size_t len, off_t offset);
 	size_t write(obj_category category, const string &key, const char *value, size_t len, off_t offset);
+	/*
+	 * read_head()
+	 *
+	 * Read the whole first RADOS object of the key into 'bl', which is sized to the object.
+	 * Returns the number of bytes read.
+	 */
+	size_t read_head(obj_category category, const string &key, librados::bufferlist &bl);
 	bool exist(obj_category category, const string &key);
 	bool stat(obj_category category, const string &key, size_t &size);
 	void remove(obj_category category, const string &key);
 	int truncate(obj_category category, const string &key, size_t offset);
+
+	/*
+	 * read_window()
+	 *
+	 * Read up to 'len' bytes from the head of every key with asynchronous reads,
+	 * keeping at most 'depth' of them in flight.
+	 * 'len' must not exceed OBJ_SIZE, only the first RADOS object of each key is read.
+	 * 'len' 0 reads each first object whole.
+	 *
+	 * 'done' is called in the order of 'keys' with the index of the key,
+	 * the data and the number of bytes read, or -ENOENT if there is no such object.
+	 * If 'done' throws, the reads in flight are waited for and the exception is rethrown.
+	 */
+	void read_window(obj_category category, const std::vector<string> &keys, size_t len, size_t depth,
+			 const std::function<void(size_t, const char *, int)> &done);
+
+	/*
+	 * write_window()
+	 *
+	 * Write every value at the head of its key with asynchronous writes,
+	 * keeping at most 'depth' of them in flight.
+	 * Each value must fit in a single RADOS object.
+	 */
+	void write_window(obj_category category, const std::vector<string> &keys, const std::vector<std::vector<char>> &values, size_t depth);
 };
 
 #endif /* _RADOS_IO_HPP_ */
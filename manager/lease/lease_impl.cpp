@@ -4,17 +4,126 @@
 
 using namespace std::chrono;
 
+lease_impl::lease_impl(std::shared_ptr<rados_io> meta_pool) : table(meta_pool)
+{
+}
+
+std::shared_ptr<lease_callback::Stub> lease_impl::get_holder(const std::string &addr)
+{
+	std::scoped_lock lock(holder_mutex);
+	auto ret = holders.insert({addr, nullptr});
+	if (ret.second)
+		ret.first.value() = lease_callback::NewStub(grpc::CreateChannel(addr, grpc::InsecureChannelCredentials()));
+
+	return ret.first->second;
+}
+
+void lease_impl::recall(uuid ino, const std::vector<std::string> &addrs)
+{
+	for (const std::string &addr : addrs) {
+		std::shared_ptr<lease_callback::Stub> stub = get_holder(addr);
+		std::thread([stub, ino, addr]() {
+			recall_request request;
+			request.set_ino_prefix(uuid_controller::get_prefix_from_uuid(ino));
+			request.set_ino_postfix(uuid_controller::get_postfix_from_uuid(ino));
+
+			release_response response;
+			grpc::ClientContext context;
+			context.set_deadline(system_clock::now() + milliseconds(LEASE_RECALL_INTERVAL_MS));
+
+			/* an unreachable or busy holder keeps the lease until it expires */
+			Status status = stub->recall(&context, request, &response);
+			if (!status.ok())
+				std::cerr << "recall() to " << addr << " failed: " << status.error_message() << std::endl;
+		}).detach();
+	}
+}
+
 Status lease_impl::acquire(ServerContext *context, const lease_request *request, lease_response *response)
 {
 	system_clock::time_point due;
 	std::string remote_addr = request->remote_addr();
-	int ret = table.acquire(uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix()), due, remote_addr);
+	uint32_t frag_depth;
+	std::vector<std::string> recall_addrs;
+	uuid ino = uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix());
+	uuid parent_ino = uuid_controller::splice_prefix_and_postfix(request->parent_ino_prefix(), request->parent_ino_postfix());
+	int ret = table.acquire(ino, due, remote_addr, frag_depth, request->shared(), recall_addrs, parent_ino);
+
+	if (!recall_addrs.empty())
+		recall(ino, recall_addrs);
 
 	response->set_ret(ret);
 	response->set_due(due.time_since_epoch().count());
+	response->set_frag_depth(frag_depth);
 
-	if (ret)
+	if (ret == -1)
 		response->set_remote_addr(remote_addr);
 
 	return Status::OK;
 }
+
+Status lease_impl::fragment(ServerContext *context, const fragment_request *request, fragment_response *response)
+{
+	uint32_t frag_depth = request->frag_depth();
+	int ret = table.fragment(uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix()), request->remote_addr(), frag_depth);
+
+	response->set_ret(ret);
+	response->set_frag_depth(frag_depth);
+
+	return Status::OK;
+}
+
+Status lease_impl::release(ServerContext *context, const lease_request *request, release_response *response)
+{
+	int ret = table.release(uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix()), request->remote_addr());
+
+	response->set_ret(ret);
+
+	return Status::OK;
+}
+
+Status lease_impl::transfer(ServerContext *context, const transfer_request *request, release_response *response)
+{
+	int ret = table.transfer(uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix()), request->remote_addr(), request->new_addr());
+
+	response->set_ret(ret);
+
+	return Status::OK;
+}
+
+Status lease_impl::pin(ServerContext *context, const pin_request *request, pin_response *response)
+{
+	int ret = table.pin(uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix()), request->pin_addr());
+
+	response->set_ret(ret);
+	response->set_pin_addr(request->pin_addr());
+
+	return Status::OK;
+}
+
+Status lease_impl::get_pin(ServerContext *context, const lease_request *request, pin_response *response)
+{
+	response->set_pin_addr(table.get_pin(uuid_controller::splice_prefix_and_postfix(request->ino_prefix(), request->ino_postfix())));
+	response->set_ret(0);
+
+	return Status::OK;
+}
+
+Status lease_impl::lease_range(ServerContext *context, const range_request *request, range_response *response)
+{
+	system_clock::time_point due;
+	int ret = table.lease_range(request->ino_prefix(), request->remote_addr(), due);
+
+	response->set_ret(ret);
+	if (ret == 0)
+		response->set_due(due.time_since_epoch().count());
+
+	return Status::OK;
+}
+
+Status lease_impl::release_range(ServerContext *context, const range_request *request, release_response *response)
+{
+	response->set_ret(table.release_range(request->ino_prefix(), request->remote_addr()));
+
+	return Status::OK;
+}
@@ -5,6 +5,12 @@
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
 #include <grpcpp/grpcpp.h>
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
@@ -19,7 +25,25 @@ class lease_impl final : public lease::Service {
 private:
 	lease_table table;
 
+	/* channels to the lease holders, keyed by their remote address */
+	std::mutex holder_mutex;
+	tsl::robin_map<std::string, std::shared_ptr<lease_callback::Stub>> holders;
+
+	std::shared_ptr<lease_callback::Stub> get_holder(const std::string &addr);
+	/* asks the holders to give up the lease of 'ino' in the background, the acquire() in progress isn't delayed */
+	void recall(uuid ino, const std::vector<std::string> &addrs);
+
 	Status acquire(ServerContext *context, const lease_request *request, lease_response *response) override;
+	Status fragment(ServerContext *context, const fragment_request *request, fragment_response *response) override;
+	Status release(ServerContext *context, const lease_request *request, release_response *response) override;
+	Status transfer(ServerContext *context, const transfer_request *request, release_response *response) override;
+	Status pin(ServerContext *context, const pin_request *request, pin_response *response) override;
+	Status get_pin(ServerContext *context, const lease_request *request, pin_response *response) override;
+	Status lease_range(ServerContext *context, const range_request *request, range_response *response) override;
+	Status release_range(ServerContext *context, const range_request *request, release_response *response) override;
+
+public:
+	lease_impl(std::shared_ptr<rados_io> meta_pool);
 };
 
 #endif /* _LEASE_IMPL_HPP_ */
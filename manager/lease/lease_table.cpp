@@ -1,8 +1,13 @@
 #include "lease_table.hpp"
 
-lease_table::lease_entry::lease_entry(system_clock::time_point &latest_due, const std::string &remote_addr) : due(system_clock::now() + milliseconds(LEASE_PERIOD_MS)), addr(remote_addr)
+lease_table::lease_entry::lease_entry(void) : due(system_clock::time_point::min()), write_waiting(system_clock::time_point::min()),
+					       recalled(system_clock::time_point::min())
+{
+}
+
+lease_table::lease_entry::lease_entry(const std::string &holder, system_clock::time_point holder_due)
+	: due(holder_due), addr(holder), write_waiting(system_clock::time_point::min()), recalled(system_clock::time_point::min())
 {
-	latest_due = due;
 }
 
 std::tuple<system_clock::time_point, std::string> lease_table::lease_entry::get_info(void)
@@ -11,22 +16,153 @@ std::tuple<system_clock::time_point, std::string> lease_table::lease_entry::get_
 	return std::make_tuple(due, addr);
 }
 
-bool lease_table::lease_entry::cas(system_clock::time_point &latest_due, std::string &remote_addr)
+system_clock::time_point lease_table::lease_entry::prune_readers(const std::string &remote_addr)
+{
+	system_clock::time_point now = system_clock::now();
+	system_clock::time_point last_due = system_clock::time_point::min();
+
+	for (auto it = readers.begin(); it != readers.end();) {
+		if (it->second <= now) {
+			it = readers.erase(it);
+			continue;
+		}
+		if (it->first != remote_addr)
+			last_due = std::max(last_due, it->second);
+		it++;
+	}
+
+	return last_due;
+}
+
+bool lease_table::lease_entry::may_recall(void)
+{
+	system_clock::time_point now = system_clock::now();
+	if (now < recalled + milliseconds(LEASE_RECALL_INTERVAL_MS))
+		return false;
+
+	recalled = now;
+	return true;
+}
+
+int lease_table::lease_entry::cas(system_clock::time_point &latest_due, std::string &remote_addr, std::vector<std::string> &recall_addrs)
 {
 	std::unique_lock lock(sm);
 
-	if (system_clock::now() >= due) {
-		latest_due = due = system_clock::now() + milliseconds(LEASE_PERIOD_MS);
-		addr = remote_addr;
-		return true;
-	} else if (addr == remote_addr) {
+	if (system_clock::now() < due) {
 		latest_due = due;
-		return true;
-	} else {
+		if (addr == remote_addr)
+			return 0;
+		if (may_recall())
+			recall_addrs.push_back(addr);
+		remote_addr = addr;
+		return -1;
+	}
+
+	/* the readers keep their copies until their shared leases expire or they give them up */
+	system_clock::time_point last_due = prune_readers(remote_addr);
+	if (last_due > system_clock::now()) {
+		if (may_recall()) {
+			for (auto &r : readers)
+				if (r.first != remote_addr)
+					recall_addrs.push_back(r.first);
+		}
+		write_waiting = last_due;
+		latest_due = last_due;
+		return -2;
+	}
+
+	readers.erase(remote_addr);
+	write_waiting = system_clock::time_point::min();
+	latest_due = due = system_clock::now() + milliseconds(LEASE_PERIOD_MS);
+	addr = remote_addr;
+	return 0;
+}
+
+int lease_table::lease_entry::cas_shared(system_clock::time_point &latest_due, std::string &remote_addr, std::vector<std::string> &recall_addrs)
+{
+	std::unique_lock lock(sm);
+	system_clock::time_point now = system_clock::now();
+
+	if (now < due) {
 		latest_due = due;
+		if (addr == remote_addr)
+			return 0;
+		if (may_recall())
+			recall_addrs.push_back(addr);
 		remote_addr = addr;
-		return false;
+		return -1;
 	}
+
+	/* a waiting writer isn't starved by the readers coming after it */
+	system_clock::time_point reader_due = now + milliseconds(SHARED_LEASE_PERIOD_MS);
+	if (write_waiting > now)
+		reader_due = std::min(reader_due, write_waiting);
+
+	auto ret = readers.insert({remote_addr, reader_due});
+	if (!ret.second)
+		ret.first.value() = std::max(ret.first->second, reader_due);
+
+	latest_due = reader_due;
+	return 1;
+}
+
+int lease_table::lease_entry::cas_pinned(system_clock::time_point &latest_due, std::string &remote_addr, const std::string &pin_addr,
+					std::vector<std::string> &recall_addrs)
+{
+	std::unique_lock lock(sm);
+	system_clock::time_point now = system_clock::now();
+
+	if (now < due) {
+		latest_due = due;
+		if (addr == remote_addr)
+			return 0;
+		if ((addr != pin_addr) && may_recall())
+			recall_addrs.push_back(addr);
+		remote_addr = addr;
+		return -1;
+	}
+
+	/* the pinned client takes the lease once the requestor reaches it, the requestor asks again afterwards */
+	latest_due = now;
+	remote_addr = pin_addr;
+	return -1;
+}
+
+bool lease_table::lease_entry::held_by(const std::string &remote_addr)
+{
+	std::shared_lock lock(sm);
+	return (system_clock::now() < due) && (addr == remote_addr);
+}
+
+bool lease_table::lease_entry::release(const std::string &remote_addr)
+{
+	std::unique_lock lock(sm);
+
+	if (readers.erase(remote_addr) > 0)
+		return true;
+
+	if ((system_clock::now() >= due) || (addr != remote_addr))
+		return false;
+
+	due = system_clock::now();
+	return true;
+}
+
+bool lease_table::lease_entry::transfer(const std::string &remote_addr, const std::string &new_addr)
+{
+	std::unique_lock lock(sm);
+
+	if ((system_clock::now() >= due) || (addr != remote_addr))
+		return false;
+
+	due = system_clock::now() + milliseconds(LEASE_PERIOD_MS);
+	addr = new_addr;
+	return true;
+}
+
+lease_table::lease_table(std::shared_ptr<rados_io> meta_pool) : pool(meta_pool)
+{
+	read_pins();
 }
 
 lease_table::~lease_table(void)
@@ -36,33 +172,248 @@ lease_table::~lease_table(void)
 	exit(1);
 }
 
-int lease_table::acquire(uuid ino, system_clock::time_point &latest_due, std::string &remote_addr)
+lease_table::lease_entry *lease_table::get_entry(uuid ino, bool create)
 {
-	lease_entry *e;
-	std::string addr;
-	bool found = false;
+	std::string key = uuid_to_string(ino);
 
 	{
 		std::shared_lock lock(sm);
-		auto it = map.find(uuid_to_string(ino));
-		if (it != map.end()) {
-			found = true;
-			e = it->second;
-		}
+		auto it = map.find(key);
+		if (it != map.end())
+			return it->second;
 	}
 
-	if (found)
-		return e->cas(latest_due, remote_addr) ? 0 : -1;
+	std::unique_lock lock(sm);
+	auto it = map.find(key);
+	if (it != map.end())
+		return it->second;
 
+	/* nobody else learns the ino of a new directory before its creator has it, the range lease covers it until then */
+	auto rit = ranges.find(uuid_controller::get_prefix_from_uuid(ino));
+	bool covered = (rit != ranges.end()) && (system_clock::now() < rit->second.due);
+	if (!covered && !create)
+		return nullptr;
+
+	lease_entry *e = covered ? new lease_entry(rit->second.addr, rit->second.due) : new lease_entry();
+	map.insert({key, e});
+
+	return e;
+}
+
+uint32_t lease_table::get_frag_depth(const std::string &key)
+{
+	std::shared_lock lock(sm);
+	auto it = frag_depths.find(key);
+	return (it != frag_depths.end()) ? it->second : 0;
+}
+
+std::string lease_table::resolve_pin(const std::string &key)
+{
+	std::string cur = key;
+	for (int depth = 0; depth < PIN_MAX_DEPTH; depth++) {
+		auto pit = pins.find(cur);
+		if (pit != pins.end())
+			return pit->second;
+
+		auto lit = pin_parents.find(cur);
+		if (lit == pin_parents.end())
+			break;
+		cur = lit->second;
+	}
+
+	return "";
+}
+
+std::string lease_table::update_pin(const std::string &key, const std::string &parent_key)
+{
 	{
-		std::unique_lock lock(sm);
-		auto ret = map.insert({uuid_to_string(ino), nullptr});
-		if (ret.second) {
-			ret.first.value() = new lease_entry(latest_due, remote_addr);
-			return 0;
-		} else {
-			std::tie(latest_due, addr) = ret.first->second->get_info();
-			return (addr == remote_addr) ? 0 : -1;
+		std::shared_lock lock(sm);
+		if (parent_key.empty())
+			return resolve_pin(key);
+
+		/* most acquires find the link as it should be */
+		auto it = pin_parents.find(key);
+		bool linked = (it != pin_parents.end()) && (it->second == parent_key);
+		if (linked != resolve_pin(parent_key).empty())
+			return resolve_pin(key);
+	}
+
+	/* a directory moved out of a pinned subtree loses the link on its next acquire */
+	std::unique_lock lock(sm);
+	if (resolve_pin(parent_key).empty()) {
+		pin_parents.erase(key);
+	} else {
+		auto ret = pin_parents.insert({key, parent_key});
+		if (!ret.second)
+			ret.first.value() = parent_key;
+	}
+
+	return resolve_pin(key);
+}
+
+int lease_table::acquire(uuid ino, system_clock::time_point &latest_due, std::string &remote_addr, uint32_t &frag_depth, bool shared,
+			std::vector<std::string> &recall_addrs, uuid parent_ino)
+{
+	frag_depth = get_frag_depth(uuid_to_string(ino));
+	std::string pin_addr = update_pin(uuid_to_string(ino), parent_ino.is_nil() ? "" : uuid_to_string(parent_ino));
+
+	lease_entry *e = get_entry(ino, true);
+
+	if (!pin_addr.empty() && (pin_addr != remote_addr))
+		return e->cas_pinned(latest_due, remote_addr, pin_addr, recall_addrs);
+
+	return shared ? e->cas_shared(latest_due, remote_addr, recall_addrs) : e->cas(latest_due, remote_addr, recall_addrs);
+}
+
+int lease_table::fragment(uuid ino, const std::string &remote_addr, uint32_t &frag_depth)
+{
+	std::string key = uuid_to_string(ino);
+	lease_entry *e = get_entry(ino, false);
+
+	if (e == nullptr || !e->held_by(remote_addr)) {
+		frag_depth = get_frag_depth(key);
+		return -1;
+	}
+
+	std::unique_lock lock(sm);
+	auto ret = frag_depths.insert({key, frag_depth});
+	if (!ret.second) {
+		if (ret.first->second > frag_depth) {
+			frag_depth = ret.first->second;
+			return -1;
 		}
+		ret.first.value() = frag_depth;
+	}
+
+	return 0;
+}
+
+int lease_table::release(uuid ino, const std::string &remote_addr)
+{
+	/* a directory released before anybody else asked for it drops out of the range lease too */
+	lease_entry *e = get_entry(ino, false);
+
+	if (e == nullptr)
+		return -1;
+
+	return e->release(remote_addr) ? 0 : -1;
+}
+
+int lease_table::transfer(uuid ino, const std::string &remote_addr, const std::string &new_addr)
+{
+	std::string pin_addr = get_pin(ino);
+	if (!pin_addr.empty() && (pin_addr != new_addr))
+		return -1;
+
+	lease_entry *e = get_entry(ino, false);
+
+	if (e == nullptr)
+		return -1;
+
+	return e->transfer(remote_addr, new_addr) ? 0 : -1;
+}
+
+void lease_table::write_pins(void)
+{
+	/* (key length, key, address length, address) of each pin */
+	std::vector<char> raw;
+	auto put = [&raw](const std::string &str) {
+		uint32_t len = static_cast<uint32_t>(str.size());
+		raw.insert(raw.end(), reinterpret_cast<const char *>(&len), reinterpret_cast<const char *>(&len) + sizeof(uint32_t));
+		raw.insert(raw.end(), str.begin(), str.end());
+	};
+	for (const auto &p : pins) {
+		put(p.first);
+		put(p.second);
+	}
+
+	if (raw.empty()) {
+		if (pool->exist(obj_category::CLIENT, "pins"))
+			pool->remove(obj_category::CLIENT, "pins");
+		return;
+	}
+	pool->write(obj_category::CLIENT, "pins", raw.data(), raw.size(), 0);
+	pool->truncate(obj_category::CLIENT, "pins", raw.size());
+}
+
+void lease_table::read_pins(void)
+{
+	size_t size;
+	if (!pool->stat(obj_category::CLIENT, "pins", size))
+		return;
+
+	std::vector<char> raw(size);
+	size = pool->read(obj_category::CLIENT, "pins", raw.data(), size, 0);
+
+	size_t pos = 0;
+	auto get = [&raw, &pos, size](std::string &str) {
+		uint32_t len;
+		if (pos + sizeof(uint32_t) > size)
+			return false;
+		std::copy(raw.data() + pos, raw.data() + pos + sizeof(uint32_t), reinterpret_cast<char *>(&len));
+		pos += sizeof(uint32_t);
+		if (pos + len > size)
+			return false;
+		str.assign(raw.data() + pos, len);
+		pos += len;
+		return true;
+	};
+
+	std::string key, addr;
+	while (get(key) && get(addr))
+		pins.insert({key, addr});
+}
+
+int lease_table::pin(uuid ino, const std::string &pin_addr)
+{
+	std::string key = uuid_to_string(ino);
+	std::unique_lock lock(sm);
+
+	if (pin_addr.empty()) {
+		if (pins.erase(key) == 0)
+			return -1;
+		write_pins();
+		return 0;
 	}
+
+	auto ret = pins.insert({key, pin_addr});
+	if (!ret.second)
+		ret.first.value() = pin_addr;
+	write_pins();
+
+	return 0;
+}
+
+std::string lease_table::get_pin(uuid ino)
+{
+	std::shared_lock lock(sm);
+	return resolve_pin(uuid_to_string(ino));
+}
+
+int lease_table::lease_range(uint64_t prefix, const std::string &remote_addr, system_clock::time_point &latest_due)
+{
+	std::unique_lock lock(sm);
+	system_clock::time_point now = system_clock::now();
+
+	auto ret = ranges.insert({prefix, {remote_addr, now}});
+	ino_range &r = ret.first.value();
+	if ((r.addr != remote_addr) && (now < r.due))
+		return -1;
+
+	r.addr = remote_addr;
+	latest_due = r.due = now + milliseconds(LEASE_PERIOD_MS);
+
+	return 0;
+}
+
+int lease_table::release_range(uint64_t prefix, const std::string &remote_addr)
+{
+	std::unique_lock lock(sm);
+
+	auto it = ranges.find(prefix);
+	if ((it == ranges.end()) || (it->second.addr != remote_addr))
+		return -1;
+
+	ranges.erase(it);
+	return 0;
 }
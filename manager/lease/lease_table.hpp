@@ -1,21 +1,31 @@
 #ifndef _LEASE_TABLE_HPP_
 #define _LEASE_TABLE_HPP_
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <shared_mutex>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include <boost/uuid/uuid.hpp>
 #include <tsl/robin_map.h>
 
+#include "lib/rados_io/rados_io.hpp"
 #include "util/uuid.hpp"
 
 using namespace std::chrono;
 using namespace boost::uuids;
 
 #define LEASE_PERIOD_MS 200000000
+/* short enough that a writer waits little for the readers of a directory to go away */
+#define SHARED_LEASE_PERIOD_MS 5000
+/* the holders of a contended lease are asked to give it up at most once in this period */
+#define LEASE_RECALL_INTERVAL_MS 1000
+/* an inherited pin is looked up at most this many directories up */
+#define PIN_MAX_DEPTH 4096
 
 class lease_table {
 private:
@@ -24,47 +34,193 @@ private:
 		std::shared_mutex sm;
 		system_clock::time_point due;
 		std::string addr;
+		/* <address, due> of the shared leases */
+		tsl::robin_map<std::string, system_clock::time_point> readers;
+		/* a writer waits for the readers until then, no shared lease outlives it */
+		system_clock::time_point write_waiting;
+		system_clock::time_point recalled;
+
+		/* drops the expired readers and returns the latest due of the others */
+		system_clock::time_point prune_readers(const std::string &remote_addr);
+		/* true if the holders may be recalled now, the caller holds 'sm' exclusively */
+		bool may_recall(void);
 
 	public:
-		lease_entry(system_clock::time_point &latest_due, const std::string &remote_addr);
+		/* an expired lease, the first cas() or cas_shared() grants it */
+		lease_entry(void);
+		/* a lease held by 'holder' until 'holder_due', taken over from its range lease */
+		lease_entry(const std::string &holder, system_clock::time_point holder_due);
 		~lease_entry(void) = default;
 
 		std::tuple<system_clock::time_point, std::string> get_info(void);
 
 		/*
-		 * cas() - Try to acquire the lease atomically
+		 * cas() - Try to acquire the exclusive lease atomically
 		 *
 		 * On success
-		 * - Return true
+		 * - Return 0
 		 * - 'latest_due' is set to the updated due
 		 *
 		 * On failure
-		 * - Return false
+		 * - Return -1
 		 * - 'latest_due' is set to the current due
 		 * - 'remote_addr' is changed to the address of the current leader
+		 *
+		 * While other clients hold shared leases
+		 * - Return -2
+		 * - 'latest_due' is set to the time by which they expire
+		 *
+		 * The holders to be recalled are appended to 'recall_addrs'
 		 */
-		bool cas(system_clock::time_point &latest_due, std::string &remote_addr);
+		int cas(system_clock::time_point &latest_due, std::string &remote_addr, std::vector<std::string> &recall_addrs);
+
+		/*
+		 * cas_shared() - Try to acquire a shared lease atomically
+		 *
+		 * On success
+		 * - Return 1, or 0 if 'remote_addr' is the leader
+		 * - 'latest_due' is set to the due of the lease
+		 *
+		 * On failure
+		 * - Return -1
+		 * - 'latest_due' is set to the current due
+		 * - 'remote_addr' is changed to the address of the current leader
+		 */
+		int cas_shared(system_clock::time_point &latest_due, std::string &remote_addr, std::vector<std::string> &recall_addrs);
+
+		/*
+		 * cas_pinned() - Send a client other than 'pin_addr' to the pinned client
+		 *
+		 * Return 0 if 'remote_addr' still holds the lease, taken before the pin
+		 * Otherwise return -1, 'remote_addr' is set to the current leader or to 'pin_addr' if the lease is free
+		 * A leader other than 'pin_addr' is appended to 'recall_addrs'
+		 */
+		int cas_pinned(system_clock::time_point &latest_due, std::string &remote_addr, const std::string &pin_addr,
+			       std::vector<std::string> &recall_addrs);
+
+		/* Is 'remote_addr' the leader now? */
+		bool held_by(const std::string &remote_addr);
+
+		/* Expire the lease now if 'remote_addr' is the leader or a reader */
+		bool release(const std::string &remote_addr);
+
+		/* Make 'new_addr' the leader for a full period if 'remote_addr' is the leader */
+		bool transfer(const std::string &remote_addr, const std::string &new_addr);
+	};
+
+	struct ino_range {
+		std::string addr;
+		system_clock::time_point due;
 	};
 
 	std::shared_mutex sm;
 	tsl::robin_map<std::string, lease_entry *> map;
+	/* <ino prefix, holder> of the pre-leased ranges */
+	tsl::robin_map<uint64_t, ino_range> ranges;
+	/* directories split into fragments, it outlives the lease of the directory */
+	tsl::robin_map<std::string, uint32_t> frag_depths;
+	/* <directory, client> of the pinned subtrees, kept in the meta pool so that a restart doesn't unpin them */
+	std::shared_ptr<rados_io> pool;
+	tsl::robin_map<std::string, std::string> pins;
+	/* <directory, parent> of the directories acquired below a pinned one, the pin is inherited through them */
+	tsl::robin_map<std::string, std::string> pin_parents;
+
+	/*
+	 * The entry of 'ino', a missing one is created from the range lease covering it.
+	 * Without 'create' nullptr is returned if no range lease covers it either.
+	 */
+	lease_entry *get_entry(uuid ino, bool create);
+	uint32_t get_frag_depth(const std::string &key);
+	/* the caller holds 'sm' */
+	std::string resolve_pin(const std::string &key);
+	/* links 'key' to 'parent_key' if the parent is pinned, and returns the pin of 'key' */
+	std::string update_pin(const std::string &key, const std::string &parent_key);
+	/* the caller holds 'sm', the inherited links are learnt again from the acquires */
+	void write_pins(void);
+	void read_pins(void);
 
 public:
-	lease_table(void) = default;
+	lease_table(std::shared_ptr<rados_io> meta_pool);
 	~lease_table(void);
 
 	/*
 	 * acquire() - Try to acquire the lease atomically
 	 *
 	 * On success
-	 * - Return 0
+	 * - Return 0 for the exclusive lease, 1 for a shared one
 	 * - 'latest_due' is set to the updated due
 	 *
 	 * On failure
 	 * - Return -1
 	 * - 'remote_addr' is changed to the address of the current leader
+	 *
+	 * If the exclusive lease waits for the readers
+	 * - Return -2
+	 * - 'latest_due' is set to the time to ask again
+	 *
+	 * On contention, the clients to be asked to give up their leases are appended to 'recall_addrs'
 	 */
-	int acquire(uuid ino, system_clock::time_point &latest_due, std::string &remote_addr);
+	int acquire(uuid ino, system_clock::time_point &latest_due, std::string &remote_addr, uint32_t &frag_depth, bool shared,
+		    std::vector<std::string> &recall_addrs, uuid parent_ino);
+
+	/*
+	 * fragment() - Raise the fragmentation depth of a directory
+	 *
+	 * On success
+	 * - Return 0
+	 *
+	 * On failure (the requestor isn't the leader or the depth would decrease)
+	 * - Return -1
+	 *
+	 * In both cases, 'frag_depth' is set to the current depth
+	 */
+	int fragment(uuid ino, const std::string &remote_addr, uint32_t &frag_depth);
+
+	/*
+	 * release() - Expire the lease held by 'remote_addr'
+	 *
+	 * On success
+	 * - Return 0
+	 *
+	 * On failure (the requestor holds no lease)
+	 * - Return -1
+	 */
+	int release(uuid ino, const std::string &remote_addr);
+
+	/*
+	 * transfer() - Hand the lease held by 'remote_addr' over to 'new_addr'
+	 *
+	 * On success
+	 * - Return 0
+	 *
+	 * On failure (the requestor isn't the leader or the directory is pinned to another client)
+	 * - Return -1
+	 */
+	int transfer(uuid ino, const std::string &remote_addr, const std::string &new_addr);
+
+	/*
+	 * pin() - Pin the subtree of 'ino' to 'pin_addr', an empty address unpins it
+	 *
+	 * Return -1 if 'ino' is to be unpinned but isn't pinned itself, an inherited pin is removed from above
+	 */
+	int pin(uuid ino, const std::string &pin_addr);
+	/* get_pin() - The client 'ino' is pinned to, empty if it isn't pinned */
+	std::string get_pin(uuid ino);
+
+	/*
+	 * lease_range() - Lease every ino with 'prefix' to 'remote_addr', or renew it
+	 *
+	 * On success
+	 * - Return 0
+	 * - 'latest_due' is set to the due of the range lease
+	 *
+	 * On failure (another client holds the range)
+	 * - Return -1
+	 */
+	int lease_range(uint64_t prefix, const std::string &remote_addr, system_clock::time_point &latest_due);
+
+	/* release_range() - Expire the range lease held by 'remote_addr', return -1 if it isn't held by it */
+	int release_range(uint64_t prefix, const std::string &remote_addr);
 };
 
 #endif /* _LEASE_TABLE_HPP_ */
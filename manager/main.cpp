@@ -30,7 +30,7 @@ int main(int argc, char *argv[])
 	auto meta_pool = std::make_shared<rados_io>(ci, meta_pool_name);
 
 	std::string server_address(manager_ip + ":" + manager_port);
-	lease_impl lease_service;
+	lease_impl lease_service(meta_pool);
 	session_impl session_service(meta_pool);
 
 	ServerBuilder builder;
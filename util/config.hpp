@@ -21,4 +21,14 @@ T lookup_config(const Config &config, const char *field)
 	}
 }
 
+/* for optional settings */
+template <typename T>
+T lookup_config(const Config &config, const char *field, T default_value)
+{
+	T value;
+	if (!config.lookupValue(field, value))
+		return default_value;
+	return value;
+}
+
 #endif /* _CONFIG_HPP_ */
@@ -0,0 +1,40 @@
+#include "frag.hpp"
+
+#include <boost/uuid/name_generator_sha1.hpp>
+
+uint64_t get_name_hash(const std::string &name)
+{
+	/* FNV-1a, the placement of a name must not depend on the build */
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : name) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+uint64_t make_frag_id(uint64_t depth, uint64_t bits)
+{
+	return (depth << FRAG_MAX_DEPTH) | (bits & ((1ULL << FRAG_MAX_DEPTH) - 1));
+}
+
+uint64_t get_frag_depth(uint64_t id)
+{
+	return id >> FRAG_MAX_DEPTH;
+}
+
+uint64_t get_frag_bits(uint64_t id)
+{
+	return id & ((1ULL << FRAG_MAX_DEPTH) - 1);
+}
+
+uint64_t get_frag_id_of(const std::string &name, uint64_t depth)
+{
+	return make_frag_id(depth, get_name_hash(name) & ((1ULL << depth) - 1));
+}
+
+uuid get_frag_ino(const uuid &dir_ino, uint64_t id)
+{
+	name_generator_sha1 gen(dir_ino);
+	return gen(std::to_string(id));
+}
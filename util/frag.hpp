@@ -0,0 +1,29 @@
+#ifndef _FRAG_HPP_
+#define _FRAG_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include <boost/uuid/uuid.hpp>
+
+using namespace boost::uuids;
+
+/*
+ * The hash space of a directory is cut by the lowest bits of the name hash.
+ * An id packs (depth, bits): the depth in the top byte and the suffix bits below it.
+ * Dentry shards and directory fragments both use it.
+ */
+#define FRAG_MAX_DEPTH (56)
+
+uint64_t get_name_hash(const std::string &name);
+
+uint64_t make_frag_id(uint64_t depth, uint64_t bits);
+uint64_t get_frag_depth(uint64_t id);
+uint64_t get_frag_bits(uint64_t id);
+/* the id at 'depth' covering 'name' */
+uint64_t get_frag_id_of(const std::string &name, uint64_t depth);
+
+/* every client derives the same ino for a fragment, it keys the fragment's lease, journal and dentry object */
+uuid get_frag_ino(const uuid &dir_ino, uint64_t id);
+
+#endif /* _FRAG_HPP_ */
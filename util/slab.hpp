@@ -0,0 +1,99 @@
+#ifndef _SLAB_HPP_
+#define _SLAB_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#define SLAB_CHUNK_SLOTS (4096)
+
+/*
+ * Fixed size slots carved out of large chunks.
+ * A freed slot goes to the free list of its pool and is reused by the next allocation,
+ * chunks are kept until exit so that a bounded cache keeps a flat footprint.
+ */
+template <size_t SLOT_SIZE>
+class slab_pool {
+private:
+	struct free_slot {
+		free_slot *next;
+	};
+
+	std::mutex slab_mutex;
+	free_slot *free_list = nullptr;
+	std::vector<std::unique_ptr<char[]>> chunks;
+
+	void grow() {
+		chunks.push_back(std::make_unique<char[]>(SLOT_SIZE * SLAB_CHUNK_SLOTS));
+		char *chunk = chunks.back().get();
+		for (size_t i = 0; i < SLAB_CHUNK_SLOTS; i++) {
+			auto *s = reinterpret_cast<free_slot *>(chunk + i * SLOT_SIZE);
+			s->next = free_list;
+			free_list = s;
+		}
+	}
+
+public:
+	static slab_pool &instance() {
+		static slab_pool pool;
+		return pool;
+	}
+
+	void *alloc() {
+		std::scoped_lock lock(slab_mutex);
+		if (free_list == nullptr)
+			grow();
+
+		free_slot *s = free_list;
+		free_list = s->next;
+		return s;
+	}
+
+	void free(void *p) {
+		std::scoped_lock lock(slab_mutex);
+		auto *s = static_cast<free_slot *>(p);
+		s->next = free_list;
+		free_list = s;
+	}
+};
+
+/*
+ * Allocator for std::allocate_shared(), the object and its control block share one slot.
+ * Arrays and over-aligned types fall back to operator new.
+ */
+template <typename T>
+class slab_allocator {
+private:
+	static constexpr size_t slot_size = ((sizeof(T) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)) * alignof(std::max_align_t);
+	static constexpr bool slab_fit = alignof(T) <= alignof(std::max_align_t);
+
+public:
+	using value_type = T;
+
+	slab_allocator() noexcept = default;
+	template <typename U>
+	slab_allocator(const slab_allocator<U> &) noexcept {}
+
+	T *allocate(size_t n) {
+		if (n != 1 || !slab_fit)
+			return static_cast<T *>(::operator new(n * sizeof(T)));
+		return static_cast<T *>(slab_pool<slot_size>::instance().alloc());
+	}
+
+	void deallocate(T *p, size_t n) noexcept {
+		if (n != 1 || !slab_fit) {
+			::operator delete(p);
+			return;
+		}
+		slab_pool<slot_size>::instance().free(p);
+	}
+
+	template <typename U>
+	bool operator==(const slab_allocator<U> &) const noexcept { return true; }
+	template <typename U>
+	bool operator!=(const slab_allocator<U> &) const noexcept { return false; }
+};
+
+#endif /* _SLAB_HPP_ */
@@ -1,8 +1,25 @@
 #include "uuid.hpp"
 
+uuid_controller::uuid_controller(uint64_t client_id) : client_id(client_id), next_range_seq(0) {
+}
+
 uuid uuid_controller::alloc_new_uuid() {
 	global_logger.log(inode_ops, "Called alloc_new_uuid()");
-	return this->generator();
+	if (this->client_id == 0)
+		return this->generator();
+
+	thread_local const uuid_controller *range_owner = nullptr;
+	thread_local uint64_t range_prefix;
+	thread_local uint64_t next_postfix;
+
+	if (range_owner != this) {
+		uint64_t seq = this->next_range_seq.fetch_add(1, std::memory_order_relaxed) & ((1ULL << INO_RANGE_SEQ_BITS) - 1);
+		range_prefix = (this->client_id << INO_RANGE_SEQ_BITS) | seq;
+		next_postfix = 0;
+		range_owner = this;
+	}
+
+	return splice_prefix_and_postfix(range_prefix, next_postfix++);
 }
 
 uint64_t uuid_controller::get_prefix_from_uuid(const uuid& id) {
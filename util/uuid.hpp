@@ -1,6 +1,7 @@
 #ifndef _UTIL_HPP_
 #define _UTIL_HPP_
 
+#include <atomic>
 #include <string>
 #include <sys/stat.h>
 
@@ -12,11 +13,24 @@
 
 using namespace boost::uuids;
 
+/* the prefix of an allocated ino is the client id followed by this many bits of range sequence */
+#define INO_RANGE_SEQ_BITS (40)
+
+/*
+ * With a client id, every thread takes a prefix of its own and counts the postfix up,
+ * so that the inos are unique without locking and the inos made by a thread stay close to each other.
+ * Each mount gets a new client id, so a prefix is never handed out twice.
+ * Without a client id the inos are random.
+ */
 class uuid_controller {
 private:
 	random_generator generator;
+	uint64_t client_id;
+	std::atomic<uint64_t> next_range_seq;
 
 public:
+	explicit uuid_controller(uint64_t client_id = 0);
+
 	uuid alloc_new_uuid();
 	static uint64_t get_prefix_from_uuid(const uuid& id);
 	static uint64_t get_postfix_from_uuid(const uuid& id);